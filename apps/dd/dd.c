@@ -0,0 +1,138 @@
+/*
+ * dd: read/write throughput test for TempOS.
+ *
+ * Copies DD_IF to DD_OF (or just reads DD_IF when DD_OF is empty) in
+ * blocks of DD_BS bytes, then prints bytes transferred, elapsed TSC
+ * cycles and throughput (KB per million cycles). With DD_SENDFILE, data
+ * is copied by the kernel (sendfile) and never reaches user space.
+ * Parameters are set at build time (see Makefile).
+ *
+ * Author: Renê de Souza Pinto
+ */
+
+/* System calls (see kernel/kernel/syscall.c) */
+#define SYS_READ   3
+#define SYS_WRITE  4
+#define SYS_OPEN   6
+#define SYS_CLOSE  7
+#define SYS_SENDFILE 12
+
+/* Open flags (see kernel/include/fcntl.h) */
+#define O_RDONLY   0x0000
+#define O_WRONLY   0x0001
+#define O_CREAT    0x0040
+
+#define STDOUT     1
+
+static char buf[DD_BS];
+
+
+static int syscall3(int nr, int a, int b, int c)
+{
+	int ret;
+
+	__asm__ __volatile__("int $0x85"
+						 : "=a"(ret)
+						 : "a"(nr), "b"(a), "c"(b), "d"(c)
+						 : "memory");
+	return ret;
+}
+
+static unsigned long long rdtsc(void)
+{
+	unsigned long long tsc;
+
+	__asm__ __volatile__("rdtsc" : "=A"(tsc));
+	return tsc;
+}
+
+static int str_len(const char *s)
+{
+	int len = 0;
+
+	while (s[len] != '\0') {
+		len++;
+	}
+	return len;
+}
+
+static void print(const char *s)
+{
+	syscall3(SYS_WRITE, STDOUT, (int)s, str_len(s));
+}
+
+static void print_num(unsigned int n)
+{
+	char str[11];
+	int pos = 10;
+
+	str[pos] = '\0';
+	do {
+		str[--pos] = '0' + (n % 10);
+		n /= 10;
+	} while (n > 0);
+	print(&str[pos]);
+}
+
+int main(void)
+{
+	unsigned int total, blocks, mcycles;
+	unsigned long long start, cycles;
+	int in, out, n;
+
+	if ((in = syscall3(SYS_OPEN, (int)DD_IF, O_RDONLY, 0)) < 0) {
+		print("dd: could not open " DD_IF "\n");
+		return 1;
+	}
+
+	out = -1;
+	if (DD_OF[0] != '\0') {
+		if ((out = syscall3(SYS_OPEN, (int)DD_OF, O_WRONLY | O_CREAT, 0644)) < 0) {
+			print("dd: could not open " DD_OF "\n");
+			syscall3(SYS_CLOSE, in, 0, 0);
+			return 1;
+		}
+	}
+
+	total  = 0;
+	blocks = 0;
+	start  = rdtsc();
+	while (DD_COUNT == 0 || blocks < DD_COUNT) {
+		if (DD_SENDFILE && out >= 0) {
+			if ((n = syscall3(SYS_SENDFILE, out, in, DD_BS)) <= 0) {
+				break;
+			}
+			total += n;
+			blocks++;
+			continue;
+		}
+		if ((n = syscall3(SYS_READ, in, (int)buf, DD_BS)) <= 0) {
+			break;
+		}
+		if (out >= 0 && syscall3(SYS_WRITE, out, (int)buf, n) != n) {
+			print("dd: write error\n");
+			break;
+		}
+		total += n;
+		blocks++;
+	}
+	cycles = rdtsc() - start;
+
+	syscall3(SYS_CLOSE, in, 0, 0);
+	if (out >= 0) {
+		syscall3(SYS_CLOSE, out, 0, 0);
+	}
+
+	mcycles = (unsigned int)(cycles >> 20) + 1;
+	print_num(blocks);
+	print(" blocks, ");
+	print_num(total);
+	print(" bytes, ");
+	print_num(mcycles);
+	print(" Mcycles, ");
+	print_num((total >> 10) / mcycles);
+	print(" KB/Mcycle\n");
+
+	return 0;
+}
+
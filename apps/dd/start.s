@@ -0,0 +1,19 @@
+/*
+ * Entry point of dd: calls main() and stays there, like init
+ * (there is no exit yet).
+ *
+ * Author: Renê de Souza Pinto
+ */
+
+.global _start
+.extern main
+
+/* Note: Program is an ELF executable linked at 0x80001000 (process space) */
+
+.text
+_start:
+	call main
+
+loop:
+	jmp loop
+
@@ -0,0 +1,21 @@
+/*
+ * hello: dynamically linked test program for TempOS. Functions come
+ * from libt.so through PLT (resolved on first call) and t_nprints is
+ * a library variable copied into the program (R_386_COPY).
+ *
+ * Author: Renê de Souza Pinto
+ */
+
+extern int t_nprints;
+extern void t_print(const char *s);
+extern void t_print_num(unsigned int n);
+
+int main(void)
+{
+	t_print("Hello from a dynamically linked program!\n");
+	t_print("Calls to t_print: ");
+	t_print_num(t_nprints + 1);
+	t_print("\n");
+	return 0;
+}
+
@@ -0,0 +1,22 @@
+/*
+ * Entry point of hello: ld.so jumps here once libraries are loaded.
+ * Calls main() and exits with its return value.
+ *
+ * Author: Renê de Souza Pinto
+ */
+
+.global _start
+.extern main
+.extern t_exit
+
+/* Note: Program is a dynamically linked ELF executable at 0x80000000 */
+
+.text
+_start:
+	call main
+	pushl %eax
+	call t_exit
+
+loop:
+	jmp loop
+
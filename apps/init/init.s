@@ -8,7 +8,7 @@
 
 .global _start
 
-/* Note: Program starts at 12MB (linker will handle this)*/
+/* Note: Program is an ELF executable linked at 0x80001000 (process space) */
 
 .text
 _start:
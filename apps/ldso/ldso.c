@@ -0,0 +1,609 @@
+/*
+ * ld.so: minimal dynamic linker for TempOS.
+ *
+ * Kernel maps the program and ld.so (see PT_INTERP in
+ * kernel/kernel/execve.c) and starts ld.so, which:
+ *
+ *   1. Relocates itself (base address comes from AT_BASE).
+ *   2. Finds the program dynamic section through AT_PHDR.
+ *   3. Maps each DT_NEEDED library from /lib with private file
+ *      mappings, so read-only segments are the page cache pages,
+ *      shared by every process using the library.
+ *   4. Processes data relocations and prepares PLT/GOT for lazy
+ *      binding: functions are resolved on their first call (see
+ *      _dl_runtime_resolve). LD_BIND_NOW (environment) or DT_BIND_NOW
+ *      resolves them at startup.
+ *   5. Jumps to program entry point (AT_ENTRY).
+ *
+ * Only i386 relocations emitted for position independent code are
+ * supported (no text relocations), libraries do not load other
+ * libraries and symbols are searched in the program first, then in
+ * libraries in load order.
+ *
+ * Author: Renê de Souza Pinto
+ */
+
+/* System calls (see kernel/kernel/syscall.c) */
+#define SYS_EXIT   0
+#define SYS_READ   3
+#define SYS_WRITE  4
+#define SYS_OPEN   6
+#define SYS_CLOSE  7
+#define SYS_MMAP   9
+#define SYS_MUNMAP 10
+
+/* Memory mapping (see kernel/include/tempos/mmap.h) */
+#define PROT_READ     0x01
+#define PROT_WRITE    0x02
+#define PROT_EXEC     0x04
+#define MAP_PRIVATE   0x02
+#define MAP_FIXED     0x10
+#define MAP_ANONYMOUS 0x20
+#define MAP_FAILED    ((unsigned int)-1)
+
+#define O_RDONLY   0x0000
+#define STDERR     2
+
+#define PAGE_SIZE  4096
+#define PAGE_MASK  (~(PAGE_SIZE - 1))
+
+/* ELF (see kernel/include/fs/elf32.h) */
+#define PT_LOAD    1
+#define PT_DYNAMIC 2
+#define PT_PHDR    6
+#define PF_X       0x1
+#define PF_W       0x2
+#define PF_R       0x4
+
+#define DT_NULL     0
+#define DT_NEEDED   1
+#define DT_PLTRELSZ 2
+#define DT_PLTGOT   3
+#define DT_HASH     4
+#define DT_STRTAB   5
+#define DT_SYMTAB   6
+#define DT_REL      17
+#define DT_RELSZ    18
+#define DT_JMPREL   23
+#define DT_BIND_NOW 24
+
+#define AT_NULL    0
+#define AT_PHDR    3
+#define AT_PHNUM   5
+#define AT_BASE    7
+#define AT_ENTRY   9
+
+#define R_386_32       1
+#define R_386_COPY     5
+#define R_386_GLOB_DAT 6
+#define R_386_JMP_SLOT 7
+#define R_386_RELATIVE 8
+
+#define ELF32_R_SYM(i)  ((i) >> 8)
+#define ELF32_R_TYPE(i) ((i) & 0xFF)
+
+#define NULL       ((void*)0)
+
+#define EI_NIDENT  16
+#define MAX_PHDRS  16
+
+/** Maximum number of loaded objects (program included) */
+#define MAX_DSO    16
+
+typedef unsigned int   uint32_t;
+typedef unsigned short uint16_t;
+
+typedef struct {
+	unsigned char e_ident[EI_NIDENT];
+	uint16_t e_type;
+	uint16_t e_machine;
+	uint32_t e_version;
+	uint32_t e_entry;
+	uint32_t e_phoff;
+	uint32_t e_shoff;
+	uint32_t e_flags;
+	uint16_t e_ehsize;
+	uint16_t e_phentsize;
+	uint16_t e_phnum;
+	uint16_t e_shentsize;
+	uint16_t e_shnum;
+	uint16_t e_shstrndx;
+} Elf32_Ehdr;
+
+typedef struct {
+	uint32_t p_type;
+	uint32_t p_offset;
+	uint32_t p_vaddr;
+	uint32_t p_paddr;
+	uint32_t p_filesz;
+	uint32_t p_memsz;
+	uint32_t p_flags;
+	uint32_t p_align;
+} Elf32_Phdr;
+
+typedef struct {
+	int d_tag;
+	uint32_t d_val;
+} Elf32_Dyn;
+
+typedef struct {
+	uint32_t st_name;
+	uint32_t st_value;
+	uint32_t st_size;
+	unsigned char st_info;
+	unsigned char st_other;
+	uint16_t st_shndx;
+} Elf32_Sym;
+
+typedef struct {
+	uint32_t r_offset;
+	uint32_t r_info;
+} Elf32_Rel;
+
+struct mmap_args {
+	void *addr;
+	uint32_t len;
+	int prot;
+	int flags;
+	int fd;
+	uint32_t offset;
+};
+
+/** A loaded object: program, library or ld.so itself */
+struct dso {
+	uint32_t bias;
+	uint32_t *hash;
+	Elf32_Sym *symtab;
+	char *strtab;
+	Elf32_Rel *rel;
+	uint32_t relsz;
+	Elf32_Rel *jmprel;
+	uint32_t pltrelsz;
+	uint32_t *pltgot;
+	int bind_now;
+};
+
+/* Program is dsos[0], libraries follow */
+static struct dso dsos[MAX_DSO];
+static int ndsos;
+
+extern Elf32_Dyn _DYNAMIC[] __attribute__((visibility("hidden")));
+extern void _dl_runtime_resolve(void);
+
+uint32_t dl_main(uint32_t *sp);
+uint32_t dl_fixup(struct dso *obj, uint32_t reloc_off);
+
+
+static int syscall3(int nr, int a, int b, int c)
+{
+	int ret;
+
+	__asm__ __volatile__("int $0x85"
+						 : "=a"(ret)
+						 : "a"(nr), "b"(a), "c"(b), "d"(c)
+						 : "memory");
+	return ret;
+}
+
+void *memset(void *s, int c, uint32_t n)
+{
+	char *p = s;
+
+	while (n--) {
+		*p++ = c;
+	}
+	return s;
+}
+
+void *memcpy(void *dest, const void *src, uint32_t n)
+{
+	char *d = dest;
+	const char *s = src;
+
+	while (n--) {
+		*d++ = *s++;
+	}
+	return dest;
+}
+
+static int str_len(const char *s)
+{
+	int len = 0;
+
+	while (s[len] != '\0') {
+		len++;
+	}
+	return len;
+}
+
+static int str_eq(const char *a, const char *b)
+{
+	while (*a != '\0' && *a == *b) {
+		a++;
+		b++;
+	}
+	return (*a == *b);
+}
+
+static void print(const char *s)
+{
+	syscall3(SYS_WRITE, STDERR, (int)s, str_len(s));
+}
+
+/**
+ * Print an error message and terminate the process.
+ */
+static void fatal(const char *msg, const char *name)
+{
+	print("ld.so: ");
+	print(msg);
+	if (name != NULL) {
+		print(name);
+	}
+	print("\n");
+	syscall3(SYS_EXIT, 127, 0, 0);
+	for (;;);
+}
+
+static uint32_t do_mmap(uint32_t addr, uint32_t len, int prot, int flags,
+						int fd, uint32_t offset)
+{
+	struct mmap_args args;
+
+	args.addr   = (void*)addr;
+	args.len    = len;
+	args.prot   = prot;
+	args.flags  = flags;
+	args.fd     = fd;
+	args.offset = offset;
+	return (uint32_t)syscall3(SYS_MMAP, (int)&args, 0, 0);
+}
+
+/**
+ * Fill object information from its dynamic section.
+ */
+static void parse_dynamic(struct dso *obj, Elf32_Dyn *dyn)
+{
+	for (; dyn->d_tag != DT_NULL; dyn++) {
+		switch (dyn->d_tag) {
+			case DT_HASH:
+				obj->hash = (uint32_t*)(obj->bias + dyn->d_val);
+				break;
+			case DT_STRTAB:
+				obj->strtab = (char*)(obj->bias + dyn->d_val);
+				break;
+			case DT_SYMTAB:
+				obj->symtab = (Elf32_Sym*)(obj->bias + dyn->d_val);
+				break;
+			case DT_REL:
+				obj->rel = (Elf32_Rel*)(obj->bias + dyn->d_val);
+				break;
+			case DT_RELSZ:
+				obj->relsz = dyn->d_val;
+				break;
+			case DT_JMPREL:
+				obj->jmprel = (Elf32_Rel*)(obj->bias + dyn->d_val);
+				break;
+			case DT_PLTRELSZ:
+				obj->pltrelsz = dyn->d_val;
+				break;
+			case DT_PLTGOT:
+				obj->pltgot = (uint32_t*)(obj->bias + dyn->d_val);
+				break;
+			case DT_BIND_NOW:
+				obj->bind_now = 1;
+				break;
+		}
+	}
+}
+
+static uint32_t elf_hash(const char *name)
+{
+	uint32_t h = 0, g;
+
+	while (*name != '\0') {
+		h = (h << 4) + (unsigned char)*name++;
+		if ((g = (h & 0xF0000000)) != 0) {
+			h ^= g >> 24;
+		}
+		h &= ~g;
+	}
+	return h;
+}
+
+/**
+ * Look for a defined symbol in loaded objects (program first).
+ *
+ * \param name Symbol name.
+ * \param first Index of first object to search (1 skips program).
+ * \param size Symbol size (returned, may be NULL).
+ * \return Symbol address, or 0 if not found.
+ */
+static uint32_t lookup(const char *name, int first, uint32_t *size)
+{
+	uint32_t h = elf_hash(name);
+	uint32_t nbucket, *bucket, *chain, i;
+	struct dso *obj;
+	Elf32_Sym *sym;
+	int n;
+
+	for (n = first; n < ndsos; n++) {
+		obj = &dsos[n];
+		if (obj->hash == NULL) {
+			continue;
+		}
+		nbucket = obj->hash[0];
+		bucket  = &obj->hash[2];
+		chain   = &bucket[nbucket];
+		for (i = bucket[h % nbucket]; i != 0; i = chain[i]) {
+			sym = &obj->symtab[i];
+			if (sym->st_shndx != 0 &&
+				str_eq(name, &obj->strtab[sym->st_name])) {
+				if (size != NULL) {
+					*size = sym->st_size;
+				}
+				return obj->bias + sym->st_value;
+			}
+		}
+	}
+	return 0;
+}
+
+/**
+ * Apply one relocation of an object.
+ *
+ * \param obj Object.
+ * \param rel Relocation.
+ * \param lazy Only adjust PLT slots (they point back to PLT).
+ */
+static void relocate(struct dso *obj, Elf32_Rel *rel, int lazy)
+{
+	uint32_t *where = (uint32_t*)(obj->bias + rel->r_offset);
+	uint32_t type   = ELF32_R_TYPE(rel->r_info);
+	uint32_t value  = 0, size = 0;
+	char *name;
+
+	if (type == R_386_RELATIVE) {
+		*where += obj->bias;
+		return;
+	}
+	if (type == R_386_JMP_SLOT && lazy) {
+		*where += obj->bias;
+		return;
+	}
+
+	name = &obj->strtab[obj->symtab[ELF32_R_SYM(rel->r_info)].st_name];
+	value = lookup(name, (type == R_386_COPY ? 1 : 0), &size);
+	if (value == 0) {
+		fatal("undefined symbol: ", name);
+	}
+
+	switch (type) {
+		case R_386_32:
+			*where += value;
+			break;
+		case R_386_GLOB_DAT:
+		case R_386_JMP_SLOT:
+			*where = value;
+			break;
+		case R_386_COPY:
+			memcpy(where, (void*)value, size);
+			break;
+		default:
+			fatal("unsupported relocation in ", name);
+	}
+}
+
+/**
+ * Process all relocations of an object.
+ */
+static void relocate_object(struct dso *obj, int bind_now)
+{
+	uint32_t i;
+
+	for (i = 0; i < obj->relsz / sizeof(Elf32_Rel); i++) {
+		relocate(obj, &obj->rel[i], 0);
+	}
+	for (i = 0; i < obj->pltrelsz / sizeof(Elf32_Rel); i++) {
+		relocate(obj, &obj->jmprel[i], !(bind_now || obj->bind_now));
+	}
+
+	/* PLT0 pushes GOT[1] and jumps to GOT[2] */
+	if (obj->pltgot != NULL) {
+		obj->pltgot[1] = (uint32_t)obj;
+		obj->pltgot[2] = (uint32_t)&_dl_runtime_resolve;
+	}
+}
+
+/**
+ * Map a shared library. Address range is reserved with an anonymous
+ * mapping first, then each PT_LOAD segment is mapped (privately) from
+ * the file at its place; bss is zero filled memory.
+ *
+ * \param name Library name (from DT_NEEDED).
+ * \param obj Object (returned).
+ */
+static void load_library(const char *name, struct dso *obj)
+{
+	char path[64], buf[sizeof(Elf32_Ehdr) + MAX_PHDRS * sizeof(Elf32_Phdr)];
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr*)buf;
+	Elf32_Phdr *phdr;
+	Elf32_Dyn *dyn = NULL;
+	uint32_t lo = (uint32_t)-1, hi = 0, base, start, fend, mend;
+	int fd, len, prot, i;
+
+	len = str_len(name);
+	if (len + 6 > (int)sizeof(path)) {
+		fatal("name too long: ", name);
+	}
+	memcpy(path, "/lib/", 5);
+	memcpy(&path[5], name, len + 1);
+
+	if ((fd = syscall3(SYS_OPEN, (int)path, O_RDONLY, 0)) < 0) {
+		fatal("could not open ", path);
+	}
+	len = syscall3(SYS_READ, fd, (int)buf, sizeof(buf));
+	if (len < (int)sizeof(Elf32_Ehdr) || ehdr->e_phnum > MAX_PHDRS ||
+		ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf32_Phdr) > (uint32_t)len) {
+		fatal("bad ELF header: ", path);
+	}
+	phdr = (Elf32_Phdr*)&buf[ehdr->e_phoff];
+
+	for (i = 0; i < ehdr->e_phnum; i++) {
+		if (phdr[i].p_type != PT_LOAD) {
+			continue;
+		}
+		if ((phdr[i].p_vaddr & PAGE_MASK) < lo) {
+			lo = phdr[i].p_vaddr & PAGE_MASK;
+		}
+		if (phdr[i].p_vaddr + phdr[i].p_memsz > hi) {
+			hi = phdr[i].p_vaddr + phdr[i].p_memsz;
+		}
+	}
+	if (hi <= lo) {
+		fatal("nothing to load: ", path);
+	}
+
+	/* Reserve address range */
+	hi = (hi + PAGE_SIZE - 1) & PAGE_MASK;
+	base = do_mmap(0, hi - lo, PROT_READ, (MAP_PRIVATE | MAP_ANONYMOUS), -1, 0);
+	if (base == MAP_FAILED) {
+		fatal("out of memory: ", path);
+	}
+	syscall3(SYS_MUNMAP, base, hi - lo, 0);
+	obj->bias = base - lo;
+
+	for (i = 0; i < ehdr->e_phnum; i++) {
+		if (phdr[i].p_type == PT_DYNAMIC) {
+			dyn = (Elf32_Dyn*)(obj->bias + phdr[i].p_vaddr);
+		}
+		if (phdr[i].p_type != PT_LOAD) {
+			continue;
+		}
+
+		prot = ((phdr[i].p_flags & PF_R) ? PROT_READ : 0) |
+			   ((phdr[i].p_flags & PF_W) ? PROT_WRITE : 0) |
+			   ((phdr[i].p_flags & PF_X) ? PROT_EXEC : 0);
+		start = obj->bias + (phdr[i].p_vaddr & PAGE_MASK);
+		fend  = obj->bias + phdr[i].p_vaddr + phdr[i].p_filesz;
+		mend  = obj->bias + phdr[i].p_vaddr + phdr[i].p_memsz;
+
+		if (phdr[i].p_filesz > 0 &&
+			do_mmap(start, fend - start, prot, (MAP_PRIVATE | MAP_FIXED), fd,
+					phdr[i].p_offset & PAGE_MASK) != start) {
+			fatal("could not map ", path);
+		}
+
+		/* bss: end of last file page, then anonymous pages */
+		if (mend > fend) {
+			start = (fend + PAGE_SIZE - 1) & PAGE_MASK;
+			if ((fend & ~PAGE_MASK) && phdr[i].p_filesz > 0 && (prot & PROT_WRITE)) {
+				memset((void*)fend, 0, (mend < start ? mend : start) - fend);
+			}
+			if (mend > start &&
+				do_mmap(start, mend - start, prot,
+						(MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS), -1, 0) != start) {
+				fatal("out of memory: ", path);
+			}
+		}
+	}
+	syscall3(SYS_CLOSE, fd, 0, 0);
+
+	if (dyn == NULL) {
+		fatal("no dynamic section: ", path);
+	}
+	parse_dynamic(obj, dyn);
+}
+
+/**
+ * Resolve a PLT slot on its first call (see _dl_runtime_resolve).
+ *
+ * \param obj Object which made the call (GOT[1]).
+ * \param reloc_off Offset of relocation into DT_JMPREL.
+ * \return Function address.
+ */
+uint32_t dl_fixup(struct dso *obj, uint32_t reloc_off)
+{
+	Elf32_Rel *rel = (Elf32_Rel*)((char*)obj->jmprel + reloc_off);
+
+	relocate(obj, rel, 0);
+	return *(uint32_t*)(obj->bias + rel->r_offset);
+}
+
+/**
+ * Dynamic linker main: see the top of this file.
+ *
+ * \param sp Initial stack pointer of process.
+ * \return Program entry point.
+ */
+uint32_t dl_main(uint32_t *sp)
+{
+	uint32_t argc = sp[0], *aux, base = 0, phdr_addr = 0, phnum = 0, entry = 0;
+	char **envp = (char**)&sp[argc + 2];
+	Elf32_Phdr *phdr;
+	Elf32_Dyn *dyn = NULL;
+	struct dso self, *prog = &dsos[0];
+	int bind_now = 0, n;
+	uint32_t i;
+
+	for (i = 0; envp[i] != NULL; i++) {
+		if (envp[i][0] == 'L' && str_eq(envp[i], "LD_BIND_NOW=1")) {
+			bind_now = 1;
+		}
+	}
+	for (aux = (uint32_t*)&envp[i + 1]; aux[0] != AT_NULL; aux += 2) {
+		switch (aux[0]) {
+			case AT_PHDR:  phdr_addr = aux[1]; break;
+			case AT_PHNUM: phnum = aux[1];     break;
+			case AT_BASE:  base = aux[1];      break;
+			case AT_ENTRY: entry = aux[1];     break;
+		}
+	}
+
+	/* Relocate ld.so itself (only relative relocations, no symbols) */
+	memset(&self, 0, sizeof(self));
+	self.bias = base;
+	parse_dynamic(&self, _DYNAMIC);
+	for (i = 0; i < self.relsz / sizeof(Elf32_Rel); i++) {
+		if (ELF32_R_TYPE(self.rel[i].r_info) == R_386_RELATIVE) {
+			*(uint32_t*)(base + self.rel[i].r_offset) += base;
+		}
+	}
+
+	/* Program */
+	phdr = (Elf32_Phdr*)phdr_addr;
+	for (i = 0; i < phnum; i++) {
+		if (phdr[i].p_type == PT_PHDR) {
+			prog->bias = phdr_addr - phdr[i].p_vaddr;
+		}
+	}
+	for (i = 0; i < phnum; i++) {
+		if (phdr[i].p_type == PT_DYNAMIC) {
+			dyn = (Elf32_Dyn*)(prog->bias + phdr[i].p_vaddr);
+		}
+	}
+	if (dyn == NULL) {
+		fatal("program is not dynamically linked", NULL);
+	}
+	parse_dynamic(prog, dyn);
+	ndsos = 1;
+
+	/* Libraries */
+	for (; dyn->d_tag != DT_NULL; dyn++) {
+		if (dyn->d_tag != DT_NEEDED) {
+			continue;
+		}
+		if (ndsos == MAX_DSO) {
+			fatal("too many libraries", NULL);
+		}
+		load_library(&prog->strtab[dyn->d_val], &dsos[ndsos++]);
+	}
+
+	/* Libraries first: copy relocations of program read their data */
+	for (n = ndsos - 1; n >= 0; n--) {
+		relocate_object(&dsos[n], bind_now);
+	}
+
+	return entry;
+}
+
@@ -0,0 +1,45 @@
+/*
+ * Entry points of ld.so.
+ *
+ * _start: kernel jumps here (instead of program entry) with the
+ * initial process stack: argc, argv, envp and auxiliary vector.
+ * dl_main() loads and relocates everything, then the program is
+ * started with the same stack.
+ *
+ * _dl_runtime_resolve: lazy binding. PLT0 of an object jumps here
+ * (through GOT[2]) with GOT[1] (the object) and the offset of the
+ * PLT relocation on the stack. The slot is resolved by dl_fixup(),
+ * then the function is called with caller's registers and return
+ * address untouched.
+ *
+ * Author: Renê de Souza Pinto
+ */
+
+.global _start
+.global _dl_runtime_resolve
+.hidden _dl_runtime_resolve
+.hidden dl_main
+.hidden dl_fixup
+
+.text
+_start:
+	movl %esp, %eax
+	pushl %eax
+	call dl_main
+	addl $4, %esp
+	xorl %edx, %edx
+	jmp *%eax
+
+_dl_runtime_resolve:
+	pushl %eax
+	pushl %ecx
+	pushl %edx
+	pushl 16(%esp)      /* relocation offset */
+	pushl 16(%esp)      /* object */
+	call dl_fixup
+	addl $8, %esp
+	popl %edx
+	popl %ecx
+	xchgl %eax, (%esp)  /* restore eax, function address on top */
+	ret $8
+
@@ -0,0 +1,62 @@
+/*
+ * libt: small shared library for TempOS (system call wrappers and
+ * output helpers), loaded by ld.so.
+ *
+ * Author: Renê de Souza Pinto
+ */
+
+/* System calls (see kernel/kernel/syscall.c) */
+#define SYS_EXIT   0
+#define SYS_WRITE  4
+
+#define STDOUT     1
+
+/* Number of calls to t_print (exported data, see hello) */
+int t_nprints;
+
+
+int t_syscall3(int nr, int a, int b, int c)
+{
+	int ret;
+
+	__asm__ __volatile__("int $0x85"
+						 : "=a"(ret)
+						 : "a"(nr), "b"(a), "c"(b), "d"(c)
+						 : "memory");
+	return ret;
+}
+
+void t_exit(int status)
+{
+	t_syscall3(SYS_EXIT, status, 0, 0);
+}
+
+int t_strlen(const char *s)
+{
+	int len = 0;
+
+	while (s[len] != '\0') {
+		len++;
+	}
+	return len;
+}
+
+void t_print(const char *s)
+{
+	t_nprints++;
+	t_syscall3(SYS_WRITE, STDOUT, (int)s, t_strlen(s));
+}
+
+void t_print_num(unsigned int n)
+{
+	char str[11];
+	int pos = 10;
+
+	str[pos] = '\0';
+	do {
+		str[--pos] = '0' + (n % 10);
+		n /= 10;
+	} while (n > 0);
+	t_print(&str[pos]);
+}
+
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: bitops.h
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ARCH_X86_BITOPS_H
+
+	#define ARCH_X86_BITOPS_H
+
+	#include <unistd.h>
+
+	/**
+	 * Find the first (least significant) bit set in a word.
+	 *
+	 * \param word Word (must not be zero).
+	 * \return Bit index.
+	 */
+	static inline uint32_t find_first_bit(uint32_t word)
+	{
+		uint32_t bit;
+
+		__asm__("bsfl %1, %0" : "=r"(bit) : "rm"(word));
+		return bit;
+	}
+
+#endif /* ARCH_X86_BITOPS_H */
+
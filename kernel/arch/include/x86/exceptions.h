@@ -25,6 +25,11 @@
 
 	#define ARCH_X86_EXCEPTIONS_H
 
+	/* Page fault error code bits */
+	#define PF_PRESENT	0x01
+	#define PF_WRITE	0x02
+	#define PF_USER		0x04
+
 	void ex_div(pt_regs regs);
 	void ex_debug();
 	void ex_nmi();
@@ -28,6 +28,7 @@
 	#include <unistd.h>
 
 	#define CR0_PG_MASK		0x80000000
+	#define CR0_WP_MASK		0x00010000
 
 
 	extern uchar8_t inb(uint16_t port);
@@ -52,5 +53,11 @@
 
 	extern void write_cr3(uint32_t value);
 
+	extern uint32_t read_cr2(void);
+
+	extern void flush_tlb_page(uint32_t addr);
+
+	extern uint64_t read_tsc(void);
+
 #endif /* ARCH_X86_IO_H */
 
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: mc146818.h
+ * Desc: Real Time Clock (RTC) MC146818 compatible
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ARCH_X86_RTC
+
+	#define ARCH_X86_RTC
+
+	#include <unistd.h>
+
+	/* I/O ports used by RTC (CMOS) */
+	#define RTC_ADDR_PORT	0x70
+	#define RTC_DATA_PORT	0x71
+
+	/* Registers */
+	#define RTC_SECONDS		0x00
+	#define RTC_MINUTES		0x02
+	#define RTC_HOURS		0x04
+	#define RTC_DAY			0x07
+	#define RTC_MONTH		0x08
+	#define RTC_YEAR		0x09
+	#define RTC_STATUS_A	0x0A
+	#define RTC_STATUS_B	0x0B
+
+	/* Status register A: update in progress */
+	#define RTC_UIP			0x80
+	/* Status register B: 24 hour mode and binary (not BCD) format */
+	#define RTC_24H			0x02
+	#define RTC_BINARY		0x04
+	/* Hours register: PM bit at 12 hour mode */
+	#define RTC_PM			0x80
+
+
+	uint32_t rtc_get_time(void);
+
+#endif /* ARCH_X86_RTC */
+
@@ -67,5 +67,15 @@
 
 	void *kmalloc_e(uint32_t size);
 
+	uint32_t virt_to_phys(void *addr);
+
+	int map_page(pagedir_t *dir, uint32_t vaddr, uint32_t paddr, uint32_t flags);
+
+	uint32_t get_page_entry(pagedir_t *dir, uint32_t vaddr);
+
+	void set_page_entry(pagedir_t *dir, uint32_t vaddr, uint32_t entry);
+
+	void unmap_page(pagedir_t *dir, uint32_t vaddr);
+
 #endif /* ARCH_X86_MM_H */
 
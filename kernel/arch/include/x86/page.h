@@ -47,6 +47,8 @@
 	#define PAGE_PRESENT		0x01
 	#define PAGE_WRITABLE		0x02
 	#define PAGE_USER			0x04
+	#define PAGE_ACCESSED		0x20
+	#define PAGE_DIRTY			0x40
 
 #endif /* ARCH_X86_PAGE_H */
 
@@ -93,6 +93,8 @@
 		pt_regs regs;
 		/** Page table directory */
 		uint32_t cr3;
+		/** Page table directory (virtual address of the structure) */
+		struct _page_dir *pgdir;
 	} __attribute__((packed));
 
 	typedef struct _tss_struct tss_t;
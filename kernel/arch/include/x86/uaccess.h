@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: uaccess.h
+ * Desc: Access to user space memory
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ARCH_X86_UACCESS_H
+
+	#define ARCH_X86_UACCESS_H
+
+	#include <unistd.h>
+
+	/** User space ends where kernel starts (3GB) */
+	#define USER_SPACE_END 0xC0000000
+
+	/** Check if a buffer (addr, n) is into user space */
+	#define access_ok(addr, n) ((uint32_t)(addr) != 0 && \
+				(uint32_t)(addr) <= USER_SPACE_END && \
+				(uint32_t)(n) <= USER_SPACE_END - (uint32_t)(addr))
+
+	/**
+	 * Exception table entry: a fault at insn resumes at fixup
+	 */
+	struct _ex_table_entry_st {
+		uint32_t insn;
+		uint32_t fixup;
+	};
+
+	typedef struct _ex_table_entry_st ex_table_entry_t;
+
+
+	/* Prototypes */
+	extern uint32_t __copy_user(void *to, const void *from, uint32_t n);
+
+	uint32_t search_ex_table(uint32_t eip);
+
+	uint32_t copy_to_user(void *to, const void *from, uint32_t n);
+
+	uint32_t copy_from_user(void *to, const void *from, uint32_t n);
+
+	int strncpy_from_user(char *to, const char *from, uint32_t n);
+
+#endif /* ARCH_X86_UACCESS_H */
+
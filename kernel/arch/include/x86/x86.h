@@ -72,6 +72,40 @@
 
 	typedef struct _pt_regs pt_regs;
 
+	/**
+	 * Stack of a system call, from its first argument up to the
+	 * user context saved by the processor.
+	 * \note Do not change the order of elements in the structure!
+	 * \see arch/x86/kernel/sys_enter.S
+	 */
+	struct _sys_frame {
+		/** Arguments (EBX, ECX, EDX) */
+		uint32_t arg[3];
+		/** Return address (exit_syscall) */
+		uint32_t ret;
+		/** Data segments */
+		uint16_t gs;
+		uint16_t fs;
+		uint16_t es;
+		uint16_t ds;
+		/** Stack base pointer */
+		uint32_t ebp;
+		/** Kernel stack pointer (to iret) */
+		uint32_t kesp;
+		/** User instruction pointer */
+		uint32_t eip;
+		/** User code segment */
+		uint32_t cs;
+		/** EFLAGS */
+		uint32_t eflags;
+		/** User stack pointer */
+		uint32_t esp;
+		/** User stack segment */
+		uint32_t ss;
+	} __attribute__((packed));
+
+	typedef struct _sys_frame sys_frame;
+
 	/* Prototypes */
 	void dump_cpu(void);
 
@@ -7,5 +7,5 @@
 
 obj-y += exceptions.o gdt.o idt.o io.o dump_cpu.o
 
-obj-x86asm += isr.o task.o
+obj-x86asm += isr.o task.o uaccess.o
 
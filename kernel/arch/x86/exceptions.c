@@ -25,6 +25,9 @@
 #include <tempos/kernel.h>
 #include <x86/x86.h>
 #include <x86/exceptions.h>
+#include <x86/uaccess.h>
+#include <x86/io.h>
+#include <tempos/mmap.h>
 
 
 void ex_div(pt_regs regs)
@@ -118,6 +121,19 @@ void ex_gp(int code, pt_regs regs)
  */
 void ex_pfault(int code, pt_regs regs)
 {
+	uint32_t fixup;
+
+	/* Memory mapped area: page is mapped on demand */
+	if (mmap_fault(read_cr2(), (code & PF_WRITE) != 0)) {
+		return;
+	}
+
+	/* Fault while kernel was copying user data: resume at fixup code */
+	if ((fixup = search_ex_table(regs.eip)) != 0) {
+		((volatile pt_regs *)&regs)->eip = fixup;
+		return;
+	}
+
 	dump_cpu_regs(&regs);
 	panic("PAGE FAULT");
 }
@@ -97,3 +97,25 @@ inline void write_cr3(uint32_t value)
 	asm volatile("movl %0, %%cr3" : : "r" (value));
 }
 
+
+inline uint32_t read_cr2(void)
+{
+	uint32_t cr2;
+	asm volatile("movl %%cr2, %0" : "=r" (cr2));
+	return(cr2);
+}
+
+
+inline void flush_tlb_page(uint32_t addr)
+{
+	asm volatile("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
+
+
+inline uint64_t read_tsc(void)
+{
+	uint64_t tsc;
+	asm volatile("rdtsc" : "=A" (tsc));
+	return(tsc);
+}
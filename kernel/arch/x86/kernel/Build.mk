@@ -5,7 +5,7 @@
 # TBS - Build configuration file
 #
 
-obj-y += i8259A.o i82C54.o irq.o task.o atomic.o
+obj-y += i8259A.o i82C54.o mc146818.o irq.o task.o atomic.o
 
 obj-x86asm += sys_enter.o
 
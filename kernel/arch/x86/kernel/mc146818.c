@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: mc146818.c
+ * Desc: Driver for Real Time Clock (RTC) MC146818 compatible
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <x86/mc146818.h>
+#include <x86/io.h>
+
+/* Prototypes */
+static uchar8_t rtc_read(uchar8_t reg);
+
+static uint32_t bcd_to_bin(uint32_t value);
+
+
+/**
+ * Read a RTC register.
+ *
+ * \param reg Register.
+ * \return Register value.
+ */
+static uchar8_t rtc_read(uchar8_t reg)
+{
+	outb(reg, RTC_ADDR_PORT);
+	return inb(RTC_DATA_PORT);
+}
+
+/**
+ * Convert a BCD value to binary.
+ */
+static uint32_t bcd_to_bin(uint32_t value)
+{
+	return ((value >> 4) * 10) + (value & 0x0F);
+}
+
+/**
+ * Read current date and time from RTC.
+ *
+ * \return Seconds since 1970-01-01 00:00:00 (UTC is assumed).
+ */
+uint32_t rtc_get_time(void)
+{
+	uint32_t sec, min, hour, day, mon, year, days;
+	uchar8_t status, pm;
+
+	/* Wait for an update cycle to finish, then read twice to be sure */
+	do {
+		while (rtc_read(RTC_STATUS_A) & RTC_UIP);
+		sec  = rtc_read(RTC_SECONDS);
+		min  = rtc_read(RTC_MINUTES);
+		hour = rtc_read(RTC_HOURS);
+		day  = rtc_read(RTC_DAY);
+		mon  = rtc_read(RTC_MONTH);
+		year = rtc_read(RTC_YEAR);
+	} while (sec != rtc_read(RTC_SECONDS));
+
+	status = rtc_read(RTC_STATUS_B);
+	pm     = hour & RTC_PM;
+	hour  &= ~RTC_PM;
+
+	if ( !(status & RTC_BINARY) ) {
+		sec  = bcd_to_bin(sec);
+		min  = bcd_to_bin(min);
+		hour = bcd_to_bin(hour);
+		day  = bcd_to_bin(day);
+		mon  = bcd_to_bin(mon);
+		year = bcd_to_bin(year);
+	}
+
+	if ( !(status & RTC_24H) ) {
+		hour %= 12;
+		if (pm) {
+			hour += 12;
+		}
+	}
+
+	/* Century register is not standard */
+	year += (year < 70 ? 2000 : 1900);
+
+	/* Days since epoch (March based year, so leap day is the last one) */
+	if (mon <= 2) {
+		mon  += 12;
+		year -= 1;
+	}
+	days = (365 * year) + (year / 4) - (year / 100) + (year / 400) +
+		   ((153 * (mon - 3) + 2) / 5) + day - 719469;
+
+	return (((days * 24) + hour) * 60 + min) * 60 + sec;
+}
+
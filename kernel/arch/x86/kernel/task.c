@@ -73,7 +73,10 @@ void arch_init_scheduler(void (*start_routine)(void*))
 	newth->priority    = DEFAULT_PRIORITY;
 	newth->pid         = KERNEL_PID;
 	newth->return_code = 0;
-	newth->wait_queue  = 0;
+	init_waitqueue_head(&newth->exit_wait);
+	memset(newth->files, 0, sizeof(newth->files));
+	newth->mmap = NULL;
+	newth->ioring = NULL;
 
 	newth->arch_tss.regs.eip = (uint32_t)start_routine;
 	newth->arch_tss.regs.ds  = KERNEL_DS;
@@ -83,11 +86,12 @@ void arch_init_scheduler(void (*start_routine)(void*))
 	newth->arch_tss.regs.es  = KERNEL_DS;
 	newth->arch_tss.regs.cs  = KERNEL_CS;
 	newth->arch_tss.cr3 = (uint32_t)kerneldir->dir_phy_addr; /* physical address */
+	newth->arch_tss.pgdir = (pagedir_t*)kerneldir;
 	newth->arch_tss.regs.eflags = (eflags | EFLAGS_IF); /* enable interrupts */
 
 	cli();
-	c_llist_add(&tasks, newth);
-	cur_task = tasks;
+	sched_add_task(newth);
+	cur_task = newth->tnode;
 	arch_tss_cur_task = &newth->arch_tss;
 	sti();
 
@@ -116,6 +120,7 @@ void setup_task(task_t *task, void (*start_routine)(void*))
 	task->arch_tss.regs.es  = KERNEL_DS;
 	task->arch_tss.regs.cs  = KERNEL_CS;
 	task->arch_tss.cr3 = (uint32_t)kerneldir->dir_phy_addr; /* physical address */
+	task->arch_tss.pgdir = (pagedir_t*)kerneldir;
 
 	task->arch_tss.regs.eflags = EFLAGS_IF;
 	
@@ -5,5 +5,5 @@
 # TBS - Build configuration file
 #
 
-obj-y += mm.o
+obj-y += mm.o uaccess.o
 
@@ -78,6 +78,7 @@
 #include <x86/gdt.h>
 #include <x86/karch.h>
 #include <tempos/kernel.h>
+#include <tempos/mm.h>
 
 /** Address used by kmalloc_e */
 static uint32_t free_phy_addr;
@@ -228,9 +229,10 @@ void init_pg(karch_t *kinf)
 	}
 	stack_top = 0;
 
-	/* Enable Paging System */
+	/* Enable Paging System (write protection is also honored
+	   in kernel mode, so copy on write works for user copies) */
 	write_cr3(kerneldir->dir_phy_addr);
-	write_cr0(read_cr0() | CR0_PG_MASK);
+	write_cr0(read_cr0() | CR0_PG_MASK | CR0_WP_MASK);
 
 	/* Reload GDT */
 	setup_GDT();
@@ -333,3 +335,85 @@ void *kmalloc_e(uint32_t size)
 	return((void *)tmp);
 }
 
+
+
+/**
+ * Return the physical address of a kernel virtual address
+ * (kernel image or memory allocated by kmalloc).
+ */
+uint32_t virt_to_phys(void *addr)
+{
+	uint32_t vaddr  = (uint32_t)addr;
+	uint32_t *table = kerneldir->tables[vaddr >> (PAGE_SHIFT + TABLE_SHIFT)];
+
+	return(PAGE_PADDR(table[(vaddr >> PAGE_SHIFT) & (TABLE_SIZE - 1)]) |
+		   (vaddr & ~PAGE_MASK));
+}
+
+
+/**
+ * Map a page into a pages directory. Page tables not present
+ * (user directories) are allocated.
+ *
+ * \param dir Pages directory.
+ * \param vaddr Virtual address.
+ * \param paddr Physical address of the page.
+ * \param flags Page flags (PAGE_PRESENT is always set).
+ * \return 0 on success, -1 if there is no memory for page table.
+ */
+int map_page(pagedir_t *dir, uint32_t vaddr, uint32_t paddr, uint32_t flags)
+{
+	uint32_t index = vaddr >> (PAGE_SHIFT + TABLE_SHIFT);
+	uint32_t *table;
+
+	if ((table = dir->tables[index]) == NULL) {
+		if ((table = (uint32_t*)kmalloc_page(GFP_NORMAL_Z | GFP_ZEROP)) == NULL) {
+			return(-1);
+		}
+		dir->tables[index] = table;
+		dir->tables_phy_addr[index] = MAKE_ENTRY(virt_to_phys(table),
+									(PAGE_WRITABLE | PAGE_PRESENT | PAGE_USER));
+	}
+
+	table[(vaddr >> PAGE_SHIFT) & (TABLE_SIZE - 1)] = MAKE_ENTRY(paddr, (flags | PAGE_PRESENT));
+	flush_tlb_page(vaddr);
+
+	return(0);
+}
+
+
+/**
+ * Return the page table entry of a virtual address (0 if not mapped).
+ */
+uint32_t get_page_entry(pagedir_t *dir, uint32_t vaddr)
+{
+	uint32_t *table = dir->tables[vaddr >> (PAGE_SHIFT + TABLE_SHIFT)];
+
+	if (table == NULL) {
+		return(0);
+	}
+	return(table[(vaddr >> PAGE_SHIFT) & (TABLE_SIZE - 1)]);
+}
+
+
+/**
+ * Change the page table entry of a mapped virtual address.
+ */
+void set_page_entry(pagedir_t *dir, uint32_t vaddr, uint32_t entry)
+{
+	uint32_t *table = dir->tables[vaddr >> (PAGE_SHIFT + TABLE_SHIFT)];
+
+	if (table != NULL) {
+		table[(vaddr >> PAGE_SHIFT) & (TABLE_SIZE - 1)] = entry;
+		flush_tlb_page(vaddr);
+	}
+}
+
+
+/**
+ * Unmap a page from a pages directory (page itself is not released).
+ */
+void unmap_page(pagedir_t *dir, uint32_t vaddr)
+{
+	set_page_entry(dir, vaddr, 0);
+}
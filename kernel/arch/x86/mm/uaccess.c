@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: uaccess.c
+ * Desc: Access to user space memory
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <x86/uaccess.h>
+#include <x86/page.h>
+
+/** Exception table bounds (see setup.ld) */
+extern ex_table_entry_t __start_ex_table[];
+extern ex_table_entry_t __stop_ex_table[];
+
+
+/**
+ * Search the fixup address of an instruction which can fault.
+ *
+ * \param eip Faulting instruction address.
+ * \return uint32_t Fixup address, or 0 if instruction is not on
+ * exception table.
+ */
+uint32_t search_ex_table(uint32_t eip)
+{
+	ex_table_entry_t *entry;
+
+	for (entry = __start_ex_table; entry < __stop_ex_table; entry++) {
+		if (entry->insn == eip) {
+			return entry->fixup;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Copy data to user space.
+ *
+ * \param to User space destination.
+ * \param from Kernel source.
+ * \param n Number of bytes.
+ * \return uint32_t Number of bytes that could not be copied (0 on success).
+ */
+uint32_t copy_to_user(void *to, const void *from, uint32_t n)
+{
+	if (!access_ok(to, n)) {
+		return n;
+	}
+	return __copy_user(to, from, n);
+}
+
+/**
+ * Copy data from user space.
+ *
+ * \param to Kernel destination.
+ * \param from User space source.
+ * \param n Number of bytes.
+ * \return uint32_t Number of bytes that could not be copied (0 on success).
+ */
+uint32_t copy_from_user(void *to, const void *from, uint32_t n)
+{
+	if (!access_ok(from, n)) {
+		return n;
+	}
+	return __copy_user(to, from, n);
+}
+
+/**
+ * Copy a string from user space. String is copied in bulk, up to
+ * the end of each page, so it never touches pages after its end.
+ *
+ * \param to Kernel destination.
+ * \param from User space string.
+ * \param n Size of destination.
+ * \return Length of string, or -1 on fault (or if it doesn't fit).
+ */
+int strncpy_from_user(char *to, const char *from, uint32_t n)
+{
+	uint32_t done, len, i;
+
+	for (done = 0; done < n; done += len) {
+		len = PAGE_SIZE - (((uint32_t)from + done) & (PAGE_SIZE - 1));
+		if (len > n - done) {
+			len = n - done;
+		}
+		if (copy_from_user(&to[done], &from[done], len) != 0) {
+			return -1;
+		}
+		for (i = 0; i < len; i++) {
+			if (to[done + i] == '\0') {
+				return done + i;
+			}
+		}
+	}
+
+	return -1;
+}
+
@@ -84,6 +84,13 @@
 #define ATA_DISCARD_NEXT_IRQ  0x01
 #define ATA_HANDLE_NEXT_IRQ   0x00
 
+/** Polling never spins longer than (1 / ATA_POLL_MAX_DIV) of a tick */
+#define ATA_POLL_MAX_DIV	2
+/** Polling spins up to ATA_POLL_FACTOR times the mean service time */
+#define ATA_POLL_FACTOR		2
+/** Weight (log2) of the moving average of service times */
+#define ATA_SVC_EWMA_SHIFT	3
+
 /** ATA devices information */
 static ata_dev_info ata_devices[4];
 
@@ -100,6 +107,8 @@ struct _block_op {
 	int device;
 	/** Buffer */
 	buff_header_t *buff;
+	/** TSC value when request was queued */
+	uint64_t queued;
 };
 
 /**
@@ -115,6 +124,32 @@ static llist *blk_queue[4];
 /** Indicate when we should discard a IRQ */
 static char discard_irq[2];
 
+/**
+ * Service time information of the device on each bus.
+ * Used to adapt the spin budget of polled completion.
+ */
+struct _ata_svc_info {
+	/** TSC value when the last read command was sent */
+	uint64_t issued;
+	/** Moving average of read service time (TSC cycles) */
+	uint32_t mean;
+	/** Synchronous reads completed while polling */
+	uint32_t poll_hits;
+	/** Synchronous reads that went to sleep after polling */
+	uint32_t poll_misses;
+};
+
+static struct _ata_svc_info ata_svc[2];
+
+/** Polled completion mode for synchronous reads (0 = off) */
+static char ata_poll_mode = 0;
+
+/**
+ * Synchronous read latency histograms (log2 of microseconds).
+ * Index 0: polling off, index 1: polling on.
+ */
+static uint32_t sync_lat_hist[2][BLKSTAT_BUCKETS];
+
 /** Driver structure */
 dev_blk_driver_t ata_bus_drv[2];
 
@@ -143,6 +178,14 @@ static int read_hd_sector(int major, int device, uint64_t addr);
 
 static int write_hd_sector(int major, int device, uint64_t addr, char *sector);
 
+static void ata_update_svc(uchar8_t bus);
+
+static int ata_poll_completion(uchar8_t bus, buff_header_t *buf);
+
+static void ata_account_latency(char polled, uint32_t cycles);
+
+static int ata_merge_request(int dev, char op, buff_header_t *buf);
+
 
 /** ATA block device operations (Read/Write) */
 struct _blk_dev_op ata_ops = {
@@ -604,6 +647,7 @@ static int read_hd_sector(int major, int device, uint64_t addr)
 	dc = (inb(pio_ports[bus][REG_DC]) & 0xF0) | 0x40;
 	outb(dc, pio_ports[bus][REG_DC]);
 
+	ata_svc[bus].issued = read_tsc();
 	send_cmd(bus, CMD_READ_SECTORS_EXT);
 	wait_bus(bus);
 
@@ -718,8 +762,10 @@ static int write_hd_sector(int major, int device, uint64_t addr, char *sector)
 static void ata_handler1(int id, pt_regs *regs)
 {
 	uint16_t data, i;
-	buff_header_t *buf;
+	uchar8_t *dst;
+	buff_header_t *buf, *done;
 	struct _block_op *bop;
+	int done_dev;
 
 	cli();
 
@@ -735,15 +781,17 @@ static void ata_handler1(int id, pt_regs *regs)
 	/* Primary */
 	bop = (struct _block_op *)blk_queue[0]->element;
 	buf = bop->buff;
+	dst = (uchar8_t *)BUFF_DATA(buf);
 
 	if (bop->op == OP_READ) {
 		/* Read block */
+		ata_update_svc(PRI_BUS);
 
 		for(i=0; i<SECTOR_SIZE; i+=2) {
 			wait_bus(PRI_BUS);
 			data = inw(pio_ports[PRI_BUS][REG_DATA]);
-			buf->data[i+1] = (uchar8_t)((data >> 0x08) & 0xFF);
-			buf->data[i]   = (uchar8_t)(data & 0xFF);
+			dst[i+1] = (uchar8_t)((data >> 0x08) & 0xFF);
+			dst[i]   = (uchar8_t)(data & 0xFF);
 		}
 	} else if (bop->op == OP_WRITE) {
 		/* Write is done. Just ignore next IRQ */
@@ -753,6 +801,10 @@ static void ata_handler1(int id, pt_regs *regs)
 		kprintf(KERN_CRIT "Unknown ATA operation (should be Read or Write).");
 	}
 	buf->status = BUFF_ST_VALID; 
+	blkstat_complete(&ata_bus_drv[PRI_BUS].stats, (bop->op == OP_WRITE), 1,
+						(uint32_t)(read_tsc() - bop->queued));
+	done     = buf;
+	done_dev = bop->device;
 	llist_remove(&blk_queue[0], bop);
 	kfree(bop);
 
@@ -764,7 +816,7 @@ static void ata_handler1(int id, pt_regs *regs)
 		if (bop->op == OP_READ) {
 			read_hd_sector(DEVMAJOR_ATA_PRI, bop->device, buf->addr);
 		} else if (bop->op == OP_WRITE) {
-			write_hd_sector(DEVMAJOR_ATA_PRI, bop->device, buf->addr, buf->data);
+			write_hd_sector(DEVMAJOR_ATA_PRI, bop->device, buf->addr, BUFF_DATA(buf));
 		} else {
 			kprintf(KERN_CRIT "Unknown ATA operation (should be Read or Write).");
 		}
@@ -772,14 +824,17 @@ static void ata_handler1(int id, pt_regs *regs)
 
 	/* Wakeup process waiting for this interrupt */
 	sti();
-	wakeup(WAIT_INT_IDE_PRI);
+	wakeup_all(&done->io_wait);
+	biodone(DEVMAJOR_ATA_PRI, done_dev, done);
 }
 
 static void ata_handler2(int id, pt_regs *regs)
 {
 	uint16_t data, i;
-	buff_header_t *buf;
+	uchar8_t *dst;
+	buff_header_t *buf, *done;
 	struct _block_op *bop;
+	int done_dev;
 
 	cli();
 
@@ -795,15 +850,17 @@ static void ata_handler2(int id, pt_regs *regs)
 	/* Secondary */
 	bop = (struct _block_op *)blk_queue[2]->element;
 	buf = bop->buff;
+	dst = (uchar8_t *)BUFF_DATA(buf);
 
 	if (bop->op == OP_READ) {
 		/* Read block */
+		ata_update_svc(SEC_BUS);
 
 		for(i=0; i<SECTOR_SIZE; i+=2) {
 			wait_bus(SEC_BUS);
 			data = inw(pio_ports[SEC_BUS][REG_DATA]);
-			buf->data[i+1] = (uchar8_t)((data >> 0x08) & 0xFF);
-			buf->data[i]   = (uchar8_t)(data & 0xFF);  
+			dst[i+1] = (uchar8_t)((data >> 0x08) & 0xFF);
+			dst[i]   = (uchar8_t)(data & 0xFF);  
 		}
 	} else if (bop->op == OP_WRITE) {
 		/* Write is done. Just ignore next IRQ */
@@ -813,6 +870,10 @@ static void ata_handler2(int id, pt_regs *regs)
 		kprintf(KERN_CRIT "Unknown ATA operation (should be Read or Write).");
 	}
 	buf->status = BUFF_ST_VALID;
+	blkstat_complete(&ata_bus_drv[SEC_BUS].stats, (bop->op == OP_WRITE), 1,
+						(uint32_t)(read_tsc() - bop->queued));
+	done     = buf;
+	done_dev = bop->device;
 	llist_remove(&blk_queue[2], bop);
 	kfree(bop);
 
@@ -824,7 +885,7 @@ static void ata_handler2(int id, pt_regs *regs)
 		if (bop->op == OP_READ) {
 			read_hd_sector(DEVMAJOR_ATA_SEC, bop->device, buf->addr);
 		} else if (bop->op == OP_WRITE) {
-			write_hd_sector(DEVMAJOR_ATA_SEC, bop->device, buf->addr, buf->data);
+			write_hd_sector(DEVMAJOR_ATA_SEC, bop->device, buf->addr, BUFF_DATA(buf));
 		} else {
 			kprintf(KERN_CRIT "Unknown ATA operation (should be Read or Write).");
 		}
@@ -832,7 +893,8 @@ static void ata_handler2(int id, pt_regs *regs)
 
 	/* Wakeup process waiting for this interrupt */
 	sti();
-	wakeup(WAIT_INT_IDE_SEC);
+	wakeup_all(&done->io_wait);
+	biodone(DEVMAJOR_ATA_SEC, done_dev, done);
 }
 
 /**
@@ -874,6 +936,12 @@ int read_async_ata_sector(int major, int device, buff_header_t *buf)
 
 
 	cli();
+	/* Block is already queued to be read */
+	if (ata_merge_request(dev, OP_READ, buf)) {
+		sti();
+		return 0;
+	}
+
 	/* First, mark block as busy */
 	buf->status = BUFF_ST_BUSY;
 
@@ -885,7 +953,9 @@ int read_async_ata_sector(int major, int device, buff_header_t *buf)
 		bop->op     = OP_READ;
 		bop->buff   = buf;
 		bop->device = device;
+		bop->queued = read_tsc();
 	}
+	blkstat_queue(&block_dev_drivers[major]->stats);
 
 	if (blk_queue[dev] == NULL) {
 		/** The queue is empty, so we can process this block now! */
@@ -913,16 +983,23 @@ int read_async_ata_sector(int major, int device, buff_header_t *buf)
 int read_sync_ata_sector(int major, int device, buff_header_t *buf)
 {
 	int res;
-	
-	res = read_async_ata_sector(major, device, buf);
+	char polled;
+	uint64_t start;
+
+	start  = read_tsc();
+	polled = ata_poll_mode;
+	res    = read_async_ata_sector(major, device, buf);
+
+	/* Fast devices: spin a little before going to sleep */
+	if (res == 0 && polled) {
+		ata_poll_completion((major == DEVMAJOR_ATA_PRI ? PRI_BUS : SEC_BUS), buf);
+	}
 
 	/** Wait block to become available */
-	if (major == DEVMAJOR_ATA_PRI) {
-		while(buf->status == BUFF_ST_BUSY)
-			sleep_on(WAIT_INT_IDE_PRI);
-	} else {
-		while(buf->status == BUFF_ST_BUSY)
-			sleep_on(WAIT_INT_IDE_SEC);
+	wait_event(&buf->io_wait, buf->status != BUFF_ST_BUSY);
+
+	if (res == 0) {
+		ata_account_latency(polled, (uint32_t)(read_tsc() - start));
 	}
 
 	return res;
@@ -943,32 +1020,27 @@ int write_async_ata_sector(int major, int device, buff_header_t *buf)
 	uchar8_t dev;
 	struct _block_op *bop;
 
+	/* Same device mapping of reads: partitions are minors of the disk */
 	if (major == DEVMAJOR_ATA_PRI) {
-		switch(device) {
-			case DEVNUM_HDA:
-				dev = 0;
-				break;
-
-			case DEVNUM_HDB:
-				dev = 1;
-				break;
-
-			default:
-				return -1;
+		
+		if (device >= DEVNUM_HDA && device < DEVNUM_HDB) {
+			dev = 0;
+		} else if (device >= DEVNUM_HDB) {
+			dev = 1;
+		} else {
+			return -1;
 		}
+		
 	} else if(major == DEVMAJOR_ATA_SEC) {
-		switch(device) {
-			case DEVNUM_HDC:
-				dev = 2;
-				break;
 
-			case DEVNUM_HDD:
-				dev = 3;
-				break;
-
-			default:
-				return -1;
+		if (device >= DEVNUM_HDC && device < DEVNUM_HDD) {
+			dev = 2;
+		} else if (device >= DEVNUM_HDD) {
+			dev = 3;
+		} else {
+			return -1;
 		}
+
 	} else {
 		return -1;
 	}
@@ -983,14 +1055,17 @@ int write_async_ata_sector(int major, int device, buff_header_t *buf)
 		sti();
 		return -1;
 	} else {
-		bop->op   = OP_WRITE;
-		bop->buff = buf; 
+		bop->op     = OP_WRITE;
+		bop->buff   = buf; 
+		bop->device = device;
+		bop->queued = read_tsc();
 	}
+	blkstat_queue(&block_dev_drivers[major]->stats);
 
 	if (blk_queue[dev] == NULL) {
 		/** The queue is empty, so we can process this block now! */
 		llist_add(&blk_queue[dev], bop); 
-		write_hd_sector(major, device, buf->addr, buf->data);
+		write_hd_sector(major, device, buf->addr, BUFF_DATA(buf));
 	} else {
 		/** The queue is not empty, we will just add the block to the queue,
 		 *  so it will be process later, by interrupt handler */
@@ -1018,14 +1093,190 @@ int write_sync_ata_sector(int major, int device, buff_header_t *buf)
 	res = write_async_ata_sector(major, device, buf);
 
 	/** Wait block to become available */
-	if (major == DEVMAJOR_ATA_PRI) {
-		while(buf->status == BUFF_ST_BUSY)
-			sleep_on(WAIT_INT_IDE_PRI);
+	wait_event(&buf->io_wait, buf->status != BUFF_ST_BUSY);
+
+	return res;
+}
+
+
+
+/**
+ * Update the mean read service time of the device on a bus.
+ * \note Called from interrupt handlers when a read command completes.
+ *
+ * \param bus Primary or Secondary bus.
+ */
+static void ata_update_svc(uchar8_t bus)
+{
+	struct _ata_svc_info *svc = &ata_svc[bus];
+	uint32_t delta;
+
+	delta = (uint32_t)(read_tsc() - svc->issued);
+
+	if (svc->mean == 0) {
+		svc->mean = delta;
 	} else {
-		while(buf->status == BUFF_ST_BUSY)
-			sleep_on(WAIT_INT_IDE_SEC);
+		svc->mean = svc->mean - (svc->mean >> ATA_SVC_EWMA_SHIFT)
+						+ (delta >> ATA_SVC_EWMA_SHIFT);
 	}
+}
 
-	return res;
+
+/**
+ * Spin waiting for a block to be read, instead of sleeping.
+ * The spin budget is a multiple of the mean service time of the device,
+ * but never longer than a fraction of a tick: for slow devices, sleeping
+ * (and running another task) is cheaper than spinning.
+ *
+ * \param bus Primary or Secondary bus.
+ * \param buf Buffer being read.
+ * \return 1 if the block became available while polling, 0 otherwise.
+ */
+static int ata_poll_completion(uchar8_t bus, buff_header_t *buf)
+{
+	struct _ata_svc_info *svc = &ata_svc[bus];
+	volatile char *status = &buf->status;
+	uint32_t budget;
+	uint64_t start;
+
+	/* Nothing measured yet */
+	if (svc->mean == 0 || tsc_per_jiffy == 0) {
+		return 0;
+	}
+
+	budget = svc->mean * ATA_POLL_FACTOR;
+	if (budget > (tsc_per_jiffy / ATA_POLL_MAX_DIV)) {
+		/* Device is too slow to be worth polling */
+		svc->poll_misses++;
+		return 0;
+	}
+
+	start = read_tsc();
+	while (*status == BUFF_ST_BUSY) {
+		if ((uint32_t)(read_tsc() - start) >= budget) {
+			svc->poll_misses++;
+			return 0;
+		}
+	}
+
+	svc->poll_hits++;
+	return 1;
+}
+
+
+/**
+ * Account latency of a synchronous read.
+ *
+ * \param polled Polled completion mode was used (1) or not (0).
+ * \param cycles Latency in TSC cycles.
+ */
+static void ata_account_latency(char polled, uint32_t cycles)
+{
+	sync_lat_hist[(polled ? 1 : 0)][blkstat_bucket(tsc_to_usecs(cycles))]++;
+}
+
+
+/**
+ * Check if a buffer is already queued for the same operation. In this case
+ * the new request is merged into the queued one.
+ * \note Must be called with interrupts disabled.
+ *
+ * \param dev Device queue.
+ * \param op Operation (OP_READ or OP_WRITE).
+ * \param buf Buffer.
+ * \return 1 if the request was merged, 0 otherwise.
+ */
+static int ata_merge_request(int dev, char op, buff_header_t *buf)
+{
+	struct _block_op *bop;
+	llist *tmp;
+
+	foreach(blk_queue[dev], tmp) {
+		bop = (struct _block_op *)tmp->element;
+		if (bop->buff == buf && bop->op == op) {
+			blkstat_merge(&ata_bus_drv[(dev < 2 ? PRI_BUS : SEC_BUS)].stats);
+			return 1;
+		}
+	}
+
+	return 0;
 }
 
+
+/**
+ * Enable or disable polled completion of synchronous reads.
+ *
+ * \param on 1 to enable, 0 to disable.
+ */
+void ata_set_poll_mode(int on)
+{
+	ata_poll_mode = (on ? 1 : 0);
+}
+
+
+/**
+ * Show synchronous read latency (p50/p99) with polling on and off,
+ * and the polling statistics of each bus.
+ */
+void ata_print_sync_latency(void)
+{
+	int i;
+
+	kprintf(KERN_INFO "ATA: synchronous read latency (polling is %s)\n",
+			(ata_poll_mode ? "on" : "off"));
+
+	for (i = 0; i < 2; i++) {
+		kprintf(KERN_INFO "  polling %s: p50 < %d us, p99 < %d us\n",
+				(i ? "on " : "off"),
+				blkstat_percentile(sync_lat_hist[i], 50),
+				blkstat_percentile(sync_lat_hist[i], 99));
+	}
+
+	for (i = 0; i < 2; i++) {
+		kprintf(KERN_INFO "  bus %d: mean service %d us, %d polled, %d slept\n", i,
+				tsc_to_usecs(ata_svc[i].mean),
+				ata_svc[i].poll_hits, ata_svc[i].poll_misses);
+	}
+}
+
+/**
+ * Synchronous read latency benchmark: read n sectors from the start
+ * of a device, first with polling off and then with polling on, and
+ * show latencies (see ata_print_sync_latency()). Buffer cache is not
+ * used, so every read goes to the device.
+ *
+ * \param major Bus - Primary or Secondary IDE.
+ * \param device Device number.
+ * \param n Number of sectors read in each mode.
+ */
+void ata_sync_bench(int major, int device, uint32_t n)
+{
+	buff_header_t *buf;
+	char old_mode = ata_poll_mode;
+	uint32_t i;
+	int mode;
+
+	if ((buf = (buff_header_t*)kmalloc(sizeof(buff_header_t), GFP_NORMAL_Z)) == NULL) {
+		return;
+	}
+	memset(buf, 0, sizeof(buff_header_t));
+	init_waitqueue_head(&buf->wait);
+	init_waitqueue_head(&buf->io_wait);
+	memset(sync_lat_hist, 0, sizeof(sync_lat_hist));
+
+	/* Polling off first: it also measures mean service time */
+	for (mode = 0; mode < 2; mode++) {
+		ata_poll_mode = mode;
+		for (i = 0; i < n; i++) {
+			buf->addr = i;
+			if (read_sync_ata_sector(major, device, buf) < 0) {
+				kprintf(KERN_ERROR "ATA: sync bench: could not read sector %d.\n", i);
+				break;
+			}
+		}
+	}
+
+	ata_poll_mode = old_mode;
+	kfree(buf);
+	ata_print_sync_latency();
+}
@@ -32,7 +32,6 @@ static buff_header_t *search_blk(buff_hashq_t *queue, int device, uint64_t block
 static void blk_remove_from_freelist(buff_hashq_t *queue, int device, uint64_t blocknum);
 static buff_header_t *get_free_blk(buff_hashq_t *queue, int device, uint64_t blocknum);
 static void add_to_buff_queue(buff_hashq_t *queue, buff_header_t *buff, int device, uint64_t blocknum);
-static buff_header_t *getblk(int major, int device, uint64_t blocknum);
 
 
 /**
@@ -70,6 +69,13 @@ buff_hashq_t *create_hash_queue(uint64_t size)
 		hash_queue->hashtable[i] = NULL;
 	}
 
+	/* Wait queues */
+	init_waitqueue_head(&hash_queue->free_wait);
+	for (i = 0; i < BUFF_QUEUE_SIZE; i++) {
+		init_waitqueue_head(&hash_queue->blocks[i].wait);
+		init_waitqueue_head(&hash_queue->blocks[i].io_wait);
+	}
+
 	/* Free list head */
 	head = &hash_queue->blocks[0];
 	head->free_prev = head;
@@ -157,8 +163,8 @@ static void blk_remove_from_freelist(buff_hashq_t *queue, int device, uint64_t b
 	prev = tmp->free_prev;
 	next = tmp->free_next;
 
-	next->prev = prev;
-	prev->next = next;
+	next->free_prev = prev;
+	prev->free_next = next;
 	sti();
 	return;
 }
@@ -290,8 +296,10 @@ static void add_to_buff_queue(buff_hashq_t *queue, buff_header_t *buff, int devi
  * \param device Minor number (device number)
  * \param blocknum Block number (address)
  * \return buff_header_t* Pointer to the block
+ * \note Block contents are not read from device, so this function can be
+ *       used to overwrite whole blocks. Release it with brelse().
  */
-static buff_header_t *getblk(int major, int device, uint64_t blocknum)
+buff_header_t *getblk(int major, int device, uint64_t blocknum)
 {
 	buff_header_t *buff;
 	dev_blk_driver_t *driver;
@@ -303,13 +311,14 @@ static buff_header_t *getblk(int major, int device, uint64_t blocknum)
 		if ( (buff = search_blk(driver->buffer_queue, device, blocknum)) != NULL ) {
 			/* Block is in hash queue */
 			
+			cli();
 			if (buff->status == BUFF_ST_BUSY) {
-				sleep_on(WAIT_THIS_BLOCK_BUFFER_GET_FREE);
+				/* Only one waiter can get it when it's released */
+				sleep_on_exclusive(&buff->wait);
 				continue;
 			}
 			
 			/* Remove buffer from free list and set as busy */
-			cli();
 			buff->status = BUFF_ST_BUSY;
 			sti();
 			blk_remove_from_freelist(driver->buffer_queue, device, blocknum);
@@ -319,7 +328,9 @@ static buff_header_t *getblk(int major, int device, uint64_t blocknum)
 			
 			/* There are no free buffers on free list */
 			if ( (buff = get_free_blk(driver->buffer_queue, device, blocknum)) == NULL ) {
-				sleep_on(WAIT_BLOCK_BUFFER_GET_FREE);
+				wait_event_exclusive(&driver->buffer_queue->free_wait,
+					driver->buffer_queue->freelist_head->free_next !=
+					driver->buffer_queue->freelist_head);
 				continue;
 			} else {
 
@@ -355,9 +366,6 @@ void brelse(int major, int device, buff_header_t *buff)
 
 	driver = block_dev_drivers[major]; 
 
-	wakeup(WAIT_BLOCK_BUFFER_GET_FREE);
-	wakeup(WAIT_THIS_BLOCK_BUFFER_GET_FREE);
-	
 	cli();
 
 	head = driver->buffer_queue->freelist_head;
@@ -381,6 +389,10 @@ void brelse(int major, int device, buff_header_t *buff)
 	sti();
 
 	buff->status = BUFF_ST_UNLOCKED;
+
+	/* One process waiting for this buffer, one waiting for any buffer */
+	wakeup(&buff->wait);
+	wakeup(&driver->buffer_queue->free_wait);
 }
 
 
@@ -408,6 +420,8 @@ buff_header_t *bread(int major, int device, uint64_t blocknum)
 		buff->status = BUFF_ST_VALID;
 	}
 
+	blkstat_cache(&driver->stats, (buff->status == BUFF_ST_VALID));
+
 	if (buff->status != BUFF_ST_VALID) {
 		/* Read from device (synchronous) */
 		if (driver->dev_ops->read_sync_block(major, device, buff) < 0) {
@@ -467,6 +481,112 @@ buff_header_t *breada(int major, int device, uint64_t blocknum1, uint64_t blockn
 	return NULL;
 }
 
+/**
+ * Start an asynchronous read of a block into the cache (read ahead).
+ * Caller doesn't wait: buffer is released by biodone() when the read
+ * completes, so later bread() calls find it in cache.
+ *
+ * \param major Major number of the device
+ * \param device Minor number (device number)
+ * \param blocknum Block number (address)
+ * \return int 1 if a read was started, 0 if block is cached (or being
+ * read), -1 on error.
+ */
+int bprefetch(int major, int device, uint64_t blocknum)
+{
+	buff_header_t *buff;
+	dev_blk_driver_t *driver;
+
+	driver = block_dev_drivers[major]; 
+
+	if (search_blk(driver->buffer_queue, device, blocknum) != NULL) {
+		return 0;
+	}
+
+	if ((buff = getblk(major, device, blocknum)) == NULL) {
+		return -1;
+	}
+
+	if (buff->status == BUFF_ST_BUSY) {
+		/* Block was cached meanwhile */
+		buff->status = BUFF_ST_VALID;
+		brelse(major, device, buff);
+		return 0;
+	}
+
+	buff->release = 1;
+	if (driver->dev_ops->read_async_block(major, device, buff) < 0) {
+		buff->release = 0;
+		brelse(major, device, buff);
+		return -1;
+	}
+
+	return 1;
+}
+
+/**
+ * Keep the cache coherent with a direct (uncached) transfer of a block.
+ * If the block is cached, a read is served from the cached copy (which
+ * may be newer than the device, i.e. a delayed write), and a write
+ * updates the cached copy besides going to the device.
+ *
+ * \param major Major number of the device
+ * \param device Minor number (device number)
+ * \param blocknum Block number (address)
+ * \param data Data of the direct transfer (BUFF_SIZE bytes)
+ * \param write 1 for a write, 0 for a read
+ * \return int 1 if the block is cached (read is done), 0 otherwise.
+ */
+int bdirect_sync(int major, int device, uint64_t blocknum, char *data, int write)
+{
+	buff_header_t *buff;
+	dev_blk_driver_t *driver;
+
+	driver = block_dev_drivers[major]; 
+
+	if (search_blk(driver->buffer_queue, device, blocknum) == NULL) {
+		return 0;
+	}
+
+	if ((buff = getblk(major, device, blocknum)) == NULL) {
+		return 0;
+	}
+
+	if (buff->status != BUFF_ST_BUSY && !write) {
+		/* Buffer was recycled meanwhile (it is hashed again, so fill it) */
+		driver->dev_ops->read_sync_block(major, device, buff);
+	}
+
+	if (write) {
+		memcpy(buff->data, data, BUFF_SIZE);
+	} else {
+		memcpy(data, buff->data, BUFF_SIZE);
+	}
+	buff->status = BUFF_ST_VALID;
+	brelse(major, device, buff);
+
+	return 1;
+}
+
+/**
+ * Called by device drivers when the I/O of a buffer is done: buffer
+ * becomes valid (one process waiting for it is woken up), and buffers
+ * of asynchronous reads started by bprefetch() are released.
+ *
+ * \param major Major number of the device
+ * \param device Minor number (device number)
+ * \param buff The buffer.
+ */
+void biodone(int major, int device, buff_header_t *buff)
+{
+	buff->status = BUFF_ST_VALID;
+	wakeup(&buff->wait);
+	if (buff->release) {
+		buff->release = 0;
+		brelse(major, device, buff);
+	}
+}
+
 /**
  * Write block back to device.
  *
@@ -23,6 +23,267 @@
  */
 
 #include <fs/elf32.h>
+#include <tempos/kernel.h>
+#include <tempos/sched.h>
+#include <tempos/mmap.h>
+#include <sys/stat.h>
+#include <string.h>
 
-/** \todo: Implements ELF parser */
+
+static int elf32_check(elf32_image *img);
+
+static int elf32_prot(Elf32_Word flags);
+
+
+/**
+ * Check ELF header and program headers of an executable: only i386
+ * executables (or shared objects), whose loadable segments fit into
+ * process address space (below the stack) and can be mapped straight
+ * from file pages. Dynamically linked executables must name their
+ * interpreter.
+ *
+ * \param img Executable.
+ * \return 0 if executable is valid, -1 otherwise.
+ */
+static int elf32_check(elf32_image *img)
+{
+	Elf32_Ehdr *eh = &img->ehdr;
+	Elf32_Phdr *ph;
+	uint32_t start, end, last;
+	int i, interp, dynamic;
+
+	if (eh->e_ident[EI_MAG0] != ELFMAG0 || eh->e_ident[EI_MAG1] != ELFMAG1 ||
+		eh->e_ident[EI_MAG2] != ELFMAG2 || eh->e_ident[EI_MAG3] != ELFMAG3 ||
+		eh->e_ident[EI_CLASS] != ELFCLASS32 || eh->e_ident[EI_DATA] != ELFDATA2LSB ||
+		(eh->e_type != ET_EXEC && eh->e_type != ET_DYN) || eh->e_machine != EM_386 ||
+		eh->e_version != EV_CURRENT || eh->e_phentsize != sizeof(Elf32_Phdr) ||
+		eh->e_phnum == 0 || eh->e_phnum > ELF32_MAX_PHDRS) {
+		return -1;
+	}
+
+	/* Segments must be sorted by address and must not share pages */
+	last    = MMAP_AREA_START;
+	interp  = 0;
+	dynamic = 0;
+	for (i = 0; i < img->ehdr.e_phnum; i++) {
+		ph = &img->phdr[i];
+		if (ph->p_type == PT_INTERP) {
+			interp = 1;
+		} else if (ph->p_type == PT_DYNAMIC) {
+			dynamic = 1;
+		}
+		if (ph->p_type != PT_LOAD || ph->p_memsz == 0) {
+			continue;
+		}
+
+		if (ph->p_filesz > ph->p_memsz ||
+			((ph->p_vaddr - ph->p_offset) & ~PAGE_MASK) ||
+			ph->p_offset + ph->p_filesz < ph->p_offset ||
+			ph->p_offset + ph->p_filesz > img->inode->i_size) {
+			return -1;
+		}
+
+		start = (ph->p_vaddr + img->bias) & PAGE_MASK;
+		end   = ph->p_vaddr + img->bias + ph->p_memsz;
+		if (ph->p_vaddr + img->bias < ph->p_vaddr || end < ph->p_vaddr + img->bias ||
+			start < last || end > USER_STACK_TOP - USER_STACK_SIZE) {
+			return -1;
+		}
+		last = PAGE_ALIGN(end);
+	}
+
+	/* Relocations are done by the interpreter (see apps/ldso) */
+	if (dynamic && !interp && eh->e_type == ET_EXEC) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Convert segment permissions to memory protection.
+ *
+ * \param flags Segment flags (PF_*).
+ * \return int Protection (PROT_*).
+ */
+static int elf32_prot(Elf32_Word flags)
+{
+	int prot = PROT_NONE;
+
+	if ( (flags & PF_R) ) {
+		prot |= PROT_READ;
+	}
+	if ( (flags & PF_W) ) {
+		prot |= PROT_WRITE;
+	}
+	if ( (flags & PF_X) ) {
+		prot |= PROT_EXEC;
+	}
+	return prot;
+}
+
+/**
+ * Open an executable: ELF header and program headers are read and
+ * checked. Nothing is loaded yet.
+ *
+ * \param img Executable.
+ * \param inode Executable file.
+ * \param base Load address of position independent files (ET_DYN).
+ * \return 0 on success, -1 if file is not a valid executable.
+ */
+int elf32_open(elf32_image *img, vfs_inode *inode, uint32_t base)
+{
+	uint32_t size;
+
+	img->inode = inode;
+	img->phdr  = NULL;
+	img->bias  = 0;
+
+	if ((inode->i_mode & S_IFMT) != S_IFREG) {
+		return -1;
+	}
+
+	if (vfs_readi(inode, (char*)&img->ehdr, 0, sizeof(Elf32_Ehdr)) != sizeof(Elf32_Ehdr) ||
+		img->ehdr.e_phnum == 0 || img->ehdr.e_phnum > ELF32_MAX_PHDRS ||
+		img->ehdr.e_phentsize != sizeof(Elf32_Phdr)) {
+		return -1;
+	}
+	if (img->ehdr.e_type == ET_DYN) {
+		img->bias = base;
+	}
+
+	size = img->ehdr.e_phnum * sizeof(Elf32_Phdr);
+	if ((img->phdr = (Elf32_Phdr*)kmalloc(size, GFP_NORMAL_Z)) == NULL) {
+		return -1;
+	}
+	if (vfs_readi(inode, (char*)img->phdr, img->ehdr.e_phoff, size) != (int)size ||
+		elf32_check(img) < 0) {
+		elf32_close(img);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Get the program interpreter (dynamic linker) of an executable.
+ *
+ * \param img Executable.
+ * \param path Interpreter path name (returned).
+ * \param size Size of path buffer.
+ * \return 1 if executable has an interpreter, 0 if it is statically
+ *         linked, -1 on error.
+ */
+int elf32_interp(elf32_image *img, char *path, uint32_t size)
+{
+	Elf32_Phdr *ph;
+	int i;
+
+	for (i = 0; i < img->ehdr.e_phnum; i++) {
+		ph = &img->phdr[i];
+		if (ph->p_type != PT_INTERP) {
+			continue;
+		}
+		if (ph->p_filesz < 2 || ph->p_filesz > size ||
+			vfs_readi(img->inode, path, ph->p_offset, ph->p_filesz) != (int)ph->p_filesz ||
+			path[ph->p_filesz - 1] != '\0') {
+			return -1;
+		}
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Get the address of program headers into process memory (passed to
+ * the interpreter, so it can find the dynamic section).
+ *
+ * \param img Executable.
+ * \return uint32_t Address, or 0 if program headers are not loaded.
+ */
+uint32_t elf32_phdr_addr(elf32_image *img)
+{
+	Elf32_Phdr *ph;
+	int i;
+
+	for (i = 0; i < img->ehdr.e_phnum; i++) {
+		ph = &img->phdr[i];
+		if (ph->p_type == PT_PHDR) {
+			return ph->p_vaddr + img->bias;
+		}
+	}
+	for (i = 0; i < img->ehdr.e_phnum; i++) {
+		ph = &img->phdr[i];
+		if (ph->p_type == PT_LOAD && img->ehdr.e_phoff >= ph->p_offset &&
+			img->ehdr.e_phoff - ph->p_offset < ph->p_filesz) {
+			return ph->p_vaddr + img->bias + (img->ehdr.e_phoff - ph->p_offset);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Map the loadable segments of an executable into a process. No page
+ * is read here: they are read from page cache on the first access
+ * (see mmap_fault), so only touched pages are ever read from disk.
+ * Text pages are page cache pages shared (read only) by all processes
+ * running the executable, data pages are copied on the first write,
+ * and bss is zero filled.
+ *
+ * \param img Executable (see elf32_open).
+ * \param task Process.
+ * \param entry Entry point of program.
+ * \return 0 on success, -1 on error.
+ */
+int elf32_map(elf32_image *img, task_t *task, uint32_t *entry)
+{
+	Elf32_Phdr *ph;
+	uint32_t start, end, filesz;
+	int i;
+
+	for (i = 0; i < img->ehdr.e_phnum; i++) {
+		ph = &img->phdr[i];
+		if (ph->p_type != PT_LOAD || ph->p_memsz == 0) {
+			continue;
+		}
+
+		start  = (ph->p_vaddr + img->bias) & PAGE_MASK;
+		end    = PAGE_ALIGN(ph->p_vaddr + img->bias + ph->p_memsz);
+		filesz = (ph->p_filesz > 0 ? ph->p_vaddr + img->bias + ph->p_filesz - start : 0);
+
+		/*
+		 * Read only segment without bss (text): its last page is
+		 * mapped from file as it is, so all of its pages are shared
+		 * page cache pages (no private copy to clear the tail).
+		 */
+		if (!(ph->p_flags & PF_W) && ph->p_filesz == ph->p_memsz) {
+			filesz = end - start;
+		}
+
+		if (mmap_segment(task, start, end - start, elf32_prot(ph->p_flags),
+						 (filesz > 0 ? img->inode : NULL),
+						 (filesz > 0 ? ph->p_offset & PAGE_MASK : 0),
+						 filesz) == NULL) {
+			return -1;
+		}
+	}
+
+	*entry = img->ehdr.e_entry + img->bias;
+	return 0;
+}
+
+/**
+ * Release an executable opened with elf32_open.
+ *
+ * \param img Executable.
+ */
+void elf32_close(elf32_image *img)
+{
+	if (img->phdr != NULL) {
+		kfree(img->phdr);
+		img->phdr = NULL;
+	}
+}
 
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: blkstat.c
+ * Desc: Block devices I/O statistics
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/kernel.h>
+#include <tempos/delay.h>
+#include <fs/device.h>
+#include <fs/blkstat.h>
+#include <arch/io.h>
+#include <string.h>
+
+
+/**
+ * A request was added to the device queue.
+ *
+ * \param st Statistics of the device.
+ */
+void blkstat_queue(blk_iostat_t *st)
+{
+	if (st->in_queue++ == 0) {
+		st->busy_since = read_tsc();
+	}
+	if (st->in_queue > st->max_queue) {
+		st->max_queue = st->in_queue;
+	}
+}
+
+
+/**
+ * A request was merged with another one already queued.
+ *
+ * \param st Statistics of the device.
+ */
+void blkstat_merge(blk_iostat_t *st)
+{
+	st->merges++;
+}
+
+
+/**
+ * A request was completed by the device.
+ * \note Called from interrupt handlers.
+ *
+ * \param st Statistics of the device.
+ * \param write 1 for write requests, 0 for read requests.
+ * \param sectors Number of sectors transferred.
+ * \param cycles Request latency (since it was queued) in TSC cycles.
+ */
+void blkstat_complete(blk_iostat_t *st, char write, uint32_t sectors, uint32_t cycles)
+{
+	uint32_t usecs = tsc_to_usecs(cycles);
+
+	if (write) {
+		st->writes++;
+		st->write_sectors += sectors;
+		st->write_usecs   += usecs;
+		st->write_lat[blkstat_bucket(usecs)]++;
+	} else {
+		st->reads++;
+		st->read_sectors += sectors;
+		st->read_usecs   += usecs;
+		st->read_lat[blkstat_bucket(usecs)]++;
+	}
+
+	if (st->in_queue > 0 && --st->in_queue == 0) {
+		st->busy_usecs += tsc_to_usecs((uint32_t)(read_tsc() - st->busy_since));
+	}
+}
+
+
+/**
+ * Account a buffer cache lookup.
+ *
+ * \param st Statistics of the device.
+ * \param hit 1 if block was found valid in cache, 0 otherwise.
+ */
+void blkstat_cache(blk_iostat_t *st, char hit)
+{
+	if (hit) {
+		st->cache_hits++;
+	} else {
+		st->cache_misses++;
+	}
+}
+
+
+/**
+ * Return the histogram bucket of a latency.
+ *
+ * \param usecs Latency in microseconds.
+ * \return uint32_t Bucket: floor(log2(usecs)).
+ */
+uint32_t blkstat_bucket(uint32_t usecs)
+{
+	uint32_t bucket = 0;
+
+	while (usecs > 1 && bucket < (BLKSTAT_BUCKETS - 1)) {
+		usecs >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+
+/**
+ * Return the upper bound (in microseconds) of the histogram bucket
+ * where a percentile falls.
+ *
+ * \param hist Latency histogram (BLKSTAT_BUCKETS entries).
+ * \param pct Percentile (1 - 100).
+ * \return uint32_t Latency upper bound, 0 if histogram is empty.
+ */
+uint32_t blkstat_percentile(uint32_t *hist, uint32_t pct)
+{
+	uint32_t i, total, target, sum;
+
+	total = 0;
+	for (i = 0; i < BLKSTAT_BUCKETS; i++) {
+		total += hist[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+
+	target = ((total * pct) + 99) / 100;
+	sum    = 0;
+	for (i = 0; i < BLKSTAT_BUCKETS; i++) {
+		sum += hist[i];
+		if (sum >= target) {
+			break;
+		}
+	}
+
+	return (2 << i);
+}
+
+
+/**
+ * Get a copy of the statistics of a block device.
+ *
+ * \param major Major number of the device.
+ * \param st Where statistics will be copied to.
+ * \return int 0 on success, -1 if there is no such device.
+ */
+int blkstat_get(int major, blk_iostat_t *st)
+{
+	dev_blk_driver_t *driver;
+
+	if (major < 0 || major >= MAX_DEVBLOCK_DRIVERS || st == NULL) {
+		return -1;
+	}
+
+	driver = block_dev_drivers[major];
+	if (driver == NULL) {
+		return -1;
+	}
+
+	cli();
+	memcpy(st, &driver->stats, sizeof(blk_iostat_t));
+	sti();
+
+	return 0;
+}
+
+
+/**
+ * Show statistics of block devices on the console.
+ *
+ * \param major Major number of the device, or -1 for all devices.
+ */
+void blkstat_dump(int major)
+{
+	blk_iostat_t st;
+	int i;
+
+	for (i = 0; i < MAX_DEVBLOCK_DRIVERS; i++) {
+		if ((major >= 0 && i != major) || blkstat_get(i, &st) < 0) {
+			continue;
+		}
+
+		kprintf(KERN_INFO "blk %d: %d reads (%d sectors), %d writes (%d sectors), %d merges\n",
+				i, st.reads, st.read_sectors, st.writes, st.write_sectors, st.merges);
+		kprintf(KERN_INFO "  queue %d (max %d), busy %d us, cache %d hits / %d misses\n",
+				st.in_queue, st.max_queue, st.busy_usecs, st.cache_hits, st.cache_misses);
+		kprintf(KERN_INFO "  read:  p50 < %d us, p99 < %d us\n",
+				blkstat_percentile(st.read_lat, 50), blkstat_percentile(st.read_lat, 99));
+		kprintf(KERN_INFO "  write: p50 < %d us, p99 < %d us\n",
+				blkstat_percentile(st.write_lat, 50), blkstat_percentile(st.write_lat, 99));
+	}
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: dcache.c
+ * Desc: Implements the directory entry (name lookup) cache
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/kernel.h>
+#include <fs/vfs.h>
+#include <fs/dcache.h>
+#include <arch/io.h>
+#include <string.h>
+
+/** Directory entries */
+static vfs_dentry *dentries;
+
+/** Hash table */
+static vfs_dentry *dcache_htable[DCACHE_HASH_SIZE];
+
+/** LRU list head: head->lru_next is the least recently used entry */
+static vfs_dentry dcache_lru;
+
+/* Prototypes */
+static uint32_t dcache_hash(dev_t device, uint32_t parent, const char *name);
+
+static vfs_dentry *dcache_search(dev_t device, uint32_t parent, const char *name, uint32_t hash);
+
+static void dcache_unhash(vfs_dentry *dentry);
+
+static void dcache_lru_move(vfs_dentry *dentry, char tail);
+
+
+/**
+ * Initialize the directory entry cache.
+ */
+void dcache_init(void)
+{
+	int i;
+
+	dentries = (vfs_dentry*)kmalloc(sizeof(vfs_dentry) * DCACHE_SIZE, GFP_NORMAL_Z);
+	if (dentries == NULL) {
+		panic("Could not allocate memory for directory entry cache.");
+	}
+
+	memset(dentries, 0, sizeof(vfs_dentry) * DCACHE_SIZE);
+	for (i = 0; i < DCACHE_HASH_SIZE; i++) {
+		dcache_htable[i] = NULL;
+	}
+
+	/* All entries start unused on LRU list */
+	dcache_lru.lru_next = &dcache_lru;
+	dcache_lru.lru_prev = &dcache_lru;
+	for (i = 0; i < DCACHE_SIZE; i++) {
+		dcache_lru_move(&dentries[i], 1);
+	}
+}
+
+/**
+ * Hash function (FNV-1a) for a directory entry.
+ *
+ * \param device Device.
+ * \param parent Directory i-node number.
+ * \param name Entry name.
+ * \return uint32_t Hash value.
+ */
+static uint32_t dcache_hash(dev_t device, uint32_t parent, const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	hash = (hash ^ parent) * 16777619U;
+	hash = (hash ^ ((device.major << 16) | device.minor)) * 16777619U;
+	while (*name != '\0') {
+		hash = (hash ^ (uchar8_t)*name++) * 16777619U;
+	}
+
+	return hash;
+}
+
+/**
+ * Search for an entry on hash table.
+ *
+ * \return vfs_dentry The entry (if was found), NULL otherwise.
+ */
+static vfs_dentry *dcache_search(dev_t device, uint32_t parent, const char *name, uint32_t hash)
+{
+	vfs_dentry *tmp;
+
+	for (tmp = dcache_htable[hash % DCACHE_HASH_SIZE]; tmp != NULL; tmp = tmp->next) {
+		if (tmp->hash == hash && tmp->parent == parent &&
+				DEV_CMP(tmp->device, device) && strcmp(tmp->name, name) == 0) {
+			break;
+		}
+	}
+
+	return tmp;
+}
+
+/**
+ * Remove an entry from hash table.
+ *
+ * \param dentry The entry.
+ */
+static void dcache_unhash(vfs_dentry *dentry)
+{
+	uint32_t pos;
+
+	if (dentry->prev == NULL) {
+		/* not hashed */
+		return;
+	}
+
+	pos = dentry->hash % DCACHE_HASH_SIZE;
+	if (dentry->prev == dentry) {
+		/* first of the queue */
+		dcache_htable[pos] = dentry->next;
+		if (dentry->next != NULL) {
+			dentry->next->prev = dentry->next;
+		}
+	} else {
+		dentry->prev->next = dentry->next;
+		if (dentry->next != NULL) {
+			dentry->next->prev = dentry->prev;
+		}
+	}
+
+	dentry->prev = NULL;
+	dentry->next = NULL;
+}
+
+/**
+ * Move an entry to the tail (most recently used) or to the
+ * head (next to be reused) of LRU list.
+ *
+ * \param dentry The entry.
+ * \param tail 1 to move to the tail, 0 to the head.
+ */
+static void dcache_lru_move(vfs_dentry *dentry, char tail)
+{
+	vfs_dentry *prev, *next;
+
+	/* Remove from list */
+	if (dentry->lru_next != NULL) {
+		dentry->lru_prev->lru_next = dentry->lru_next;
+		dentry->lru_next->lru_prev = dentry->lru_prev;
+	}
+
+	if (tail) {
+		prev = dcache_lru.lru_prev;
+		next = &dcache_lru;
+	} else {
+		prev = &dcache_lru;
+		next = dcache_lru.lru_next;
+	}
+
+	dentry->lru_prev = prev;
+	dentry->lru_next = next;
+	prev->lru_next   = dentry;
+	next->lru_prev   = dentry;
+}
+
+/**
+ * Look up a name on a directory.
+ *
+ * \param dir Directory i-node.
+ * \param name Entry name.
+ * \param ino Where the i-node number will be stored on DCACHE_HIT.
+ * \return DCACHE_HIT, DCACHE_NEGATIVE or DCACHE_MISS.
+ */
+int dcache_lookup(vfs_inode *dir, const char *name, uint32_t *ino)
+{
+	vfs_dentry *dentry;
+	int ret;
+
+	if (strlen(name) >= DCACHE_NAME_LEN) {
+		return DCACHE_MISS;
+	}
+
+	cli();
+	dentry = dcache_search(dir->device, dir->number, name,
+					dcache_hash(dir->device, dir->number, name));
+	if (dentry == NULL) {
+		ret = DCACHE_MISS;
+	} else {
+		dcache_lru_move(dentry, 1);
+		if (dentry->inode == 0) {
+			ret = DCACHE_NEGATIVE;
+		} else {
+			*ino = dentry->inode;
+			ret  = DCACHE_HIT;
+		}
+	}
+	sti();
+
+	return ret;
+}
+
+/**
+ * Add an entry to the cache, reusing the least recently used one.
+ *
+ * \param dir Directory i-node.
+ * \param name Entry name.
+ * \param ino i-node number of the entry, or 0 to add a negative entry.
+ */
+void dcache_add(vfs_inode *dir, const char *name, uint32_t ino)
+{
+	vfs_dentry *dentry, *head;
+	uint32_t hash, pos;
+
+	if (strlen(name) >= DCACHE_NAME_LEN) {
+		return;
+	}
+
+	hash = dcache_hash(dir->device, dir->number, name);
+
+	cli();
+	if ((dentry = dcache_search(dir->device, dir->number, name, hash)) == NULL) {
+		/* Reuse least recently used entry */
+		dentry = dcache_lru.lru_next;
+		dcache_unhash(dentry);
+
+		dentry->device = dir->device;
+		dentry->parent = dir->number;
+		dentry->hash   = hash;
+		strcpy(dentry->name, name);
+
+		/* Add to hash queue */
+		pos  = hash % DCACHE_HASH_SIZE;
+		head = dcache_htable[pos];
+		dentry->prev = dentry;
+		dentry->next = head;
+		if (head != NULL) {
+			head->prev = dentry;
+		}
+		dcache_htable[pos] = dentry;
+	}
+
+	dentry->inode = ino;
+	dcache_lru_move(dentry, 1);
+	sti();
+}
+
+/**
+ * Remove an entry from cache (if present).
+ * \note Should be called when a directory entry is created, removed or renamed.
+ *
+ * \param dir Directory i-node.
+ * \param name Entry name.
+ */
+void dcache_invalidate(vfs_inode *dir, const char *name)
+{
+	vfs_dentry *dentry;
+
+	if (strlen(name) >= DCACHE_NAME_LEN) {
+		return;
+	}
+
+	cli();
+	dentry = dcache_search(dir->device, dir->number, name,
+					dcache_hash(dir->device, dir->number, name));
+	if (dentry != NULL) {
+		dcache_unhash(dentry);
+		dcache_lru_move(dentry, 0);
+	}
+	sti();
+}
+
+/**
+ * Remove all entries of a device from cache.
+ * \note Should be called when a super block of device is (re)read.
+ *
+ * \param device Device.
+ */
+void dcache_purge_dev(dev_t device)
+{
+	int i;
+
+	cli();
+	for (i = 0; i < DCACHE_SIZE; i++) {
+		if (dentries[i].prev != NULL && DEV_CMP(dentries[i].device, device)) {
+			dcache_unhash(&dentries[i]);
+			dcache_lru_move(&dentries[i], 0);
+		}
+	}
+	sti();
+}
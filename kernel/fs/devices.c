@@ -25,6 +25,7 @@
 #include <tempos/kernel.h>
 #include <fs/vfs.h>
 #include <fs/device.h>
+#include <string.h>
 
 /** Table of device drivers for character devices */
 dev_char_driver_t *char_dev_drivers[MAX_DEVCHAR_DRIVERS];
@@ -78,6 +79,9 @@ int register_block_driver(dev_blk_driver_t *driver)
 		return -1;
 	}
 	
+	/* Reset I/O statistics */
+	memset(&driver->stats, 0, sizeof(blk_iostat_t));
+
 	/* Initialize i-nodes hash queue for this device */
 	for (i = 0; i < MAX_MINOR_DEVICES; i++) {
 		driver->inodes_hash_table[i] = NULL;
@@ -0,0 +1,704 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: balloc.c
+ * Desc: Block and i-node allocation for EXT2 file system
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/kernel.h>
+#include <tempos/wait.h>
+#include <fs/vfs.h>
+#include <fs/ext2/ext2.h>
+#include <fs/bhash.h>
+#include <arch/io.h>
+#include <string.h>
+
+/** Bit not found */
+#define NO_BIT 0xFFFFFFFF
+
+/** Test, set and clear a bit of a bitmap */
+#define BIT_TEST(map, n)  ((map)[(n) >> 5] & (1UL << ((n) & 31)))
+#define BIT_SET(map, n)   ((map)[(n) >> 5] |= (1UL << ((n) & 31)))
+#define BIT_CLEAR(map, n) ((map)[(n) >> 5] &= ~(1UL << ((n) & 31)))
+
+/** Blocks preallocated for regular files */
+static uint32_t ext2_prealloc_blocks = EXT2_DEFAULT_PREALLOC;
+
+
+/* Prototypes */
+static void alloc_lock(ext2_fsdriver_t *fs);
+
+static void alloc_unlock(ext2_fsdriver_t *fs);
+
+static void free_blocks(vfs_superblock *sb, uint32_t block, uint32_t count);
+
+static void sync_free_blocks(vfs_superblock *sb);
+
+static uint32_t find_next_zero_bit(uint32_t *map, uint32_t size, uint32_t start);
+
+static uint32_t find_next_zero_byte(uint32_t *map, uint32_t size, uint32_t start);
+
+static uint32_t *load_bitmap(vfs_superblock *sb, uint32_t group, char inode_map);
+
+static void write_bitmap(vfs_superblock *sb, uint32_t group, char inode_map,
+						 uint32_t first, uint32_t last);
+
+static void write_group_desc(vfs_superblock *sb, uint32_t group);
+
+static uint32_t group_blocks(ext2_fsdriver_t *fs, uint32_t group);
+
+static uint32_t alloc_in_group(vfs_superblock *sb, uint32_t group, uint32_t goal,
+							   uint32_t want, uint32_t *got);
+
+static uint32_t new_blocks(vfs_superblock *sb, uint32_t goal, uint32_t want, uint32_t *got);
+
+static uint32_t find_inode_group(ext2_fsdriver_t *fs, uint32_t parent, uint16_t mode);
+
+
+/**
+ * Update free blocks count of VFS super block, which doesn't include
+ * blocks reserved by delayed allocation.
+ *
+ * \param sb Super block.
+ */
+static void sync_free_blocks(vfs_superblock *sb)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	uint32_t nfree;
+
+	cli();
+	nfree = fs->sb->s_free_blocks_count;
+	sb->s_free_blocks_count = (nfree > sb->s_reserved_blocks ?
+							   nfree - sb->s_reserved_blocks : 0);
+	sti();
+}
+
+/**
+ * Lock allocator. Bitmap cache is shared by all i-nodes of the file
+ * system and reading a bitmap may sleep.
+ *
+ * \param fs EXT2 driver information.
+ */
+static void alloc_lock(ext2_fsdriver_t *fs)
+{
+	cli();
+	while (fs->alloc_locked) {
+		sleep_on_exclusive(&fs->alloc_wait);
+		cli();
+	}
+	fs->alloc_locked = 1;
+	sti();
+}
+
+/**
+ * Unlock allocator.
+ *
+ * \param fs EXT2 driver information.
+ */
+static void alloc_unlock(ext2_fsdriver_t *fs)
+{
+	cli();
+	fs->alloc_locked = 0;
+	sti();
+	wakeup(&fs->alloc_wait);
+}
+
+/**
+ * Set size of preallocation window used for regular files.
+ *
+ * \param blocks Number of blocks (0 disables preallocation).
+ */
+void ext2_set_prealloc(int blocks)
+{
+	ext2_prealloc_blocks = (blocks > 0 ? blocks : 0);
+}
+
+/**
+ * Find next zero bit of a bitmap, testing a whole word at a time.
+ *
+ * \param map Bitmap.
+ * \param size Number of bits of the bitmap.
+ * \param start First bit to test.
+ * \return uint32_t Bit number, or size if there is no zero bit.
+ */
+static uint32_t find_next_zero_bit(uint32_t *map, uint32_t size, uint32_t start)
+{
+	uint32_t i, w;
+
+	if (start >= size) {
+		return size;
+	}
+
+	/* Bits below start (at first word) are taken as used */
+	i = start & ~31;
+	w = map[i >> 5] | ((1UL << (start & 31)) - 1);
+	while (1) {
+		if (w != 0xFFFFFFFF) {
+			i += __builtin_ctz(~w);
+			return (i < size ? i : size);
+		}
+
+		i += 32;
+		if (i >= size) {
+			return size;
+		}
+		w = map[i >> 5];
+	}
+}
+
+/**
+ * Find next zero byte (eight free bits) of a bitmap.
+ *
+ * \param map Bitmap.
+ * \param size Number of bits of the bitmap.
+ * \param start First bit to test (rounded up to byte boundary).
+ * \return uint32_t First bit of the byte, or size if there is no zero byte.
+ */
+static uint32_t find_next_zero_byte(uint32_t *map, uint32_t size, uint32_t start)
+{
+	uchar8_t *bmap = (uchar8_t*)map;
+	uint32_t i;
+
+	for (i = (start + 7) >> 3; ((i << 3) + 8) <= size; i++) {
+		if (bmap[i] == 0) {
+			return (i << 3);
+		}
+	}
+
+	return size;
+}
+
+/**
+ * Get block (or i-node) bitmap of a group. Only the last used bitmap
+ * of each type is kept in memory.
+ *
+ * \param sb Super block.
+ * \param group Group number.
+ * \param inode_map 1 for i-node bitmap, 0 for block bitmap.
+ * \return uint32_t* The bitmap, NULL on error.
+ */
+static uint32_t *load_bitmap(vfs_superblock *sb, uint32_t group, char inode_map)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	uint32_t **cache, *cgroup, blk;
+
+	if (inode_map) {
+		cache  = &fs->ibitmap;
+		cgroup = &fs->ibitmap_group;
+		blk    = fs->gdesc[group].bg_inode_bitmap;
+	} else {
+		cache  = &fs->bbitmap;
+		cgroup = &fs->bbitmap_group;
+		blk    = fs->gdesc[group].bg_block_bitmap;
+	}
+
+	if (*cache != NULL) {
+		if (*cgroup == group) {
+			return *cache;
+		}
+		kfree(*cache);
+	}
+
+	*cache  = (uint32_t*)ext2_get_fs_block(sb, blk);
+	*cgroup = (*cache != NULL ? group : EXT2_NO_GROUP);
+
+	return *cache;
+}
+
+/**
+ * Write back the bytes of a bitmap that hold a range of bits.
+ *
+ * \param sb Super block.
+ * \param group Group number.
+ * \param inode_map 1 for i-node bitmap, 0 for block bitmap.
+ * \param first First bit changed.
+ * \param last Last bit changed.
+ */
+static void write_bitmap(vfs_superblock *sb, uint32_t group, char inode_map,
+						 uint32_t first, uint32_t last)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+
+	if (inode_map) {
+		ext2_write_sectors(sb, fs->gdesc[group].bg_inode_bitmap, (char*)fs->ibitmap,
+						   first >> 3, (last >> 3) - (first >> 3) + 1);
+	} else {
+		ext2_write_sectors(sb, fs->gdesc[group].bg_block_bitmap, (char*)fs->bbitmap,
+						   first >> 3, (last >> 3) - (first >> 3) + 1);
+	}
+}
+
+/**
+ * Write back a group descriptor.
+ *
+ * \param sb Super block.
+ * \param group Group number.
+ */
+static void write_group_desc(vfs_superblock *sb, uint32_t group)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	uint32_t blk_bytes, off;
+
+	blk_bytes = fs->block_size * SECTOR_SIZE;
+	off       = group * sizeof(ext2_group_t);
+
+	/* Group descriptors table starts right after super block */
+	ext2_write_sectors(sb, fs->sb->s_first_data_block + 1 + (off / blk_bytes),
+					   &((char*)fs->gdesc)[off - (off % blk_bytes)],
+					   off % blk_bytes, sizeof(ext2_group_t));
+}
+
+/**
+ * Number of blocks of a group (last group can be smaller).
+ */
+static uint32_t group_blocks(ext2_fsdriver_t *fs, uint32_t group)
+{
+	ext2_superblock_t *sb = fs->sb;
+
+	if (group == fs->n_groups - 1) {
+		return sb->s_blocks_count - sb->s_first_data_block -
+				(group * sb->s_blocks_per_group);
+	}
+	return sb->s_blocks_per_group;
+}
+
+/**
+ * Allocate blocks into a group.
+ *
+ * The goal block is used if it is free, otherwise a free block near it
+ * (same 64 blocks window), then a free byte of the bitmap (so there is
+ * room to grow contiguously) and then any free block.
+ *
+ * \param sb Super block.
+ * \param group Group number.
+ * \param goal Goal block (relative to group).
+ * \param want Number of contiguous blocks wanted.
+ * \param got Number of blocks allocated.
+ * \return uint32_t First block allocated (relative to group), NO_BIT on error.
+ */
+static uint32_t alloc_in_group(vfs_superblock *sb, uint32_t group, uint32_t goal,
+							   uint32_t want, uint32_t *got)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	uint32_t *map, nbits, bit, limit, n;
+
+	*got = 0;
+	if (fs->gdesc[group].bg_free_blocks_count == 0) {
+		return NO_BIT;
+	}
+
+	if ((map = load_bitmap(sb, group, 0)) == NULL) {
+		return NO_BIT;
+	}
+
+	nbits = group_blocks(fs, group);
+	if (goal >= nbits) {
+		goal = 0;
+	}
+
+	/* Goal or near it */
+	limit = (goal + 64) & ~63;
+	if (limit > nbits) {
+		limit = nbits;
+	}
+	bit = find_next_zero_bit(map, limit, goal);
+
+	if (bit >= limit) {
+		bit = find_next_zero_byte(map, nbits, goal);
+		if (bit >= nbits) {
+			bit = find_next_zero_bit(map, nbits, goal);
+			if (bit >= nbits) {
+				bit = find_next_zero_bit(map, nbits, 0);
+			}
+			if (bit >= nbits) {
+				return NO_BIT;
+			}
+		}
+	}
+
+	/* Claim contiguous free blocks */
+	for (n = 0; n < want && (bit + n) < nbits; n++) {
+		if (BIT_TEST(map, bit + n)) {
+			break;
+		}
+		BIT_SET(map, bit + n);
+	}
+	write_bitmap(sb, group, 0, bit, bit + n - 1);
+
+	fs->gdesc[group].bg_free_blocks_count -= n;
+	write_group_desc(sb, group);
+	fs->sb->s_free_blocks_count -= n;
+	fs->sb_dirty = 1;
+	sync_free_blocks(sb);
+
+	*got = n;
+	return bit;
+}
+
+/**
+ * Allocate contiguous blocks starting the search at goal's group.
+ *
+ * \param sb Super block.
+ * \param goal Goal block.
+ * \param want Number of contiguous blocks wanted.
+ * \param got Number of blocks allocated.
+ * \return uint32_t First block allocated, 0 if file system is full.
+ */
+static uint32_t new_blocks(vfs_superblock *sb, uint32_t goal, uint32_t want, uint32_t *got)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	ext2_superblock_t *esb = fs->sb;
+	uint32_t group, gbit, bit, g, i;
+
+	if (goal < esb->s_first_data_block || goal >= esb->s_blocks_count) {
+		goal = esb->s_first_data_block;
+	}
+
+	group = (goal - esb->s_first_data_block) / esb->s_blocks_per_group;
+	gbit  = (goal - esb->s_first_data_block) - (group * esb->s_blocks_per_group);
+
+	for (i = 0; i < fs->n_groups; i++) {
+		g = group + i;
+		if (g >= fs->n_groups) {
+			g -= fs->n_groups;
+		}
+
+		bit = alloc_in_group(sb, g, (i == 0 ? gbit : 0), want, got);
+		if (bit != NO_BIT) {
+			return esb->s_first_data_block + (g * esb->s_blocks_per_group) + bit;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Allocate a block for an i-node.
+ *
+ * Sequential allocations are served from i-node preallocation window,
+ * so files growing at same time (each one with its own window) remain
+ * contiguous.
+ *
+ * \param inode i-node.
+ * \param goal Goal block (usually next to previous block of the file).
+ * \param count Number of blocks caller is going to allocate (delayed
+ *              allocation writes whole runs), the rest are preallocated.
+ * \return uint32_t Block number, 0 if file system is full.
+ */
+uint32_t ext2_new_block(vfs_inode *inode, uint32_t goal, uint32_t count)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)inode->sb->fs_driver;
+	uint32_t block, got, want;
+
+	if (inode->i_prealloc_count > 0) {
+		if (inode->i_prealloc_block == goal) {
+			inode->i_prealloc_block++;
+			inode->i_prealloc_count--;
+			return goal;
+		}
+		ext2_discard_prealloc(inode);
+	}
+
+	alloc_lock(fs);
+
+	want = (count > 0 ? count : 1);
+	if ((inode->i_mode & S_IFMT) == S_IFREG) {
+		want += ext2_prealloc_blocks;
+	}
+
+	block = new_blocks(inode->sb, goal, want, &got);
+	if (block != 0 && got > 1) {
+		inode->i_prealloc_block = block + 1;
+		inode->i_prealloc_count = got - 1;
+	}
+	alloc_unlock(fs);
+
+	return block;
+}
+
+/**
+ * Release unused blocks of i-node preallocation window.
+ *
+ * \param inode i-node.
+ */
+void ext2_discard_prealloc(vfs_inode *inode)
+{
+	if (inode->i_prealloc_count > 0) {
+		ext2_free_blocks(inode->sb, inode->i_prealloc_block, inode->i_prealloc_count);
+		inode->i_prealloc_count = 0;
+	}
+}
+
+/**
+ * Free contiguous blocks.
+ *
+ * \param sb Super block.
+ * \param block First block.
+ * \param count Number of blocks.
+ */
+void ext2_free_blocks(vfs_superblock *sb, uint32_t block, uint32_t count)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+
+	alloc_lock(fs);
+	free_blocks(sb, block, count);
+	alloc_unlock(fs);
+}
+
+/**
+ * Free contiguous blocks (allocator must be locked).
+ *
+ * \param sb Super block.
+ * \param block First block.
+ * \param count Number of blocks.
+ */
+static void free_blocks(vfs_superblock *sb, uint32_t block, uint32_t count)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	ext2_superblock_t *esb = fs->sb;
+	uint32_t *map, group, bit, nbits, n;
+
+	while (count > 0) {
+		if (block < esb->s_first_data_block || block >= esb->s_blocks_count) {
+			kprintf(KERN_ERROR "ext2: freeing block %d out of range.\n", block);
+			return;
+		}
+
+		group = (block - esb->s_first_data_block) / esb->s_blocks_per_group;
+		bit   = (block - esb->s_first_data_block) - (group * esb->s_blocks_per_group);
+		nbits = group_blocks(fs, group);
+
+		if ((map = load_bitmap(sb, group, 0)) == NULL) {
+			return;
+		}
+
+		for (n = 0; n < count && (bit + n) < nbits; n++) {
+			BIT_CLEAR(map, bit + n);
+		}
+		write_bitmap(sb, group, 0, bit, bit + n - 1);
+
+		fs->gdesc[group].bg_free_blocks_count += n;
+		write_group_desc(sb, group);
+		esb->s_free_blocks_count += n;
+		fs->sb_dirty = 1;
+		sync_free_blocks(sb);
+
+		block += n;
+		count -= n;
+	}
+}
+
+/**
+ * Choose a group for a new i-node.
+ *
+ * Directories are spread over groups with above average free i-nodes
+ * (the one with more free blocks wins), so their files have room.
+ * Files stay at parent's group, or go to a group found by quadratic
+ * hash (like Linux ext2), and at last by linear search.
+ *
+ * \param fs EXT2 driver information.
+ * \param parent Parent directory i-node number.
+ * \param mode File mode.
+ * \return uint32_t Group number, EXT2_NO_GROUP if there is no free i-node.
+ */
+static uint32_t find_inode_group(ext2_fsdriver_t *fs, uint32_t parent, uint16_t mode)
+{
+	ext2_group_t *gd;
+	uint32_t pgroup, avg, best, g, i;
+
+	pgroup = (parent - 1) / fs->sb->s_inodes_per_group;
+	if (pgroup >= fs->n_groups) {
+		pgroup = 0;
+	}
+
+	if ((mode & S_IFMT) == S_IFDIR) {
+		avg  = fs->sb->s_free_inodes_count / fs->n_groups;
+		best = EXT2_NO_GROUP;
+		for (i = 0, g = pgroup; i < fs->n_groups; i++, g++) {
+			if (g >= fs->n_groups) {
+				g = 0;
+			}
+
+			gd = &fs->gdesc[g];
+			if (gd->bg_free_inodes_count == 0 || gd->bg_free_inodes_count < avg) {
+				continue;
+			}
+			if (best == EXT2_NO_GROUP ||
+				gd->bg_free_blocks_count > fs->gdesc[best].bg_free_blocks_count) {
+				best = g;
+			}
+		}
+		if (best != EXT2_NO_GROUP) {
+			return best;
+		}
+	} else {
+		gd = &fs->gdesc[pgroup];
+		if (gd->bg_free_inodes_count > 0 && gd->bg_free_blocks_count > 0) {
+			return pgroup;
+		}
+
+		g = pgroup;
+		for (i = 1; i < fs->n_groups; i <<= 1) {
+			g += i;
+			if (g >= fs->n_groups) {
+				g -= fs->n_groups;
+			}
+
+			gd = &fs->gdesc[g];
+			if (gd->bg_free_inodes_count > 0 && gd->bg_free_blocks_count > 0) {
+				return g;
+			}
+		}
+	}
+
+	for (i = 0, g = pgroup; i < fs->n_groups; i++, g++) {
+		if (g >= fs->n_groups) {
+			g = 0;
+		}
+		if (fs->gdesc[g].bg_free_inodes_count > 0) {
+			return g;
+		}
+	}
+
+	return EXT2_NO_GROUP;
+}
+
+/**
+ * Allocate a new i-node (on disk).
+ *
+ * \param sb Super block.
+ * \param parent Parent directory i-node number.
+ * \param mode File mode.
+ * \return uint32_t i-node number, 0 if there is no free i-node.
+ */
+uint32_t ext2_new_inode(vfs_superblock *sb, uint32_t parent, uint16_t mode)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	ext2_superblock_t *esb = fs->sb;
+	uint32_t *map, group, start, bit;
+
+	if (parent == 0) {
+		parent = EXT2_ROOT_INO;
+	}
+
+	alloc_lock(fs);
+	if ((group = find_inode_group(fs, parent, mode)) == EXT2_NO_GROUP ||
+		(map = load_bitmap(sb, group, 1)) == NULL) {
+		alloc_unlock(fs);
+		return 0;
+	}
+
+	/* Skip reserved i-nodes */
+	start = 0;
+	if (group == 0) {
+		start = (esb->s_rev_level > 0 ? esb->s_first_ino : EXT2_FIRST_INO) - 1;
+	}
+
+	bit = find_next_zero_bit(map, esb->s_inodes_per_group, start);
+	if (bit >= esb->s_inodes_per_group) {
+		kprintf(KERN_ERROR "ext2: group %d has no free i-node.\n", group);
+		alloc_unlock(fs);
+		return 0;
+	}
+
+	BIT_SET(map, bit);
+	write_bitmap(sb, group, 1, bit, bit);
+
+	fs->gdesc[group].bg_free_inodes_count--;
+	if ((mode & S_IFMT) == S_IFDIR) {
+		fs->gdesc[group].bg_used_dirs_count++;
+	}
+	write_group_desc(sb, group);
+	esb->s_free_inodes_count--;
+	fs->sb_dirty = 1;
+	alloc_unlock(fs);
+
+	return (group * esb->s_inodes_per_group) + bit + 1;
+}
+
+/**
+ * Release an i-node (on disk).
+ *
+ * \param sb Super block.
+ * \param ino i-node number.
+ * \param mode File mode.
+ */
+void ext2_release_inode(vfs_superblock *sb, uint32_t ino, uint16_t mode)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	ext2_superblock_t *esb = fs->sb;
+	uint32_t *map, group, bit;
+
+	if (ino < EXT2_FIRST_INO || ino > esb->s_inodes_count) {
+		return;
+	}
+
+	group = (ino - 1) / esb->s_inodes_per_group;
+	bit   = (ino - 1) - (group * esb->s_inodes_per_group);
+
+	alloc_lock(fs);
+	if ((map = load_bitmap(sb, group, 1)) == NULL) {
+		alloc_unlock(fs);
+		return;
+	}
+
+	BIT_CLEAR(map, bit);
+	write_bitmap(sb, group, 1, bit, bit);
+
+	fs->gdesc[group].bg_free_inodes_count++;
+	if ((mode & S_IFMT) == S_IFDIR) {
+		fs->gdesc[group].bg_used_dirs_count--;
+	}
+	write_group_desc(sb, group);
+	esb->s_free_inodes_count++;
+	fs->sb_dirty = 1;
+	alloc_unlock(fs);
+}
+
+/**
+ * Write super block back to device.
+ *
+ * \param sb Super block.
+ * \return 1 on success, 0 otherwise.
+ */
+int ext2_write_super(vfs_superblock *sb)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	buff_header_t *buff;
+	int i, ret = 1;
+
+	for (i = 0; i < 2; i++) {
+		buff = getblk(sb->device.major, sb->device.minor, EXT2_SUPERBLOCK_SECTOR + i);
+		if (buff == NULL) {
+			return 0;
+		}
+		memcpy(buff->data, &((char*)fs->sb)[i * SECTOR_SIZE], SECTOR_SIZE);
+		if (bwrite(sb->device.major, sb->device.minor, buff, BWRITE_SYNC) < 0) {
+			ret = 0;
+		}
+		brelse(sb->device.major, sb->device.minor, buff);
+	}
+
+	fs->sb_dirty = 0;
+	sync_free_blocks(sb);
+	sb->s_free_inodes_count = fs->sb->s_free_inodes_count;
+
+	return ret;
+}
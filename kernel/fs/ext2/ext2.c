@@ -25,30 +25,9 @@
 #include <fs/vfs.h>
 #include <fs/ext2/ext2.h>
 #include <fs/bhash.h>
+#include <tempos/timer.h>
 #include <string.h>
 
-#define SECTOR_SIZE 512
-
-/** 
- * This structure is used only by EXT2 driver to keep information about the
- * file system into the VFS structure.
- */
-struct _ext2_fs_driver {
-	/** ext2 superblock */
-	struct _ext2_superblock_st *sb;
-	/** group descriptor */
-	struct _ext2_group_descriptor_st *gdesc;
-	/** number of groups */
-	uint32_t n_groups;
-	/** size of blocks bitmap */
-	uint32_t blks_bmap_size;
-	/** size of i-node bitmap */
-	uint32_t inodes_bmap_size;
-	/** block size in sector units */
-	uint32_t block_size;
-};
-typedef struct _ext2_fs_driver ext2_fsdriver_t;
-
 
 /** ext2 fs type */
 vfs_fs_type ext2_fs_type;
@@ -64,8 +43,56 @@ int ext2_get_sb(dev_t device, vfs_superblock *sb);
 
 int ext2_get_inode(vfs_inode *inode);
 
-char *ext2_get_fs_block(vfs_superblock *sb, uint32_t blocknum);
+int ext2_write_inode(vfs_inode *inode);
+
+int ext2_write_inodes(vfs_superblock *sb, vfs_inode **inodes, uint32_t count);
+
+int ext2_put_inode(vfs_inode *inode);
+
+int ext2_alloc_inode(vfs_superblock *sb, vfs_inode *inode);
+
+int ext2_free_inode(vfs_superblock *sb, vfs_inode *inode);
+
+int ext2_put_fs_block(vfs_superblock *sb, uint32_t blocknum, char *data);
+
+uint32_t ext2_bmap(vfs_inode *inode, uint32_t lblk, int create);
+
+int ext2_link(vfs_inode *dir, const char *name, vfs_inode *inode);
+
+int ext2_unlink(vfs_inode *dir, const char *name);
+
+static void ext2_inode_addr(ext2_fsdriver_t *fs, uint32_t number,
+							uint64_t *sector, uint32_t *offset);
+
+static int ext2_update_inode(vfs_inode *inode, uint32_t dtime);
+
+static void ext2_fill_inode(ext2_inode_t *raw, vfs_inode *inode, uint32_t dtime);
+
+static uint32_t ext2_block_goal(vfs_inode *inode, uint32_t lblk);
+
+static uint32_t ext2_alloc_fs_block(vfs_inode *inode, uint32_t goal, int zero, uint32_t count);
+
+static void ext2_free_run(vfs_superblock *sb, uint32_t *run, uint32_t block);
+
+static void ext2_free_branch(vfs_inode *inode, uint32_t block, int level, uint32_t *run);
 
+int ext2_lookup(vfs_inode *dir, const char *name, uint32_t *ino);
+
+static char *ext2_dir_block(vfs_inode *dir, uint32_t lblk);
+
+static uint32_t ext2_search_dirblock(char *block, uint32_t blk_size,
+									 const char *name, size_t len);
+
+static int ext2_dirhash(const char *name, int len, int version,
+						uint32_t *seed, uint32_t *hash);
+
+static int ext2_dx_lookup(vfs_inode *dir, const char *name, uint32_t *ino);
+
+/** Use directory indexes on lookups */
+static int ext2_htree_enabled = 1;
+
+/** Read ahead i-node table blocks when a directory is read */
+static int ext2_inode_ra_enabled = 1;
 
 /**
  * This function registers EXT2 file system in VFS.
@@ -78,6 +105,20 @@ void register_ext2(void)
 
 	ext2_sb_ops.get_inode      = ext2_get_inode;
 	ext2_sb_ops.get_fs_block   = ext2_get_fs_block;
+	ext2_sb_ops.read_fs_block  = ext2_read_fs_block;
+	ext2_sb_ops.prefetch_fs_block = ext2_prefetch_fs_block;
+	ext2_sb_ops.lookup         = ext2_lookup;
+	ext2_sb_ops.prefetch_inodes = ext2_prefetch_inodes;
+	ext2_sb_ops.write_inode    = ext2_write_inode;
+	ext2_sb_ops.write_inodes   = ext2_write_inodes;
+	ext2_sb_ops.put_inode      = ext2_put_inode;
+	ext2_sb_ops.alloc_inode    = ext2_alloc_inode;
+	ext2_sb_ops.free_inode     = ext2_free_inode;
+	ext2_sb_ops.write_super    = ext2_write_super;
+	ext2_sb_ops.put_fs_block   = ext2_put_fs_block;
+	ext2_sb_ops.bmap           = ext2_bmap;
+	ext2_sb_ops.link           = ext2_link;
+	ext2_sb_ops.unlink         = ext2_unlink;
 
 	register_fs_type(&ext2_fs_type);
 }
@@ -119,12 +160,12 @@ int ext2_get_sb(dev_t device, vfs_superblock *sb)
 	ext2_group_t *ext2_gd;
 	ext2_fsdriver_t *fsdriver;
 	char tmp[2*SECTOR_SIZE];
-	uint32_t grp_offset;
+	uint64_t grp_offset;
+	uint32_t gdt_size, i;
 
-	fsdriver = (ext2_fsdriver_t*)kmalloc(sizeof(ext2_fs_type), GFP_NORMAL_Z); 
+	fsdriver = (ext2_fsdriver_t*)kmalloc(sizeof(ext2_fsdriver_t), GFP_NORMAL_Z); 
 	ext2_sb  = (ext2_superblock_t*)kmalloc(sizeof(ext2_superblock_t), GFP_NORMAL_Z);
-	ext2_gd  = (ext2_group_t*)kmalloc(sizeof(ext2_group_t), GFP_NORMAL_Z);
-	if (ext2_sb == NULL || fsdriver == NULL || ext2_gd == NULL) {
+	if (ext2_sb == NULL || fsdriver == NULL) {
 		return 0;
 	}
 
@@ -139,27 +180,98 @@ int ext2_get_sb(dev_t device, vfs_superblock *sb)
 	brelse(device.major, device.minor, blks[0]);
 	brelse(device.major, device.minor, blks[1]);
 
-	/* Read EXT2 Group Descriptor and calculate FS information */
+	/* Calculate FS information */
 	fsdriver->block_size = get_block_size(*ext2_sb) / SECTOR_SIZE;
+	if (ext2_sb->s_rev_level > 0) {
+		fsdriver->inode_size = ext2_sb->s_inode_size;
+	} else {
+		fsdriver->inode_size = sizeof(ext2_inode_t);
+	}
 
-	grp_offset = ext2_sb->s_first_data_block * fsdriver->block_size;
-	blks[0] = bread(device.major, device.minor, grp_offset + EXT2_SUPERBLOCK_SECTOR);
-	memcpy(ext2_gd, blks[0]->data, sizeof(ext2_group_t));
-	brelse(device.major, device.minor, blks[0]);
+	fsdriver->n_groups          = div_rup(ext2_sb->s_blocks_count - ext2_sb->s_first_data_block,
+										  ext2_sb->s_blocks_per_group);
+
+	/* Check features */
+	if (ext2_sb->s_rev_level > 0 &&
+		(ext2_sb->s_feature_incompat & ~EXT2_FEATURE_INCOMPAT_SUPP)) {
+		kprintf(KERN_ERROR "ext2: unsupported features: 0x%x\n",
+				ext2_sb->s_feature_incompat & ~EXT2_FEATURE_INCOMPAT_SUPP);
+		kfree(ext2_sb);
+		kfree(fsdriver);
+		return 0;
+	}
+
+	sb->flags = 0;
+	if (ext2_sb->s_rev_level > 0 &&
+		((ext2_sb->s_feature_incompat & ~EXT2_FEATURE_INCOMPAT_WRITE) ||
+		 (ext2_sb->s_feature_ro_compat & ~EXT2_FEATURE_RO_COMPAT_WRITE))) {
+		kprintf(KERN_WARNING "ext2: file system features allow only read-only access.\n");
+		sb->flags |= SB_RDONLY;
+	}
+
+	fsdriver->desc_size = sizeof(ext2_group_t);
+	if ((ext2_sb->s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) &&
+		ext2_sb->s_desc_size >= EXT4_MIN_DESC_SIZE_64BIT) {
+		fsdriver->desc_size = ext2_sb->s_desc_size;
+	}
+
+	/**
+	 * Read the whole group descriptors table, it starts at the block
+	 * right after the super block. Only the fields of EXT2 descriptors
+	 * are kept from larger (64bit) descriptors.
+	 */
+	gdt_size = div_rup(fsdriver->n_groups * sizeof(ext2_group_t), SECTOR_SIZE) * SECTOR_SIZE;
+	ext2_gd  = (ext2_group_t*)kmalloc(gdt_size, GFP_NORMAL_Z);
+	if (ext2_gd == NULL) {
+		kfree(ext2_sb);
+		kfree(fsdriver);
+		return 0;
+	}
+
+	grp_offset = (uint64_t)(ext2_sb->s_first_data_block + 1) * fsdriver->block_size;
+	if (fsdriver->desc_size == sizeof(ext2_group_t)) {
+		for (i = 0; i < gdt_size; i += SECTOR_SIZE, grp_offset++) {
+			blks[0] = bread(device.major, device.minor, grp_offset);
+			memcpy(&((char*)ext2_gd)[i], blks[0]->data, SECTOR_SIZE);
+			brelse(device.major, device.minor, blks[0]);
+		}
+	} else {
+		blks[0] = NULL;
+		for (i = 0; i < fsdriver->n_groups; i++) {
+			if ((i * fsdriver->desc_size) % SECTOR_SIZE == 0) {
+				if (blks[0] != NULL) {
+					brelse(device.major, device.minor, blks[0]);
+				}
+				blks[0] = bread(device.major, device.minor, grp_offset++);
+			}
+			memcpy(&ext2_gd[i], &blks[0]->data[(i * fsdriver->desc_size) % SECTOR_SIZE],
+				   sizeof(ext2_group_t));
+		}
+		if (blks[0] != NULL) {
+			brelse(device.major, device.minor, blks[0]);
+		}
+	}
 
-	fsdriver->n_groups          = div_rup(ext2_sb->s_blocks_count, ext2_sb->s_blocks_per_group);
 	fsdriver->blks_bmap_size    = div_rup(div_rup(ext2_sb->s_blocks_per_group, 8), get_block_size(*ext2_sb));
 	fsdriver->inodes_bmap_size  = div_rup(div_rup(ext2_sb->s_inodes_per_group, 8), get_block_size(*ext2_sb));
 
 	/* Keep enouth information of ext2 fs in memory */
 	fsdriver->sb    = ext2_sb;
 	fsdriver->gdesc = ext2_gd;
+	fsdriver->bbitmap       = NULL;
+	fsdriver->bbitmap_group = EXT2_NO_GROUP;
+	fsdriver->ibitmap       = NULL;
+	fsdriver->ibitmap_group = EXT2_NO_GROUP;
+	fsdriver->sb_dirty      = 0;
+	fsdriver->alloc_locked  = 0;
+	init_waitqueue_head(&fsdriver->alloc_wait);
 	sb->fs_driver   = fsdriver;
 	
 	/* Now, fill VFS super block */
 	sb->s_inodes_count      = ext2_sb->s_inodes_count;
 	sb->s_blocks_count      = ext2_sb->s_r_blocks_count;  
 	sb->s_free_blocks_count = ext2_sb->s_free_blocks_count;  
+	sb->s_reserved_blocks   = 0;
 	sb->s_free_inodes_count = ext2_sb->s_free_inodes_count; 
 	sb->s_log_block_size    = get_block_size(*ext2_sb);
 	sb->s_mtime             = ext2_sb->s_mtime; 			
@@ -188,7 +300,8 @@ int ext2_get_sb(dev_t device, vfs_superblock *sb)
  */
 int ext2_get_inode(vfs_inode *inode)
 {
-	uint32_t itab_addr, iblk, iblk_addr, grp_block, grp_number, number;
+	uint32_t ioffset, number;
+	uint64_t sector;
 	ext2_fsdriver_t *fs;
 	ext2_superblock_t *sb;
 	buff_header_t *blk;
@@ -207,47 +320,18 @@ int ext2_get_inode(vfs_inode *inode)
 		number = inode->number;
 	}
 
-	/* Calculate which group i-node belongs to */
-	grp_number = (number - 1) / sb->s_inodes_per_group;
-
-	/**
-	 * Revision 0 of EXT2 file system stores a copy of super block and group
-	 * descriptor at the beginning of each block group.
-	 * Revision 1 and later reduce the number of these backups by keeping a copy
-	 * of super block and group descritor only in block groups 0, 1 and powers
-	 * of 3, 5 and 7.
-	 */
-	if (sb->s_rev_level > 0) {
-		grp_block = fs->gdesc->bg_inode_table;
-		for (i = 1; i <= grp_number; i++) {
-			grp_block += sb->s_blocks_per_group;
-
-			if (i == 1 || (i % 3) == 0 || (i % 5) == 0 || (i % 7) == 0) {
-				//grp_block--;
-			} else {
-				grp_block -= 2;
-			}
-		}
-	} else {
-		grp_block = (sb->s_blocks_per_group * grp_number) + fs->gdesc->bg_inode_table;
+	if (number > sb->s_inodes_count) {
+		return 0;
 	}
 
-	/* Find i-node table block addr */
-	if (grp_number > 0) {
-		number = number - (grp_number * sb->s_inodes_per_group);
-	}
-	itab_addr  = (grp_block * get_block_size(*sb));
-	iblk       = ((number - 1) * sizeof(ext2_inode_t));
-	itab_addr += iblk;
-	itab_addr  = itab_addr / SECTOR_SIZE;
-	iblk_addr  = iblk - ((iblk / SECTOR_SIZE) * SECTOR_SIZE);
+	ext2_inode_addr(fs, number, &sector, &ioffset);
 
 	/* Read the i-node */
-	blk = bread(inode->device.major, inode->device.minor, itab_addr);
+	blk = bread(inode->device.major, inode->device.minor, sector);
 	if (blk == NULL) {
 		return 0;
 	} else {
-		memcpy(&inode_ext2, &blk->data[iblk_addr], sizeof(ext2_inode_t));
+		memcpy(&inode_ext2, &blk->data[ioffset], sizeof(ext2_inode_t));
 		brelse(inode->device.major, inode->device.minor, blk);
 	}
 
@@ -266,78 +350,1296 @@ int ext2_get_inode(vfs_inode *inode)
 		inode->i_block[i] = inode_ext2.i_block[i];
 	}
 
+	/* Extent tree is walked by ext2_bmap() */
+	if (inode->i_flags & EXT4_EXTENTS_FL) {
+		inode->flags |= IFLAG_FS_BMAP;
+	} else {
+		inode->flags &= ~IFLAG_FS_BMAP;
+	}
+
 	return 1;
 }
 
 /**
- * Retrieve a file system block (logic) from device.
+ * Locate an i-node into its group's i-node table.
+ *
+ * \param fs EXT2 driver information.
+ * \param number i-node number.
+ * \param sector Device sector where i-node is.
+ * \param offset Byte offset of i-node into sector.
+ */
+static void ext2_inode_addr(ext2_fsdriver_t *fs, uint32_t number,
+							uint64_t *sector, uint32_t *offset)
+{
+	uint32_t grp_number, index, ioffset, blk_bytes;
+
+	/* Group and index into group's i-node table */
+	grp_number = (number - 1) / fs->sb->s_inodes_per_group;
+	index      = (number - 1) - (grp_number * fs->sb->s_inodes_per_group);
+
+	/* i-node table block comes from group descriptor */
+	blk_bytes = fs->block_size * SECTOR_SIZE;
+	ioffset   = index * fs->inode_size;
+	*sector   = (uint64_t)(fs->gdesc[grp_number].bg_inode_table +
+						   (ioffset / blk_bytes)) * fs->block_size;
+	ioffset   = ioffset % blk_bytes;
+	*sector  += ioffset / SECTOR_SIZE;
+	*offset   = ioffset % SECTOR_SIZE;
+}
+
+/**
+ * Write VFS i-node information to disk i-node.
+ *
+ * \param inode i-node.
+ * \param dtime Deletion time (0 for used i-nodes).
+ * \return 1 on success. 0 otherwise.
+ */
+static int ext2_update_inode(vfs_inode *inode, uint32_t dtime)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)inode->sb->fs_driver;
+	buff_header_t *blk;
+	uint32_t ioffset, number;
+	uint64_t sector;
+	int ret;
+
+	if (inode->sb->flags & SB_RDONLY) {
+		return 0;
+	}
+
+	number = (inode->number == 0 ? EXT2_ROOT_INO : inode->number);
+	ext2_inode_addr(fs, number, &sector, &ioffset);
+
+	/* Other fields of disk i-node are kept */
+	blk = bread(inode->device.major, inode->device.minor, sector);
+	if (blk == NULL) {
+		return 0;
+	}
+
+	ext2_fill_inode((ext2_inode_t*)&blk->data[ioffset], inode, dtime);
+
+	ret = bwrite(inode->device.major, inode->device.minor, blk, BWRITE_SYNC);
+	brelse(inode->device.major, inode->device.minor, blk);
+
+	return (ret < 0 ? 0 : 1);
+}
+
+/**
+ * Copy VFS i-node information to a disk i-node (other fields of
+ * disk i-node are kept).
+ *
+ * \param raw Disk i-node.
+ * \param inode VFS i-node.
+ * \param dtime Deletion time (0 for used i-nodes).
+ */
+static void ext2_fill_inode(ext2_inode_t *raw, vfs_inode *inode, uint32_t dtime)
+{
+	int i;
+
+	raw->i_mode        = inode->i_mode;
+	raw->i_uid         = inode->i_uid;
+	raw->i_size        = inode->i_size;
+	raw->i_atime       = inode->i_atime;
+	raw->i_ctime       = inode->i_ctime;
+	raw->i_mtime       = inode->i_mtime;
+	raw->i_dtime       = dtime;
+	raw->i_gid         = inode->i_gid;
+	raw->i_links_count = inode->i_links_count;
+	raw->i_blocks      = inode->i_blocks;
+	raw->i_flags       = inode->i_flags;
+	for (i = 0; i < 15; i++) {
+		raw->i_block[i] = inode->i_block[i];
+	}
+}
+
+/**
+ * Update disk i-node with current information.
+ *
+ * \param inode i-node.
+ * \return 1 on success. 0 otherwise.
+ */
+int ext2_write_inode(vfs_inode *inode)
+{
+	return ext2_update_inode(inode, 0);
+}
+
+/**
+ * Update a batch of disk i-nodes. i-nodes sharing an i-node table
+ * block are copied into it and written with a single block write
+ * (only the sectors between first and last changed i-node).
  *
  * \param sb Super block.
- * \param blocknum Block number.
- * \return char* NULL on error, block data (allocated with kmalloc) otherwise.
+ * \param inodes i-nodes, sorted by number.
+ * \param count Number of i-nodes.
+ * \return 1 on success. 0 otherwise.
  */
-char *ext2_get_fs_block(vfs_superblock *sb, uint32_t blocknum)
+int ext2_write_inodes(vfs_superblock *sb, vfs_inode **inodes, uint32_t count)
 {
-	/* Maximum blocks = (for 4KB)*/
-	buff_header_t *blks[4096/SECTOR_SIZE];
-	ext2_fsdriver_t *fs;
-	int i, nb;
-	uint64_t baddr;
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	uint32_t i, number, grp, index, blk_bytes, first, last;
+	uint32_t cur_blk = 0, blk = 0, off = 0;
 	char *block;
+	int ret = 1;
 
-	fs = (ext2_fsdriver_t*)sb->fs_driver;
-	baddr = blocknum * fs->block_size;
+	if (sb->flags & SB_RDONLY) {
+		return 0;
+	}
 
-	block = (char*)kmalloc(get_block_size(*fs->sb), GFP_NORMAL_Z);
-	if (block == NULL) {
-		return NULL;
+	blk_bytes = fs->block_size * SECTOR_SIZE;
+	if ((block = (char*)kmalloc(blk_bytes, GFP_NORMAL_Z)) == NULL) {
+		return 0;
 	}
 
-	nb = get_block_size(*fs->sb) / SECTOR_SIZE;
-	for (i = 0; i < nb; i++, baddr++) {
-		blks[i] = bread(sb->device.major, sb->device.minor, baddr);
-		memcpy(&block[(i * SECTOR_SIZE)], blks[i]->data, SECTOR_SIZE);
-		brelse(sb->device.major, sb->device.minor, blks[i]);
+	first = last = 0;
+	for (i = 0; i <= count; i++) {
+		if (i < count) {
+			number = (inodes[i]->number == 0 ? EXT2_ROOT_INO : inodes[i]->number);
+			grp    = (number - 1) / fs->sb->s_inodes_per_group;
+			index  = (number - 1) - (grp * fs->sb->s_inodes_per_group);
+			blk    = fs->gdesc[grp].bg_inode_table + ((index * fs->inode_size) / blk_bytes);
+			off    = (index * fs->inode_size) % blk_bytes;
+		}
+
+		/* Write previous block when batch moves to another one */
+		if (last > first && (i == count || blk != cur_blk)) {
+			if (!ext2_write_sectors(sb, cur_blk, block, first, last - first)) {
+				ret = 0;
+			}
+			first = last = 0;
+		}
+		if (i == count) {
+			break;
+		}
+
+		if (last == first) {
+			if (!ext2_read_fs_block(sb, blk, block)) {
+				ret = 0;
+				continue;
+			}
+			cur_blk = blk;
+			first   = off;
+		}
+
+		ext2_fill_inode((ext2_inode_t*)&block[off], inodes[i], 0);
+		if (off < first) {
+			first = off;
+		}
+		if (off + fs->inode_size > last) {
+			last = off + fs->inode_size;
+		}
 	}
-	
-	return block;
+
+	kfree(block);
+	return ret;
 }
 
 /**
- * Division a/b with rounded up.
- * \param a Value of a.
- * \param b Value of b.
- * \return Result of division a/b with rounded up.
- **/
-uint32_t div_rup(uint32_t a, uint32_t b)
+ * Called when last reference to an i-node is released: unused blocks
+ * of preallocation window are returned and super block is written.
+ *
+ * \param inode i-node.
+ * \return 1 on success. 0 otherwise.
+ */
+int ext2_put_inode(vfs_inode *inode)
 {
-	uint32_t res = (a/b);
-	if ((res*b) < a) {
-		res++;
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)inode->sb->fs_driver;
+
+	ext2_discard_prealloc(inode);
+
+	if (fs->sb_dirty) {
+		return ext2_write_super(inode->sb);
 	}
-	return res;
+	return 1;
 }
 
+/**
+ * Alloc a new i-node on disk.
+ *
+ * \param sb Super block.
+ * \param inode On input number is the parent directory and i_mode the
+ *              file type. On output, number is the new i-node.
+ * \return 1 on success. 0 otherwise.
+ */
+int ext2_alloc_inode(vfs_superblock *sb, vfs_inode *inode)
+{
+	uint32_t ino;
+
+	if ((ino = ext2_new_inode(sb, inode->number, inode->i_mode)) == 0) {
+		return 0;
+	}
+
+	inode->number = ino;
+	return 1;
+}
 
 /**
- * Return block size in bytes.
+ * Free a run of contiguous blocks being accumulated.
+ *
  * \param sb Super block.
- * \return Block size in bytes.
+ * \param run Run (first block and number of blocks).
+ * \param block Next block to free (0 just flushes the run).
  */
-uint32_t get_block_size(ext2_superblock_t sb)
+static void ext2_free_run(vfs_superblock *sb, uint32_t *run, uint32_t block)
 {
-	uint32_t size = 1024; /* default */
+	if (block != 0 && run[1] > 0 && block == (run[0] + run[1])) {
+		run[1]++;
+		return;
+	}
 
-	switch(sb.s_log_block_size) {
-		case EXT2_BLOCK_SIZE_2k:
-			size = 2048;
-			break;
+	if (run[1] > 0) {
+		ext2_free_blocks(sb, run[0], run[1]);
+	}
+	run[0] = block;
+	run[1] = (block != 0 ? 1 : 0);
+}
 
-		case EXT2_BLOCK_SIZE_4k:
-			size = 4096;
-			break;
+/**
+ * Free a block and (for indirect blocks) all blocks it points to.
+ *
+ * \param inode i-node.
+ * \param block Block number.
+ * \param level Indirection level (0 for data blocks).
+ * \param run Run of blocks to free.
+ */
+static void ext2_free_branch(vfs_inode *inode, uint32_t block, int level, uint32_t *run)
+{
+	uint32_t *ind, i, n_entries;
+
+	if (block == 0) {
+		return;
 	}
 
-	return size;
+	if (level > 0) {
+		n_entries = inode->sb->s_log_block_size / sizeof(uint32_t);
+		ind = (uint32_t*)ext2_get_fs_block(inode->sb, block);
+		if (ind != NULL) {
+			for (i = 0; i < n_entries; i++) {
+				ext2_free_branch(inode, ind[i], level - 1, run);
+			}
+			kfree(ind);
+		}
+	}
+
+	ext2_free_run(inode->sb, run, block);
+}
+
+/**
+ * Delete an i-node and all blocks associated with it.
+ *
+ * \param sb Super block.
+ * \param inode i-node.
+ * \return 1 on success. 0 otherwise.
+ */
+int ext2_free_inode(vfs_superblock *sb, vfs_inode *inode)
+{
+	uint32_t run[2] = {0, 0};
+	int i;
+
+	if ((sb->flags & SB_RDONLY) || (inode->i_flags & EXT4_EXTENTS_FL)) {
+		return 0;
+	}
+
+	ext2_discard_prealloc(inode);
+
+	for (i = 0; i < VFS_NDIR_BLOCKS; i++) {
+		ext2_free_branch(inode, inode->i_block[i], 0, run);
+	}
+	ext2_free_branch(inode, inode->i_block[VFS_IND_BLOCK], 1, run);
+	ext2_free_branch(inode, inode->i_block[VFS_DIND_BLOCK], 2, run);
+	ext2_free_branch(inode, inode->i_block[VFS_TIND_BLOCK], 3, run);
+	ext2_free_run(sb, run, 0);
+
+	for (i = 0; i < 15; i++) {
+		inode->i_block[i] = 0;
+	}
+	inode->i_blocks      = 0;
+	inode->i_size        = 0;
+	inode->i_links_count = 0;
+	vfs_bmap_invalidate(inode);
+
+	ext2_update_inode(inode, get_seconds());
+	ext2_release_inode(sb, inode->number, inode->i_mode);
+
+	return 1;
+}
+
+/**
+ * Choose a goal block for a file block: next to the previous block
+ * of the file, or at i-node's group (with an offset based on i-node
+ * number, so new files of the same group do not share the same area).
+ *
+ * \param inode i-node.
+ * \param lblk File logic block.
+ * \return uint32_t Goal block.
+ */
+static uint32_t ext2_block_goal(vfs_inode *inode, uint32_t lblk)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)inode->sb->fs_driver;
+	ext2_superblock_t *sb = fs->sb;
+	uint32_t number, group, prev;
+
+	if (inode->i_alloc_pblk != 0) {
+		if (lblk > inode->i_alloc_lblk) {
+			return inode->i_alloc_pblk + (lblk - inode->i_alloc_lblk);
+		}
+		return inode->i_alloc_pblk + 1;
+	}
+
+	if (lblk > 0) {
+		prev = vfs_bmap(inode, (lblk - 1) * inode->sb->s_log_block_size).blk_number;
+		if (prev != 0) {
+			return prev + 1;
+		}
+	}
+
+	number = (inode->number == 0 ? EXT2_ROOT_INO : inode->number);
+	group  = (number - 1) / sb->s_inodes_per_group;
+
+	return sb->s_first_data_block + (group * sb->s_blocks_per_group) +
+			((number % 16) * (sb->s_blocks_per_group / 16));
+}
+
+/**
+ * Allocate a block for an i-node.
+ *
+ * \param inode i-node.
+ * \param goal Goal block.
+ * \param zero Fill block with zeros (indirect blocks).
+ * \param count Number of blocks that are going to be allocated.
+ * \return uint32_t Block number, 0 if file system is full.
+ */
+static uint32_t ext2_alloc_fs_block(vfs_inode *inode, uint32_t goal, int zero, uint32_t count)
+{
+	uint32_t block, blk_size;
+	char *data;
+
+	if ((block = ext2_new_block(inode, goal, count)) == 0) {
+		return 0;
+	}
+
+	blk_size = inode->sb->s_log_block_size;
+	if (zero) {
+		data = (char*)kmalloc(blk_size, GFP_NORMAL_Z);
+		if (data == NULL) {
+			ext2_free_blocks(inode->sb, block, 1);
+			return 0;
+		}
+		memset(data, 0, blk_size);
+		ext2_put_fs_block(inode->sb, block, data);
+		kfree(data);
+	}
+
+	inode->i_blocks += blk_size / SECTOR_SIZE;
+	return block;
 }
 
+/**
+ * Map file logic block to file system block.
+ *
+ * \param inode i-node.
+ * \param lblk File logic block.
+ * \param create Allocate block (and indirect blocks) if it is not mapped.
+ *               Number of blocks caller is going to allocate from lblk on.
+ * \return uint32_t Block number, 0 on holes (or if file system is full).
+ * \note Caller should write i-node back when i_blocks changes.
+ */
+uint32_t ext2_bmap(vfs_inode *inode, uint32_t lblk, int create)
+{
+	vfs_superblock *sb = inode->sb;
+	uint32_t n_entries, rel, div, digit, goal, parent, child, *slot, *ind;
+	int i, level;
+
+	/* Extent mapped files are read-only */
+	if (inode->i_flags & EXT4_EXTENTS_FL) {
+		return (create ? 0 : ext4_ext_bmap(inode, lblk));
+	}
+
+	n_entries = sb->s_log_block_size / sizeof(uint32_t);
+	rel       = 0;
+
+	if (lblk < VFS_NDIR_BLOCKS) {
+		level = 0;
+		slot  = &inode->i_block[lblk];
+	} else {
+		rel = lblk - VFS_NDIR_BLOCKS;
+		if (rel < n_entries) {
+			level = 1;
+			slot  = &inode->i_block[VFS_IND_BLOCK];
+		} else if ((rel -= n_entries) < (n_entries * n_entries)) {
+			level = 2;
+			slot  = &inode->i_block[VFS_DIND_BLOCK];
+		} else {
+			rel  -= n_entries * n_entries;
+			level = 3;
+			slot  = &inode->i_block[VFS_TIND_BLOCK];
+		}
+	}
+
+	goal = 0;
+	if (create) {
+		goal = ext2_block_goal(inode, lblk);
+	}
+
+	/* Block pointed by i-node */
+	if (*slot == 0) {
+		if (!create || (*slot = ext2_alloc_fs_block(inode, goal, (level > 0), create)) == 0) {
+			return 0;
+		}
+		goal = *slot + 1;
+	}
+	parent = *slot;
+
+	/* Walk into indirect blocks */
+	for (i = level; i > 0; i--) {
+		for (div = 1, digit = 1; digit < (uint32_t)i; digit++) {
+			div *= n_entries;
+		}
+		digit = (rel / div) % n_entries;
+
+		if ((ind = (uint32_t*)ext2_get_fs_block(sb, parent)) == NULL) {
+			return 0;
+		}
+
+		child = ind[digit];
+		if (child == 0 && create) {
+			child = ext2_alloc_fs_block(inode, goal, (i > 1), create);
+			if (child != 0) {
+				ind[digit] = child;
+				ext2_write_sectors(sb, parent, (char*)ind,
+								   digit * sizeof(uint32_t), sizeof(uint32_t));
+				goal = child + 1;
+			}
+		}
+		kfree(ind);
+
+		if (child == 0) {
+			return 0;
+		}
+		parent = child;
+	}
+
+	if (create) {
+		inode->i_alloc_lblk = lblk;
+		inode->i_alloc_pblk = parent;
+	}
+
+	return parent;
+}
+
+/**
+ * Add a directory entry.
+ *
+ * \param dir Directory i-node.
+ * \param name Entry name.
+ * \param inode i-node of the entry.
+ * \return 1 on success. 0 otherwise.
+ * \note Directory index is not updated, so indexed directories become
+ *       unindexed (linear) directories.
+ */
+int ext2_link(vfs_inode *dir, const char *name, vfs_inode *inode)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)dir->sb->fs_driver;
+	ext2_directory_t *de, *nde;
+	uint32_t blk_size, nblocks, lblk, pblk, pos, used, need;
+	size_t nlen;
+	uchar8_t ftype;
+	char *block;
+
+	nlen = strlen(name);
+	if (nlen == 0 || nlen > EXT2_NAME_LEN) {
+		return 0;
+	}
+
+	ftype = EXT2_FT_UNKNOWN;
+	if (fs->sb->s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE) {
+		ftype = ((inode->i_mode & S_IFMT) == S_IFDIR ? EXT2_FT_DIR : EXT2_FT_REG_FILE);
+	}
+
+	blk_size = dir->sb->s_log_block_size;
+	nblocks  = dir->i_size / blk_size;
+	need     = EXT2_REC_LEN(nlen);
+
+	/* Look for an entry with enough room */
+	for (lblk = 0; lblk < nblocks; lblk++) {
+		pblk = vfs_bmap(dir, lblk * blk_size).blk_number;
+		if (pblk == 0 || (block = ext2_get_fs_block(dir->sb, pblk)) == NULL) {
+			continue;
+		}
+
+		for (pos = 0; pos + 8 <= blk_size; pos += de->rec_len) {
+			de = (ext2_directory_t*)&block[pos];
+			if (de->rec_len < 8 || (pos + de->rec_len) > blk_size) {
+				break;
+			}
+
+			used = (de->inode != 0 ? EXT2_REC_LEN(de->name_len) : 0);
+			if (de->rec_len - used < need) {
+				continue;
+			}
+
+			/* Split entry */
+			nde = de;
+			if (used > 0) {
+				nde = (ext2_directory_t*)&block[pos + used];
+				nde->rec_len = de->rec_len - used;
+				de->rec_len  = used;
+			}
+			nde->inode     = inode->number;
+			nde->name_len  = nlen;
+			nde->file_type = ftype;
+			memcpy(nde->name, name, nlen);
+
+			ext2_write_sectors(dir->sb, pblk, block, pos, used + need);
+			kfree(block);
+			goto done;
+		}
+		kfree(block);
+	}
+
+	/* No room: append a new block to directory */
+	if ((pblk = ext2_bmap(dir, nblocks, 1)) == 0) {
+		return 0;
+	}
+	if ((block = (char*)kmalloc(blk_size, GFP_NORMAL_Z)) == NULL) {
+		return 0;
+	}
+	memset(block, 0, blk_size);
+	nde = (ext2_directory_t*)block;
+	nde->inode     = inode->number;
+	nde->rec_len   = blk_size;
+	nde->name_len  = nlen;
+	nde->file_type = ftype;
+	memcpy(nde->name, name, nlen);
+	ext2_put_fs_block(dir->sb, pblk, block);
+	kfree(block);
+
+	dir->i_size += blk_size;
+	vfs_bmap_invalidate(dir);
+
+done:
+	dir->i_flags &= ~EXT2_INDEX_FL;
+	vfs_mark_dirty(dir);
+	return 1;
+}
+
+/**
+ * Remove a directory entry. The entry is merged into the previous one
+ * of the block, so directory index (if any) is still valid.
+ *
+ * \param dir Directory i-node.
+ * \param name Entry name.
+ * \return 1 on success. 0 otherwise.
+ */
+int ext2_unlink(vfs_inode *dir, const char *name)
+{
+	ext2_directory_t *de, *prev;
+	uint32_t blk_size, nblocks, lblk, pblk, pos, ppos;
+	size_t nlen;
+	char *block;
+
+	nlen     = strlen(name);
+	blk_size = dir->sb->s_log_block_size;
+	nblocks  = dir->i_size / blk_size;
+
+	for (lblk = 0; lblk < nblocks; lblk++) {
+		pblk = vfs_bmap(dir, lblk * blk_size).blk_number;
+		if (pblk == 0 || (block = ext2_get_fs_block(dir->sb, pblk)) == NULL) {
+			continue;
+		}
+
+		prev = NULL;
+		ppos = 0;
+		for (pos = 0; pos + 8 <= blk_size; pos += de->rec_len) {
+			de = (ext2_directory_t*)&block[pos];
+			if (de->rec_len < 8 || (pos + de->rec_len) > blk_size) {
+				break;
+			}
+
+			if (de->inode != 0 && de->name_len == nlen &&
+				strncmp(de->name, name, nlen) == 0) {
+				if (prev != NULL) {
+					prev->rec_len += de->rec_len;
+					ext2_write_sectors(dir->sb, pblk, block, ppos, 8);
+				} else {
+					de->inode = 0;
+					ext2_write_sectors(dir->sb, pblk, block, pos, 8);
+				}
+				kfree(block);
+				return 1;
+			}
+
+			prev = de;
+			ppos = pos;
+		}
+		kfree(block);
+	}
+
+	return 0;
+}
+
+/**
+ * Write part of a file system block to device.
+ *
+ * \param sb Super block.
+ * \param blocknum Block number.
+ * \param data Block data (whole block).
+ * \param offset Offset of first byte changed.
+ * \param len Number of bytes changed.
+ * \return 1 on success. 0 otherwise.
+ * \note Whole sectors holding the bytes are written synchronously.
+ */
+int ext2_write_sectors(vfs_superblock *sb, uint32_t blocknum, char *data,
+					   uint32_t offset, uint32_t len)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	buff_header_t *buff;
+	uint32_t s, last;
+	uint64_t baddr;
+	int ret = 1;
+
+	if (len == 0) {
+		return 1;
+	}
+
+	s     = offset / SECTOR_SIZE;
+	last  = (offset + len - 1) / SECTOR_SIZE;
+	baddr = (uint64_t)blocknum * fs->block_size + s;
+
+	for (; s <= last; s++, baddr++) {
+		buff = getblk(sb->device.major, sb->device.minor, baddr);
+		if (buff == NULL) {
+			return 0;
+		}
+
+		memcpy(buff->data, &data[s * SECTOR_SIZE], SECTOR_SIZE);
+		if (bwrite(sb->device.major, sb->device.minor, buff, BWRITE_SYNC) < 0) {
+			ret = 0;
+		}
+		brelse(sb->device.major, sb->device.minor, buff);
+	}
+
+	return ret;
+}
+
+/**
+ * Write a whole file system block to device.
+ *
+ * \param sb Super block.
+ * \param blocknum Block number.
+ * \param data Block data.
+ * \return 1 on success. 0 otherwise.
+ */
+int ext2_put_fs_block(vfs_superblock *sb, uint32_t blocknum, char *data)
+{
+	return ext2_write_sectors(sb, blocknum, data, 0, sb->s_log_block_size);
+}
+
+/**
+ * Retrieve a file system block (logic) from device.
+ *
+ * \param sb Super block.
+ * \param blocknum Block number.
+ * \return char* NULL on error, block data (allocated with kmalloc) otherwise.
+ */
+char *ext2_get_fs_block(vfs_superblock *sb, uint32_t blocknum)
+{
+	char *block;
+
+	block = (char*)kmalloc(sb->s_log_block_size, GFP_NORMAL_Z);
+	if (block == NULL) {
+		return NULL;
+	}
+
+	if (!ext2_read_fs_block(sb, blocknum, block)) {
+		kfree(block);
+		return NULL;
+	}
+	return block;
+}
+
+/**
+ * Read a file system block (logic) from device into a buffer.
+ *
+ * \param sb Super block.
+ * \param blocknum Block number.
+ * \param data Destination buffer (block size).
+ * \return 1 on success. 0 otherwise.
+ */
+int ext2_read_fs_block(vfs_superblock *sb, uint32_t blocknum, char *data)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	buff_header_t *buff;
+	uint64_t baddr;
+	uint32_t i;
+
+	baddr = (uint64_t)blocknum * fs->block_size;
+	for (i = 0; i < fs->block_size; i++, baddr++) {
+		buff = bread(sb->device.major, sb->device.minor, baddr);
+		if (buff == NULL) {
+			return 0;
+		}
+		memcpy(&data[i * SECTOR_SIZE], buff->data, SECTOR_SIZE);
+		brelse(sb->device.major, sb->device.minor, buff);
+	}
+
+	return 1;
+}
+
+/**
+ * Start reading a file system block into buffer cache (read ahead).
+ *
+ * \param sb Super block.
+ * \param blocknum Block number.
+ * \return Number of sectors being read, or -1 on error.
+ */
+int ext2_prefetch_fs_block(vfs_superblock *sb, uint32_t blocknum)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)sb->fs_driver;
+	uint64_t baddr;
+	uint32_t i;
+	int ret, count = 0;
+
+	baddr = (uint64_t)blocknum * fs->block_size;
+	for (i = 0; i < fs->block_size; i++, baddr++) {
+		if ((ret = bprefetch(sb->device.major, sb->device.minor, baddr)) < 0) {
+			return -1;
+		}
+		count += ret;
+	}
+
+	return count;
+}
+
+/**
+ * Division a/b with rounded up.
+ * \param a Value of a.
+ * \param b Value of b.
+ * \return Result of division a/b with rounded up.
+ **/
+uint32_t div_rup(uint32_t a, uint32_t b)
+{
+	uint32_t res = (a/b);
+	if ((res*b) < a) {
+		res++;
+	}
+	return res;
+}
+
+
+/**
+ * Return block size in bytes.
+ * \param sb Super block.
+ * \return Block size in bytes.
+ */
+uint32_t get_block_size(ext2_superblock_t sb)
+{
+	uint32_t size = 1024; /* default */
+
+	switch(sb.s_log_block_size) {
+		case EXT2_BLOCK_SIZE_2k:
+			size = 2048;
+			break;
+
+		case EXT2_BLOCK_SIZE_4k:
+			size = 4096;
+			break;
+	}
+
+	return size;
+}
+
+/**
+ * Enable or disable directory index (htree) lookups.
+ *
+ * \param enable 0 to always use linear search.
+ */
+void ext2_set_htree(int enable)
+{
+	ext2_htree_enabled = enable;
+}
+
+/**
+ * Enable or disable i-node table read ahead.
+ *
+ * \param enable 0 to read i-nodes only on demand.
+ */
+void ext2_set_inode_ra(int enable)
+{
+	ext2_inode_ra_enabled = enable;
+}
+
+/**
+ * Start reading the i-node table blocks of all i-nodes referenced by a
+ * directory block. Entries of a directory are usually allocated close
+ * to each other, so the blocks of each group are read as a single
+ * range, which the device driver merges into one request. This turns
+ * a scan of a directory (stat of each entry) into a few large reads
+ * instead of one synchronous read per i-node.
+ *
+ * \param dir Directory i-node.
+ * \param block Directory (leaf) block data.
+ * \return Number of sectors being read, or -1 on error.
+ */
+int ext2_prefetch_inodes(vfs_inode *dir, char *block)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)dir->sb->fs_driver;
+	uint32_t grp[EXT2_INODE_RA_GROUPS], first[EXT2_INODE_RA_GROUPS];
+	uint32_t last[EXT2_INODE_RA_GROUPS];
+	uint32_t blk_size, blk_bytes, pos, number, g, iblk, b;
+	ext2_directory_t *entry;
+	int i, ngroups, ret, count;
+
+	if (!ext2_inode_ra_enabled) {
+		return 0;
+	}
+
+	blk_size  = dir->sb->s_log_block_size;
+	blk_bytes = fs->block_size * SECTOR_SIZE;
+	ngroups   = 0;
+
+	/* Find the range of i-node table blocks of each group */
+	pos = 0;
+	while (pos + 8 <= blk_size) {
+		entry = (ext2_directory_t*)&block[pos];
+		if (entry->rec_len < 8 || (pos + entry->rec_len) > blk_size) {
+			/* corrupted block */
+			break;
+		}
+		pos += entry->rec_len;
+
+		number = entry->inode;
+		if (number == 0 || number > fs->sb->s_inodes_count) {
+			continue;
+		}
+
+		g    = (number - 1) / fs->sb->s_inodes_per_group;
+		iblk = (((number - 1) - (g * fs->sb->s_inodes_per_group)) *
+				fs->inode_size) / blk_bytes;
+
+		for (i = 0; i < ngroups && grp[i] != g; i++);
+		if (i == ngroups) {
+			if (ngroups == EXT2_INODE_RA_GROUPS) {
+				continue;
+			}
+			grp[i]   = g;
+			first[i] = last[i] = iblk;
+			ngroups++;
+		} else if (iblk < first[i]) {
+			first[i] = iblk;
+		} else if (iblk > last[i]) {
+			last[i] = iblk;
+		}
+	}
+
+	/* Read each range */
+	count = 0;
+	for (i = 0; i < ngroups; i++) {
+		if (last[i] - first[i] >= EXT2_INODE_RA_BLOCKS) {
+			last[i] = first[i] + EXT2_INODE_RA_BLOCKS - 1;
+		}
+
+		b = fs->gdesc[grp[i]].bg_inode_table;
+		for (iblk = first[i]; iblk <= last[i]; iblk++) {
+			if ((ret = ext2_prefetch_fs_block(dir->sb, b + iblk)) < 0) {
+				return -1;
+			}
+			count += ret;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Find a name into a directory.
+ *
+ * \param dir Directory i-node.
+ * \param name Name to find.
+ * \param ino Where i-node number will be stored.
+ * \return 1 if name was found, 0 if not, -1 if directory is not indexed
+ *         (VFS should do a linear search).
+ */
+int ext2_lookup(vfs_inode *dir, const char *name, uint32_t *ino)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)dir->sb->fs_driver;
+
+	if (!ext2_htree_enabled ||
+		!(fs->sb->s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) ||
+		!(dir->i_flags & EXT2_INDEX_FL)) {
+		return -1;
+	}
+
+	return ext2_dx_lookup(dir, name, ino);
+}
+
+/**
+ * Read a directory block.
+ *
+ * \param dir Directory i-node.
+ * \param lblk Logical block number into directory.
+ * \return char* Block data (allocated with kmalloc), NULL on error.
+ */
+static char *ext2_dir_block(vfs_inode *dir, uint32_t lblk)
+{
+	vfs_bmap_t bmap;
+
+	bmap = vfs_bmap(dir, lblk * dir->sb->s_log_block_size);
+	if (bmap.blk_number == 0) {
+		return NULL;
+	}
+
+	return dir->sb->sb_op->get_fs_block(dir->sb, bmap.blk_number);
+}
+
+/**
+ * Search a name into a directory (leaf) block.
+ *
+ * \param block Block data.
+ * \param blk_size Block size.
+ * \param name Name.
+ * \param len Name length.
+ * \return uint32_t i-node number if name was found, 0 otherwise.
+ */
+static uint32_t ext2_search_dirblock(char *block, uint32_t blk_size,
+									 const char *name, size_t len)
+{
+	ext2_directory_t *dir;
+	uint32_t pos = 0;
+
+	while (pos + 8 <= blk_size) {
+		dir = (ext2_directory_t*)&block[pos];
+		if (dir->rec_len < 8 || (pos + dir->rec_len) > blk_size) {
+			/* corrupted block */
+			break;
+		}
+
+		if (dir->inode != 0 && dir->name_len == len &&
+			strncmp(dir->name, name, len) == 0) {
+			return dir->inode;
+		}
+
+		pos += dir->rec_len;
+	}
+
+	return 0;
+}
+
+/**
+ * Search a name through directory index (htree).
+ *
+ * \param dir Directory i-node.
+ * \param name Name to find.
+ * \param ino Where i-node number will be stored.
+ * \return 1 if name was found, 0 if not, -1 if index is not valid.
+ */
+static int ext2_dx_lookup(vfs_inode *dir, const char *name, uint32_t *ino)
+{
+	ext2_fsdriver_t *fs = (ext2_fsdriver_t*)dir->sb->fs_driver;
+	ext2_dx_root_info_t *info;
+	ext2_dx_entry_t *entries;
+	uint32_t blk_size, hash, count, limit, lblk, lo, hi, mid, at;
+	int levels, version;
+	size_t len;
+	char *iblock, *leaf;
+
+	blk_size = dir->sb->s_log_block_size;
+	len      = strlen(name);
+
+	/* dx root lives at the first block, right after "." and ".." */
+	if ((iblock = ext2_dir_block(dir, 0)) == NULL) {
+		return -1;
+	}
+
+	info = (ext2_dx_root_info_t*)&iblock[24];
+	if (info->reserved_zero != 0 || info->info_length != 8 ||
+		info->indirect_levels >= EXT2_HTREE_LEVELS) {
+		kfree(iblock);
+		return -1;
+	}
+
+	version = info->hash_version;
+	if (version <= EXT2_HASH_TEA &&
+		(fs->sb->s_flags & EXT2_FLAGS_UNSIGNED_HASH)) {
+		version += 3;
+	}
+
+	if (!ext2_dirhash(name, len, version, fs->sb->s_hash_seed, &hash)) {
+		kfree(iblock);
+		return -1;
+	}
+
+	levels  = info->indirect_levels;
+	entries = (ext2_dx_entry_t*)&iblock[24 + info->info_length];
+	limit   = (blk_size - (24 + info->info_length)) / sizeof(ext2_dx_entry_t);
+
+	while (1) {
+		count = EXT2_DX_COUNT(entries);
+		if (count == 0 || count > EXT2_DX_LIMIT(entries) ||
+			EXT2_DX_LIMIT(entries) > limit) {
+			kfree(iblock);
+			return -1;
+		}
+
+		/* Binary search: last entry with hash <= name's hash */
+		lo = 1;
+		hi = count;
+		while (lo < hi) {
+			mid = lo + ((hi - lo) / 2);
+			if (entries[mid].hash > hash) {
+				hi = mid;
+			} else {
+				lo = mid + 1;
+			}
+		}
+		at = lo - 1;
+
+		if (levels == 0) {
+			break;
+		}
+
+		/* Go down into index node */
+		lblk = entries[at].block & EXT2_DX_BLOCK_MASK;
+		kfree(iblock);
+		if ((iblock = ext2_dir_block(dir, lblk)) == NULL) {
+			return -1;
+		}
+		entries = (ext2_dx_entry_t*)&iblock[8];
+		limit   = (blk_size - 8) / sizeof(ext2_dx_entry_t);
+		levels--;
+	}
+
+	/**
+	 * Search leaf block. When next leaf starts with the same hash
+	 * (collision bit set), entries can continue on it.
+	 */
+	*ino = 0;
+	while (1) {
+		lblk = entries[at].block & EXT2_DX_BLOCK_MASK;
+		if ((leaf = ext2_dir_block(dir, lblk)) == NULL) {
+			/* Not a miss: let VFS search (and report the error) */
+			kfree(iblock);
+			return -1;
+		}
+
+		*ino = ext2_search_dirblock(leaf, blk_size, name, len);
+		if (*ino != 0) {
+			ext2_prefetch_inodes(dir, leaf);
+			kfree(leaf);
+			break;
+		}
+		kfree(leaf);
+
+		at++;
+		if (at >= count || (entries[at].hash & ~1) != hash) {
+			break;
+		}
+	}
+
+	kfree(iblock);
+	return (*ino != 0 ? 1 : 0);
+}
+
+
+/* Directory hash functions (compatible with e2fsprogs/Linux) */
+
+#define ROL32(x, s)   (((x) << (s)) | ((x) >> (32 - (s))))
+#define DX_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define DX_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define DX_H(x, y, z) ((x) ^ (y) ^ (z))
+#define DX_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = ROL32(a, s))
+#define DX_K1 0
+#define DX_K2 013240474631UL
+#define DX_K3 015666365641UL
+
+/**
+ * Basic cut-down MD4 transform.
+ */
+static void half_md4_transform(uint32_t buf[4], uint32_t const in[8])
+{
+	uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	/* Round 1 */
+	DX_ROUND(DX_F, a, b, c, d, in[0] + DX_K1,  3);
+	DX_ROUND(DX_F, d, a, b, c, in[1] + DX_K1,  7);
+	DX_ROUND(DX_F, c, d, a, b, in[2] + DX_K1, 11);
+	DX_ROUND(DX_F, b, c, d, a, in[3] + DX_K1, 19);
+	DX_ROUND(DX_F, a, b, c, d, in[4] + DX_K1,  3);
+	DX_ROUND(DX_F, d, a, b, c, in[5] + DX_K1,  7);
+	DX_ROUND(DX_F, c, d, a, b, in[6] + DX_K1, 11);
+	DX_ROUND(DX_F, b, c, d, a, in[7] + DX_K1, 19);
+
+	/* Round 2 */
+	DX_ROUND(DX_G, a, b, c, d, in[1] + DX_K2,  3);
+	DX_ROUND(DX_G, d, a, b, c, in[3] + DX_K2,  5);
+	DX_ROUND(DX_G, c, d, a, b, in[5] + DX_K2,  9);
+	DX_ROUND(DX_G, b, c, d, a, in[7] + DX_K2, 13);
+	DX_ROUND(DX_G, a, b, c, d, in[0] + DX_K2,  3);
+	DX_ROUND(DX_G, d, a, b, c, in[2] + DX_K2,  5);
+	DX_ROUND(DX_G, c, d, a, b, in[4] + DX_K2,  9);
+	DX_ROUND(DX_G, b, c, d, a, in[6] + DX_K2, 13);
+
+	/* Round 3 */
+	DX_ROUND(DX_H, a, b, c, d, in[3] + DX_K3,  3);
+	DX_ROUND(DX_H, d, a, b, c, in[7] + DX_K3,  9);
+	DX_ROUND(DX_H, c, d, a, b, in[2] + DX_K3, 11);
+	DX_ROUND(DX_H, b, c, d, a, in[6] + DX_K3, 15);
+	DX_ROUND(DX_H, a, b, c, d, in[1] + DX_K3,  3);
+	DX_ROUND(DX_H, d, a, b, c, in[5] + DX_K3,  9);
+	DX_ROUND(DX_H, c, d, a, b, in[0] + DX_K3, 11);
+	DX_ROUND(DX_H, b, c, d, a, in[4] + DX_K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+/**
+ * TEA transform (16 rounds).
+ */
+static void tea_transform(uint32_t buf[4], uint32_t const in[4])
+{
+	uint32_t sum = 0;
+	uint32_t b0 = buf[0], b1 = buf[1];
+	uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+	int n = 16;
+
+	do {
+		sum += 0x9E3779B9;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	} while (--n);
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+/**
+ * Legacy ext2 directory hash.
+ */
+static uint32_t dx_hack_hash(const char *name, int len, int usign)
+{
+	uint32_t hash, hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+	int c;
+
+	while (len--) {
+		c = usign ? (int)(uchar8_t)*name : (int)(signed char)*name;
+		name++;
+
+		hash = hash1 + (hash0 ^ (c * 7152373));
+		if (hash & 0x80000000) {
+			hash -= 0x7FFFFFFF;
+		}
+		hash1 = hash0;
+		hash0 = hash;
+	}
+
+	return (hash0 << 1);
+}
+
+/**
+ * Convert a string into hash input buffer.
+ */
+static void str2hashbuf(const char *msg, int len, uint32_t *buf, int num, int usign)
+{
+	uint32_t pad, val;
+	int i, c;
+
+	pad  = (uint32_t)len | ((uint32_t)len << 8);
+	pad |= pad << 16;
+
+	val = pad;
+	if (len > num * 4) {
+		len = num * 4;
+	}
+
+	for (i = 0; i < len; i++) {
+		c   = usign ? (int)(uchar8_t)msg[i] : (int)(signed char)msg[i];
+		val = c + (val << 8);
+		if ((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+
+	if (--num >= 0) {
+		*buf++ = val;
+	}
+	while (--num >= 0) {
+		*buf++ = pad;
+	}
+}
+
+/**
+ * Compute the hash of a directory entry name.
+ *
+ * \param name Name.
+ * \param len Name length.
+ * \param version Hash version (EXT2_HASH_*).
+ * \param seed Hash seed (from super block).
+ * \param hash Where hash will be stored.
+ * \return 1 on success, 0 if hash version is unknown.
+ */
+static int ext2_dirhash(const char *name, int len, int version,
+						uint32_t *seed, uint32_t *hash)
+{
+	uint32_t buf[4], in[8];
+	int i, usign;
+
+	buf[0] = 0x67452301;
+	buf[1] = 0xEFCDAB89;
+	buf[2] = 0x98BADCFE;
+	buf[3] = 0x10325476;
+
+	/* Use seed if it is not zero */
+	for (i = 0; i < 4; i++) {
+		if (seed[i] != 0) {
+			break;
+		}
+	}
+	if (i < 4) {
+		memcpy(buf, seed, sizeof(buf));
+	}
+
+	usign = (version >= EXT2_HASH_LEGACY_UNSIGNED);
+
+	switch (version) {
+		case EXT2_HASH_LEGACY:
+		case EXT2_HASH_LEGACY_UNSIGNED:
+			*hash = dx_hack_hash(name, len, usign);
+			break;
+
+		case EXT2_HASH_HALF_MD4:
+		case EXT2_HASH_HALF_MD4_UNSIGNED:
+			while (len > 0) {
+				str2hashbuf(name, len, in, 8, usign);
+				half_md4_transform(buf, in);
+				len  -= 32;
+				name += 32;
+			}
+			*hash = buf[1];
+			break;
+
+		case EXT2_HASH_TEA:
+		case EXT2_HASH_TEA_UNSIGNED:
+			while (len > 0) {
+				str2hashbuf(name, len, in, 4, usign);
+				tea_transform(buf, in);
+				len  -= 16;
+				name += 16;
+			}
+			*hash = buf[0];
+			break;
+
+		default:
+			return 0;
+	}
+
+	/* Last hash value is reserved as end of directory mark */
+	*hash &= ~1;
+	if (*hash == 0xFFFFFFFE) {
+		*hash = 0xFFFFFFFC;
+	}
+
+	return 1;
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: extents.c
+ * Desc: Extent tree (ext4) block mapping for EXT2 driver
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/kernel.h>
+#include <fs/vfs.h>
+#include <fs/ext2/ext2.h>
+#include <string.h>
+
+/* Prototypes */
+static int ext_check_header(ext4_extent_header_t *eh, uint32_t size);
+
+
+/**
+ * Check an extent tree node header.
+ *
+ * \param eh Node header.
+ * \param size Node size (in bytes).
+ * \return 1 if header is valid, 0 otherwise.
+ */
+static int ext_check_header(ext4_extent_header_t *eh, uint32_t size)
+{
+	uint32_t max;
+
+	max = (size - sizeof(ext4_extent_header_t)) / sizeof(ext4_extent_t);
+
+	return (eh->eh_magic == EXT4_EXT_MAGIC && eh->eh_depth <= EXT4_EXT_MAX_DEPTH &&
+			eh->eh_max <= max && eh->eh_entries <= eh->eh_max);
+}
+
+/**
+ * Map file logic block of an extent mapped i-node. Index and leaf
+ * nodes are searched by binary search, and the extent found is kept
+ * at i-node block map cache, so blocks of a contiguous file are
+ * mapped with no metadata reads.
+ *
+ * \param inode i-node.
+ * \param lblk File logic block.
+ * \return uint32_t Block number, 0 on holes (and uninitialized extents).
+ */
+uint32_t ext4_ext_bmap(vfs_inode *inode, uint32_t lblk)
+{
+	ext4_extent_header_t *eh;
+	ext4_extent_idx_t *idx;
+	ext4_extent_t *ext;
+	uint32_t blk_size, size, len, pblk, next;
+	char *block;
+	int lo, hi, mid, depth;
+
+	blk_size = inode->sb->s_log_block_size;
+	block    = NULL;
+	eh       = (ext4_extent_header_t*)inode->i_block;
+	size     = sizeof(inode->i_block);
+	pblk     = 0;
+
+	for (depth = -1; ; ) {
+		if (!ext_check_header(eh, size) || (depth >= 0 && eh->eh_depth != depth)) {
+			kprintf(KERN_ERROR "ext2: i-node %d: bad extent tree.\n", inode->number);
+			break;
+		}
+		if (eh->eh_entries == 0) {
+			break;
+		}
+		depth = eh->eh_depth;
+
+		/* Last entry starting at or before lblk */
+		lo = 0;
+		hi = eh->eh_entries - 1;
+		if (depth > 0) {
+			idx = (ext4_extent_idx_t*)(eh + 1);
+			if (lblk < idx[0].ei_block) {
+				break;
+			}
+			while (lo < hi) {
+				mid = (lo + hi + 1) / 2;
+				if (idx[mid].ei_block <= lblk) {
+					lo = mid;
+				} else {
+					hi = mid - 1;
+				}
+			}
+			if (idx[lo].ei_leaf_hi != 0) {
+				kprintf(KERN_ERROR "ext2: i-node %d: block above 32 bits.\n", inode->number);
+				break;
+			}
+			next = idx[lo].ei_leaf_lo;
+
+			/* Go down into next level */
+			if (block != NULL) {
+				kfree(block);
+			}
+			if ((block = ext2_get_fs_block(inode->sb, next)) == NULL) {
+				break;
+			}
+			eh    = (ext4_extent_header_t*)block;
+			size  = blk_size;
+			depth--;
+			continue;
+		}
+
+		ext = (ext4_extent_t*)(eh + 1);
+		if (lblk < ext[0].ee_block) {
+			break;
+		}
+		while (lo < hi) {
+			mid = (lo + hi + 1) / 2;
+			if (ext[mid].ee_block <= lblk) {
+				lo = mid;
+			} else {
+				hi = mid - 1;
+			}
+		}
+
+		/* Uninitialized extents are read as zeros (holes) */
+		len = ext[lo].ee_len;
+		if (len > EXT4_EXT_INIT_MAX_LEN || lblk >= ext[lo].ee_block + len) {
+			break;
+		}
+		if (ext[lo].ee_start_hi != 0) {
+			kprintf(KERN_ERROR "ext2: i-node %d: block above 32 bits.\n", inode->number);
+			break;
+		}
+
+		/* Keep the whole extent at block map cache */
+		inode->i_ext_lblk = ext[lo].ee_block;
+		inode->i_ext_pblk = ext[lo].ee_start_lo;
+		inode->i_ext_len  = len;
+
+		pblk = ext[lo].ee_start_lo + (lblk - ext[lo].ee_block);
+		break;
+	}
+
+	if (block != NULL) {
+		kfree(block);
+	}
+	return pblk;
+}
+
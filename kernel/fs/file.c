@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: file.c
+ * Desc: Open files (system's file table and file descriptors)
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/kernel.h>
+#include <tempos/sched.h>
+#include <fs/vfs.h>
+#include <arch/io.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+
+/* Prototypes */
+static vfs_file *file_alloc(void);
+
+
+/**
+ * Get a free entry of system's file table.
+ *
+ * \return vfs_file* Entry (with one reference), or NULL if table is full.
+ */
+static vfs_file *file_alloc(void)
+{
+	vfs_file *file;
+	int i;
+
+	cli();
+	for (i = 0; i < VFS_MAX_OPEN_FILES; i++) {
+		file = &file_table[i];
+		if (file->f_count == 0) {
+			file->f_count = 1;
+			sti();
+			return file;
+		}
+	}
+	sti();
+
+	return NULL;
+}
+
+/**
+ * Open a file.
+ *
+ * \param pathname File path name.
+ * \param flags Open flags (O_RDONLY, O_WRONLY, O_RDWR, O_CREAT, O_APPEND,
+ *              O_DIRECT).
+ * \param mode Permissions of a new file (O_CREAT).
+ * \return vfs_file* Open file, or NULL on error.
+ */
+vfs_file *vfs_open(const char *pathname, int flags, uint16_t mode)
+{
+	vfs_inode *inode;
+	vfs_file *file;
+
+	if ((inode = vfs_namei(pathname)) == NULL) {
+		if (!(flags & O_CREAT)) {
+			return NULL;
+		}
+		if ((inode = vfs_create(pathname, S_IFREG | (mode & ~S_IFMT))) == NULL) {
+			return NULL;
+		}
+	}
+
+	/* Directories are not written through files */
+	if ((inode->i_mode & S_IFMT) == S_IFDIR && (flags & O_ACCMODE) != O_RDONLY) {
+		vfs_iput(inode);
+		return NULL;
+	}
+
+	/* Direct I/O needs a block device under the file system */
+	if ((flags & O_DIRECT) && block_dev_drivers[inode->sb->device.major] == NULL) {
+		vfs_iput(inode);
+		return NULL;
+	}
+
+	if ((file = file_alloc()) == NULL) {
+		kprintf(KERN_ERROR "System's file table is full.\n");
+		vfs_iput(inode);
+		return NULL;
+	}
+
+	file->inode   = inode;
+	file->f_pos   = 0;
+	file->f_flags = flags;
+	memset(&file->f_ra, 0, sizeof(vfs_ra_state));
+
+	return file;
+}
+
+/**
+ * Duplicate a reference of an open file.
+ *
+ * \param file Open file.
+ * \return vfs_file* The same file.
+ */
+vfs_file *vfs_fdup(vfs_file *file)
+{
+	cli();
+	file->f_count++;
+	sti();
+
+	return file;
+}
+
+/**
+ * Release a reference of an open file. On last reference, file is
+ * closed and its i-node released.
+ *
+ * \param file Open file.
+ */
+void vfs_close(vfs_file *file)
+{
+	vfs_inode *inode = NULL;
+
+	cli();
+	if (--file->f_count == 0) {
+		inode = file->inode;
+		file->inode = NULL;
+	}
+	sti();
+
+	if (inode != NULL) {
+		vfs_iput(inode);
+	}
+}
+
+/**
+ * Change file offset.
+ *
+ * \param file Open file.
+ * \param offset Offset (bytes).
+ * \param whence SEEK_SET, SEEK_CUR or SEEK_END.
+ * \return New file offset, or -1 on error.
+ */
+int vfs_lseek(vfs_file *file, int32_t offset, int whence)
+{
+	int32_t pos;
+
+	switch (whence) {
+		case SEEK_SET:
+			pos = offset;
+			break;
+
+		case SEEK_CUR:
+			pos = (int32_t)file->f_pos + offset;
+			break;
+
+		case SEEK_END:
+			pos = (int32_t)file->inode->i_size + offset;
+			break;
+
+		default:
+			return -1;
+	}
+
+	if (pos < 0) {
+		return -1;
+	}
+	file->f_pos = pos;
+
+	return pos;
+}
+
+/**
+ * Install an open file into lowest free descriptor of current process.
+ *
+ * \param file Open file.
+ * \return File descriptor, or -1 if process's table is full.
+ */
+int fd_install(vfs_file *file)
+{
+	task_t *task = GET_TASK(cur_task);
+	int fd;
+
+	for (fd = 0; fd < PROCESS_MAX_FILES; fd++) {
+		if (task->files[fd] == NULL) {
+			task->files[fd] = file;
+			return fd;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Get the open file of a descriptor of current process.
+ *
+ * \param fd File descriptor.
+ * \return vfs_file* Open file, or NULL if descriptor is not valid.
+ */
+vfs_file *fd_get(int fd)
+{
+	if (fd < 0 || fd >= PROCESS_MAX_FILES) {
+		return NULL;
+	}
+	return GET_TASK(cur_task)->files[fd];
+}
+
+/**
+ * Close a file descriptor of current process.
+ *
+ * \param fd File descriptor.
+ * \return 0 on success, -1 if descriptor is not valid.
+ */
+int fd_close(int fd)
+{
+	task_t *task = GET_TASK(cur_task);
+	vfs_file *file;
+
+	if ((file = fd_get(fd)) == NULL) {
+		return -1;
+	}
+	task->files[fd] = NULL;
+	vfs_close(file);
+
+	return 0;
+}
+
+/**
+ * Close all file descriptors of a process.
+ *
+ * \param task Process.
+ */
+void fd_close_all(task_t *task)
+{
+	vfs_file *file;
+	int fd;
+
+	for (fd = 0; fd < PROCESS_MAX_FILES; fd++) {
+		if ((file = task->files[fd]) != NULL) {
+			task->files[fd] = NULL;
+			vfs_close(file);
+		}
+	}
+}
+
+/**
+ * Duplicate all file descriptors of a process (its table was copied
+ * from parent on fork, so each open file gets one more reference).
+ *
+ * \param task Process.
+ */
+void fd_dup_all(task_t *task)
+{
+	int fd;
+
+	for (fd = 0; fd < PROCESS_MAX_FILES; fd++) {
+		if (task->files[fd] != NULL) {
+			vfs_fdup(task->files[fd]);
+		}
+	}
+}
+
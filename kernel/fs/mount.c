@@ -27,6 +27,8 @@
 #include <tempos/sched.h>
 #include <fs/vfs.h>
 #include <fs/device.h>
+#include <fs/dcache.h>
+#include <string.h>
 
 /**
  * Mount root file system
@@ -62,8 +64,13 @@ int vfs_mount_root(dev_t device)
 	/* Mount table entry: first position */
 	mnt = &mount_table[0];
 
+	/* Names cached for a previous super block of device are stale */
+	dcache_purge_dev(device);
+
 	/* Read file system super block */
-	fs->get_sb(device, &mnt->sb);
+	if ( !fs->get_sb(device, &mnt->sb) ) {
+		return 0;
+	}
 
 	/* Get root i-node */
 	root = vfs_iget(&mnt->sb, 0);
@@ -94,3 +101,128 @@ int vfs_mount_root(dev_t device)
 	return 1;
 }
 
+
+/**
+ * Mount a file system on a directory.
+ *
+ * \param fsname File system type name.
+ * \param device Device.
+ * \param path Directory path name.
+ * \return 1 on success, 0 otherwise.
+ */
+int vfs_mount(const char *fsname, dev_t device, const char *path)
+{
+	vfs_fs_type *fs = NULL;
+	vfs_mount_table *mnt = NULL;
+	vfs_inode *dir, *root;
+	int i;
+
+	for (i = 0; i < VFS_SUPPORTED_FS; i++) {
+		if (vfs_filesystems[i] != NULL && strcmp(vfs_filesystems[i]->name, fsname) == 0) {
+			fs = vfs_filesystems[i];
+			break;
+		}
+	}
+	if (fs == NULL || !fs->check_fs_type(device)) {
+		kprintf(KERN_ERROR "VFS: unknown file system %s.\n", fsname);
+		return 0;
+	}
+
+	/* First entry is the root file system */
+	for (i = 1; i < VFS_MAX_MOUNTED_FS; i++) {
+		if (mount_table[i].root_inode == NULL) {
+			mnt = &mount_table[i];
+			break;
+		}
+	}
+	if (mnt == NULL) {
+		return 0;
+	}
+
+	if ((dir = vfs_namei(path)) == NULL) {
+		kprintf(KERN_ERROR "VFS: %s not found.\n", path);
+		return 0;
+	}
+	if ( !(dir->i_mode & S_IFDIR) || (dir->flags & IFLAG_MOUNT_POINT) ) {
+		vfs_iput(dir);
+		return 0;
+	}
+
+	dcache_purge_dev(device);
+	if ( !fs->get_sb(device, &mnt->sb) ) {
+		vfs_iput(dir);
+		return 0;
+	}
+	if ((root = vfs_iget(&mnt->sb, 0)) == NULL) {
+		vfs_iput(dir);
+		return 0;
+	}
+
+	/* Both i-nodes are kept (referenced) while mounted */
+	root->flags |= IFLAG_MOUNT_POINT;
+	dir->flags  |= IFLAG_MOUNT_POINT;
+
+	mnt->device       = device;
+	mnt->root_inode   = root;
+	mnt->mnt_on_inode = dir;
+	mnt->fs           = fs;
+	mnt->root_name    = fs->name;
+	mnt->mnt_on_name  = NULL;
+
+	kprintf("VFS: %s (%d,%d) mounted.\n", fs->name, device.major, device.minor);
+	return 1;
+}
+
+/**
+ * Cross a mount point: return root i-node of file system mounted on
+ * a directory (the directory reference is released).
+ *
+ * \param inode Directory i-node.
+ * \return Root i-node of mounted file system, or the same i-node.
+ */
+vfs_inode *vfs_mount_cross(vfs_inode *inode)
+{
+	vfs_inode *root;
+	int i;
+
+	if ( !(inode->flags & IFLAG_MOUNT_POINT) ) {
+		return inode;
+	}
+
+	for (i = 1; i < VFS_MAX_MOUNTED_FS; i++) {
+		if (mount_table[i].root_inode != NULL && mount_table[i].mnt_on_inode == inode) {
+			root = vfs_idup(mount_table[i].root_inode);
+			vfs_iput(inode);
+			return root;
+		}
+	}
+	return inode;
+}
+
+/**
+ * Leave a mounted file system upwards: for the root i-node of a
+ * mounted file system, return the directory where it's mounted on
+ * (so ".." is looked up there). The i-node reference is released.
+ *
+ * \param inode Directory i-node.
+ * \return Directory where file system is mounted on, or the same i-node.
+ */
+vfs_inode *vfs_mount_parent(vfs_inode *inode)
+{
+	vfs_inode *dir;
+	int i;
+
+	if ( !(inode->flags & IFLAG_MOUNT_POINT) ) {
+		return inode;
+	}
+
+	for (i = 1; i < VFS_MAX_MOUNTED_FS; i++) {
+		if (mount_table[i].root_inode == inode) {
+			dir = vfs_idup(mount_table[i].mnt_on_inode);
+			vfs_iput(inode);
+			return dir;
+		}
+	}
+	return inode;
+}
+
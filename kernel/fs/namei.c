@@ -24,26 +24,35 @@
 
 #include <tempos/kernel.h>
 #include <tempos/sched.h>
+#include <tempos/delay.h>
+#include <tempos/timer.h>
 #include <fs/vfs.h>
+#include <fs/dcache.h>
+#include <fs/blkstat.h>
+#include <arch/io.h>
 #include <string.h>
 
 /* Prototypes */
 
-static vfs_inode *_vfs_find_component(vfs_inode *inode, char *component);
+static int _vfs_find_component(vfs_inode *inode, char *component, uint32_t *ino);
+
+static vfs_inode *_vfs_parent(const char *pathname, char *name);
 
 
 /**
  * Convert path name to i-node.
  *
  * \param pathname Path name.
- * \return NULL if path name is invalid, or the i-node (locked) otherwise.
+ * \return NULL if path name is invalid, or the i-node otherwise.
+ * \note The returned i-node should be released by vfs_iput().
  */
 vfs_inode *vfs_namei(const char *pathname)
 {
 	char comp[VFS_NAME_LEN], isroot;
-	vfs_inode *inode;
+	vfs_inode *inode, *next;
 	task_t *current_task;
 	size_t i, start, clen;
+	uint32_t ino;
 	
 	current_task = GET_TASK(cur_task);
 
@@ -54,6 +63,7 @@ vfs_inode *vfs_namei(const char *pathname)
 		inode  = current_task->i_cdir;
 		isroot = 0;
 	}
+	vfs_idup(inode);
 
 	start = 1;
 	for (i = 1; i <= strlen(pathname); i++) {
@@ -67,39 +77,245 @@ vfs_inode *vfs_namei(const char *pathname)
 				continue;
 			}
 
-			if (strcmp(comp, "..") == 0 && isroot) {
-				continue;
+			if (strcmp(comp, "..") == 0) {
+				if (isroot) {
+					continue;
+				}
+				/* ".." of a mounted file system's root */
+				inode = vfs_mount_parent(inode);
+			}
+
+			if ( !(inode->i_mode & S_IFDIR) ) {
+				vfs_iput(inode);
+				return NULL;
+			}
+
+			/* Look at directory entry cache first */
+			switch (dcache_lookup(inode, comp, &ino)) {
+				case DCACHE_NEGATIVE:
+					vfs_iput(inode);
+					return NULL;
+
+				case DCACHE_MISS:
+					/* Find component at i-node directory */
+					switch (_vfs_find_component(inode, comp, &ino)) {
+						case 1:
+							dcache_add(inode, comp, ino);
+							break;
+						case 0:
+							/* Only a real miss is cached (negative entry) */
+							dcache_add(inode, comp, 0);
+							vfs_iput(inode);
+							return NULL;
+						default:
+							vfs_iput(inode);
+							return NULL;
+					}
+					break;
 			}
 
-			/* Find component at i-node directory */
-			if ((inode = _vfs_find_component(inode, comp)) == NULL) {
+			/* Release intermediate directory */
+			next = vfs_iget(inode->sb, ino);
+			vfs_iput(inode);
+			if (next == NULL) {
 				return NULL;
 			}
+			inode = vfs_mount_cross(next);
 		}
 	}
 
 	return inode;
 }
 
+/**
+ * Create a new (empty) file.
+ *
+ * \param pathname Path name.
+ * \param mode File mode (type and permissions).
+ * \return NULL if file could not be created, or the new i-node otherwise.
+ * \note The returned i-node should be released by vfs_iput().
+ */
+vfs_inode *vfs_create(const char *pathname, uint16_t mode)
+{
+	char name[VFS_NAME_LEN];
+	vfs_inode *dir, *inode, tmp;
+	vfs_superblock *sb;
+	uint32_t ino;
+	size_t i;
+
+	if ((dir = _vfs_parent(pathname, name)) == NULL) {
+		return NULL;
+	}
+
+	sb = dir->sb;
+	if ((sb->flags & SB_RDONLY) || sb->sb_op->alloc_inode == NULL ||
+		sb->sb_op->link == NULL || _vfs_find_component(dir, name, &ino) != 0) {
+		vfs_iput(dir);
+		return NULL;
+	}
+
+	/* Alloc i-node near its parent */
+	tmp.number = dir->number;
+	tmp.i_mode = mode;
+	if (!sb->sb_op->alloc_inode(sb, &tmp)) {
+		vfs_iput(dir);
+		return NULL;
+	}
+
+	if ((inode = vfs_iget(sb, tmp.number)) == NULL) {
+		vfs_iput(dir);
+		return NULL;
+	}
+
+	inode->i_mode        = mode;
+	inode->i_uid         = 0;
+	inode->i_gid         = 0;
+	inode->i_size        = 0;
+	inode->i_links_count = 1;
+	inode->i_blocks      = 0;
+	inode->i_flags       = 0;
+	inode->flags        &= ~IFLAG_FS_BMAP;
+	inode->i_atime = inode->i_ctime = inode->i_mtime = get_seconds();
+	for (i = 0; i < 15; i++) {
+		inode->i_block[i] = 0;
+	}
+	vfs_bmap_invalidate(inode);
+	vfs_mark_dirty(inode);
+
+	if (!sb->sb_op->link(dir, name, inode)) {
+		/* vfs_iput() frees it */
+		inode->i_links_count = 0;
+		vfs_iput(inode);
+		vfs_iput(dir);
+		return NULL;
+	}
+
+	dcache_invalidate(dir, name);
+	dir->i_mtime = dir->i_ctime = inode->i_ctime;
+	vfs_mark_dirty(dir);
+	vfs_iput(dir);
+	return inode;
+}
+
+/**
+ * Remove a file name. File is deleted when it has no more names
+ * and it's not in use.
+ *
+ * \param pathname Path name.
+ * \return 0 on success, -1 otherwise.
+ */
+int vfs_unlink(const char *pathname)
+{
+	char name[VFS_NAME_LEN];
+	vfs_inode *dir, *inode;
+	vfs_superblock *sb;
+	uint32_t ino;
+
+	if ((dir = _vfs_parent(pathname, name)) == NULL) {
+		return -1;
+	}
+
+	sb = dir->sb;
+	if ((sb->flags & SB_RDONLY) || sb->sb_op->unlink == NULL || _vfs_find_component(dir, name, &ino) != 1 ||
+		(inode = vfs_iget(sb, ino)) == NULL) {
+		vfs_iput(dir);
+		return -1;
+	}
+
+	/* Directories are not removed here */
+	if ((inode->i_mode & S_IFMT) == S_IFDIR || !sb->sb_op->unlink(dir, name)) {
+		vfs_iput(inode);
+		vfs_iput(dir);
+		return -1;
+	}
+	dcache_invalidate(dir, name);
+	dir->i_mtime = dir->i_ctime = get_seconds();
+	vfs_mark_dirty(dir);
+
+	inode->i_links_count--;
+	inode->i_ctime = dir->i_ctime;
+	vfs_mark_dirty(inode);
+
+	vfs_iput(inode);
+	vfs_iput(dir);
+	return 0;
+}
+
+/**
+ * Find parent directory of a path name.
+ *
+ * \param pathname Path name.
+ * \param name Buffer to last component of path name.
+ * \return Parent directory i-node (released by vfs_iput()), or NULL
+ *         if it's not a directory.
+ */
+static vfs_inode *_vfs_parent(const char *pathname, char *name)
+{
+	char parent[VFS_NAME_LEN];
+	vfs_inode *dir;
+	size_t len, i;
+	int last;
+
+	len = strlen(pathname);
+	while (len > 1 && pathname[len-1] == '/') {
+		len--;
+	}
+	if (len == 0 || len >= VFS_NAME_LEN) {
+		return NULL;
+	}
+
+	/* Split parent directory and last component */
+	for (last = len - 1; last >= 0 && pathname[last] != '/'; last--);
+
+	i = len - (last + 1);
+	if (i == 0) {
+		return NULL;
+	}
+	strncpy(name, &pathname[last + 1], i);
+	name[i] = '\0';
+
+	if (last < 0) {
+		dir = GET_TASK(cur_task)->i_cdir;
+		vfs_idup(dir);
+	} else {
+		i = (last == 0 ? 1 : last);
+		strncpy(parent, pathname, i);
+		parent[i] = '\0';
+		if ((dir = vfs_namei(parent)) == NULL) {
+			return NULL;
+		}
+	}
+
+	if ( !(dir->i_mode & S_IFDIR) ) {
+		vfs_iput(dir);
+		return NULL;
+	}
+	return dir;
+}
+
 /**
  * Find component directory entry in i-node.
  *
  * \param inode Direcroty i-node to search.
  * \param component Component name.
- * \return Component i-node (if was found), or NULL otherwise.
+ * \param ino Component i-node number (returned).
+ * \return 1 if component was found, 0 if it doesn't exist, -1 on error
+ *         (directory could not be read).
  */
-static vfs_inode *_vfs_find_component(vfs_inode *inode, char *component)
+static int _vfs_find_component(vfs_inode *inode, char *component, uint32_t *ino)
 {
 	uint32_t dirsize, blk_size, pos, bpos, oldpos;
 	char *block;
 	vfs_directory dir;
 	vfs_superblock *sb;
 	vfs_bmap_t bmap;
-	vfs_inode *newinode;
+	uint32_t newinode;
+
+	*ino = 0;
 
 	/* Check if i-node is a directory */
 	if ( !(inode->i_mode & S_IFDIR) ) {
-		return NULL;
+		return -1;
 	} else {
 		/* Get information */
 		sb       = inode->sb;
@@ -107,15 +323,27 @@ static vfs_inode *_vfs_find_component(vfs_inode *inode, char *component)
 		blk_size = inode->sb->s_log_block_size;
 	}
 
+	/* Let file system use its directory index (if any) */
+	if (sb->sb_op->lookup != NULL) {
+		switch (sb->sb_op->lookup(inode, component, &newinode)) {
+			case 1:
+				*ino = newinode;
+				return 1;
+			case 0:
+				return 0;
+		}
+	}
+
 	/* Read directory contents */
 	pos      = 0;
 	bpos     = 0;
-	newinode = NULL;
-	while (pos < dirsize) {
+	newinode = 0;
+	while (pos < dirsize && newinode == 0) {
 		bmap = vfs_bmap(inode, pos);
 		block = sb->sb_op->get_fs_block(sb, bmap.blk_number);
 		if (block == NULL) {
-			break;
+			/* Read error: name may exist, don't report a miss */
+			return -1;
 		} else {
 			bpos = bmap.blk_offset;
 		}
@@ -126,12 +354,17 @@ static vfs_inode *_vfs_find_component(vfs_inode *inode, char *component)
 			memcpy(&dir.inode, &block[bpos], sizeof(uint32_t));
 			bpos += sizeof(uint32_t);
 			
-			if (dir.inode == 0) {
-				break;
-			}
-
 			memcpy(&dir.rec_len, &block[bpos], sizeof(uint16_t));
 			bpos += sizeof(uint16_t);
+
+			if (dir.rec_len == 0) {
+				break;
+			} else if (dir.inode == 0) {
+				/* Unused entry (or index node), skip it */
+				oldpos += dir.rec_len;
+				bpos = oldpos;
+				continue;
+			}
 			
 			memcpy(&dir.name_len, &block[bpos], sizeof(uchar8_t));
 			/* skip file type, not necessary here */
@@ -145,17 +378,82 @@ static vfs_inode *_vfs_find_component(vfs_inode *inode, char *component)
 
 			if (strcmp(dir.name, component) == 0) {
 				/* Component found! */
-				newinode = vfs_iget(inode->sb, dir.inode);
-				/* TODO: iput current inode */
-				/* vfs_iput(inode->sb, inode); */
+				newinode = dir.inode;
 				break;
 			}
 		}
 
+		/* Next lookups probably are for the neighbours (directory scan) */
+		if (newinode != 0 && sb->sb_op->prefetch_inodes != NULL) {
+			sb->sb_op->prefetch_inodes(inode, block);
+		}
+
 		pos += blk_size;
 		kfree(block);
 	}
 
-	return newinode;
+	*ino = newinode;
+	return (newinode != 0 ? 1 : 0);
 }
 
+/**
+ * Directory lookup benchmark. Looks up names generated by
+ * rootfs/gen_bigdir_img.sh (f00000, f00001, ...) into a directory
+ * and prints the average lookup time and device reads.
+ *
+ * \param dirname Directory path name.
+ * \param nfiles Number of entries of the directory.
+ * \param all Look up every entry in order (directory scan, like
+ *            "ls -l") instead of a sample spread over the directory.
+ */
+void vfs_namei_bench(const char *dirname, uint32_t nfiles, int all)
+{
+	char path[VFS_NAME_LEN];
+	blk_iostat_t before, after;
+	vfs_inode *inode;
+	uint64_t start;
+	uint32_t i, n, step, usecs, found, major;
+	size_t len;
+
+	if ((inode = vfs_namei(dirname)) == NULL) {
+		kprintf(KERN_ERROR "namei bench: %s not found.\n", dirname);
+		return;
+	}
+	major = inode->device.major;
+	vfs_iput(inode);
+
+	len = strlen(dirname);
+	if (len + 8 >= VFS_NAME_LEN || nfiles == 0) {
+		return;
+	}
+	strcpy(path, dirname);
+	path[len++] = '/';
+	path[len]   = 'f';
+	path[len+6] = '\0';
+
+	/* Sample names spread over whole directory */
+	step = (nfiles > 1000 && !all ? nfiles / 1000 : 1);
+
+	blkstat_get(major, &before);
+	usecs = found = n = 0;
+	for (i = 0; i < nfiles; i += step, n++) {
+		path[len+1] = '0' + ((i / 10000) % 10);
+		path[len+2] = '0' + ((i / 1000) % 10);
+		path[len+3] = '0' + ((i / 100) % 10);
+		path[len+4] = '0' + ((i / 10) % 10);
+		path[len+5] = '0' + (i % 10);
+
+		start = read_tsc();
+		inode = vfs_namei(path);
+		usecs += tsc_to_usecs((uint32_t)(read_tsc() - start));
+
+		if (inode != NULL) {
+			found++;
+			vfs_iput(inode);
+		}
+	}
+	blkstat_get(major, &after);
+
+	kprintf(KERN_INFO "namei bench: %s: %d lookups, %d found, avg %d us, total %d ms, %d dev reads\n",
+			dirname, n, found, usecs / n, usecs / 1000, after.reads - before.reads);
+}
@@ -0,0 +1,489 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: pagecache.c
+ * Desc: Implements the page cache (file data)
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/kernel.h>
+#include <tempos/wait.h>
+#include <fs/vfs.h>
+#include <fs/pagecache.h>
+#include <arch/io.h>
+#include <string.h>
+
+/** Pages */
+static vfs_page pages[PAGECACHE_PAGES];
+
+/** Free pages (linked by lru_next) */
+static vfs_page *page_free;
+
+/** LRU list head: head->lru_next is the least recently used page */
+static vfs_page page_lru;
+
+/* Prototypes */
+static void **radix_lookup(vfs_inode *inode, uint32_t index, int create);
+
+static void radix_free(void **root, int height);
+
+static void lru_remove(vfs_page *page);
+
+static void lru_add_tail(vfs_page *page);
+
+static void page_detach(vfs_page *page, void ***root, int *height);
+
+static vfs_page *page_alloc(void);
+
+static int page_fill(vfs_inode *inode, vfs_page *page);
+
+
+/**
+ * Initialize page cache.
+ */
+void pagecache_init(void)
+{
+	int i;
+
+	page_free = NULL;
+	for (i = PAGECACHE_PAGES - 1; i >= 0; i--) {
+		pages[i].inode    = NULL;
+		pages[i].data     = NULL;
+		pages[i].count    = 0;
+		pages[i].flags    = 0;
+		init_waitqueue_head(&pages[i].wait);
+		pages[i].lru_prev = NULL;
+		pages[i].lru_next = page_free;
+		page_free = &pages[i];
+	}
+
+	page_lru.lru_next = &page_lru;
+	page_lru.lru_prev = &page_lru;
+}
+
+/**
+ * Find the slot of a page into i-node's radix tree.
+ *
+ * \param inode i-node.
+ * \param index Page number.
+ * \param create Create tree nodes when they don't exist.
+ * \return void** Slot, or NULL if it does not exist (or no memory).
+ * \note Interrupts should be disabled.
+ */
+static void **radix_lookup(vfs_inode *inode, uint32_t index, int create)
+{
+	void **node, **child;
+	int height;
+
+	height = (index >= PAGECACHE_RADIX_SLOTS ? 2 : 1);
+
+	/* Grow tree: old root becomes the first child of new root */
+	while (inode->i_pages_height < height) {
+		if (!create) {
+			return NULL;
+		}
+		node = (void**)kmalloc(PAGECACHE_RADIX_SLOTS * sizeof(void*), GFP_NORMAL_Z);
+		if (node == NULL) {
+			return NULL;
+		}
+		memset(node, 0, PAGECACHE_RADIX_SLOTS * sizeof(void*));
+		if (inode->i_pages_height > 0) {
+			node[0] = inode->i_pages;
+		}
+		inode->i_pages = node;
+		inode->i_pages_height++;
+	}
+
+	node = inode->i_pages;
+	if (inode->i_pages_height == 2) {
+		child = (void**)node[index >> PAGECACHE_RADIX_SHIFT];
+		if (child == NULL) {
+			if (!create) {
+				return NULL;
+			}
+			child = (void**)kmalloc(PAGECACHE_RADIX_SLOTS * sizeof(void*), GFP_NORMAL_Z);
+			if (child == NULL) {
+				return NULL;
+			}
+			memset(child, 0, PAGECACHE_RADIX_SLOTS * sizeof(void*));
+			node[index >> PAGECACHE_RADIX_SHIFT] = child;
+		}
+		node = child;
+	}
+
+	return &node[index & PAGECACHE_RADIX_MASK];
+}
+
+/**
+ * Release radix tree nodes.
+ *
+ * \param root Tree root.
+ * \param height Tree height.
+ */
+static void radix_free(void **root, int height)
+{
+	int i;
+
+	if (root == NULL) {
+		return;
+	}
+
+	if (height == 2) {
+		for (i = 0; i < PAGECACHE_RADIX_SLOTS; i++) {
+			if (root[i] != NULL) {
+				kfree(root[i]);
+			}
+		}
+	}
+	kfree(root);
+}
+
+/**
+ * Remove a page from LRU list.
+ *
+ * \param page Page.
+ */
+static void lru_remove(vfs_page *page)
+{
+	if (page->lru_next != NULL) {
+		page->lru_prev->lru_next = page->lru_next;
+		page->lru_next->lru_prev = page->lru_prev;
+		page->lru_next = NULL;
+		page->lru_prev = NULL;
+	}
+}
+
+/**
+ * Add a page to the tail (most recently used) of LRU list.
+ *
+ * \param page Page.
+ */
+static void lru_add_tail(vfs_page *page)
+{
+	page->lru_prev = page_lru.lru_prev;
+	page->lru_next = &page_lru;
+	page_lru.lru_prev->lru_next = page;
+	page_lru.lru_prev = page;
+}
+
+/**
+ * Remove a page from its i-node (interrupts disabled). When i-node has
+ * no more pages, its tree is detached and returned to be released.
+ *
+ * \param page Page.
+ * \param root Tree to be released (NULL if none).
+ * \param height Height of tree to be released.
+ */
+static void page_detach(vfs_page *page, void ***root, int *height)
+{
+	vfs_inode *inode = page->inode;
+	void **slot;
+
+	*root = NULL;
+	if (inode == NULL) {
+		return;
+	}
+
+	slot = radix_lookup(inode, page->index, 0);
+	if (slot != NULL && *slot == page) {
+		*slot = NULL;
+		if (--inode->i_npages == 0) {
+			*root   = inode->i_pages;
+			*height = inode->i_pages_height;
+			inode->i_pages = NULL;
+			inode->i_pages_height = 0;
+		}
+	}
+	page->inode = NULL;
+	page->flags = 0;
+}
+
+/**
+ * Get a free page, evicting the least recently used one if needed.
+ *
+ * \return vfs_page* Page (with data), or NULL if all pages are in use.
+ */
+static vfs_page *page_alloc(void)
+{
+	vfs_page *page;
+	void **root;
+	int height;
+
+	cli();
+	root = NULL;
+	if ((page = page_free) != NULL) {
+		page_free = page->lru_next;
+		page->lru_next = NULL;
+	} else if ((page = page_lru.lru_next) != &page_lru) {
+		lru_remove(page);
+		page_detach(page, &root, &height);
+	} else {
+		page = NULL;
+	}
+	sti();
+
+	if (root != NULL) {
+		radix_free(root, height);
+	}
+
+	if (page != NULL && page->data == NULL) {
+		/* Page aligned: pages can be mapped into user space (mmap) */
+		page->data = (char*)kmalloc_page(GFP_NORMAL_Z);
+		if (page->data == NULL) {
+			cli();
+			page->lru_next = page_free;
+			page_free = page;
+			sti();
+			return NULL;
+		}
+	}
+	return page;
+}
+
+/**
+ * Read a page from file, block by block (through file system block
+ * mapping, including blocks waiting for delayed allocation).
+ *
+ * \param inode i-node.
+ * \param page Page.
+ * \return 1 on success, 0 otherwise.
+ */
+static int page_fill(vfs_inode *inode, vfs_page *page)
+{
+	uint32_t blk_size, bpp, lblk, i;
+	int ret = 1;
+
+	blk_size = inode->sb->s_log_block_size;
+	bpp      = PAGE_SIZE / blk_size;
+	lblk     = page->index * bpp;
+
+	/* Serialize with writes */
+	vfs_ilock(inode);
+	for (i = 0; i < bpp; i++, lblk++) {
+		if ((lblk * blk_size) >= inode->i_size) {
+			memset(&page->data[i * blk_size], 0, blk_size);
+		} else if (vfs_read_block(inode, lblk, &page->data[i * blk_size]) < 0) {
+			ret = 0;
+			break;
+		}
+	}
+	vfs_iunlock(inode);
+
+	return ret;
+}
+
+/**
+ * Get a page of a file, reading it when it's not in cache.
+ *
+ * \param inode i-node.
+ * \param index Page number (file offset >> PAGE_SHIFT).
+ * \return vfs_page* Page, or NULL on error.
+ * \note Page should be released by pagecache_put().
+ */
+vfs_page *pagecache_get(vfs_inode *inode, uint32_t index)
+{
+	vfs_page *page;
+	void **slot;
+
+	if (inode->sb->s_log_block_size > PAGE_SIZE) {
+		return NULL;
+	}
+
+	while (1) {
+		cli();
+		slot = radix_lookup(inode, index, 0);
+		if (slot != NULL && *slot != NULL) {
+			/* Cache hit */
+			page = (vfs_page*)*slot;
+			if (page->count++ == 0) {
+				lru_remove(page);
+			}
+			while ( (page->flags & PG_LOCKED) ) {
+				sleep_on(&page->wait);
+				cli();
+			}
+			sti();
+
+			if ( !(page->flags & PG_UPTODATE) ) {
+				pagecache_put(page);
+				return NULL;
+			}
+			return page;
+		}
+		sti();
+
+		if ((page = page_alloc()) == NULL) {
+			kprintf(KERN_ERROR "page cache: all pages are in use.\n");
+			return NULL;
+		}
+
+		cli();
+		slot = radix_lookup(inode, index, 1);
+		if (slot == NULL || *slot != NULL) {
+			/* No memory, or page was added meanwhile */
+			page->lru_next = page_free;
+			page_free = page;
+			sti();
+			if (slot == NULL) {
+				return NULL;
+			}
+			continue;
+		}
+
+		/* Page goes to tree locked, until it's read */
+		*slot = page;
+		inode->i_npages++;
+		page->inode = inode;
+		page->index = index;
+		page->count = 1;
+		page->flags = PG_LOCKED;
+		sti();
+
+		if (page_fill(inode, page)) {
+			page->flags = PG_UPTODATE;
+			wakeup_all(&page->wait);
+			return page;
+		}
+
+		page->flags = 0;
+		wakeup_all(&page->wait);
+		pagecache_put(page);
+		return NULL;
+	}
+}
+
+/**
+ * Release a page. Unused pages stay in cache (LRU list).
+ *
+ * \param page Page.
+ */
+void pagecache_put(vfs_page *page)
+{
+	void **root = NULL;
+	int height;
+
+	cli();
+	if (--page->count == 0) {
+		if ( (page->flags & PG_UPTODATE) ) {
+			lru_add_tail(page);
+		} else {
+			/* Page could not be read */
+			page_detach(page, &root, &height);
+			page->lru_next = page_free;
+			page_free = page;
+		}
+	}
+	sti();
+
+	if (root != NULL) {
+		radix_free(root, height);
+	}
+}
+
+/**
+ * Check if a page of a file is in cache (without reading it).
+ *
+ * \param inode i-node.
+ * \param index Page number.
+ * \return 1 if page is cached, 0 otherwise.
+ */
+int pagecache_cached(vfs_inode *inode, uint32_t index)
+{
+	void **slot;
+	int ret;
+
+	cli();
+	slot = radix_lookup(inode, index, 0);
+	ret  = (slot != NULL && *slot != NULL);
+	sti();
+
+	return ret;
+}
+
+/**
+ * Update cached page with data being written to file.
+ *
+ * \param inode i-node.
+ * \param offset File offset.
+ * \param buf Data.
+ * \param len Data length (should not cross a page).
+ * \note Caller should hold the i-node lock.
+ */
+void pagecache_write(vfs_inode *inode, uint32_t offset, char *buf, uint32_t len)
+{
+	vfs_page *page;
+	void **slot;
+
+	if (inode->i_npages == 0) {
+		return;
+	}
+
+	cli();
+	slot = radix_lookup(inode, offset >> PAGE_SHIFT, 0);
+	if (slot != NULL && (page = (vfs_page*)*slot) != NULL &&
+		(page->flags & PG_UPTODATE)) {
+		memcpy(&page->data[offset & (PAGE_SIZE - 1)], buf, len);
+	}
+	sti();
+}
+
+/**
+ * Drop all cached pages of an i-node (i-node is being released).
+ *
+ * \param inode i-node.
+ */
+void pagecache_invalidate(vfs_inode *inode)
+{
+	void **root = NULL, **slot;
+	vfs_page *page;
+	uint32_t i, max;
+	int height;
+
+	if (inode->i_npages == 0) {
+		return;
+	}
+
+	max = (inode->i_pages_height == 2 ? PAGECACHE_RADIX_SLOTS * PAGECACHE_RADIX_SLOTS :
+										PAGECACHE_RADIX_SLOTS);
+	cli();
+	for (i = 0; i < max && inode->i_npages > 0; i++) {
+		/* Skip empty subtrees */
+		if ((slot = radix_lookup(inode, i, 0)) == NULL) {
+			i |= PAGECACHE_RADIX_MASK;
+			continue;
+		}
+		if ((page = (vfs_page*)*slot) == NULL) {
+			continue;
+		}
+		if (page->count > 0) {
+			kprintf(KERN_ERROR "page cache: dropping page in use.\n");
+		}
+		lru_remove(page);
+		page_detach(page, &root, &height);
+		page->count    = 0;
+		page->lru_next = page_free;
+		page_free = page;
+	}
+	sti();
+
+	if (root != NULL) {
+		radix_free(root, height);
+	}
+}
+
@@ -47,7 +47,10 @@ part_table_st *parse_mbr(dev_blk_driver_t blk_drv, int device)
 
 
 	/* Read MBR */
-	sec.addr = 0;
+	sec.addr   = 0;
+	sec.direct = NULL;
+	init_waitqueue_head(&sec.wait);
+	init_waitqueue_head(&sec.io_wait);
 	blk_drv.dev_ops->read_sync_block(blk_drv.major, device, &sec);
 	memcpy(&mbr, sec.data, sizeof(mbr));
 
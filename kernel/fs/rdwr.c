@@ -0,0 +1,1420 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: rdwr.c
+ * Desc: Read and write file contents (VFS).
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/kernel.h>
+#include <tempos/sched.h>
+#include <tempos/delay.h>
+#include <tempos/timer.h>
+#include <fs/vfs.h>
+#include <fs/blkstat.h>
+#include <fs/pagecache.h>
+#include <fs/bhash.h>
+#include <arch/io.h>
+#include <arch/uaccess.h>
+#include <fcntl.h>
+#include <string.h>
+
+/** Maximum number of files of read/write benchmark */
+#define RW_BENCH_MAX_FILES 8
+
+/** Size of each write of read/write benchmark */
+#define RW_BENCH_CHUNK     4096
+
+/** Size of temporary file of read/write benchmark */
+#define RW_BENCH_TMP_KB    256
+
+/** Maximum number of user pages of a direct I/O batch */
+#define DIO_MAX_PAGES      8
+
+/** Maximum number of sectors of a direct I/O batch */
+#define DIO_MAX_SECTORS    ((DIO_MAX_PAGES * PAGE_SIZE) / BUFF_SIZE)
+
+/** Read/write benchmark thread information */
+struct _rw_bench_st {
+	vfs_inode *inode;
+	uint32_t bytes;
+	char *buf;
+	int error;
+};
+
+
+/** Blocks for delayed allocation */
+static vfs_dirty_blk dirty_pool[VFS_DIRTY_BLOCKS];
+
+/** Free blocks of dirty_pool */
+static vfs_dirty_blk *dirty_free;
+
+/** Maximum read ahead window (in pages), 0 disables read ahead */
+static uint32_t ra_max_pages = VFS_RA_MAX_PAGES;
+
+
+/* Prototypes */
+static vfs_dirty_blk *dirty_find(vfs_inode *inode, uint32_t lblk);
+
+static vfs_dirty_blk *dirty_add(vfs_inode *inode, uint32_t lblk);
+
+static void dirty_release(vfs_dirty_blk *dblk);
+
+static int reserve_block(vfs_superblock *sb);
+
+static void unreserve_blocks(vfs_superblock *sb, uint32_t count);
+
+static int writeback_locked(vfs_inode *inode);
+
+static void readahead_issue(vfs_inode *inode, uint32_t index, uint32_t npages);
+
+static void readahead(vfs_inode *inode, vfs_ra_state *ra, uint32_t index, uint32_t npages);
+
+static int readi(vfs_inode *inode, vfs_ra_state *ra, char *buf,
+				 uint32_t offset, uint32_t count, int user);
+
+static int writef(vfs_file *file, char *buf, uint32_t count, uint32_t *pos);
+
+static int dio_map(char *buf, uint32_t len, int write, char **kpages);
+
+static void dio_unmap(char **kpages, uint32_t npages);
+
+static int dio_alloc(vfs_inode *inode, uint32_t offset, uint32_t len);
+
+static int direct_io(vfs_file *file, char *buf, uint32_t count,
+					 uint32_t offset, int write);
+
+
+/**
+ * Initialize delayed allocation blocks.
+ */
+void vfs_delalloc_init(void)
+{
+	int i;
+
+	dirty_free = NULL;
+	for (i = VFS_DIRTY_BLOCKS - 1; i >= 0; i--) {
+		dirty_pool[i].data = NULL;
+		dirty_pool[i].next = dirty_free;
+		dirty_free = &dirty_pool[i];
+	}
+}
+
+/**
+ * Find a delayed block of an i-node.
+ *
+ * \param inode i-node.
+ * \param lblk File logic block.
+ * \return vfs_dirty_blk* Block, or NULL if there is no delayed block.
+ */
+static vfs_dirty_blk *dirty_find(vfs_inode *inode, uint32_t lblk)
+{
+	vfs_dirty_blk *dblk;
+
+	/* Appends hit the last block */
+	if (inode->i_dirty_tail == NULL || inode->i_dirty_tail->lblk < lblk) {
+		return NULL;
+	}
+
+	for (dblk = inode->i_dirty; dblk != NULL && dblk->lblk <= lblk; dblk = dblk->next) {
+		if (dblk->lblk == lblk) {
+			return dblk;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Add a delayed block to an i-node (keeping list sorted).
+ *
+ * \param inode i-node.
+ * \param lblk File logic block.
+ * \return vfs_dirty_blk* New block, or NULL if there is no free block.
+ */
+static vfs_dirty_blk *dirty_add(vfs_inode *inode, uint32_t lblk)
+{
+	vfs_dirty_blk *dblk, *prev;
+
+	cli();
+	dblk = dirty_free;
+	if (dblk != NULL) {
+		dirty_free = dblk->next;
+	}
+	sti();
+
+	if (dblk == NULL) {
+		return NULL;
+	}
+
+	dblk->data = (char*)kmalloc(inode->sb->s_log_block_size, GFP_NORMAL_Z);
+	if (dblk->data == NULL) {
+		dirty_release(dblk);
+		return NULL;
+	}
+	dblk->lblk = lblk;
+
+	if (inode->i_dirty_tail == NULL || inode->i_dirty_tail->lblk < lblk) {
+		/* Append */
+		dblk->next = NULL;
+		if (inode->i_dirty_tail != NULL) {
+			inode->i_dirty_tail->next = dblk;
+		} else {
+			inode->i_dirty = dblk;
+		}
+		inode->i_dirty_tail = dblk;
+	} else if (inode->i_dirty->lblk > lblk) {
+		dblk->next = inode->i_dirty;
+		inode->i_dirty = dblk;
+	} else {
+		for (prev = inode->i_dirty; prev->next->lblk < lblk; prev = prev->next);
+		dblk->next = prev->next;
+		prev->next = dblk;
+	}
+
+	return dblk;
+}
+
+/**
+ * Return a delayed block to the pool.
+ *
+ * \param dblk Block.
+ */
+static void dirty_release(vfs_dirty_blk *dblk)
+{
+	if (dblk->data != NULL) {
+		kfree(dblk->data);
+		dblk->data = NULL;
+	}
+
+	cli();
+	dblk->next = dirty_free;
+	dirty_free = dblk;
+	sti();
+}
+
+/**
+ * Reserve a block of file system for delayed allocation.
+ *
+ * \param sb Super block.
+ * \return 1 on success, 0 if file system is full.
+ */
+static int reserve_block(vfs_superblock *sb)
+{
+	cli();
+	if (sb->s_free_blocks_count == 0) {
+		sti();
+		return 0;
+	}
+	sb->s_free_blocks_count--;
+	sb->s_reserved_blocks++;
+	sti();
+
+	return 1;
+}
+
+/**
+ * Release blocks reserved for delayed allocation.
+ *
+ * \param sb Super block.
+ * \param count Number of blocks.
+ */
+static void unreserve_blocks(vfs_superblock *sb, uint32_t count)
+{
+	cli();
+	sb->s_reserved_blocks   -= count;
+	sb->s_free_blocks_count += count;
+	sti();
+}
+
+/**
+ * Allocate and write delayed blocks of an i-node (i-node locked).
+ * Each run of contiguous logic blocks is allocated at once, so it
+ * can be placed contiguously on disk.
+ *
+ * \param inode i-node.
+ * \return 0 on success, -1 on error.
+ */
+static int writeback_locked(vfs_inode *inode)
+{
+	vfs_superblock *sb = inode->sb;
+	vfs_dirty_blk *dblk, *end;
+	uint32_t run, pblk, iblocks;
+	int ret = 0;
+
+	if (inode->i_dirty == NULL) {
+		return 0;
+	}
+
+	while ((dblk = inode->i_dirty) != NULL) {
+		/* Length of the run starting here */
+		for (run = 1, end = dblk; end->next != NULL &&
+			 end->next->lblk == end->lblk + 1; end = end->next, run++);
+
+		for (; run > 0; run--) {
+			dblk = inode->i_dirty;
+
+			/* Reservation becomes a real allocation */
+			unreserve_blocks(sb, 1);
+			iblocks = inode->i_blocks;
+			if ((pblk = sb->sb_op->bmap(inode, dblk->lblk, run)) == 0) {
+				reserve_block(sb);
+				ret = -1;
+				break;
+			}
+			if (iblocks != inode->i_blocks && dblk->lblk >= VFS_NDIR_BLOCKS) {
+				vfs_bmap_invalidate(inode);
+			}
+
+			if (!sb->sb_op->put_fs_block(sb, pblk, dblk->data)) {
+				ret = -1;
+			}
+
+			inode->i_dirty = dblk->next;
+			dirty_release(dblk);
+		}
+
+		if (ret < 0) {
+			break;
+		}
+	}
+
+	if (inode->i_dirty == NULL) {
+		inode->i_dirty_tail = NULL;
+	}
+	vfs_mark_dirty(inode);
+
+	return ret;
+}
+
+/**
+ * Allocate and write delayed blocks of an i-node.
+ *
+ * \param inode i-node.
+ * \return 0 on success, -1 on error.
+ */
+int vfs_writeback(vfs_inode *inode)
+{
+	int ret;
+
+	vfs_ilock(inode);
+	ret = writeback_locked(inode);
+	vfs_iunlock(inode);
+
+	return ret;
+}
+
+/**
+ * Drop delayed blocks of an i-node (file was removed or truncated),
+ * they never reach block bitmaps.
+ *
+ * \param inode i-node.
+ */
+void vfs_drop_dirty(vfs_inode *inode)
+{
+	vfs_dirty_blk *dblk;
+	uint32_t count = 0;
+
+	while ((dblk = inode->i_dirty) != NULL) {
+		inode->i_dirty = dblk->next;
+		dirty_release(dblk);
+		count++;
+	}
+	inode->i_dirty_tail = NULL;
+
+	if (count > 0) {
+		unreserve_blocks(inode->sb, count);
+	}
+}
+
+/**
+ * Read a file block into a buffer.
+ *
+ * \param inode i-node.
+ * \param lblk File logic block.
+ * \param buf Destination buffer (block size).
+ * \return 0 on success, -1 on error.
+ */
+int vfs_read_block(vfs_inode *inode, uint32_t lblk, char *buf)
+{
+	vfs_superblock *sb = inode->sb;
+	uint32_t blk_size, pblk;
+	vfs_dirty_blk *dblk;
+	char *block;
+
+	blk_size = sb->s_log_block_size;
+
+	/* Blocks waiting for allocation are only in memory */
+	if ((dblk = dirty_find(inode, lblk)) != NULL) {
+		memcpy(buf, dblk->data, blk_size);
+		return 0;
+	}
+
+	/* Holes are read as zeros */
+	if ((pblk = vfs_bmap(inode, lblk * blk_size).blk_number) == 0) {
+		memset(buf, 0, blk_size);
+		return 0;
+	}
+
+	if (sb->sb_op->read_fs_block != NULL) {
+		return (sb->sb_op->read_fs_block(sb, pblk, buf) ? 0 : -1);
+	}
+
+	if ((block = sb->sb_op->get_fs_block(sb, pblk)) == NULL) {
+		return -1;
+	}
+	memcpy(buf, block, blk_size);
+	kfree(block);
+	return 0;
+}
+
+/**
+ * Set maximum read ahead window.
+ *
+ * \param kbytes Window size in KB (0 disables read ahead).
+ */
+void vfs_set_readahead(uint32_t kbytes)
+{
+	/* Two windows (current and next) should fit in buffer cache */
+	uint32_t max = (BUFF_QUEUE_SIZE / 2) / (PAGE_SIZE / BUFF_SIZE);
+
+	ra_max_pages = kbytes / (PAGE_SIZE / 1024);
+	if (ra_max_pages > max) {
+		ra_max_pages = max;
+	}
+}
+
+/**
+ * Return maximum read ahead window (in pages).
+ */
+uint32_t vfs_readahead_pages(void)
+{
+	return ra_max_pages;
+}
+
+/**
+ * Start read ahead of file pages not in cache (used by mmap faults,
+ * which do not keep a read ahead state).
+ *
+ * \param inode i-node.
+ * \param index First page.
+ * \param npages Number of pages.
+ */
+void vfs_readahead(vfs_inode *inode, uint32_t index, uint32_t npages)
+{
+	readahead_issue(inode, index, npages);
+}
+
+/**
+ * Start asynchronous reads of file pages that are not cached. Blocks
+ * go to buffer cache, where page cache fills will find them.
+ *
+ * \param inode i-node.
+ * \param index First page.
+ * \param npages Number of pages.
+ */
+static void readahead_issue(vfs_inode *inode, uint32_t index, uint32_t npages)
+{
+	vfs_superblock *sb = inode->sb;
+	uint32_t blk_size, bpp, lblk, pblk, last, i;
+
+	blk_size = sb->s_log_block_size;
+	if (sb->sb_op->prefetch_fs_block == NULL || blk_size > PAGE_SIZE ||
+		inode->i_size == 0) {
+		return;
+	}
+	bpp  = PAGE_SIZE / blk_size;
+	last = (inode->i_size - 1) >> PAGE_SHIFT;
+	if (index > last) {
+		return;
+	}
+	if (npages > last - index + 1) {
+		npages = last - index + 1;
+	}
+
+	vfs_ilock(inode);
+	for (; npages > 0; npages--, index++) {
+		if (pagecache_cached(inode, index)) {
+			continue;
+		}
+		lblk = index * bpp;
+		for (i = 0; i < bpp && (lblk * blk_size) < inode->i_size; i++, lblk++) {
+			/* Delayed blocks are in memory, holes are zeros */
+			if (dirty_find(inode, lblk) != NULL) {
+				continue;
+			}
+			if ((pblk = vfs_bmap(inode, lblk * blk_size).blk_number) == 0) {
+				continue;
+			}
+			if (sb->sb_op->prefetch_fs_block(sb, pblk) < 0) {
+				vfs_iunlock(inode);
+				return;
+			}
+		}
+	}
+	vfs_iunlock(inode);
+}
+
+/**
+ * Update read ahead state of a file on each read. A sequential
+ * stream gets an initial window (from the page being read); when the
+ * reader reaches the mark of current window, the next window (twice
+ * bigger, up to ra_max_pages) is read asynchronously. Random access
+ * shrinks the window and stops reading ahead.
+ *
+ * \param inode i-node.
+ * \param ra Read ahead state.
+ * \param index First page being read.
+ * \param npages Number of pages being read.
+ */
+static void readahead(vfs_inode *inode, vfs_ra_state *ra, uint32_t index, uint32_t npages)
+{
+	uint32_t end = index + npages;
+
+	if (ra_max_pages == 0) {
+		return;
+	}
+
+	/* Small reads can continue at the last page read */
+	if (index != ra->next && index + 1 != ra->next) {
+		ra->size >>= 2;
+		ra->async_start = 0;
+		ra->next = end;
+		return;
+	}
+	ra->next = end;
+
+	if (ra->async_start == 0) {
+		/* Sequential stream begins */
+		if (ra->size < VFS_RA_INIT_PAGES) {
+			ra->size = VFS_RA_INIT_PAGES;
+		}
+		if (ra->size > ra_max_pages) {
+			ra->size = ra_max_pages;
+		}
+		ra->start = index;
+		ra->async_start = index + (npages < ra->size ? npages : ra->size);
+		readahead_issue(inode, ra->start, ra->size);
+	}
+
+	while (ra->async_start < end) {
+		/* Read next window while current one is consumed */
+		ra->start += ra->size;
+		ra->size <<= 1;
+		if (ra->size > ra_max_pages) {
+			ra->size = ra_max_pages;
+		}
+		ra->async_start = ra->start;
+		readahead_issue(inode, ra->start, ra->size);
+	}
+}
+
+/**
+ * Read data from an i-node (through page cache).
+ *
+ * \param inode i-node.
+ * \param buf Destination buffer.
+ * \param offset File offset.
+ * \param count Number of bytes to read.
+ * \return Number of bytes read, or -1 on error.
+ */
+int vfs_readi(vfs_inode *inode, char *buf, uint32_t offset, uint32_t count)
+{
+	return vfs_readi_ra(inode, NULL, buf, offset, count);
+}
+
+/**
+ * Read data from an i-node (through page cache), reading ahead
+ * following the access pattern of an open file.
+ *
+ * \param inode i-node.
+ * \param ra Read ahead state of the file (NULL for no read ahead).
+ * \param buf Destination buffer.
+ * \param offset File offset.
+ * \param count Number of bytes to read.
+ * \return Number of bytes read, or -1 on error.
+ */
+int vfs_readi_ra(vfs_inode *inode, vfs_ra_state *ra, char *buf,
+				 uint32_t offset, uint32_t count)
+{
+	return readi(inode, ra, buf, offset, count, 0);
+}
+
+/**
+ * Read data from an i-node (through page cache) to kernel or user
+ * space. Page data is copied straight to user buffer.
+ *
+ * \param inode i-node.
+ * \param ra Read ahead state of the file (NULL for no read ahead).
+ * \param buf Destination buffer.
+ * \param offset File offset.
+ * \param count Number of bytes to read.
+ * \param user Destination buffer is in user space.
+ * \return Number of bytes read, or -1 on error.
+ */
+static int readi(vfs_inode *inode, vfs_ra_state *ra, char *buf,
+				 uint32_t offset, uint32_t count, int user)
+{
+	uint32_t poff, len, done, left;
+	vfs_page *page;
+
+	if (offset >= inode->i_size) {
+		return 0;
+	}
+	if (count > inode->i_size - offset) {
+		count = inode->i_size - offset;
+	}
+
+	if (ra != NULL) {
+		readahead(inode, ra, offset >> PAGE_SHIFT,
+				  ((offset + count - 1) >> PAGE_SHIFT) - (offset >> PAGE_SHIFT) + 1);
+	}
+
+	for (done = 0; done < count; done += len, offset += len) {
+		poff = offset & (PAGE_SIZE - 1);
+		len  = PAGE_SIZE - poff;
+		if (len > count - done) {
+			len = count - done;
+		}
+
+		if ((page = pagecache_get(inode, offset >> PAGE_SHIFT)) == NULL) {
+			return (done > 0 ? (int)done : -1);
+		}
+		if (user) {
+			left = copy_to_user(&buf[done], &page->data[poff], len);
+		} else {
+			memcpy(&buf[done], &page->data[poff], len);
+			left = 0;
+		}
+		pagecache_put(page);
+
+		if (left > 0) {
+			/* Bad user buffer */
+			done += len - left;
+			return (done > 0 ? (int)done : -1);
+		}
+	}
+
+	if (done > 0) {
+		vfs_touch_atime(inode);
+	}
+	return done;
+}
+
+/**
+ * Read from an open file (at file offset) to user space.
+ *
+ * \param file Open file.
+ * \param buf User buffer.
+ * \param count Number of bytes to read.
+ * \return Number of bytes read, or -1 on error.
+ */
+int vfs_read(vfs_file *file, char *buf, uint32_t count)
+{
+	int ret;
+
+	if ((file->f_flags & O_ACCMODE) == O_WRONLY) {
+		return -1;
+	}
+
+	if ((file->f_flags & O_DIRECT)) {
+		ret = direct_io(file, buf, count, file->f_pos, 0);
+	} else {
+		ret = readi(file->inode, &file->f_ra, buf, file->f_pos, count, 1);
+	}
+	if (ret > 0) {
+		file->f_pos += ret;
+	}
+
+	return ret;
+}
+
+/**
+ * Read from an open file at a given offset to user space (file
+ * offset is not changed).
+ *
+ * \param file Open file.
+ * \param buf User buffer.
+ * \param count Number of bytes to read.
+ * \param offset File offset.
+ * \return Number of bytes read, or -1 on error.
+ */
+int vfs_pread(vfs_file *file, char *buf, uint32_t count, uint32_t offset)
+{
+	if ((file->f_flags & O_ACCMODE) == O_WRONLY) {
+		return -1;
+	}
+
+	if ((file->f_flags & O_DIRECT)) {
+		return direct_io(file, buf, count, offset, 0);
+	}
+
+	return readi(file->inode, &file->f_ra, buf, offset, count, 1);
+}
+
+/**
+ * Write user data to an open file. Data is copied from user space
+ * a page at time.
+ *
+ * \param file Open file.
+ * \param buf User buffer.
+ * \param count Number of bytes to write.
+ * \param pos File offset, updated with bytes written.
+ * \return Number of bytes written, or -1 on error.
+ */
+static int writef(vfs_file *file, char *buf, uint32_t count, uint32_t *pos)
+{
+	uint32_t done, len, left;
+	char *kbuf;
+	int ret;
+
+	if ((file->f_flags & O_ACCMODE) == O_RDONLY) {
+		return -1;
+	}
+
+	if ((file->f_flags & O_DIRECT)) {
+		ret = direct_io(file, buf, count, *pos, 1);
+		if (ret > 0) {
+			*pos += ret;
+		}
+		return ret;
+	}
+
+	if ((kbuf = (char*)kmalloc(PAGE_SIZE, GFP_NORMAL_Z)) == NULL) {
+		return -1;
+	}
+
+	for (done = 0; done < count; done += ret) {
+		len  = (count - done > PAGE_SIZE ? PAGE_SIZE : count - done);
+		left = copy_from_user(kbuf, &buf[done], len);
+		if (left == len) {
+			break;
+		}
+
+		ret = vfs_writei(file->inode, kbuf, *pos, len - left);
+		if (ret <= 0) {
+			break;
+		}
+		*pos += ret;
+		if (left > 0) {
+			done += ret;
+			break;
+		}
+	}
+	kfree(kbuf);
+
+	return (done > 0 || count == 0 ? (int)done : -1);
+}
+
+/**
+ * Map the pages of a user buffer into kernel space, so device drivers
+ * can transfer data straight to them (from interrupt handlers, which
+ * can run on behalf of any process). Pages are faulted in first and,
+ * when the device will write to them, made writable (copy on write).
+ *
+ * \param buf User buffer.
+ * \param len Buffer length.
+ * \param write 1 if data goes from buffer to device (file write).
+ * \param kpages Kernel addresses of the mapped pages.
+ * \return Number of mapped pages, or -1 on error (bad buffer).
+ */
+static int dio_map(char *buf, uint32_t len, int write, char **kpages)
+{
+	task_t *task = GET_TASK(cur_task);
+	uint32_t vaddr, entry, npages, i;
+	char c;
+
+	vaddr  = (uint32_t)buf & PAGE_MASK;
+	npages = (((uint32_t)buf & ~PAGE_MASK) + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+	for (i = 0; i < npages; i++, vaddr += PAGE_SIZE) {
+		/* Fault page in (and break copy on write when reading) */
+		if (copy_from_user(&c, (char*)vaddr, 1) != 0 ||
+			(!write && copy_to_user((char*)vaddr, &c, 1) != 0)) {
+			break;
+		}
+
+		entry = get_page_entry(task->arch_tss.pgdir, vaddr);
+		if ( !(entry & PAGE_PRESENT) ) {
+			break;
+		}
+		if ((kpages[i] = (char*)kmap_page(PAGE_PADDR(entry))) == NULL) {
+			break;
+		}
+	}
+
+	if (i < npages) {
+		dio_unmap(kpages, i);
+		return -1;
+	}
+	return npages;
+}
+
+/**
+ * Unmap user pages mapped by dio_map().
+ *
+ * \param kpages Kernel addresses of the pages.
+ * \param npages Number of pages.
+ */
+static void dio_unmap(char **kpages, uint32_t npages)
+{
+	uint32_t i;
+
+	for (i = 0; i < npages; i++) {
+		kunmap_page(kpages[i]);
+	}
+}
+
+/**
+ * Allocate the blocks of a file region not allocated yet (i-node
+ * locked), so direct writes have where to go. Blocks only partially
+ * covered by the region are zeroed on disk first.
+ *
+ * \param inode i-node.
+ * \param offset File offset.
+ * \param len Region length.
+ * \return 0 on success, -1 on error.
+ */
+static int dio_alloc(vfs_inode *inode, uint32_t offset, uint32_t len)
+{
+	vfs_superblock *sb = inode->sb;
+	uint32_t blk_size, lblk, last, pblk, iblocks;
+	char *zero = NULL;
+	int ret = 0;
+
+	blk_size = sb->s_log_block_size;
+	last     = (offset + len - 1) / blk_size;
+
+	for (lblk = offset / blk_size; lblk <= last; lblk++) {
+		if (vfs_bmap(inode, lblk * blk_size).blk_number != 0) {
+			continue;
+		}
+
+		if (!reserve_block(sb)) {
+			ret = -1;
+			break;
+		}
+		unreserve_blocks(sb, 1);
+		iblocks = inode->i_blocks;
+		if ((pblk = sb->sb_op->bmap(inode, lblk, 1)) == 0) {
+			ret = -1;
+			break;
+		}
+		if (iblocks != inode->i_blocks && lblk >= VFS_NDIR_BLOCKS) {
+			vfs_bmap_invalidate(inode);
+		}
+
+		if (lblk * blk_size >= offset && (lblk + 1) * blk_size <= offset + len) {
+			continue;
+		}
+		if (zero == NULL) {
+			if ((zero = (char*)kmalloc(blk_size, GFP_NORMAL_Z)) == NULL) {
+				ret = -1;
+				break;
+			}
+			memset(zero, 0, blk_size);
+		}
+		if (!sb->sb_op->put_fs_block(sb, pblk, zero)) {
+			ret = -1;
+			break;
+		}
+	}
+
+	if (zero != NULL) {
+		kfree(zero);
+	}
+	return ret;
+}
+
+/**
+ * Direct I/O (O_DIRECT): file offsets are mapped through the file
+ * system and sectors are transferred between device and user pages,
+ * bypassing buffer and page caches. Buffer, offset and count must be
+ * sector aligned. Delayed blocks of the file are written first, and
+ * each sector is checked against the buffer cache: cached sectors are
+ * read from cache and updated by writes, so caches stay coherent.
+ *
+ * \param file Open file.
+ * \param buf User buffer.
+ * \param count Number of bytes.
+ * \param offset File offset.
+ * \param write 1 to write to file, 0 to read from file.
+ * \return Number of bytes transferred, or -1 on error.
+ */
+static int direct_io(vfs_file *file, char *buf, uint32_t count,
+					 uint32_t offset, int write)
+{
+	vfs_inode *inode = file->inode;
+	vfs_superblock *sb = inode->sb;
+	dev_blk_driver_t *driver;
+	buff_header_t *bufs, *bh;
+	vfs_bmap_t bmap;
+	char *kpages[DIO_MAX_PAGES];
+	char *data;
+	uint32_t blk_size, done, len, pos, poff, i, n;
+	int npages, ret;
+
+	if ((((uint32_t)buf | count | offset) & (BUFF_SIZE - 1)) != 0) {
+		return -1;
+	}
+
+	driver = block_dev_drivers[sb->device.major];
+	if (driver == NULL || sb->sb_op->bmap == NULL ||
+		(write && ((sb->flags & SB_RDONLY) || sb->sb_op->put_fs_block == NULL))) {
+		return -1;
+	}
+
+	if (!write) {
+		if (offset >= inode->i_size) {
+			return 0;
+		}
+		/* Last sector of file is read whole */
+		if (count > inode->i_size - offset) {
+			count = (inode->i_size - offset + BUFF_SIZE - 1) & ~(BUFF_SIZE - 1);
+		}
+	}
+	if (count == 0) {
+		return 0;
+	}
+
+	/* Device must see delayed blocks of the file */
+	if (vfs_writeback(inode) < 0) {
+		return -1;
+	}
+
+	bufs = (buff_header_t*)kmalloc(DIO_MAX_SECTORS * sizeof(buff_header_t), GFP_NORMAL_Z);
+	if (bufs == NULL) {
+		return -1;
+	}
+
+	blk_size = sb->s_log_block_size;
+	ret      = 0;
+
+	vfs_ilock(inode);
+	for (done = 0; done < count; done += len) {
+		poff = ((uint32_t)&buf[done] & ~PAGE_MASK);
+		len  = DIO_MAX_PAGES * PAGE_SIZE - poff;
+		if (len > count - done) {
+			len = count - done;
+		}
+
+		if ((npages = dio_map(&buf[done], len, write, kpages)) < 0) {
+			ret = -1;
+			break;
+		}
+		if (write && dio_alloc(inode, offset + done, len) < 0) {
+			dio_unmap(kpages, npages);
+			ret = -1;
+			break;
+		}
+
+		/* Build device requests of the batch */
+		for (pos = 0, n = 0; pos < len; pos += BUFF_SIZE) {
+			data = &kpages[(poff + pos) >> PAGE_SHIFT][(poff + pos) & ~PAGE_MASK];
+			bmap = vfs_bmap(inode, offset + done + pos);
+
+			if (bmap.blk_number == 0) {
+				if (write) {
+					ret = -1;
+					break;
+				}
+				/* Hole */
+				memset(data, 0, BUFF_SIZE);
+				continue;
+			}
+
+			if (write) {
+				pagecache_write(inode, offset + done + pos, data, BUFF_SIZE);
+			}
+			if (bdirect_sync(sb->device.major, sb->device.minor,
+							 (uint64_t)bmap.blk_number * (blk_size / BUFF_SIZE) +
+							 bmap.blk_offset / BUFF_SIZE, data, write) && !write) {
+				/* Read from cache */
+				continue;
+			}
+
+			bh          = &bufs[n++];
+			bh->addr    = (uint64_t)bmap.blk_number * (blk_size / BUFF_SIZE) +
+						  bmap.blk_offset / BUFF_SIZE;
+			bh->device  = sb->device.minor;
+			bh->direct  = data;
+			bh->release = 0;
+			bh->status  = BUFF_ST_BUSY;
+		}
+
+		/* Requests are served in order: waiting for the last one
+		   (synchronous) waits for the whole batch */
+		for (i = 0; ret == 0 && i < n; i++) {
+			if (i == n - 1) {
+				ret = (write ? driver->dev_ops->write_sync_block(sb->device.major, sb->device.minor, &bufs[i]) :
+							   driver->dev_ops->read_sync_block(sb->device.major, sb->device.minor, &bufs[i]));
+			} else {
+				ret = (write ? driver->dev_ops->write_async_block(sb->device.major, sb->device.minor, &bufs[i]) :
+							   driver->dev_ops->read_async_block(sb->device.major, sb->device.minor, &bufs[i]));
+			}
+			if (ret != 0) {
+				/* Driver still points to queued requests (and to pages
+				   mapped for them): wait before unmapping and freeing */
+				while (i-- > 0) {
+					wait_event(&bufs[i].io_wait, bufs[i].status != BUFF_ST_BUSY);
+				}
+				break;
+			}
+		}
+		for (i = 0; ret == 0 && i < n; i++) {
+			if (bufs[i].status != BUFF_ST_VALID) {
+				ret = -1;
+			}
+		}
+
+		dio_unmap(kpages, npages);
+		if (ret < 0) {
+			break;
+		}
+	}
+
+	if (write) {
+		if (offset + done > inode->i_size) {
+			inode->i_size = offset + done;
+		}
+		if (done > 0) {
+			inode->i_mtime = inode->i_ctime = get_seconds();
+			vfs_mark_dirty(inode);
+		}
+	} else if (done > inode->i_size - offset) {
+		done = inode->i_size - offset;
+	}
+	vfs_iunlock(inode);
+	kfree(bufs);
+
+	if (!write && done > 0) {
+		vfs_touch_atime(inode);
+	}
+
+	return (done > 0 ? (int)done : ret);
+}
+
+/**
+ * Write user data to an open file (at file offset, or at end of
+ * file with O_APPEND).
+ *
+ * \param file Open file.
+ * \param buf User buffer.
+ * \param count Number of bytes to write.
+ * \return Number of bytes written, or -1 on error.
+ */
+int vfs_write(vfs_file *file, char *buf, uint32_t count)
+{
+	if ((file->f_flags & O_APPEND)) {
+		file->f_pos = file->inode->i_size;
+	}
+
+	return writef(file, buf, count, &file->f_pos);
+}
+
+/**
+ * Write user data to an open file at a given offset (file offset
+ * is not changed).
+ *
+ * \param file Open file.
+ * \param buf User buffer.
+ * \param count Number of bytes to write.
+ * \param offset File offset.
+ * \return Number of bytes written, or -1 on error.
+ */
+int vfs_pwrite(vfs_file *file, char *buf, uint32_t count, uint32_t offset)
+{
+	return writef(file, buf, count, &offset);
+}
+
+/**
+ * Copy data between two open files inside kernel: input pages are
+ * taken from page cache (with read ahead) and written straight to
+ * output file, with no user buffer. Both file offsets are advanced.
+ *
+ * \param out Output file.
+ * \param in Input file.
+ * \param count Number of bytes to copy.
+ * \return Number of bytes copied, or -1 on error.
+ */
+int vfs_sendfile(vfs_file *out, vfs_file *in, uint32_t count)
+{
+	vfs_inode *inode = in->inode;
+	uint32_t poff, len, done;
+	vfs_page *page;
+	int ret;
+
+	if ((in->f_flags & O_ACCMODE) == O_WRONLY ||
+		(out->f_flags & O_ACCMODE) == O_RDONLY || out->inode == inode) {
+		return -1;
+	}
+
+	if (in->f_pos >= inode->i_size) {
+		return 0;
+	}
+	if (count > inode->i_size - in->f_pos) {
+		count = inode->i_size - in->f_pos;
+	}
+	if (count == 0) {
+		return 0;
+	}
+
+	if ((out->f_flags & O_APPEND)) {
+		out->f_pos = out->inode->i_size;
+	}
+
+	readahead(inode, &in->f_ra, in->f_pos >> PAGE_SHIFT,
+			  ((in->f_pos + count - 1) >> PAGE_SHIFT) - (in->f_pos >> PAGE_SHIFT) + 1);
+
+	for (done = 0; done < count; done += ret) {
+		poff = in->f_pos & (PAGE_SIZE - 1);
+		len  = PAGE_SIZE - poff;
+		if (len > count - done) {
+			len = count - done;
+		}
+
+		if ((page = pagecache_get(inode, in->f_pos >> PAGE_SHIFT)) == NULL) {
+			break;
+		}
+		ret = vfs_writei(out->inode, &page->data[poff], out->f_pos, len);
+		pagecache_put(page);
+		if (ret <= 0) {
+			break;
+		}
+
+		in->f_pos  += ret;
+		out->f_pos += ret;
+	}
+
+	if (done > 0) {
+		vfs_touch_atime(inode);
+	}
+
+	return (done > 0 ? (int)done : -1);
+}
+
+/**
+ * Write data to an i-node. Blocks already allocated are written
+ * through. New blocks are only reserved and kept in memory: they get
+ * allocated by vfs_writeback().
+ *
+ * \param inode i-node.
+ * \param buf Source buffer.
+ * \param offset File offset.
+ * \param count Number of bytes to write.
+ * \return Number of bytes written, or -1 on error.
+ */
+int vfs_writei(vfs_inode *inode, char *buf, uint32_t offset, uint32_t count)
+{
+	vfs_superblock *sb = inode->sb;
+	uint32_t blk_size, lblk, boff, len, done, pblk, iblocks;
+	vfs_dirty_blk *dblk;
+	char *block;
+	int ret;
+
+	if ((sb->flags & SB_RDONLY) || sb->sb_op->bmap == NULL ||
+		sb->sb_op->put_fs_block == NULL) {
+		return -1;
+	}
+
+	blk_size = sb->s_log_block_size;
+	ret      = 0;
+
+	vfs_ilock(inode);
+	for (done = 0; done < count; done += len, offset += len) {
+		lblk = offset / blk_size;
+		boff = offset % blk_size;
+		len  = blk_size - boff;
+		if (len > count - done) {
+			len = count - done;
+		}
+
+		/* Keep cached page up to date */
+		pagecache_write(inode, offset, &buf[done], len);
+
+		/* Block waiting for allocation */
+		if ((dblk = dirty_find(inode, lblk)) != NULL) {
+			memcpy(&dblk->data[boff], &buf[done], len);
+			continue;
+		}
+
+		pblk = vfs_bmap(inode, offset).blk_number;
+		if (pblk == 0) {
+			/* New block: delay allocation */
+			if (!reserve_block(sb)) {
+				ret = -1;
+				break;
+			}
+			if ((dblk = dirty_add(inode, lblk)) == NULL) {
+				/* No memory left for delayed blocks: write them */
+				writeback_locked(inode);
+				dblk = dirty_add(inode, lblk);
+			}
+			if (dblk != NULL) {
+				if (len != blk_size) {
+					memset(dblk->data, 0, blk_size);
+				}
+				memcpy(&dblk->data[boff], &buf[done], len);
+				continue;
+			}
+
+			/* Allocate it right now */
+			unreserve_blocks(sb, 1);
+			iblocks = inode->i_blocks;
+			if ((pblk = sb->sb_op->bmap(inode, lblk, 1)) == 0) {
+				ret = -1;
+				break;
+			}
+			if (iblocks != inode->i_blocks && lblk >= VFS_NDIR_BLOCKS) {
+				vfs_bmap_invalidate(inode);
+			}
+			block = NULL;
+			if (len != blk_size) {
+				if ((block = (char*)kmalloc(blk_size, GFP_NORMAL_Z)) == NULL) {
+					ret = -1;
+					break;
+				}
+				memset(block, 0, blk_size);
+			}
+		} else if (len != blk_size) {
+			/* Partial block: read, modify and write */
+			if ((block = sb->sb_op->get_fs_block(sb, pblk)) == NULL) {
+				ret = -1;
+				break;
+			}
+		} else {
+			/* Whole block, no need to read it */
+			block = NULL;
+		}
+
+		if (block == NULL) {
+			if (!sb->sb_op->put_fs_block(sb, pblk, &buf[done])) {
+				ret = -1;
+				break;
+			}
+			continue;
+		}
+
+		memcpy(&block[boff], &buf[done], len);
+		if (!sb->sb_op->put_fs_block(sb, pblk, block)) {
+			ret = -1;
+		}
+		kfree(block);
+		if (ret < 0) {
+			break;
+		}
+	}
+
+	if (offset > inode->i_size) {
+		inode->i_size = offset;
+	}
+	if (done > 0) {
+		inode->i_mtime = inode->i_ctime = get_seconds();
+		vfs_mark_dirty(inode);
+	}
+	vfs_iunlock(inode);
+
+	return (done > 0 ? (int)done : ret);
+}
+
+/**
+ * Read/write benchmark thread: write a file in chunks.
+ *
+ * \param arg Thread information.
+ */
+static void rw_bench_writer(void *arg)
+{
+	struct _rw_bench_st *th = (struct _rw_bench_st*)arg;
+	uint32_t pos;
+
+	for (pos = 0; pos < th->bytes; pos += RW_BENCH_CHUNK) {
+		if (vfs_writei(th->inode, th->buf, pos, RW_BENCH_CHUNK) != RW_BENCH_CHUNK) {
+			th->error = 1;
+			return;
+		}
+	}
+}
+
+/**
+ * Count physical discontinuities (fragments) of a file.
+ *
+ * \param inode i-node.
+ * \return Number of fragments.
+ */
+static uint32_t rw_bench_fragments(vfs_inode *inode)
+{
+	uint32_t blk_size, pos, pblk, prev, frags;
+
+	blk_size = inode->sb->s_log_block_size;
+	frags    = 0;
+	prev     = 0;
+	for (pos = 0; pos < inode->i_size; pos += blk_size) {
+		pblk = vfs_bmap(inode, pos).blk_number;
+		if (pblk != 0 && pblk != prev + 1) {
+			frags++;
+		}
+		prev = pblk;
+	}
+
+	return frags;
+}
+
+/**
+ * Read/write benchmark. Creates files rwbench0, rwbench1, ... into a
+ * directory and writes them concurrently (one kernel thread per file),
+ * then reads them back sequentially. Prints fragments per file and
+ * throughput. At last, a temporary file is written and removed (with
+ * delayed allocation, it should not be written to device). Running it
+ * on a tmpfs directory gives the cost of VFS alone.
+ *
+ * \param dirname Directory of the files.
+ * \param nfiles Number of files (up to 8).
+ * \param kbytes Size of each file in KB.
+ */
+void vfs_rw_bench(const char *dirname, uint32_t nfiles, uint32_t kbytes)
+{
+	struct _rw_bench_st th[RW_BENCH_MAX_FILES];
+	task_t *tasks[RW_BENCH_MAX_FILES];
+	char *read_pass[] = {"cold", "cold, read ahead", "cached"};
+	vfs_ra_state ra;
+	blk_iostat_t before, after;
+	char path[VFS_NAME_LEN];
+	uint32_t i, pos, usecs, frags, total, major, pass, len;
+	vfs_inode *inode;
+	uint64_t start;
+	char *buf;
+
+	len = strlen(dirname);
+	while (len > 0 && dirname[len-1] == '/') {
+		len--;
+	}
+	if (nfiles == 0 || kbytes == 0 || len + 13 >= VFS_NAME_LEN) {
+		return;
+	}
+	strncpy(path, dirname, len);
+	strcpy(&path[len], "/rwbench0");
+	len += 8;
+
+	if (nfiles > RW_BENCH_MAX_FILES) {
+		nfiles = RW_BENCH_MAX_FILES;
+	}
+	kbytes = (kbytes + 3) & ~3;
+
+	if ((buf = (char*)kmalloc(RW_BENCH_CHUNK, GFP_NORMAL_Z)) == NULL) {
+		return;
+	}
+	for (i = 0; i < RW_BENCH_CHUNK; i++) {
+		buf[i] = (char)i;
+	}
+
+	for (i = 0; i < nfiles; i++) {
+		path[len] = '0' + i;
+		if ((inode = vfs_namei(path)) != NULL) {
+			kprintf(KERN_ERROR "rw bench: %s already exists.\n", path);
+			vfs_iput(inode);
+			nfiles = i;
+			break;
+		}
+		if ((inode = vfs_create(path, S_IFREG | 0644)) == NULL) {
+			kprintf(KERN_ERROR "rw bench: could not create %s.\n", path);
+			nfiles = i;
+			break;
+		}
+		th[i].inode = inode;
+		th[i].bytes = kbytes * 1024;
+		th[i].buf   = buf;
+		th[i].error = 0;
+	}
+
+	/* Concurrent writes */
+	start = read_tsc();
+	for (i = 0; i < nfiles; i++) {
+		tasks[i] = kernel_thread_create(DEFAULT_PRIORITY, rw_bench_writer, &th[i]);
+	}
+	for (i = 0; i < nfiles; i++) {
+		if (tasks[i] != NULL) {
+			kernel_thread_wait(tasks[i]);
+		} else {
+			th[i].error = 1;
+		}
+	}
+	/* Delayed blocks are allocated here */
+	vfs_sync();
+	usecs = tsc_to_usecs((uint32_t)(read_tsc() - start));
+
+	total = nfiles * kbytes;
+	frags = 0;
+	for (i = 0; i < nfiles; i++) {
+		frags += rw_bench_fragments(th[i].inode);
+		if (th[i].error) {
+			kprintf(KERN_ERROR "rw bench: write error on file %d.\n", i);
+		}
+	}
+	kprintf(KERN_INFO "rw bench: %d files x %d KB, %d fragments/file, write %d KB/s\n",
+			nfiles, kbytes, (nfiles > 0 ? frags / nfiles : 0),
+			(total * 1000) / (usecs / 1000 + 1));
+
+	/*
+	 * Sequential reads: from device without and with read ahead,
+	 * then from page cache
+	 */
+	for (pass = 0; pass < 3; pass++) {
+		for (i = 0; i < nfiles && pass < 2; i++) {
+			pagecache_invalidate(th[i].inode);
+		}
+		start = read_tsc();
+		for (i = 0; i < nfiles; i++) {
+			memset(&ra, 0, sizeof(vfs_ra_state));
+			for (pos = 0; pos < th[i].bytes; pos += RW_BENCH_CHUNK) {
+				if (vfs_readi_ra(th[i].inode, (pass == 0 ? NULL : &ra), buf,
+								 pos, RW_BENCH_CHUNK) <= 0) {
+					break;
+				}
+			}
+		}
+		usecs = tsc_to_usecs((uint32_t)(read_tsc() - start));
+
+		kprintf(KERN_INFO "rw bench: sequential read (%s) %d KB/s\n",
+				read_pass[pass], (total * 1000) / (usecs / 1000 + 1));
+	}
+	for (i = 0; i < nfiles; i++) {
+		vfs_iput(th[i].inode);
+	}
+
+	/* Temporary file: written and removed before writeback */
+	strcpy(&path[len], ".tmp");
+	if ((inode = vfs_create(path, S_IFREG | 0644)) != NULL) {
+		major = inode->device.major;
+		/* No statistics for devices without driver (tmpfs) */
+		memset(&before, 0, sizeof(blk_iostat_t));
+		memset(&after, 0, sizeof(blk_iostat_t));
+		blkstat_get(major, &before);
+		for (pos = 0; pos < RW_BENCH_TMP_KB * 1024; pos += RW_BENCH_CHUNK) {
+			vfs_writei(inode, buf, pos, RW_BENCH_CHUNK);
+		}
+		vfs_iput(inode);
+		vfs_unlink(path);
+		blkstat_get(major, &after);
+
+		kprintf(KERN_INFO "rw bench: %d KB temporary file, %d sectors written\n",
+				RW_BENCH_TMP_KB, after.write_sectors - before.write_sectors);
+	}
+
+	kfree(buf);
+}
+
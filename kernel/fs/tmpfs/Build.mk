@@ -0,0 +1,9 @@
+##
+# Copyright (C) 2012 Renê de Souza Pinto
+# TempOS - Tempos is an Educational and multi purpose Operating System
+#
+# TBS - Build configuration file
+#
+
+obj-$(CONFIG_FS_TMPFS) += tmpfs.o
+
@@ -0,0 +1,561 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: tmpfs.c
+ * Desc: In-memory file system: i-nodes and data pages live only in memory
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/kernel.h>
+#include <tempos/mm.h>
+#include <fs/vfs.h>
+#include <fs/tmpfs/tmpfs.h>
+#include <fs/dev_numbers.h>
+#include <sys/stat.h>
+#include <string.h>
+
+/** tmpfs file system type */
+vfs_fs_type tmpfs_fs_type;
+
+/** tmpfs super block operations */
+vfs_sb_ops tmpfs_sb_ops;
+
+/** tmpfs instances (device minor number) */
+static tmpfs_sb tmpfs_mounts[TMPFS_MAX_MOUNTS];
+
+/* Prototypes */
+static int tmpfs_check(dev_t device);
+
+static int tmpfs_get_sb(dev_t device, vfs_superblock *sb);
+
+static tmpfs_inode *tmpfs_iget(vfs_superblock *sb, uint32_t number);
+
+static int tmpfs_get_inode(vfs_inode *inode);
+
+static int tmpfs_write_inode(vfs_inode *inode);
+
+static int tmpfs_alloc_inode(vfs_superblock *sb, vfs_inode *inode);
+
+static int tmpfs_free_inode(vfs_superblock *sb, vfs_inode *inode);
+
+static int tmpfs_write_super(vfs_superblock *sb);
+
+static char *tmpfs_get_fs_block(vfs_superblock *sb, uint32_t blocknum);
+
+static int tmpfs_read_fs_block(vfs_superblock *sb, uint32_t blocknum, char *data);
+
+static int tmpfs_put_fs_block(vfs_superblock *sb, uint32_t blocknum, char *data);
+
+static uint32_t tmpfs_bmap(vfs_inode *inode, uint32_t lblk, int create);
+
+static int tmpfs_link(vfs_inode *dir, const char *name, vfs_inode *inode);
+
+static int tmpfs_unlink(vfs_inode *dir, const char *name);
+
+static int tmpfs_lookup(vfs_inode *dir, const char *name, uint32_t *ino);
+
+
+/**
+ * Register tmpfs to VFS.
+ */
+void register_tmpfs(void)
+{
+	tmpfs_fs_type.name          = "tmpfs";
+	tmpfs_fs_type.check_fs_type = tmpfs_check;
+	tmpfs_fs_type.get_sb        = tmpfs_get_sb;
+
+	tmpfs_sb_ops.get_inode      = tmpfs_get_inode;
+	tmpfs_sb_ops.write_inode    = tmpfs_write_inode;
+	tmpfs_sb_ops.put_inode      = tmpfs_write_inode;
+	tmpfs_sb_ops.alloc_inode    = tmpfs_alloc_inode;
+	tmpfs_sb_ops.free_inode     = tmpfs_free_inode;
+	tmpfs_sb_ops.write_super    = tmpfs_write_super;
+	tmpfs_sb_ops.get_fs_block   = tmpfs_get_fs_block;
+	tmpfs_sb_ops.read_fs_block  = tmpfs_read_fs_block;
+	tmpfs_sb_ops.prefetch_fs_block = NULL;
+	tmpfs_sb_ops.put_fs_block   = tmpfs_put_fs_block;
+	tmpfs_sb_ops.bmap           = tmpfs_bmap;
+	tmpfs_sb_ops.link           = tmpfs_link;
+	tmpfs_sb_ops.unlink         = tmpfs_unlink;
+	tmpfs_sb_ops.lookup         = tmpfs_lookup;
+
+	memset(tmpfs_mounts, 0, sizeof(tmpfs_mounts));
+
+	register_fs_type(&tmpfs_fs_type);
+}
+
+/**
+ * Mount a new tmpfs instance.
+ *
+ * \param path Directory where tmpfs will be mounted.
+ * \param kbytes Size limit (KB).
+ * \return 1 on success, 0 otherwise.
+ */
+int tmpfs_mount(const char *path, uint32_t kbytes)
+{
+	dev_t device;
+	tmpfs_sb *tsb;
+	int i;
+
+	for (i = 0; i < TMPFS_MAX_MOUNTS && tmpfs_mounts[i].used; i++);
+	if (i == TMPFS_MAX_MOUNTS) {
+		kprintf(KERN_ERROR "tmpfs: too many instances.\n");
+		return 0;
+	}
+
+	tsb = &tmpfs_mounts[i];
+	tsb->max_blocks = kbytes / (PAGE_SIZE / 1024);
+	tsb->max_inodes = TMPFS_DEF_INODES;
+	if (tsb->max_blocks == 0) {
+		tsb->max_blocks = 1;
+	}
+
+	device.major = DEVMAJOR_NONE;
+	device.minor = i;
+	device.type  = DEV_TYPE_BLOCK;
+
+	if (!vfs_mount("tmpfs", device, path)) {
+		return 0;
+	}
+
+	kprintf(KERN_INFO "tmpfs: %s mounted (%d KB).\n", path,
+			tsb->max_blocks * (PAGE_SIZE / 1024));
+	return 1;
+}
+
+/**
+ * Check if a device is a tmpfs instance.
+ */
+static int tmpfs_check(dev_t device)
+{
+	return (device.major == DEVMAJOR_NONE && device.minor < TMPFS_MAX_MOUNTS);
+}
+
+/**
+ * Create a tmpfs instance: its block and i-node tables, and the
+ * root directory.
+ *
+ * \param device tmpfs device (minor is the instance).
+ * \param sb Super block to fill.
+ * \return 1 on success, 0 otherwise.
+ */
+static int tmpfs_get_sb(dev_t device, vfs_superblock *sb)
+{
+	tmpfs_sb *tsb;
+	tmpfs_inode *root;
+	uint32_t i;
+
+	if (!tmpfs_check(device) || tmpfs_mounts[device.minor].used) {
+		return 0;
+	}
+	tsb = &tmpfs_mounts[device.minor];
+
+	tsb->blocks      = (char**)kmalloc((tsb->max_blocks + 1) * sizeof(char*), GFP_NORMAL_Z);
+	tsb->free_blocks = (uint32_t*)kmalloc(tsb->max_blocks * sizeof(uint32_t), GFP_NORMAL_Z);
+	tsb->inodes      = (tmpfs_inode*)kmalloc((tsb->max_inodes + 1) * sizeof(tmpfs_inode), GFP_NORMAL_Z);
+	if (tsb->blocks == NULL || tsb->free_blocks == NULL || tsb->inodes == NULL) {
+		if (tsb->blocks != NULL) {
+			kfree(tsb->blocks);
+		}
+		if (tsb->free_blocks != NULL) {
+			kfree(tsb->free_blocks);
+		}
+		if (tsb->inodes != NULL) {
+			kfree(tsb->inodes);
+		}
+		return 0;
+	}
+
+	/* Blocks are allocated from the lowest number */
+	memset(tsb->blocks, 0, (tsb->max_blocks + 1) * sizeof(char*));
+	for (i = 0; i < tsb->max_blocks; i++) {
+		tsb->free_blocks[i] = tsb->max_blocks - i;
+	}
+	tsb->free_top = tsb->max_blocks;
+	memset(tsb->inodes, 0, (tsb->max_inodes + 1) * sizeof(tmpfs_inode));
+
+	/* Root directory */
+	root = &tsb->inodes[TMPFS_ROOT_INO];
+	root->used        = 1;
+	root->mode        = S_IFDIR | 0777;
+	root->links_count = 2;
+	root->parent      = TMPFS_ROOT_INO;
+
+	memset(sb, 0, sizeof(vfs_superblock));
+	sb->s_inodes_count      = tsb->max_inodes;
+	sb->s_free_inodes_count = tsb->max_inodes - 1;
+	sb->s_blocks_count      = tsb->max_blocks;
+	sb->s_free_blocks_count = tsb->max_blocks;
+	sb->s_log_block_size    = PAGE_SIZE;
+	sb->type                = &tmpfs_fs_type;
+	sb->device              = device;
+	sb->flags               = 0;
+	sb->sb_op               = &tmpfs_sb_ops;
+	sb->fs_driver           = tsb;
+
+	tsb->used = 1;
+	return 1;
+}
+
+/**
+ * Return tmpfs i-node of a VFS i-node number (0 is the root).
+ */
+static tmpfs_inode *tmpfs_iget(vfs_superblock *sb, uint32_t number)
+{
+	tmpfs_sb *tsb = (tmpfs_sb*)sb->fs_driver;
+
+	if (number == 0) {
+		number = TMPFS_ROOT_INO;
+	}
+	if (number > tsb->max_inodes || !tsb->inodes[number].used) {
+		return NULL;
+	}
+	return &tsb->inodes[number];
+}
+
+/**
+ * Fill VFS i-node from tmpfs i-node.
+ */
+static int tmpfs_get_inode(vfs_inode *inode)
+{
+	tmpfs_inode *ti;
+
+	if ((ti = tmpfs_iget(inode->sb, inode->number)) == NULL) {
+		return 0;
+	}
+
+	inode->i_mode        = ti->mode;
+	inode->i_uid         = ti->uid;
+	inode->i_gid         = ti->gid;
+	inode->i_size        = ti->size;
+	inode->i_atime       = ti->atime;
+	inode->i_ctime       = ti->ctime;
+	inode->i_mtime       = ti->mtime;
+	inode->i_links_count = ti->links_count;
+	inode->i_blocks      = ti->blocks;
+	inode->i_flags       = 0;
+	memset(inode->i_block, 0, sizeof(inode->i_block));
+
+	/* Blocks are always mapped by tmpfs_bmap */
+	inode->flags |= IFLAG_FS_BMAP;
+	return 1;
+}
+
+/**
+ * Update tmpfs i-node with VFS i-node information.
+ */
+static int tmpfs_write_inode(vfs_inode *inode)
+{
+	tmpfs_inode *ti;
+
+	if ((ti = tmpfs_iget(inode->sb, inode->number)) == NULL) {
+		return 0;
+	}
+
+	ti->mode        = inode->i_mode;
+	ti->uid         = inode->i_uid;
+	ti->gid         = inode->i_gid;
+	ti->size        = inode->i_size;
+	ti->atime       = inode->i_atime;
+	ti->ctime       = inode->i_ctime;
+	ti->mtime       = inode->i_mtime;
+	ti->links_count = inode->i_links_count;
+
+	/* New i-nodes are reset by vfs_create() */
+	inode->flags |= IFLAG_FS_BMAP;
+	return 1;
+}
+
+/**
+ * Alloc a new i-node.
+ *
+ * \param sb Super block.
+ * \param inode On input, number is the parent directory and i_mode the
+ *              file type. On output, number is the new i-node.
+ * \return 1 on success, 0 if there is no free i-node.
+ */
+static int tmpfs_alloc_inode(vfs_superblock *sb, vfs_inode *inode)
+{
+	tmpfs_sb *tsb = (tmpfs_sb*)sb->fs_driver;
+	tmpfs_inode *ti;
+	uint32_t i;
+
+	for (i = TMPFS_ROOT_INO + 1; i <= tsb->max_inodes && tsb->inodes[i].used; i++);
+	if (i > tsb->max_inodes) {
+		return 0;
+	}
+
+	ti = &tsb->inodes[i];
+	memset(ti, 0, sizeof(tmpfs_inode));
+	ti->used   = 1;
+	ti->mode   = inode->i_mode;
+	ti->parent = (inode->number == 0 ? TMPFS_ROOT_INO : inode->number);
+
+	sb->s_free_inodes_count--;
+	inode->number = i;
+	return 1;
+}
+
+/**
+ * Delete an i-node and release its blocks.
+ */
+static int tmpfs_free_inode(vfs_superblock *sb, vfs_inode *inode)
+{
+	tmpfs_sb *tsb = (tmpfs_sb*)sb->fs_driver;
+	tmpfs_inode *ti;
+	tmpfs_dirent *de;
+	uint32_t i, b;
+
+	if ((ti = tmpfs_iget(sb, inode->number)) == NULL ||
+		inode->number == 0 || inode->number == TMPFS_ROOT_INO) {
+		return 0;
+	}
+
+	for (i = 0; i < ti->bmap_size; i++) {
+		if ((b = ti->bmap[i]) != 0) {
+			kfree_page(tsb->blocks[b]);
+			tsb->blocks[b] = NULL;
+			tsb->free_blocks[tsb->free_top++] = b;
+			sb->s_free_blocks_count++;
+		}
+	}
+	if (ti->bmap != NULL) {
+		kfree(ti->bmap);
+	}
+	while ((de = ti->dirents) != NULL) {
+		ti->dirents = de->next;
+		kfree(de->name);
+		kfree(de);
+	}
+
+	memset(ti, 0, sizeof(tmpfs_inode));
+	sb->s_free_inodes_count++;
+	inode->i_blocks = 0;
+	return 1;
+}
+
+/**
+ * Nothing to write: tmpfs lives in memory.
+ */
+static int tmpfs_write_super(vfs_superblock *sb)
+{
+	return 1;
+}
+
+/**
+ * Return a copy of a block (should be freed).
+ */
+static char *tmpfs_get_fs_block(vfs_superblock *sb, uint32_t blocknum)
+{
+	char *data;
+
+	if ((data = (char*)kmalloc(PAGE_SIZE, GFP_NORMAL_Z)) == NULL) {
+		return NULL;
+	}
+	if (!tmpfs_read_fs_block(sb, blocknum, data)) {
+		kfree(data);
+		return NULL;
+	}
+	return data;
+}
+
+/**
+ * Read a block into a buffer.
+ */
+static int tmpfs_read_fs_block(vfs_superblock *sb, uint32_t blocknum, char *data)
+{
+	tmpfs_sb *tsb = (tmpfs_sb*)sb->fs_driver;
+
+	if (blocknum == 0 || blocknum > tsb->max_blocks || tsb->blocks[blocknum] == NULL) {
+		return 0;
+	}
+	memcpy(data, tsb->blocks[blocknum], PAGE_SIZE);
+	return 1;
+}
+
+/**
+ * Write a whole block.
+ */
+static int tmpfs_put_fs_block(vfs_superblock *sb, uint32_t blocknum, char *data)
+{
+	tmpfs_sb *tsb = (tmpfs_sb*)sb->fs_driver;
+
+	if (blocknum == 0 || blocknum > tsb->max_blocks || tsb->blocks[blocknum] == NULL) {
+		return 0;
+	}
+	memcpy(tsb->blocks[blocknum], data, PAGE_SIZE);
+	return 1;
+}
+
+/**
+ * Map a file block to a tmpfs block, allocating it when create is
+ * not zero.
+ *
+ * \param inode i-node.
+ * \param lblk File logic block.
+ * \param create Allocate block if it's a hole.
+ * \return tmpfs block number, or 0 (hole, or tmpfs is full).
+ */
+static uint32_t tmpfs_bmap(vfs_inode *inode, uint32_t lblk, int create)
+{
+	vfs_superblock *sb = inode->sb;
+	tmpfs_sb *tsb = (tmpfs_sb*)sb->fs_driver;
+	tmpfs_inode *ti;
+	uint32_t *nmap, nsize, b;
+
+	if ((ti = tmpfs_iget(sb, inode->number)) == NULL) {
+		return 0;
+	}
+	if (lblk < ti->bmap_size && ti->bmap[lblk] != 0) {
+		return ti->bmap[lblk];
+	}
+	if (!create || lblk >= TMPFS_MAX_FILE_BLOCKS || tsb->free_top == 0) {
+		return 0;
+	}
+
+	/* Grow block map */
+	if (lblk >= ti->bmap_size) {
+		nsize = (ti->bmap_size < 16 ? 16 : ti->bmap_size * 2);
+		if (nsize <= lblk) {
+			nsize = lblk + 1;
+		}
+		if ((nmap = (uint32_t*)kmalloc(nsize * sizeof(uint32_t), GFP_NORMAL_Z)) == NULL) {
+			return 0;
+		}
+		memset(nmap, 0, nsize * sizeof(uint32_t));
+		if (ti->bmap != NULL) {
+			memcpy(nmap, ti->bmap, ti->bmap_size * sizeof(uint32_t));
+			kfree(ti->bmap);
+		}
+		ti->bmap      = nmap;
+		ti->bmap_size = nsize;
+	}
+
+	b = tsb->free_blocks[tsb->free_top - 1];
+	if ((tsb->blocks[b] = (char*)kmalloc_page(GFP_NORMAL_Z | GFP_ZEROP)) == NULL) {
+		return 0;
+	}
+	tsb->free_top--;
+	sb->s_free_blocks_count--;
+
+	ti->bmap[lblk]   = b;
+	ti->blocks      += PAGE_SIZE / 512;
+	inode->i_blocks  = ti->blocks;
+	return b;
+}
+
+/**
+ * Add a directory entry.
+ *
+ * \param dir Directory i-node.
+ * \param name File name.
+ * \param inode File i-node.
+ * \return 1 on success, 0 otherwise.
+ */
+static int tmpfs_link(vfs_inode *dir, const char *name, vfs_inode *inode)
+{
+	tmpfs_inode *tdir, *ti;
+	tmpfs_dirent *de;
+
+	if ((tdir = tmpfs_iget(dir->sb, dir->number)) == NULL ||
+		(ti = tmpfs_iget(inode->sb, inode->number)) == NULL) {
+		return 0;
+	}
+
+	if ((de = (tmpfs_dirent*)kmalloc(sizeof(tmpfs_dirent), GFP_NORMAL_Z)) == NULL) {
+		return 0;
+	}
+	if ((de->name = (char*)kmalloc(strlen(name) + 1, GFP_NORMAL_Z)) == NULL) {
+		kfree(de);
+		return 0;
+	}
+	strcpy(de->name, name);
+	de->ino      = (inode->number == 0 ? TMPFS_ROOT_INO : inode->number);
+	de->next     = tdir->dirents;
+	tdir->dirents = de;
+
+	if ((ti->mode & S_IFMT) == S_IFDIR) {
+		ti->parent = (dir->number == 0 ? TMPFS_ROOT_INO : dir->number);
+	}
+	return 1;
+}
+
+/**
+ * Remove a directory entry.
+ *
+ * \param dir Directory i-node.
+ * \param name File name.
+ * \return 1 on success, 0 if name was not found.
+ */
+static int tmpfs_unlink(vfs_inode *dir, const char *name)
+{
+	tmpfs_inode *tdir;
+	tmpfs_dirent *de, **prev;
+
+	if ((tdir = tmpfs_iget(dir->sb, dir->number)) == NULL) {
+		return 0;
+	}
+
+	for (prev = &tdir->dirents; (de = *prev) != NULL; prev = &de->next) {
+		if (strcmp(de->name, name) == 0) {
+			*prev = de->next;
+			kfree(de->name);
+			kfree(de);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Find a name into a directory.
+ *
+ * \param dir Directory i-node.
+ * \param name File name.
+ * \param ino Found i-node number.
+ * \return 1 if name was found, 0 otherwise.
+ */
+static int tmpfs_lookup(vfs_inode *dir, const char *name, uint32_t *ino)
+{
+	tmpfs_inode *tdir;
+	tmpfs_dirent *de;
+	uint32_t number = (dir->number == 0 ? TMPFS_ROOT_INO : dir->number);
+
+	if ((tdir = tmpfs_iget(dir->sb, number)) == NULL) {
+		return 0;
+	}
+
+	if (strcmp(name, ".") == 0) {
+		*ino = number;
+		return 1;
+	}
+	if (strcmp(name, "..") == 0) {
+		*ino = tdir->parent;
+		return 1;
+	}
+
+	for (de = tdir->dirents; de != NULL; de = de->next) {
+		if (strcmp(de->name, name) == 0) {
+			*ino = de->ino;
+			return 1;
+		}
+	}
+	return 0;
+}
+
@@ -24,14 +24,22 @@
 
 #include <tempos/kernel.h>
 #include <tempos/wait.h>
+#include <tempos/sched.h>
+#include <tempos/timer.h>
 #include <fs/vfs.h>
 #include <fs/device.h>
+#include <fs/dcache.h>
+#include <fs/pagecache.h>
 #include <arch/io.h>
 
 #ifdef CONFIG_FS_EXT2
 	#include <fs/ext2/ext2.h>
 #endif
 
+#ifdef CONFIG_FS_TMPFS
+	#include <fs/tmpfs/tmpfs.h>
+#endif
+
 
 /** I-nodes hash queue */
 vfs_inode **inode_hash_table;
@@ -53,17 +61,37 @@ vfs_fs_type *vfs_filesystems[VFS_SUPPORTED_FS];
 /** Number of file system type already registered */
 static int vfs_reg_types = 0;
 
+/** How access time is updated on reads */
+static int atime_mode = VFS_ATIME_RELATIVE;
+
+/** Interval of writeback thread (seconds) */
+static uint32_t writeback_secs = VFS_WRITEBACK_SECS;
+
 /* Prototypes */
 static uint32_t _ipow(uint32_t x, uint32_t y);
 
+static uint32_t inode_hashfn(dev_t device, uint32_t number);
+
 static vfs_inode *search_inode(dev_t device, uint32_t number);
 
 static void inode_remove_from_freelist(vfs_inode *inode);
 
+static void inode_add_to_freelist(vfs_inode *inode);
+
 static void add_inode_htable(vfs_inode *inode);
 
+static void remove_inode_htable(vfs_inode *inode);
+
 static vfs_inode *get_free_inode(vfs_superblock *sb, uint32_t number);
 
+static void inode_pin(vfs_inode *inode);
+
+static int inode_undirty(vfs_inode *inode);
+
+static void writeback_thread(void *arg);
+
+static uint32_t *bmap_get_ind(vfs_inode *inode, int slot, uint32_t blocknum);
+
 /**
  * Integer power function.
  *
@@ -129,11 +157,36 @@ void register_all_fs_types(void)
 	head->flags = IFLAG_LIST_HEAD;
 	free_inodes_head = head;
 
+	/* At begin, i-nodes are free and unhashed */
+	for (i = 1; i < VFS_MAX_OPEN_FILES; i++) {
+		free_inodes[i].flags     = 0;
+		free_inodes[i].reference = 0;
+		init_waitqueue_head(&free_inodes[i].i_wait);
+		free_inodes[i].i_ext_len = 0;
+		free_inodes[i].i_dirty   = NULL;
+		free_inodes[i].i_dirty_tail = NULL;
+		free_inodes[i].i_dirty_next = NULL;
+		free_inodes[i].i_pages   = NULL;
+		free_inodes[i].i_pages_height = 0;
+		free_inodes[i].i_npages  = 0;
+		memset(free_inodes[i].i_ind_blk, 0, sizeof(free_inodes[i].i_ind_blk));
+	}
+
 	/* Initialize system's file table */
 	file_table = (vfs_file*)kmalloc(sizeof(vfs_file) * VFS_MAX_OPEN_FILES, GFP_NORMAL_Z);
 	if (file_table == NULL) {
 		panic("Could not allocate memory for system's file table.");
 	}
+	memset(file_table, 0, sizeof(vfs_file) * VFS_MAX_OPEN_FILES);
+
+	/* Initialize directory entry cache */
+	dcache_init();
+
+	/* Initialize delayed allocation blocks */
+	vfs_delalloc_init();
+
+	/* Initialize page cache */
+	pagecache_init();
 
 	/* Initialize device drivers interface */
 	init_drivers_interface();
@@ -147,6 +200,10 @@ void register_all_fs_types(void)
 		register_ext2();
 	#endif
 
+	#ifdef CONFIG_FS_TMPFS
+		register_tmpfs();
+	#endif
+
 	return;
 }
 
@@ -165,6 +222,24 @@ void register_fs_type(vfs_fs_type *type)
 	vfs_reg_types++;
 }
 
+/**
+ * Compute the hash queue of an i-node.
+ *
+ * \param device Device which i-node belong.
+ * \param number i-node number.
+ * \return uint32_t Position at i-node hash table.
+ */
+static uint32_t inode_hashfn(dev_t device, uint32_t number)
+{
+	uint32_t key;
+
+	key  = (device.major << 8) ^ device.minor;
+	key  = (key * 0x9E3779B1) ^ number;
+	key ^= (key >> 16);
+
+	return (key % INODE_HASH_TABLE_SIZE);
+}
+
 /**
  * Search for an i-node on i-nodes queue
  *
@@ -174,21 +249,11 @@ void register_fs_type(vfs_fs_type *type)
  */
 static vfs_inode *search_inode(dev_t device, uint32_t number)
 {
-	vfs_inode *head, *tmp;
-	uint32_t pos;
-
-	/* Find position based on i-node number */
-	pos = number % INODE_HASH_TABLE_SIZE;
-	head = inode_hash_table[pos];
+	vfs_inode *tmp;
 
-	if (head == NULL) {
-		return NULL;
-	}
-
-	/* Search for the i-node */
-	tmp = head;
+	tmp = inode_hash_table[inode_hashfn(device, number)];
 	while (tmp != NULL) {
-		if ( DEV_CMP(tmp->device, device) ) {
+		if (tmp->number == number && DEV_CMP(tmp->device, device)) {
 			break;
 		}
 		tmp = tmp->next;
@@ -203,31 +268,47 @@ static vfs_inode *search_inode(dev_t device, uint32_t number)
  */
 static void inode_remove_from_freelist(vfs_inode *inode)
 {
-	vfs_inode *head, *tmp, *prev, *next;
-
-	head = free_inodes_head;
-	tmp = head->free_next;
-	while (tmp != head) {
-		if ( DEV_CMP(tmp->device, inode->device) ) {
-			break;
-		}
-		tmp = tmp->free_next;
-	}
+	vfs_inode *prev, *next;
 
-	if (tmp == head) {
+	cli();
+	if (inode->free_next == NULL) {
 		/* i-node it's not on free list */
+		sti();
 		return;
 	}
 
-	/* Remove i-node */
+	prev = inode->free_prev;
+	next = inode->free_next;
+	prev->free_next = next;
+	next->free_prev = prev;
+
+	inode->free_next = NULL;
+	inode->free_prev = NULL;
+	sti();
+}
+
+/**
+ * Put i-node at the end of free list. The i-node keeps its
+ * hash queue, so it can be reused by vfs_iget() until it is
+ * the least recently released one.
+ *
+ * \param inode i-node.
+ */
+static void inode_add_to_freelist(vfs_inode *inode)
+{
+	vfs_inode *head = free_inodes_head;
+
 	cli();
-	prev = tmp->free_prev;
-	next = tmp->free_next;
+	if (inode->free_next != NULL) {
+		sti();
+		return;
+	}
 
-	next->prev = prev;
-	prev->next = next;
+	inode->free_next = head;
+	inode->free_prev = head->free_prev;
+	head->free_prev->free_next = inode;
+	head->free_prev = inode;
 	sti();
-	return;
 }
 
 /**
@@ -235,118 +316,116 @@ static void inode_remove_from_freelist(vfs_inode *inode)
  *
  * \param sb Super block associated with i-node.
  * \param number i-node number.
- * \return The new i-node.
+ * \return The new i-node, NULL if none could be written back for reuse.
+ * \note The i-node is returned locked and it is not read from device.
  */
 static vfs_inode *get_free_inode(vfs_superblock *sb, uint32_t number)
 {
-	vfs_inode *head, *tmp, *prev, *next;
+	vfs_inode *tmp;
+	uint32_t tries;
 
-	head = free_inodes_head;
-	tmp = head->free_next;
-	
-	/* Sanity check */
-	if (tmp == head) {
-		panic("VFS: no i-node object available!");
-	}
+	/* One pass over free list: failed write backs must not spin forever */
+	for (tries = 0; ; tries++) {
+		/* Least recently released i-node */
+		tmp = free_inodes_head->free_next;
 
-	/* try to find the i-node on the free list */
-	while (tmp != head) {
-		if ( DEV_CMP(tmp->device, sb->device) ) {
+		/* Sanity check */
+		if (tmp == free_inodes_head) {
+			return NULL;
+		}
+
+		if (tmp->i_dirty == NULL && !(tmp->flags & IFLAG_DIRTY)) {
 			break;
 		}
-		tmp = tmp->free_next;
-	}
 
-	if (tmp == head) {
-		/* i-node it's not on free list, pick up any i-node */
-		tmp = head->free_next;
+		if (tries >= VFS_MAX_OPEN_FILES) {
+			kprintf(KERN_ERROR "VFS: no clean i-node to reuse\n");
+			return NULL;
+		}
+
+		/**
+		 * Write delayed blocks and i-node before reuse it. On failure
+		 * i-node keeps its dirty state and goes to the end of free
+		 * list, so next one is tried.
+		 */
+		inode_pin(tmp);
+		if (tmp->i_dirty != NULL && vfs_writeback(tmp) < 0) {
+			kprintf(KERN_ERROR "VFS: could not write delayed blocks of i-node %d\n", tmp->number);
+		} else if (vfs_write_inode(tmp) < 0) {
+			kprintf(KERN_ERROR "VFS: could not write i-node %d\n", tmp->number);
+			vfs_mark_dirty(tmp);
+		}
+		vfs_iput(tmp);
 	}
 
-	/* remove i-node from free list */
-	cli();
-	prev = tmp->free_prev;
-	next = tmp->free_next;
-	prev->free_next = next;
-	next->free_prev = prev;
-	sti();
+	inode_remove_from_freelist(tmp);
+	remove_inode_htable(tmp);
+	vfs_bmap_invalidate(tmp);
+	pagecache_invalidate(tmp);
 
 	/* Initialize i-node */
 	tmp->device.major = sb->device.major;
 	tmp->device.minor = sb->device.minor;
-	tmp->sb = sb;
-	tmp->number = number;
+	tmp->sb        = sb;
+	tmp->number    = number;
 	tmp->reference = 1;
-	/* Read i-node from device */
-	sb->sb_op->get_inode(tmp);
+	tmp->flags     = IFLAG_LOCKED;
+	tmp->i_prealloc_count = 0;
+	tmp->i_alloc_lblk     = 0;
+	tmp->i_alloc_pblk     = 0;
 
 	return tmp;
 }
 
 /**
- * Remove i-node from old hash queue and inser onto new hash queue.
+ * Insert i-node onto its hash queue.
  *
  * \param inode i-node.
  */
 static void add_inode_htable(vfs_inode *inode)
 {
-	vfs_inode *head, *tmp, *prev, *next;
+	vfs_inode *head;
 	uint32_t pos;
 
-	/* Find position based on i-node number */
-	pos = inode->number % INODE_HASH_TABLE_SIZE;
-	head = inode_hash_table[pos];
+	pos  = inode_hashfn(inode->device, inode->number);
 
+	cli();
+	head = inode_hash_table[pos];
+	inode->prev = NULL;
+	inode->next = head;
 	if (head != NULL) {
-		/* Search and remove from hash queue */
-		tmp = head;
-		if (tmp->next == NULL) {
-			inode_hash_table[pos] = NULL;
-		} else {
-			while (tmp->next != NULL) {
-				if ( DEV_CMP(tmp->device, inode->device) ) {
-					cli();
-					prev = tmp->prev;
-					if (tmp->next == NULL) {
-						next = NULL;
-					} else {
-						next = tmp->next;
-						next->prev = prev;
-					}
-					prev->next = next;
-					sti();
-				}
-				tmp = tmp->next;
-			}
-		}
+		head->prev = inode;
 	}
+	inode_hash_table[pos] = inode;
+	inode->flags |= IFLAG_HASHED;
+	sti();
+}
 
-	/* Add to new hash queue */
-	pos = inode->number % INODE_HASH_TABLE_SIZE;
-	head = inode_hash_table[pos];
-
-	if (head == NULL) {
-		inode->next = NULL;
-		inode->prev = NULL;
-		inode_hash_table[pos] = inode;
-		return;
-	} else if (head->next == NULL) {
-		cli();
-		head->next = inode;
-		head->prev = NULL;
-		inode->next = NULL;
-		inode->prev = head;
+/**
+ * Remove i-node from its hash queue (if any).
+ *
+ * \param inode i-node.
+ */
+static void remove_inode_htable(vfs_inode *inode)
+{
+	cli();
+	if ( !(inode->flags & IFLAG_HASHED) ) {
 		sti();
 		return;
 	}
 
-	tmp = head;
-	while(tmp->next != NULL)
-		tmp = tmp->next;
+	if (inode->prev == NULL) {
+		inode_hash_table[inode_hashfn(inode->device, inode->number)] = inode->next;
+	} else {
+		inode->prev->next = inode->next;
+	}
+	if (inode->next != NULL) {
+		inode->next->prev = inode->prev;
+	}
 
-	cli();
-	inode->prev = tmp;
-	inode->next = NULL;
-	tmp->next   = inode;
+	inode->prev   = NULL;
+	inode->next   = NULL;
+	inode->flags &= ~IFLAG_HASHED;
 	sti();
 }
 
@@ -355,6 +434,8 @@ static void add_inode_htable(vfs_inode *inode)
  *
  * \param sb Super block of associated file system.
  * \param number i-node number.
+ * \return The i-node (with one more reference), NULL if there is no free i-node.
+ * \note Each call should be balanced by vfs_iput().
  */
 vfs_inode *vfs_iget(vfs_superblock *sb, uint32_t number)
 {
@@ -365,11 +446,13 @@ vfs_inode *vfs_iget(vfs_superblock *sb, uint32_t number)
 	
 		if ( (inode = search_inode(i_sb->device, number)) != NULL ) {
 			
-			/* Block is in hash table, check if is locked */
-			if ( mutex_is_locked(inode->lock) ) {
-				sleep_on(WAIT_INODE_BECOMES_UNLOCKED);
+			/* i-node is in hash table, check if is locked */
+			cli();
+			if ( (inode->flags & IFLAG_LOCKED) ) {
+				sleep_on(&inode->i_wait);
 				continue;
 			}
+			sti();
 
 			/* Special processing for mount points */
 			if ( (inode->flags & IFLAG_MOUNT_POINT) ) {
@@ -377,6 +460,7 @@ vfs_inode *vfs_iget(vfs_superblock *sb, uint32_t number)
 			}
 
 			inode_remove_from_freelist(inode);
+			inode->reference++;
 			return inode;
 
 		} else {
@@ -384,31 +468,450 @@ vfs_inode *vfs_iget(vfs_superblock *sb, uint32_t number)
 			
 			/* get new free i-node and initialize it */
 			if ((inode = get_free_inode(i_sb, number)) == NULL) {
-				panic("VFS: free i-nodes list empty!");
+				kprintf(KERN_ERROR "VFS: free i-nodes list empty!\n");
+				return NULL;
 			}
 
+			/* get_free_inode() can sleep, i-node may be there now */
+			if (search_inode(i_sb->device, number) != NULL) {
+				inode->reference = 0;
+				inode->flags     = 0;
+				inode_add_to_freelist(inode);
+				continue;
+			}
+
+			/**
+			 * i-node goes to hash table locked, so concurrent
+			 * lookups will wait until it's read from device.
+			 */
 			add_inode_htable(inode);
+			if (!i_sb->sb_op->get_inode(inode)) {
+				/* Never filled: waiters will look it up again */
+				kprintf(KERN_ERROR "VFS: could not read i-node %d\n", number);
+				remove_inode_htable(inode);
+				inode->reference = 0;
+				vfs_iunlock(inode);
+				inode_add_to_freelist(inode);
+				return NULL;
+			}
+			vfs_iunlock(inode);
 
 			return inode;
 		}
 	}
 }
 
+/**
+ * Get one more reference to an i-node already at memory.
+ *
+ * \param inode i-node.
+ * \return The same i-node.
+ */
+vfs_inode *vfs_idup(vfs_inode *inode)
+{
+	if (inode != NULL) {
+		cli();
+		inode->reference++;
+		sti();
+	}
+	return inode;
+}
+
+/**
+ * Release an i-node. When the last reference is released the file system
+ * is notified (put_inode) and the i-node goes to the end of free list,
+ * but stays at hash table to be reused.
+ *
+ * \param inode i-node.
+ */
+void vfs_iput(vfs_inode *inode)
+{
+	if (inode == NULL) {
+		return;
+	}
+
+	cli();
+	if (inode->reference <= 0) {
+		sti();
+		kprintf(KERN_ERROR "VFS: iput on free i-node %d\n", inode->number);
+		return;
+	}
+
+	inode->reference--;
+	if (inode->reference > 0) {
+		sti();
+		return;
+	}
+	sti();
+
+	/* put_inode can sleep, keep i-node locked meanwhile */
+	vfs_ilock(inode);
+	if (inode->i_links_count == 0 && inode->sb->sb_op->free_inode != NULL) {
+		/* Last reference of a removed file: delayed blocks are just dropped */
+		vfs_drop_dirty(inode);
+		inode_undirty(inode);
+		pagecache_invalidate(inode);
+		inode->sb->sb_op->free_inode(inode->sb, inode);
+	}
+	if (inode->sb->sb_op->put_inode != NULL) {
+		inode->sb->sb_op->put_inode(inode);
+	}
+	vfs_iunlock(inode);
+
+	cli();
+	if (inode->reference == 0) {
+		/* Release memory of block map cache before i-node can be reused */
+		vfs_bmap_invalidate(inode);
+		inode_add_to_freelist(inode);
+	}
+	sti();
+}
+
+/**
+ * Take a reference to a cached i-node, removing it from free list
+ * when it was not in use.
+ *
+ * \param inode i-node.
+ */
+static void inode_pin(vfs_inode *inode)
+{
+	cli();
+	if (inode->reference == 0) {
+		inode_remove_from_freelist(inode);
+	}
+	inode->reference++;
+	sti();
+}
+
+/**
+ * Write delayed blocks of all cached i-nodes, then all dirty i-nodes.
+ */
+void vfs_sync(void)
+{
+	vfs_inode *inode;
+	int i;
+
+	for (i = 1; i < VFS_MAX_OPEN_FILES; i++) {
+		inode = &free_inodes[i];
+		if (inode->i_dirty == NULL || !(inode->flags & IFLAG_HASHED)) {
+			continue;
+		}
+
+		inode_pin(inode);
+		if (vfs_writeback(inode) < 0) {
+			kprintf(KERN_ERROR "VFS: could not write i-node %d\n", inode->number);
+		}
+		vfs_iput(inode);
+	}
+
+	for (i = 0; i < VFS_MAX_MOUNTED_FS; i++) {
+		if (mount_table[i].root_inode != NULL &&
+			vfs_write_inodes(&mount_table[i].sb) < 0) {
+			kprintf(KERN_ERROR "VFS: could not write i-nodes of device %d:%d\n",
+					mount_table[i].device.major, mount_table[i].device.minor);
+		}
+	}
+}
+
+/**
+ * Write delayed blocks and i-node of a file to disk.
+ *
+ * \param inode i-node.
+ * \return 0 on success, -1 otherwise.
+ */
+int vfs_fsync(vfs_inode *inode)
+{
+	if (vfs_writeback(inode) < 0) {
+		return -1;
+	}
+	return vfs_write_inode(inode);
+}
+
+/**
+ * Mark an i-node as dirty. Changes are not written right away: dirty
+ * i-nodes are written in batches by vfs_write_inodes() (on sync, by
+ * writeback thread, or when the i-node is going to be reused).
+ *
+ * \param inode i-node.
+ */
+void vfs_mark_dirty(vfs_inode *inode)
+{
+	vfs_inode **pos;
+
+	if ((inode->sb->flags & SB_RDONLY)) {
+		return;
+	}
+
+	cli();
+	if ( (inode->flags & IFLAG_DIRTY) ) {
+		sti();
+		return;
+	}
+
+	/* Keep list sorted, so batches follow disk i-node table order */
+	pos = &inode->sb->s_dirty_inodes;
+	while (*pos != NULL && (*pos)->number < inode->number) {
+		pos = &(*pos)->i_dirty_next;
+	}
+	inode->i_dirty_next = *pos;
+	*pos = inode;
+	inode->flags |= IFLAG_DIRTY;
+	sti();
+}
+
+/**
+ * Remove an i-node from dirty list of its super block.
+ *
+ * \param inode i-node.
+ * \return 1 if i-node was dirty, 0 otherwise.
+ */
+static int inode_undirty(vfs_inode *inode)
+{
+	vfs_inode **pos;
+
+	cli();
+	if ( !(inode->flags & IFLAG_DIRTY) ) {
+		sti();
+		return 0;
+	}
+
+	pos = &inode->sb->s_dirty_inodes;
+	while (*pos != inode) {
+		pos = &(*pos)->i_dirty_next;
+	}
+	*pos = inode->i_dirty_next;
+	inode->i_dirty_next = NULL;
+	inode->flags &= ~IFLAG_DIRTY;
+	sti();
+
+	return 1;
+}
+
+/**
+ * Write an i-node to disk now (if it's dirty).
+ *
+ * \param inode i-node.
+ * \return 0 on success, -1 otherwise.
+ */
+int vfs_write_inode(vfs_inode *inode)
+{
+	if (!inode_undirty(inode)) {
+		return 0;
+	}
+	return (inode->sb->sb_op->write_inode(inode) ? 0 : -1);
+}
+
+/**
+ * Write all dirty i-nodes of a super block. i-nodes are taken in
+ * batches, so file system can coalesce the ones sharing a block.
+ *
+ * \param sb Super block.
+ * \return 0 on success, -1 if some i-node could not be written.
+ */
+int vfs_write_inodes(vfs_superblock *sb)
+{
+	vfs_inode *batch[VFS_INODE_BATCH], *inode;
+	uint32_t n, i;
+	int ret = 0;
+
+	while (sb->s_dirty_inodes != NULL) {
+		/* Take a batch, holding a reference so i-nodes are not reused */
+		n = 0;
+		while (n < VFS_INODE_BATCH && (inode = sb->s_dirty_inodes) != NULL) {
+			inode_pin(inode);
+			if (inode_undirty(inode)) {
+				batch[n++] = inode;
+			} else {
+				/* Written meanwhile by someone else */
+				vfs_iput(inode);
+			}
+		}
+
+		if (sb->sb_op->write_inodes != NULL) {
+			if (!sb->sb_op->write_inodes(sb, batch, n)) {
+				ret = -1;
+			}
+		} else {
+			for (i = 0; i < n; i++) {
+				if (!sb->sb_op->write_inode(batch[i])) {
+					ret = -1;
+				}
+			}
+		}
+
+		for (i = 0; i < n; i++) {
+			vfs_iput(batch[i]);
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * Set how access time of files is updated on reads.
+ *
+ * \param mode VFS_ATIME_NONE, VFS_ATIME_STRICT or VFS_ATIME_RELATIVE.
+ */
+void vfs_set_atime(int mode)
+{
+	atime_mode = mode;
+}
+
+/**
+ * Update access time of an i-node after a read. With relative access
+ * time, it's only updated when it's older than modification/change
+ * time (or than a day), so most reads don't make the i-node dirty.
+ *
+ * \param inode i-node.
+ */
+void vfs_touch_atime(vfs_inode *inode)
+{
+	uint32_t now;
+
+	if (atime_mode == VFS_ATIME_NONE || (inode->sb->flags & SB_RDONLY)) {
+		return;
+	}
+
+	now = get_seconds();
+	if (inode->i_atime == now) {
+		return;
+	}
+	if (atime_mode == VFS_ATIME_RELATIVE &&
+		inode->i_atime > inode->i_mtime && inode->i_atime > inode->i_ctime &&
+		(now - inode->i_atime) < VFS_RELATIME_SECS) {
+		return;
+	}
+
+	inode->i_atime = now;
+	vfs_mark_dirty(inode);
+}
+
+/**
+ * Writeback thread: periodically writes delayed blocks and dirty i-nodes.
+ */
+static void writeback_thread(void *arg)
+{
+	while (1) {
+		msleep(writeback_secs * 1000);
+		vfs_sync();
+	}
+}
+
+/**
+ * Start the writeback thread.
+ *
+ * \param secs Interval between writebacks (seconds), 0 to not start it
+ *             (changes are written only on sync or i-node reuse).
+ */
+void vfs_start_writeback(uint32_t secs)
+{
+	if (secs == 0) {
+		return;
+	}
+
+	writeback_secs = secs;
+	if (kernel_thread_create(DEFAULT_PRIORITY, writeback_thread, NULL) == NULL) {
+		kprintf(KERN_ERROR "VFS: could not start writeback thread.\n");
+	}
+}
+
+/**
+ * Lock an i-node, sleeping while it's locked by other process.
+ *
+ * \param inode i-node.
+ */
+void vfs_ilock(vfs_inode *inode)
+{
+	cli();
+	while ( (inode->flags & IFLAG_LOCKED) ) {
+		sleep_on_exclusive(&inode->i_wait);
+		cli();
+	}
+	inode->flags |= IFLAG_LOCKED;
+	sti();
+}
+
+/**
+ * Unlock an i-node and wake up processes waiting for it (processes
+ * looking it up and the next one to lock it).
+ *
+ * \param inode i-node.
+ */
+void vfs_iunlock(vfs_inode *inode)
+{
+	cli();
+	inode->flags &= ~IFLAG_LOCKED;
+	sti();
+	wakeup(&inode->i_wait);
+}
+
+/**
+ * Drop block map cache of an i-node. Should be called every time
+ * i-node's block table changes (write, truncate, etc).
+ *
+ * \param inode i-node.
+ */
+void vfs_bmap_invalidate(vfs_inode *inode)
+{
+	int i;
+
+	inode->i_ext_len = 0;
+	for (i = 0; i < VFS_BMAP_SLOTS; i++) {
+		if (inode->i_ind_blk[i] != NULL) {
+			kfree(inode->i_ind_blk[i]);
+		}
+		inode->i_ind_blk[i] = NULL;
+		inode->i_ind_nr[i]  = 0;
+	}
+}
+
+/**
+ * Get an indirect block through i-node block map cache.
+ *
+ * \param inode i-node.
+ * \param slot Cache slot.
+ * \param blocknum Indirect block number.
+ * \return uint32_t* Indirect block entries, NULL on error.
+ */
+static uint32_t *bmap_get_ind(vfs_inode *inode, int slot, uint32_t blocknum)
+{
+	char *raw_blk;
+
+	if (inode->i_ind_blk[slot] != NULL) {
+		if (inode->i_ind_nr[slot] == blocknum) {
+			return inode->i_ind_blk[slot];
+		}
+		kfree(inode->i_ind_blk[slot]);
+		inode->i_ind_blk[slot] = NULL;
+	}
+
+	raw_blk = inode->sb->sb_op->get_fs_block(inode->sb, blocknum);
+	if (raw_blk == NULL) {
+		return NULL;
+	}
+
+	inode->i_ind_nr[slot]  = blocknum;
+	inode->i_ind_blk[slot] = (uint32_t*)raw_blk;
+	return inode->i_ind_blk[slot];
+}
+
 /**
  * Translate file byte offset into file system block number, block offset, etc.
  *
  * \param inode File i-node.
  * \param offset File byte offset.
  * \return vfs_bmap_t Structure with converted numbers.
+ * \note Indirect blocks are kept at i-node block map cache and contiguous
+ *       blocks are coalesced into an extent, so sequential access reads
+ *       each indirect block only once.
  */
 vfs_bmap_t vfs_bmap(vfs_inode *inode, uint32_t offset)
 {
 	vfs_bmap_t bmap;
 	uint32_t blk_size, n_entries;
-	uint32_t b_ind, b_ind_number, b_ind_index;
-	char *raw_blk;
+	uint32_t b_ind, b_rel, b_ind_number, b_ind_index;
 	uint32_t *ind_blk;
-	int i, ilevel;
+	int i, ilevel, slot;
 
 	/* Block size (in bytes) */
 	blk_size = inode->sb->s_log_block_size;
@@ -418,6 +921,19 @@ vfs_bmap_t vfs_bmap(vfs_inode *inode, uint32_t offset)
 	bmap.blk_offset = offset - (b_ind * blk_size);
 	bmap.blk_breada = 0;
 
+	/* Check extent cache */
+	if (inode->i_ext_len > 0 && b_ind >= inode->i_ext_lblk &&
+			b_ind < (inode->i_ext_lblk + inode->i_ext_len)) {
+		bmap.blk_number = inode->i_ext_pblk + (b_ind - inode->i_ext_lblk);
+		return bmap;
+	}
+
+	/* File system maps its own blocks (extents) */
+	if (inode->flags & IFLAG_FS_BMAP) {
+		bmap.blk_number = inode->sb->sb_op->bmap(inode, b_ind, 0);
+		return bmap;
+	}
+
 	/* Check indirection level */
 	if (b_ind < VFS_NDIR_BLOCKS) {
 		bmap.blk_number = inode->i_block[b_ind];
@@ -425,38 +941,55 @@ vfs_bmap_t vfs_bmap(vfs_inode *inode, uint32_t offset)
 	} else {
 		/* Calculate how many entries indirect blocks have */
 		n_entries = blk_size / sizeof(inode->i_block[0]);
+		b_rel     = b_ind - VFS_NDIR_BLOCKS;
 		
-		if (b_ind < (VFS_NDIR_BLOCKS + n_entries)) {
+		if (b_rel < n_entries) {
 			/* Single indirection */
 			ilevel = 1;
-			b_ind  = VFS_IND_BLOCK; 
-		} else if (b_ind < (VFS_NDIR_BLOCKS + n_entries + _ipow(n_entries, 2))) {
+			b_ind_number = inode->i_block[VFS_IND_BLOCK];
+		} else if ((b_rel -= n_entries) < _ipow(n_entries, 2)) {
 			/* Double indirection */
 			ilevel = 2;
-			b_ind  = VFS_DIND_BLOCK;
+			b_ind_number = inode->i_block[VFS_DIND_BLOCK];
 		} else {
 			/* Triple indirection */
+			b_rel -= _ipow(n_entries, 2);
 			ilevel = 3;
-			b_ind  = VFS_TIND_BLOCK;
+			b_ind_number = inode->i_block[VFS_TIND_BLOCK];
 		}
 	}
 
 	/* Walk into indirect blocks */
-	b_ind_number = inode->i_block[b_ind];
-	for (i = 0; i < ilevel; i++) {
-		raw_blk = inode->sb->sb_op->get_fs_block(inode->sb, b_ind_number);
-		ind_blk = (uint32_t*)raw_blk;
+	slot = (ilevel * (ilevel - 1)) / 2;
+	for (i = 0; i < ilevel; i++, slot++) {
+		if (b_ind_number == 0) {
+			/* Hole */
+			break;
+		}
 
-		b_ind_index = (offset - 
-				((VFS_NDIR_BLOCKS + _ipow(n_entries, (ilevel-1)) * blk_size)))
-					/ (n_entries * blk_size);
+		ind_blk = bmap_get_ind(inode, slot, b_ind_number);
+		if (ind_blk == NULL) {
+			b_ind_number = 0;
+			break;
+		}
 
+		b_ind_index  = (b_rel / _ipow(n_entries, (ilevel - 1 - i))) % n_entries;
 		b_ind_number = ind_blk[b_ind_index];
-
-		kfree(raw_blk);
 	}
 	bmap.blk_number = b_ind_number;
 
+	/* Update extent cache */
+	if (b_ind_number != 0) {
+		if (inode->i_ext_len > 0 &&
+				b_ind == (inode->i_ext_lblk + inode->i_ext_len) &&
+				b_ind_number == (inode->i_ext_pblk + inode->i_ext_len)) {
+			inode->i_ext_len++;
+		} else {
+			inode->i_ext_lblk = b_ind;
+			inode->i_ext_pblk = b_ind_number;
+			inode->i_ext_len  = 1;
+		}
+	}
+
 	return bmap;
 }
-
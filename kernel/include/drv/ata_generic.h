@@ -87,5 +87,11 @@
 
 	int write_sync_ata_sector(int major, int device, buff_header_t *buf);
 
+	void ata_set_poll_mode(int on);
+
+	void ata_print_sync_latency(void);
+
+	void ata_sync_bench(int major, int device, uint32_t n);
+
 #endif /* BLK_ATA_GENERIC_H */
 
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: fcntl.h
+ * Desc: File control options (open flags)
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FCNTL_H
+
+	#define FCNTL_H
+
+	/* Access modes */
+
+	/** Open for reading only */
+	#define O_RDONLY  0x0000
+	/** Open for writing only */
+	#define O_WRONLY  0x0001
+	/** Open for reading and writing */
+	#define O_RDWR    0x0002
+	/** Access modes mask */
+	#define O_ACCMODE 0x0003
+
+	/* Open flags */
+
+	/** Create file if it does not exist */
+	#define O_CREAT   0x0040
+	/** Writes append data to the end of file */
+	#define O_APPEND  0x0400
+	/** Transfer data straight between device and user buffer (no caching) */
+	#define O_DIRECT  0x4000
+
+#endif /* FCNTL_H */
+
@@ -28,6 +28,7 @@
 	#include <linkedl.h>
 	#include <unistd.h>
 	#include <tempos/mm.h>
+	#include <tempos/wait.h>
 	#include <config.h>
 
 	/* Block buffer: possible status */
@@ -75,18 +76,29 @@
 		int device;
 		/* Status of the buffer */
 		char status;
+		/* Release buffer when asynchronous read completes (read ahead) */
+		char release;
 		/* The data of the block */
 		char data[BUFF_SIZE];
+		/* Direct I/O: data is transferred to/from here instead (NULL otherwise) */
+		char *direct;
 		/* links to make a double linked list into hash queue */
 		struct _buffer_header_t *prev;
 		struct _buffer_header_t *next;
 		/* links to make a circular linked list into free list */
 		struct _buffer_header_t *free_prev;
 		struct _buffer_header_t *free_next;
+		/* Processes waiting for the buffer to become free (exclusive) */
+		wait_queue_head_t wait;
+		/* Processes waiting for device I/O on the buffer to complete */
+		wait_queue_head_t io_wait;
 	};
 	
 	typedef struct _buffer_header_t buff_header_t;
 
+	/** Data of a buffer, as seen by device drivers */
+	#define BUFF_DATA(b)	((b)->direct != NULL ? (b)->direct : (b)->data)
+
 	/** Buffer hash queue. Each device should have one of this. */
 	struct _buff_hash_queue_t {
 		/** How many position are in hash table. */
@@ -95,6 +107,8 @@
 		struct _buffer_header_t **hashtable;
 		/** Free list head */
 		struct _buffer_header_t *freelist_head;
+		/** Processes waiting for some buffer to become free (exclusive) */
+		wait_queue_head_t free_wait;
 		/** Blocks */
 		struct _buffer_header_t blocks[BUFF_QUEUE_SIZE];
 	};
@@ -104,13 +118,21 @@
 	/* Prototypes */
 	buff_hashq_t  *create_hash_queue(uint64_t size);
 	
+	buff_header_t *getblk(int major, int device, uint64_t blocknum);
+
 	buff_header_t *bread(int major, int device, uint64_t blocknum);
 
 	void brelse(int major, int device, buff_header_t *buff);
 
 	buff_header_t *breada(int major, int device, uint64_t blocknum1, uint64_t blocknum2);
 
+	int bprefetch(int major, int device, uint64_t blocknum);
+
+	void biodone(int major, int device, buff_header_t *buff);
+
 	int bwrite(int major, int device, buff_header_t *buff, char type);
 
+	int bdirect_sync(int major, int device, uint64_t blocknum, char *data, int write);
+
 #endif /* BHASH_H */
 
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: blkstat.h
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BLKSTAT_H
+
+	#define BLKSTAT_H
+
+	#include <unistd.h>
+
+	/** Number of log2 (microseconds) buckets of latency histograms */
+	#define BLKSTAT_BUCKETS 24
+
+	/**
+	 * I/O statistics of a block device.
+	 * \note Times are expressed in microseconds and wrap around.
+	 */
+	struct _blk_iostat {
+		/** Completed read requests */
+		uint32_t reads;
+		/** Completed write requests */
+		uint32_t writes;
+		/** Sectors read */
+		uint32_t read_sectors;
+		/** Sectors written */
+		uint32_t write_sectors;
+		/** Requests merged into requests already queued */
+		uint32_t merges;
+		/** Current queue depth */
+		uint32_t in_queue;
+		/** Maximum queue depth seen */
+		uint32_t max_queue;
+		/** Time with at least one request in flight */
+		uint32_t busy_usecs;
+		/** Sum of read latencies (queue + service) */
+		uint32_t read_usecs;
+		/** Sum of write latencies (queue + service) */
+		uint32_t write_usecs;
+		/** bread() requests found in buffer cache */
+		uint32_t cache_hits;
+		/** bread() requests that went to the device */
+		uint32_t cache_misses;
+		/** Read latency histogram: bucket i counts latencies < 2^(i+1) us */
+		uint32_t read_lat[BLKSTAT_BUCKETS];
+		/** Write latency histogram */
+		uint32_t write_lat[BLKSTAT_BUCKETS];
+		/** TSC value when device became busy */
+		uint64_t busy_since;
+	};
+
+	typedef struct _blk_iostat blk_iostat_t;
+
+
+	/* Prototypes */
+	void blkstat_queue(blk_iostat_t *st);
+
+	void blkstat_merge(blk_iostat_t *st);
+
+	void blkstat_complete(blk_iostat_t *st, char write, uint32_t sectors, uint32_t cycles);
+
+	void blkstat_cache(blk_iostat_t *st, char hit);
+
+	uint32_t blkstat_bucket(uint32_t usecs);
+
+	uint32_t blkstat_percentile(uint32_t *hist, uint32_t pct);
+
+	int blkstat_get(int major, blk_iostat_t *st);
+
+	void blkstat_dump(int major);
+
+#endif /* BLKSTAT_H */
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: dcache.h
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * TempOS directory entry cache (name lookup cache).
+ */
+#ifndef VFS_DCACHE_H
+
+	#define VFS_DCACHE_H
+
+	#include <unistd.h>
+	#include <fs/vfs.h>
+
+	/** Number of entries of the directory entry cache */
+	#define DCACHE_SIZE         512
+
+	/** Directory entry cache hash table entries */
+	#define DCACHE_HASH_SIZE    256
+
+	/** Maximum name length of a cached entry (including '\0') */
+	#define DCACHE_NAME_LEN     32
+
+	/* Results of a lookup */
+
+	/** Name is not in cache */
+	#define DCACHE_MISS         0
+	/** Name is in cache */
+	#define DCACHE_HIT          1
+	/** Cache knows that name does not exist */
+	#define DCACHE_NEGATIVE     2
+
+
+	/**
+	 * Directory entry cache entry.
+	 * Entries with inode 0 are negative entries (name does not exist).
+	 */
+	struct _vfs_dentry_st {
+		/** Device of the directory */
+		dev_t device;
+		/** Directory i-node number */
+		uint32_t parent;
+		/** i-node number of the entry (0 = negative entry) */
+		uint32_t inode;
+		/** Hash value of (device, parent, name) */
+		uint32_t hash;
+		/** Entry name */
+		char name[DCACHE_NAME_LEN];
+		/** links to hash queue (NULL prev = not hashed) */
+		struct _vfs_dentry_st *prev;
+		struct _vfs_dentry_st *next;
+		/** links to LRU list */
+		struct _vfs_dentry_st *lru_prev;
+		struct _vfs_dentry_st *lru_next;
+	};
+
+	typedef struct _vfs_dentry_st vfs_dentry;
+
+
+	/* Prototypes */
+	void dcache_init(void);
+
+	int dcache_lookup(vfs_inode *dir, const char *name, uint32_t *ino);
+
+	void dcache_add(vfs_inode *dir, const char *name, uint32_t ino);
+
+	void dcache_invalidate(vfs_inode *dir, const char *name);
+
+	void dcache_purge_dev(dev_t device);
+
+#endif /* VFS_DCACHE_H */
@@ -75,6 +75,7 @@
 
 
 	/* Now, the major numbers */
+	#define DEVMAJOR_NONE        0 /* no hardware (tmpfs) */
 	#define DEVMAJOR_MEMORY      1
 	#define DEVMAJOR_ATA_PRI     3
 	#define DEVMAJOR_ATA_SEC     2
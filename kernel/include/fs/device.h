@@ -28,6 +28,7 @@
 	#include <unistd.h>
 	#include <fs/dev_numbers.h>
 	#include <fs/bhash.h>
+	#include <fs/blkstat.h>
 	#include <fs/vfs.h>
 
 	/** Number of maximum block device drivers */
@@ -82,6 +83,8 @@
 		struct _vfs_inode_st *inodes_hash_table[MAX_MINOR_DEVICES];
 		/** Driver operations */
 		struct _blk_dev_op *dev_ops;
+		/** I/O statistics */
+		blk_iostat_t stats;
 	};
 
 	typedef struct _char_device_driver_t dev_char_driver_t;
@@ -26,6 +26,7 @@
 	#define ELF32_H
 
 	#include <unistd.h>
+	#include <fs/vfs.h>
 
 
 	/* File Identification */
@@ -133,8 +134,74 @@
 	};
 
 
+	/* Dynamic section entry */
+	struct _Elf32_Dyn {
+		Elf32_Sword	d_tag;
+		union {
+			Elf32_Word	d_val;
+			Elf32_Addr	d_ptr;
+		} d_un;
+	};
+
 	typedef struct _Elf32_Ehdr Elf32_Ehdr;
 	typedef struct _Elf32_Phdr Elf32_Phdr;
+	typedef struct _Elf32_Dyn  Elf32_Dyn;
+
+	/* Dynamic section tags */
+	#define DT_NULL		0
+	#define DT_NEEDED	1
+	#define DT_PLTRELSZ	2
+	#define DT_PLTGOT	3
+	#define DT_HASH		4
+	#define DT_STRTAB	5
+	#define DT_SYMTAB	6
+	#define DT_REL		17
+	#define DT_RELSZ	18
+	#define DT_JMPREL	23
+	#define DT_BIND_NOW	24
+
+	/* Auxiliary vector (passed to program interpreter on stack) */
+	#define AT_NULL		0
+	#define AT_PHDR		3
+	#define AT_PHENT	4
+	#define AT_PHNUM	5
+	#define AT_PAGESZ	6
+	#define AT_BASE		7
+	#define AT_ENTRY	9
+
+	/** Maximum number of program headers of an executable */
+	#define ELF32_MAX_PHDRS	32
+
+	/** Load address of position independent executables (ET_DYN) */
+	#define ELF32_DYN_BASE		0x80000000
+	/** Load address of program interpreter (dynamic linker) */
+	#define ELF32_INTERP_BASE	0xB0000000
+
+	/** Executable being loaded */
+	struct _elf32_image {
+		/** Executable file */
+		vfs_inode *inode;
+		/** ELF header */
+		Elf32_Ehdr ehdr;
+		/** Program headers */
+		Elf32_Phdr *phdr;
+		/** Load bias: added to segment addresses (ET_DYN) */
+		uint32_t bias;
+	};
+
+	typedef struct _elf32_image elf32_image;
+
+	struct _task_struct;
+
+	int elf32_open(elf32_image *img, vfs_inode *inode, uint32_t base);
+
+	int elf32_interp(elf32_image *img, char *path, uint32_t size);
+
+	uint32_t elf32_phdr_addr(elf32_image *img);
+
+	int elf32_map(elf32_image *img, struct _task_struct *task, uint32_t *entry);
+
+	void elf32_close(elf32_image *img);
 
 
 #endif /* ELF32_H */
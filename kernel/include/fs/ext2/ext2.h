@@ -32,6 +32,11 @@
 	#define VFS_FS_EXT2
 
 	#include <unistd.h>
+	#include <fs/vfs.h>
+
+	#ifndef SECTOR_SIZE
+		#define SECTOR_SIZE 512
+	#endif
 
 	#define EXT2_MAGIC	0xEF53
 
@@ -52,6 +57,9 @@
 
 	#define EXT2_NAME_LEN 255
 
+	/** Size of a directory entry with a name of length n */
+	#define EXT2_REC_LEN(n) ((8 + (n) + 3) & ~3)
+
 	#define EXT2_BAD_INO          1
 	#define EXT2_ROOT_INO         2
 	#define EXT2_ACL_IDX_INO      3
@@ -60,6 +68,88 @@
 	#define EXT2_UNDEL_DIR_INO    6
 	#define EXT2_FIRST_INO       11 
 
+	/** Compatible feature: directory indexes (htree) */
+	#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x0020
+	/** Incompatible feature: directory entries record file type */
+	#define EXT2_FEATURE_INCOMPAT_FILETYPE 0x0002
+	/** Incompatible feature: file system needs journal recovery */
+	#define EXT3_FEATURE_INCOMPAT_RECOVER  0x0004
+	/** Incompatible feature: files mapped by extents (ext4) */
+	#define EXT4_FEATURE_INCOMPAT_EXTENTS  0x0040
+	/** Incompatible feature: 64 bit block numbers (ext4) */
+	#define EXT4_FEATURE_INCOMPAT_64BIT    0x0080
+	/** Incompatible feature: flexible block groups (ext4) */
+	#define EXT4_FEATURE_INCOMPAT_FLEX_BG  0x0200
+
+	/** Read-only compatible features: sparse super block and large files */
+	#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+	#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE   0x0002
+
+	/** Features that can be read */
+	#define EXT2_FEATURE_INCOMPAT_SUPP (EXT2_FEATURE_INCOMPAT_FILETYPE | \
+										EXT3_FEATURE_INCOMPAT_RECOVER  | \
+										EXT4_FEATURE_INCOMPAT_EXTENTS  | \
+										EXT4_FEATURE_INCOMPAT_64BIT    | \
+										EXT4_FEATURE_INCOMPAT_FLEX_BG)
+
+	/** Features that can be written, others make file system read-only */
+	#define EXT2_FEATURE_INCOMPAT_WRITE   EXT2_FEATURE_INCOMPAT_FILETYPE
+	#define EXT2_FEATURE_RO_COMPAT_WRITE (EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER | \
+										  EXT2_FEATURE_RO_COMPAT_LARGE_FILE)
+
+	/** Minimum size of group descriptors of 64bit file systems */
+	#define EXT4_MIN_DESC_SIZE_64BIT 64
+
+	/** Directory entry file types */
+	#define EXT2_FT_UNKNOWN  0
+	#define EXT2_FT_REG_FILE 1
+	#define EXT2_FT_DIR      2
+
+	/** Default size of preallocation window (in blocks) */
+	#define EXT2_DEFAULT_PREALLOC 8
+
+	/** No group cached */
+	#define EXT2_NO_GROUP 0xFFFFFFFF
+
+	/** i-node table read ahead: maximum blocks read per group */
+	#define EXT2_INODE_RA_BLOCKS 16
+	/** i-node table read ahead: maximum groups per directory block */
+	#define EXT2_INODE_RA_GROUPS 4
+
+	/** i-node flag: directory is indexed by hash tree */
+	#define EXT2_INDEX_FL         0x00001000
+	/** i-node flag: blocks are mapped by an extent tree */
+	#define EXT4_EXTENTS_FL       0x00080000
+
+	/** Extent tree: header magic number */
+	#define EXT4_EXT_MAGIC        0xF30A
+	/** Extent tree: maximum depth */
+	#define EXT4_EXT_MAX_DEPTH    5
+	/** Extent tree: extents longer than this are uninitialized */
+	#define EXT4_EXT_INIT_MAX_LEN 32768
+
+	/** Super block flags: signedness of chars used by directory hashes */
+	#define EXT2_FLAGS_SIGNED_HASH   0x0001
+	#define EXT2_FLAGS_UNSIGNED_HASH 0x0002
+
+	/** Directory index hash versions */
+	#define EXT2_HASH_LEGACY            0
+	#define EXT2_HASH_HALF_MD4          1
+	#define EXT2_HASH_TEA               2
+	#define EXT2_HASH_LEGACY_UNSIGNED   3
+	#define EXT2_HASH_HALF_MD4_UNSIGNED 4
+	#define EXT2_HASH_TEA_UNSIGNED      5
+
+	/** Maximum depth of directory index tree */
+	#define EXT2_HTREE_LEVELS     2
+
+	/** Mask for block field of directory index entries */
+	#define EXT2_DX_BLOCK_MASK    0x0FFFFFFF
+
+	/** Count and limit are stored at hash field of first dx entry */
+	#define EXT2_DX_LIMIT(e)      ((e)[0].hash & 0xFFFF)
+	#define EXT2_DX_COUNT(e)      ((e)[0].hash >> 16)
+
 
 	/**
 	 * EXT2 Super Block structure
@@ -138,9 +228,49 @@
 		uchar8_t s_last_mounted[64]; 
 		/** For compression */
 		uint32_t s_algorithm_usage_bitmap;
+		/** Number of blocks to try to preallocate */
+		uchar8_t s_prealloc_blocks;
+		/** Number to preallocate for dirs */
+		uchar8_t s_prealloc_dir_blocks;
+		/** Padding */
+		uint16_t s_padding1;
+		/** uuid of journal super block */
+		uchar8_t s_journal_uuid[16];
+		/** i-node number of journal file */
+		uint32_t s_journal_inum;
+		/** device number of journal file */
+		uint32_t s_journal_dev;
+		/** start of list of i-nodes to delete */
+		uint32_t s_last_orphan;
+		/** HTREE hash seed */
+		uint32_t s_hash_seed[4];
+		/** Default hash version to use */
+		uchar8_t s_def_hash_version;
+		/** Journal backup type */
+		uchar8_t s_jnl_backup_type;
+		/** Size of group descriptors (64bit feature) */
+		uint16_t s_desc_size;
+		/** Default mount options */
+		uint32_t s_default_mount_opts;
+		/** First metablock block group */
+		uint32_t s_first_meta_bg;
+		/** When the filesystem was created */
+		uint32_t s_mkfs_time;
+		/** Backup of the journal i-node */
+		uint32_t s_jnl_blocks[17];
+		/** 64bit support (ext4) */
+		uint32_t s_blocks_count_hi;
+		uint32_t s_r_blocks_count_hi;
+		uint32_t s_free_blocks_count_hi;
+		/** All i-nodes have at least this extra size */
+		uint16_t s_min_extra_isize;
+		/** New i-nodes should reserve this extra size */
+		uint16_t s_want_extra_isize;
+		/** Miscellaneous flags */
+		uint32_t s_flags;
 		/* --- */
 		/** Padding to 1024 bytes */
-		uint32_t s_reserved[205];  	
+		uint32_t s_reserved[167];
 	};
 
 	/**
@@ -230,10 +360,118 @@
 	};
 
 
+	/**
+	 * EXT2 directory index: root information (placed after "." and "..")
+	 */
+	struct _ext2_dx_root_info_st {
+		/** Always zero */
+		uint32_t reserved_zero;
+		/** Hash version */
+		uchar8_t hash_version;
+		/** Length of this structure (8) */
+		uchar8_t info_length;
+		/** Depth of index tree */
+		uchar8_t indirect_levels;
+		/** Flags (unused) */
+		uchar8_t unused_flags;
+	};
+
+	/**
+	 * EXT2 directory index entry
+	 */
+	struct _ext2_dx_entry_st {
+		/** Lowest hash value of the block */
+		uint32_t hash;
+		/** Logical block number (into directory) */
+		uint32_t block;
+	};
+
+	/**
+	 * Extent tree node header (at i_block and at each tree block)
+	 */
+	struct _ext4_extent_header_st {
+		/** Magic number (EXT4_EXT_MAGIC) */
+		uint16_t eh_magic;
+		/** Number of valid entries */
+		uint16_t eh_entries;
+		/** Capacity of entries */
+		uint16_t eh_max;
+		/** Depth of tree (0 when entries are extents) */
+		uint16_t eh_depth;
+		/** Generation of the tree */
+		uint32_t eh_generation;
+	};
+
+	/**
+	 * Extent tree index entry (internal nodes)
+	 */
+	struct _ext4_extent_idx_st {
+		/** First logic block covered by this index */
+		uint32_t ei_block;
+		/** Block of next level node (low and high 16 bits) */
+		uint32_t ei_leaf_lo;
+		uint16_t ei_leaf_hi;
+		uint16_t ei_unused;
+	};
+
+	/**
+	 * Extent (leaf entries)
+	 */
+	struct _ext4_extent_st {
+		/** First logic block of extent */
+		uint32_t ee_block;
+		/** Number of blocks */
+		uint16_t ee_len;
+		/** First physical block (high 16 bits and low 32 bits) */
+		uint16_t ee_start_hi;
+		uint32_t ee_start_lo;
+	};
+
+	/** 
+	 * This structure is used only by EXT2 driver to keep information about the
+	 * file system into the VFS structure.
+	 */
+	struct _ext2_fs_driver {
+		/** ext2 superblock */
+		struct _ext2_superblock_st *sb;
+		/** group descriptors table (one entry per group) */
+		struct _ext2_group_descriptor_st *gdesc;
+		/** number of groups */
+		uint32_t n_groups;
+		/** size of blocks bitmap */
+		uint32_t blks_bmap_size;
+		/** size of i-node bitmap */
+		uint32_t inodes_bmap_size;
+		/** block size in sector units */
+		uint32_t block_size;
+		/** size of on-disk i-node structure */
+		uint32_t inode_size;
+		/** cached block bitmap and its group */
+		uint32_t *bbitmap;
+		uint32_t bbitmap_group;
+		/** cached i-node bitmap and its group */
+		uint32_t *ibitmap;
+		uint32_t ibitmap_group;
+		/** super block must be written back */
+		char sb_dirty;
+		/** allocator (bitmaps and descriptors) is busy */
+		char alloc_locked;
+		/** processes waiting for the allocator */
+		wait_queue_head_t alloc_wait;
+		/** size of group descriptors on disk */
+		uint32_t desc_size;
+	};
+
+	typedef struct _ext2_fs_driver ext2_fsdriver_t;
 	typedef struct _ext2_superblock_st ext2_superblock_t;
 	typedef struct _ext2_group_descriptor_st ext2_group_t;
 	typedef struct _ext2_inode_st ext2_inode_t;
 	typedef struct _ext2_directory_st ext2_directory_t;
+	typedef struct _ext2_dx_root_info_st ext2_dx_root_info_t;
+	typedef struct _ext2_dx_entry_st ext2_dx_entry_t;
+	typedef struct _ext4_extent_header_st ext4_extent_header_t;
+	typedef struct _ext4_extent_idx_st ext4_extent_idx_t;
+	typedef struct _ext4_extent_st ext4_extent_t;
 
 
 	/* Prototypes */
@@ -243,5 +481,38 @@
 
 	uint32_t get_block_size(ext2_superblock_t sb);
 
+	void ext2_set_htree(int enable);
+
+	void ext2_set_inode_ra(int enable);
+
+	int ext2_prefetch_inodes(vfs_inode *dir, char *block);
+
+	char *ext2_get_fs_block(vfs_superblock *sb, uint32_t blocknum);
+
+	int ext2_read_fs_block(vfs_superblock *sb, uint32_t blocknum, char *data);
+
+	int ext2_prefetch_fs_block(vfs_superblock *sb, uint32_t blocknum);
+
+	int ext2_write_sectors(vfs_superblock *sb, uint32_t blocknum, char *data,
+						   uint32_t offset, uint32_t len);
+
+	/* extents.c */
+	uint32_t ext4_ext_bmap(vfs_inode *inode, uint32_t lblk);
+
+	/* balloc.c */
+	void ext2_set_prealloc(int blocks);
+
+	uint32_t ext2_new_block(vfs_inode *inode, uint32_t goal, uint32_t count);
+
+	void ext2_discard_prealloc(vfs_inode *inode);
+
+	void ext2_free_blocks(vfs_superblock *sb, uint32_t block, uint32_t count);
+
+	uint32_t ext2_new_inode(vfs_superblock *sb, uint32_t parent, uint16_t mode);
+
+	void ext2_release_inode(vfs_superblock *sb, uint32_t ino, uint16_t mode);
+
+	int ext2_write_super(vfs_superblock *sb);
+
 #endif /* VFS_FS_EXT2 */
 
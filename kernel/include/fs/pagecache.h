@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: pagecache.h
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * TempOS page cache: file data cached in pages, indexed by
+ * (i-node, page number). Buffer cache keeps file system metadata.
+ */
+#ifndef VFS_PAGECACHE_H
+
+	#define VFS_PAGECACHE_H
+
+
+	#include <unistd.h>
+	#include <linkedl.h>
+	#include <tempos/mm.h>
+	#include <tempos/wait.h>
+	#include <fs/vfs.h>
+
+	/** Number of pages of the page cache */
+	#define PAGECACHE_PAGES       1024
+
+	/**
+	 * Each radix tree node fills a page: 1024 slots, so two levels
+	 * cover the whole 32 bit file offsets (2^20 pages).
+	 */
+	#define PAGECACHE_RADIX_SHIFT 10
+	#define PAGECACHE_RADIX_SLOTS (1 << PAGECACHE_RADIX_SHIFT)
+	#define PAGECACHE_RADIX_MASK  (PAGECACHE_RADIX_SLOTS - 1)
+	#define PAGECACHE_RADIX_MAX_HEIGHT 2
+
+	/* Page flags */
+
+	/** Page contains valid data */
+	#define PG_UPTODATE           0x01
+	/** Page is being read */
+	#define PG_LOCKED             0x02
+
+
+	/**
+	 * Page of file data
+	 */
+	struct _vfs_page_st {
+		/** i-node (NULL when page is free) */
+		vfs_inode *inode;
+		/** Page number into file */
+		uint32_t index;
+		/** Page data (PAGE_SIZE bytes) */
+		char *data;
+		/** Reference count */
+		int count;
+		/** Flags */
+		uint16_t flags;
+		/** Processes waiting for page to become unlocked */
+		wait_queue_head_t wait;
+		/** links to LRU list of unused pages (NULL when page is in use) */
+		struct _vfs_page_st *lru_prev;
+		struct _vfs_page_st *lru_next;
+	};
+
+	typedef struct _vfs_page_st vfs_page;
+
+
+	/* Prototypes */
+	void pagecache_init(void);
+
+	vfs_page *pagecache_get(vfs_inode *inode, uint32_t index);
+
+	void pagecache_put(vfs_page *page);
+
+	int pagecache_cached(vfs_inode *inode, uint32_t index);
+
+	void pagecache_write(vfs_inode *inode, uint32_t offset, char *buf, uint32_t len);
+
+	void pagecache_invalidate(vfs_inode *inode);
+
+#endif /* VFS_PAGECACHE_H */
+
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: tmpfs.h
+ * Desc: In-memory file system
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef VFS_FS_TMPFS
+
+	#define VFS_FS_TMPFS
+
+	#include <unistd.h>
+	#include <fs/vfs.h>
+
+	/** Maximum number of mounted tmpfs instances */
+	#define TMPFS_MAX_MOUNTS    4
+
+	/** Root directory i-node */
+	#define TMPFS_ROOT_INO      1
+
+	/** Default size limit (KB) */
+	#define TMPFS_DEF_SIZE_KB   4096
+
+	/** Default number of i-nodes */
+	#define TMPFS_DEF_INODES    1024
+
+	/** Maximum file size (in blocks) */
+	#define TMPFS_MAX_FILE_BLOCKS (1 << 20)
+
+
+	/**
+	 * Directory entry
+	 */
+	struct _tmpfs_dirent_st {
+		/** i-node number */
+		uint32_t ino;
+		/** File name */
+		char *name;
+		/** Next entry */
+		struct _tmpfs_dirent_st *next;
+	};
+
+	/**
+	 * i-node (kept in memory while file exists)
+	 */
+	struct _tmpfs_inode_st {
+		uint16_t mode;
+		uint16_t uid;
+		uint16_t gid;
+		uint16_t links_count;
+		uint32_t size;
+		uint32_t atime;
+		uint32_t ctime;
+		uint32_t mtime;
+		uint32_t blocks;
+		/** i-node is in use */
+		char used;
+		/** Parent directory (directories) */
+		uint32_t parent;
+		/** Block map: file block -> tmpfs block (0 for holes) */
+		uint32_t *bmap;
+		/** Number of entries of block map */
+		uint32_t bmap_size;
+		/** Directory entries (directories) */
+		struct _tmpfs_dirent_st *dirents;
+	};
+
+	/**
+	 * tmpfs instance (super block driver data)
+	 */
+	struct _tmpfs_sb_st {
+		/** Instance is mounted */
+		char used;
+		/** Size limit (blocks) */
+		uint32_t max_blocks;
+		/** Number of i-nodes */
+		uint32_t max_inodes;
+		/** Data of each block (index 0 is not used) */
+		char **blocks;
+		/** Stack of free block numbers */
+		uint32_t *free_blocks;
+		uint32_t free_top;
+		/** i-nodes table */
+		struct _tmpfs_inode_st *inodes;
+	};
+
+	typedef struct _tmpfs_dirent_st tmpfs_dirent;
+	typedef struct _tmpfs_inode_st  tmpfs_inode;
+	typedef struct _tmpfs_sb_st     tmpfs_sb;
+
+
+	/* Prototypes */
+	void register_tmpfs(void);
+
+	int tmpfs_mount(const char *path, uint32_t kbytes);
+
+#endif /* VFS_FS_TMPFS */
+
@@ -31,8 +31,10 @@
 	#include <unistd.h>
 	#include <sys/stat.h>
 	#include <fs/bhash.h>
+	#include <tempos/wait.h>
 	#include <fs/device.h>
 	#include <semaphore.h>
+	#include <linkedl.h>
 
 	/** Compare to devices */
 	#define DEV_CMP(d1, d2)	((d1.major == d2.major && d1.minor == d2.minor) ? 1 : 0)
@@ -47,15 +49,40 @@
 	#define VFS_MAX_MOUNTED_FS 512
 
 	/** I-node hash table entries */
-	#define INODE_HASH_TABLE_SIZE VFS_MAX_OPEN_FILES
+	#define INODE_HASH_TABLE_SIZE 1021
 
 	/** Number of file systems supported by TempOS */
-	#define VFS_SUPPORTED_FS 1
+	#define VFS_SUPPORTED_FS 2
 
 	/** i-node is a mount point */
 	#define IFLAG_MOUNT_POINT  0x01
 	/** Head of linked list */
 	#define IFLAG_LIST_HEAD    0x02
+	/** i-node is locked */
+	#define IFLAG_LOCKED       0x04
+	/** i-node is at hash table */
+	#define IFLAG_HASHED       0x08
+	/** i-node blocks are mapped by file system (sb_op->bmap), e.g. extents */
+	#define IFLAG_FS_BMAP      0x10
+	/** i-node has changes not written to disk yet (see vfs_mark_dirty()) */
+	#define IFLAG_DIRTY        0x20
+
+	/** Maximum number of dirty i-nodes written in a batch */
+	#define VFS_INODE_BATCH    64
+
+	/** Default interval of periodic writeback (seconds) */
+	#define VFS_WRITEBACK_SECS 5
+
+	/** Access time updates: never, on every read, or relative (relatime) */
+	#define VFS_ATIME_NONE     0
+	#define VFS_ATIME_STRICT   1
+	#define VFS_ATIME_RELATIVE 2
+
+	/** relatime: access time older than this (seconds) is always updated */
+	#define VFS_RELATIME_SECS  (24 * 60 * 60)
+
+	/** Super block flag: file system is mounted read-only */
+	#define SB_RDONLY          0x01
 
 	/** 
 	 * As EXT2, TempOS VFS i-nodes has 15 addressing blocks.
@@ -69,6 +96,24 @@
 	#define	VFS_DIND_BLOCK      (VFS_IND_BLOCK + 1)
 	#define	VFS_TIND_BLOCK      (VFS_DIND_BLOCK + 1)
 
+	/**
+	 * Indirect blocks cached per i-node by vfs_bmap(): one for single,
+	 * two for double and three for triple indirection path.
+	 */
+	#define VFS_BMAP_SLOTS      6
+
+	/**
+	 * Number of file blocks that can be kept in memory waiting for
+	 * delayed allocation (all i-nodes).
+	 */
+	#define VFS_DIRTY_BLOCKS    1024
+
+	/** Initial read ahead window (in pages) */
+	#define VFS_RA_INIT_PAGES   4
+
+	/** Default maximum read ahead window (in pages) */
+	#define VFS_RA_MAX_PAGES    32
+
 
 	/**
 	 * Super Block structure
@@ -111,6 +156,13 @@
 		dev_t device;
 		/** Flags */
 		uint16_t flags;
+		/**
+		 * Blocks reserved by delayed allocation (already discounted
+		 * from s_free_blocks_count)
+		 */
+		uint32_t s_reserved_blocks;
+		/** Dirty i-nodes, sorted by number (linked by i_dirty_next) */
+		struct _vfs_inode_st *s_dirty_inodes;
 		/** Super block operations for this kind of file system */
 		struct _vfs_sb_operations *sb_op;
 		/** For the use of file system driver */
@@ -146,8 +198,8 @@
 		
 		/* attributes present only at memory */
 		
-		/** Lock for operations */
-		sem_t lock;
+		/** Processes waiting for i-node to become unlocked */
+		wait_queue_head_t i_wait;
 		/** Device which i-node belongs */
 		dev_t device;
 		/** Flags */
@@ -156,16 +208,50 @@
 		int reference;
 		/** i-node number */
 		uint32_t number;
-		/** links to make a double linked list */
+		/** links to make a double linked list into hash queue */
 		struct _vfs_inode_st *prev;
 		struct _vfs_inode_st *next;
-		/** links to free list */
+		/** links to free list (NULL when i-node is in use) */
 		struct _vfs_inode_st *free_next;
 		struct _vfs_inode_st *free_prev;
 		/** Associated super block */
 		struct _vfs_superblock_st *sb;
 		/** For the use of file system driver */
 		void *fs_driver;
+		/** Block map cache: last contiguous run (logical -> physical) */
+		uint32_t i_ext_lblk;
+		uint32_t i_ext_pblk;
+		uint32_t i_ext_len;
+		/** Block map cache: indirect blocks numbers and contents */
+		uint32_t i_ind_nr[VFS_BMAP_SLOTS];
+		uint32_t *i_ind_blk[VFS_BMAP_SLOTS];
+		/** Preallocation window: first block and number of blocks */
+		uint32_t i_prealloc_block;
+		uint32_t i_prealloc_count;
+		/** Last allocated block (logical and physical), allocation goal */
+		uint32_t i_alloc_lblk;
+		uint32_t i_alloc_pblk;
+		/** Blocks waiting for delayed allocation (sorted by logic block) */
+		struct _vfs_dirty_blk_st *i_dirty;
+		struct _vfs_dirty_blk_st *i_dirty_tail;
+		/** Next dirty i-node of the super block */
+		struct _vfs_inode_st *i_dirty_next;
+		/** Page cache: radix tree of pages, its height and number of pages */
+		void **i_pages;
+		uint16_t i_pages_height;
+		uint32_t i_npages;
+	};
+
+	/**
+	 * File block written but not allocated yet (delayed allocation)
+	 */
+	struct _vfs_dirty_blk_st {
+		/** File logic block */
+		uint32_t lblk;
+		/** Block data */
+		char *data;
+		/** Next block of the i-node */
+		struct _vfs_dirty_blk_st *next;
 	};
 
 	/**
@@ -218,12 +304,36 @@
 		char *mnt_on_name;
 	};
 
+	/**
+	 * Read ahead state of an open file (in pages). While reads are
+	 * sequential, the window doubles each time the reader reaches
+	 * async_start, and the next window is read asynchronously.
+	 */
+	struct _vfs_ra_state_st {
+		/** First page of current window */
+		uint32_t start;
+		/** Current window size */
+		uint32_t size;
+		/** Page which triggers the read of next window (0: none) */
+		uint32_t async_start;
+		/** Page expected by next sequential read */
+		uint32_t next;
+	};
+
 	/**
 	 * File structure. Represents a file only at system runtime.
 	 */
 	struct _vfs_file_st {
 		/** File i-node */
 		struct _vfs_inode_st *inode;
+		/** File offset */
+		uint32_t f_pos;
+		/** Open flags (see fcntl.h) */
+		int f_flags;
+		/** Reference count (file descriptors), 0 when entry is free */
+		int f_count;
+		/** Read ahead state */
+		struct _vfs_ra_state_st f_ra;
 	};
 
 	/**
@@ -246,16 +356,51 @@
 		int (*get_inode) (struct _vfs_inode_st *);
 		/** Update disk i-node with current information */
 		int (*write_inode) (struct _vfs_inode_st *);
+		/**
+		 * Update a batch of disk i-nodes, sorted by number (optional).
+		 * i-nodes sharing a disk block should be written together.
+		 */
+		int (*write_inodes) (struct _vfs_superblock_st *, struct _vfs_inode_st **, uint32_t);
 		/** write an i-node to disk and free i-node object */
 		int (*put_inode) (struct _vfs_inode_st *);
-		/** Alloc new i-node */
+		/**
+		 * Alloc new i-node. On input i-node number is the parent directory
+		 * and i_mode the file type, on output number is the new i-node.
+		 */
 		int (*alloc_inode) (struct _vfs_superblock_st *, struct _vfs_inode_st *);
 		/** Delete a i-node and all block associated with it */
 		int (*free_inode) (struct _vfs_superblock_st *, struct _vfs_inode_st *);
 		/** Update super block disk with current information */
 		int (*write_super) (struct _vfs_superblock_st*);
-		/** Retrieve a file system logic block */
+		/** Retrieve a file system logic block (returned memory must be freed) */
 		char *(*get_fs_block) (struct _vfs_superblock_st*, uint32_t blocknum);
+		/** Read a file system logic block into a buffer */
+		int (*read_fs_block) (struct _vfs_superblock_st*, uint32_t blocknum, char *data);
+		/** Start reading a file system logic block into cache (optional) */
+		int (*prefetch_fs_block) (struct _vfs_superblock_st*, uint32_t blocknum);
+		/** Write a whole file system logic block */
+		int (*put_fs_block) (struct _vfs_superblock_st*, uint32_t blocknum, char *data);
+		/**
+		 * Map file logic block to file system block, allocating it
+		 * (and indirect blocks) when create is not zero. Returns 0 on holes.
+		 * create is the number of blocks caller is going to allocate
+		 * from lblk on, so they can be placed contiguously.
+		 */
+		uint32_t (*bmap) (struct _vfs_inode_st *, uint32_t lblk, int create);
+		/** Add a directory entry (dir, name, i-node) */
+		int (*link) (struct _vfs_inode_st *, const char *, struct _vfs_inode_st *);
+		/** Remove a directory entry (dir, name) */
+		int (*unlink) (struct _vfs_inode_st *, const char *);
+		/**
+		 * Find a name into a directory (optional). Returns 1 when name was
+		 * found, 0 when not, and -1 to fall back to VFS linear search.
+		 */
+		int (*lookup) (struct _vfs_inode_st *, const char *, uint32_t *);
+		/**
+		 * Start reading i-nodes referenced by a directory block
+		 * into cache (optional).
+		 */
+		int (*prefetch_inodes) (struct _vfs_inode_st *, char *);
 	};
 
 
@@ -267,6 +412,8 @@
 	typedef struct _vfs_file_st				vfs_file;
 	typedef struct _vfs_sb_operations		vfs_sb_ops;
 	typedef struct _vfs_bmap_st             vfs_bmap_t;
+	typedef struct _vfs_dirty_blk_st        vfs_dirty_blk;
+	typedef struct _vfs_ra_state_st         vfs_ra_state;
 
 
 	/** Global free i-nodes queue */
@@ -290,11 +437,90 @@
 
 	int vfs_mount_root(dev_t device);
 
+	int vfs_mount(const char *fsname, dev_t device, const char *path);
+
+	vfs_inode *vfs_mount_cross(vfs_inode *inode);
+
+	vfs_inode *vfs_mount_parent(vfs_inode *inode);
+
 	vfs_inode *vfs_iget(vfs_superblock *sb, uint32_t number);
 
+	vfs_inode *vfs_idup(vfs_inode *inode);
+
+	void vfs_iput(vfs_inode *inode);
+
+	void vfs_ilock(vfs_inode *inode);
+
+	void vfs_iunlock(vfs_inode *inode);
+
+	void vfs_mark_dirty(vfs_inode *inode);
+
+	int vfs_write_inode(vfs_inode *inode);
+
+	int vfs_write_inodes(vfs_superblock *sb);
+
+	void vfs_set_atime(int mode);
+
+	void vfs_touch_atime(vfs_inode *inode);
+
+	void vfs_start_writeback(uint32_t secs);
+
 	vfs_bmap_t vfs_bmap(vfs_inode *inode, uint32_t offset);
 
+	void vfs_bmap_invalidate(vfs_inode *inode);
+
 	vfs_inode *vfs_namei(const char *pathname);
 
+	void vfs_namei_bench(const char *dirname, uint32_t nfiles, int all);
+
+	vfs_inode *vfs_create(const char *pathname, uint16_t mode);
+
+	int vfs_unlink(const char *pathname);
+
+	int vfs_read_block(vfs_inode *inode, uint32_t lblk, char *buf);
+
+	int vfs_readi(vfs_inode *inode, char *buf, uint32_t offset, uint32_t count);
+
+	int vfs_readi_ra(vfs_inode *inode, vfs_ra_state *ra, char *buf,
+					 uint32_t offset, uint32_t count);
+
+	void vfs_set_readahead(uint32_t kbytes);
+
+	uint32_t vfs_readahead_pages(void);
+
+	void vfs_readahead(vfs_inode *inode, uint32_t index, uint32_t npages);
+
+	int vfs_read(vfs_file *file, char *buf, uint32_t count);
+
+	int vfs_write(vfs_file *file, char *buf, uint32_t count);
+
+	int vfs_pread(vfs_file *file, char *buf, uint32_t count, uint32_t offset);
+
+	int vfs_pwrite(vfs_file *file, char *buf, uint32_t count, uint32_t offset);
+
+	vfs_file *vfs_open(const char *pathname, int flags, uint16_t mode);
+
+	vfs_file *vfs_fdup(vfs_file *file);
+
+	void vfs_close(vfs_file *file);
+
+	int vfs_lseek(vfs_file *file, int32_t offset, int whence);
+
+	int vfs_writei(vfs_inode *inode, char *buf, uint32_t offset, uint32_t count);
+
+	int vfs_sendfile(vfs_file *out, vfs_file *in, uint32_t count);
+
+	void vfs_rw_bench(const char *dirname, uint32_t nfiles, uint32_t kbytes);
+
+	void vfs_delalloc_init(void);
+
+	int vfs_writeback(vfs_inode *inode);
+
+	void vfs_drop_dirty(vfs_inode *inode);
+
+	void vfs_sync(void);
+
+	int vfs_fsync(vfs_inode *inode);
+
 #endif /* VFS_H */
 
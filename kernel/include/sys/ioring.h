@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: ioring.h
+ * Desc: Submission/completion rings for batched I/O
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SYS_IORING_H
+
+	#define SYS_IORING_H
+
+	#include <unistd.h>
+
+	/** Maximum number of submission entries (completion ring is twice) */
+	#define IORING_MAX_ENTRIES  64
+
+	/* Operations */
+
+	/** Do nothing (completion only) */
+	#define IORING_OP_NOP         0
+	/** Read from file descriptor */
+	#define IORING_OP_READ        1
+	/** Write to file descriptor */
+	#define IORING_OP_WRITE       2
+	/** Write file's delayed blocks and i-node to disk */
+	#define IORING_OP_FSYNC       3
+	/** Read sectors from block device */
+	#define IORING_OP_READ_BLOCK  4
+	/** Write sectors to block device */
+	#define IORING_OP_WRITE_BLOCK 5
+
+	/** Offset of read/write: use (and advance) file offset */
+	#define IORING_OFF_CUR      0xFFFFFFFF
+
+	/** Block device number of block operations (fd field) */
+	#define IORING_BLKDEV(major, minor)  (((major) << 16) | ((minor) & 0xFFFF))
+
+	/**
+	 * Submission queue entry
+	 */
+	struct _ioring_sqe_st {
+		/** Operation (IORING_OP_*) */
+		uchar8_t opcode;
+		uchar8_t flags;
+		uint16_t pad;
+		/** File descriptor (block device number for block operations) */
+		int fd;
+		/** File offset (bytes), or first sector for block operations */
+		uint32_t off;
+		/** Buffer address */
+		uint32_t addr;
+		/** Length (bytes; multiple of sector size for block operations) */
+		uint32_t len;
+		/** Returned in completion entry */
+		uint32_t user_data;
+	} __attribute__((packed));
+
+	/**
+	 * Completion queue entry
+	 */
+	struct _ioring_cqe_st {
+		/** user_data of submission entry */
+		uint32_t user_data;
+		/** Result (bytes transferred, 0, or -1 on error) */
+		int res;
+	} __attribute__((packed));
+
+	/**
+	 * Rings, shared between process and kernel (one page). Process
+	 * writes entries at sq_tail and kernel consumes them at sq_head.
+	 * Kernel writes completions at cq_tail, process consumes them at
+	 * cq_head. Indexes are free running (masked to access entries).
+	 */
+	struct _ioring_st {
+		volatile uint32_t sq_head;
+		volatile uint32_t sq_tail;
+		uint32_t sq_entries;
+		uint32_t sq_mask;
+		volatile uint32_t cq_head;
+		volatile uint32_t cq_tail;
+		uint32_t cq_entries;
+		uint32_t cq_mask;
+		struct _ioring_sqe_st sqes[IORING_MAX_ENTRIES];
+		struct _ioring_cqe_st cqes[IORING_MAX_ENTRIES * 2];
+	} __attribute__((packed));
+
+	typedef struct _ioring_sqe_st ioring_sqe;
+	typedef struct _ioring_cqe_st ioring_cqe;
+	typedef struct _ioring_st     ioring_t;
+
+#endif /* SYS_IORING_H */
+
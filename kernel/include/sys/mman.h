@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: mman.h
+ * Desc: Memory management declarations (mmap)
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SYS_MMAN_H
+
+	#define SYS_MMAN_H
+
+	#include <unistd.h>
+
+	/* Memory protection */
+
+	/** Page can not be accessed */
+	#define PROT_NONE      0x00
+	/** Page can be read */
+	#define PROT_READ      0x01
+	/** Page can be written */
+	#define PROT_WRITE     0x02
+	/** Page can be executed */
+	#define PROT_EXEC      0x04
+
+	/* Mapping flags */
+
+	/** Changes are shared (written to file) */
+	#define MAP_SHARED     0x01
+	/** Changes are private (copy on write) */
+	#define MAP_PRIVATE    0x02
+	/** Place mapping exactly at address */
+	#define MAP_FIXED      0x10
+	/** Mapping is not backed by any file (zero filled) */
+	#define MAP_ANONYMOUS  0x20
+
+	/* msync flags */
+
+	/** Schedule write of dirty pages */
+	#define MS_ASYNC       0x01
+	/** Invalidate other mappings of the same file */
+	#define MS_INVALIDATE  0x02
+	/** Write dirty pages and wait for completion */
+	#define MS_SYNC        0x04
+
+	/** Returned by mmap on error */
+	#define MAP_FAILED     ((void*)-1)
+
+
+	/**
+	 * mmap arguments. System calls take up to three arguments
+	 * in registers, so mmap receives a pointer to this structure.
+	 */
+	struct mmap_args {
+		void *addr;
+		size_t len;
+		int prot;
+		int flags;
+		int fd;
+		uint32_t offset;
+	};
+
+#endif /* SYS_MMAN_H */
+
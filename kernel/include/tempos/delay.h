@@ -27,7 +27,14 @@
 
 	#include <unistd.h>
 
+	/** Time stamp counter cycles per jiffy */
+	extern uint32_t tsc_per_jiffy;
+
+	/** Time stamp counter cycles per microsecond */
+	extern uint32_t tsc_per_usec;
+
 	void calibrate_delay(void);
+	uint32_t tsc_to_usecs(uint32_t cycles);
 	void udelay(uint32_t usecs);
 	void mdelay(uint32_t msecs);
 
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: ioring.h
+ * Desc: Submission/completion rings for batched I/O (kernel side)
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef TEMPOS_IORING_H
+
+	#define TEMPOS_IORING_H
+
+	#include <sys/ioring.h>
+
+	/**
+	 * Kernel side of the rings of a process. Sizes are fixed at setup
+	 * and kept here, since the process can write anything to the
+	 * shared page: only its head and tail indexes are read from there.
+	 */
+	struct _ioring_ctx_st {
+		/** Rings (page shared with process) */
+		ioring_t *ring;
+		/** Number of submission entries */
+		uint32_t sq_entries;
+		/** Mask of submission indexes */
+		uint32_t sq_mask;
+		/** Number of completion entries */
+		uint32_t cq_entries;
+		/** Mask of completion indexes */
+		uint32_t cq_mask;
+	};
+
+	typedef struct _ioring_ctx_st ioring_ctx_t;
+
+	void ioring_exit(void);
+
+#endif /* TEMPOS_IORING_H */
+
@@ -76,6 +76,14 @@
 
 	void kfree(void *ptr);
 
+	void *kmalloc_page(uint16_t flags);
+
+	void kfree_page(void *ptr);
+
+	void *kmap_page(uint32_t paddr);
+
+	void kunmap_page(void *ptr);
+
 #endif /* MEM_MANAGER_H */
 
 
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: mmap.h
+ * Desc: Memory mapped files and anonymous memory
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef TEMPOS_MMAP_H
+
+	#define TEMPOS_MMAP_H
+
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <fs/vfs.h>
+	#include <fs/pagecache.h>
+
+	/** Process address space reserved to memory mappings */
+	#define MMAP_AREA_START  0x80000000
+	#define MMAP_AREA_END    0xC0000000
+
+	/** User stack: top of process address space */
+	#define USER_STACK_TOP   MMAP_AREA_END
+	#define USER_STACK_SIZE  0x20000
+
+	/**
+	 * Area flag (kernel only): pages belong to kernel (shared memory
+	 * with a kernel object), they are not released with the area and
+	 * the area can not be unmapped by process.
+	 */
+	#define VM_PINNED        0x1000
+
+	/**
+	 * Page of a mapping. Shared file pages are page cache pages,
+	 * anonymous and written private pages are process's own copies.
+	 */
+	struct _vm_page_st {
+		/** Page cache page (file mappings) */
+		vfs_page *page;
+		/** Private copy (anonymous mappings and copy on write) */
+		char *copy;
+	};
+
+	typedef struct _vm_page_st vm_page_t;
+
+	/**
+	 * Memory mapped area of a process
+	 */
+	struct _vm_area_st {
+		/** First address */
+		uint32_t start;
+		/** Address after last page */
+		uint32_t end;
+		/** Protection (PROT_*) */
+		int prot;
+		/** Flags (MAP_*) */
+		int flags;
+		/** Mapped file (NULL for anonymous mappings) */
+		vfs_inode *inode;
+		/** File page number mapped at start */
+		uint32_t pgoff;
+		/** Address after last byte backed by file, the rest of area
+		    is zero filled (segments of executables) */
+		uint32_t file_end;
+		/** Pages of mapping (one entry per page) */
+		vm_page_t *pages;
+		/** Next area (sorted by address) */
+		struct _vm_area_st *next;
+	};
+
+	typedef struct _vm_area_st vm_area;
+
+	struct _task_struct;
+
+
+	uint32_t do_mmap(uint32_t addr, uint32_t len, int prot, int flags,
+					 vfs_file *file, uint32_t offset);
+
+	int do_munmap(uint32_t addr, uint32_t len);
+
+	vm_area *mmap_segment(struct _task_struct *task, uint32_t addr, uint32_t len,
+						  int prot, vfs_inode *inode, uint32_t offset, uint32_t filesz);
+
+	void mmap_release(struct _task_struct *task);
+
+	int do_msync(uint32_t addr, uint32_t len, int flags);
+
+	int mmap_fault(uint32_t addr, int write);
+
+	void mmap_exit(void);
+
+	uint32_t mmap_kernel_page(void *page, int prot);
+
+#endif /* TEMPOS_MMAP_H */
+
@@ -28,6 +28,9 @@
 	#include <sys/types.h>
 	#include <unistd.h>
 	#include <fs/vfs.h>
+	#include <tempos/mmap.h>
+	#include <tempos/ioring.h>
+	#include <tempos/wait.h>
 	#include <arch/task.h>
 	#include <linkedl.h>
 
@@ -40,8 +43,16 @@
 	/** Task state: Zombie */
 	#define TASK_ZOMBIE       0x03
 
+	/** Number of priority levels (one run queue each) */
+	#define SCHED_PRIO_LEVELS 32
+	/** Highest priority */
+	#define MAX_PRIORITY      0
+	/** Lowest priority */
+	#define MIN_PRIORITY      (SCHED_PRIO_LEVELS - 1)
 	/** Default priority */
-	#define DEFAULT_PRIORITY  0
+	#define DEFAULT_PRIORITY  16
+	/** Priority of idle thread (runs only when nothing else can) */
+	#define IDLE_PRIORITY     MIN_PRIORITY
 
 	/** PID of kernel threads */
 	#define KERNEL_PID 0
@@ -55,6 +66,9 @@
 	/** Maximum number of process */
 	#define MAX_NUM_PROCESS 32000
 
+	/** Maximum number of open files (descriptors) per process */
+	#define PROCESS_MAX_FILES 32
+
 
 	/** Return cur_task circular linked list element (or NULL) */
 	#define GET_TASK(a) (a == NULL ? NULL : (task_t*)a->element)
@@ -80,8 +94,16 @@
 		
 		/** Process state */
 		int state;
-		/** Process priority */
+		/** Process priority (MAX_PRIORITY to MIN_PRIORITY) */
 		int priority;
+		/** Next task on run queue of its priority */
+		struct _task_struct *rq_next;
+		/** Previous task on run queue (head points to tail) */
+		struct _task_struct *rq_prev;
+		/** Task is on a run queue */
+		int on_rq;
+		/** Element of tasks list */
+		c_llist *tnode;
 		/** Process ID */
 		pid_t pid;
 		/** Process's stack base */
@@ -90,12 +112,18 @@
 		char *kstack;
 		/** Return code */
 		int return_code;
-		/** Wait queue */
-		int wait_queue;
+		/** Processes waiting for this one to exit */
+		wait_queue_head_t exit_wait;
 		/** Root i-node */
 		vfs_inode *i_root;
 		/** Current directory i-node */
 		vfs_inode *i_cdir;
+		/** File descriptors table (entries of system's file table) */
+		vfs_file *files[PROCESS_MAX_FILES];
+		/** Memory mapped areas */
+		vm_area *mmap;
+		/** Submission/completion rings (shared with process) */
+		ioring_ctx_t *ioring;
 	};
 	typedef struct _task_struct task_t;
 
@@ -114,6 +142,12 @@
 
 	void schedule(void);
 
+	int sched_add_task(task_t *task);
+
+	void sched_remove_task(task_t *task);
+
+	void sched_wakeup(task_t *task);
+
 	task_t *kernel_thread_create(int priority, void (*start_routine)(void *), void *arg);
 	
 	void kernel_thread_exit(int return_code);
@@ -128,7 +162,25 @@
 
 	pid_t _fork(task_t *thread);
 
-	void _exec_init(char *init_data);
+	int _exec_init(const char *path);
+
+	task_t *exec_process(const char *path, pid_t pid);
+
+	void exec_bench(const char *path, uint32_t n);
+
+	int do_execve(task_t *task, const char *path, char *const argv[],
+				  char *const envp[], int user, uint32_t *entry, uint32_t *sp);
+
+	/* File descriptors (fs/file.c) */
+	int fd_install(vfs_file *file);
+
+	vfs_file *fd_get(int fd);
+
+	int fd_close(int fd);
+
+	void fd_close_all(task_t *task);
+
+	void fd_dup_all(task_t *task);
 
 	/* These are Architecture specific */
 	void arch_init_scheduler(void (*start_routine)(void*));
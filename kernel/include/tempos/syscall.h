@@ -25,10 +25,11 @@
 
 	#define SYSCALL_H
 
-	#define SYSCALL_COUNT 5
+	#define SYSCALL_COUNT 17
 
 #ifndef ASM
 	#include <unistd.h>
+	#include <sys/mman.h>
 
 	#define _pushargs __attribute__((regparm(0)))
 
@@ -37,6 +38,18 @@
 	_pushargs int      sys_execve(const char *filename, char *const argv[], char *const envp[]);
 	_pushargs ssize_t  sys_read(int fd, void *buf, size_t count);
 	_pushargs ssize_t  sys_write(int fd, const void *buf, size_t count);
+	_pushargs int      sys_iostat(int major, void *buf);
+	_pushargs int      sys_open(const char *pathname, int flags, int mode);
+	_pushargs int      sys_close(int fd);
+	_pushargs int      sys_lseek(int fd, int offset, int whence);
+	_pushargs int      sys_mmap(struct mmap_args *uargs);
+	_pushargs int      sys_munmap(void *addr, size_t len);
+	_pushargs int      sys_msync(void *addr, size_t len, int flags);
+	_pushargs ssize_t  sys_sendfile(int out_fd, int in_fd, size_t count);
+	_pushargs int      sys_ioring_setup(uint32_t entries);
+	_pushargs int      sys_ioring_enter(uint32_t to_submit, uint32_t min_complete);
+	_pushargs int      sys_sync(void);
+	_pushargs int      sys_fsync(int fd);
 #endif
 
 #endif /* SYSCALL_H */
@@ -32,6 +32,7 @@
 	#ifdef CONFIG_ARCH_X86
 		#include <x86/x86.h>
 		#include <x86/i82C54.h>
+		#include <x86/mc146818.h>
 		
 		#define TIMER_IRQ	0
 	#endif
@@ -55,5 +56,9 @@
 	void init_timer(void);
 	int new_alarm(uint32_t expires, void (*handler)(pt_regs *, void *), void *arg);
 
+	uint32_t get_seconds(void);
+
+	void msleep(uint32_t msecs);
+
 #endif /* TIMER_H */
 
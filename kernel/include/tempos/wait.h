@@ -26,38 +26,84 @@
 	#define WAIT_H
 
 	#include <unistd.h>
-	#include <tempos/sched.h>
-	#include <linkedl.h>
+	#include <arch/io.h>
+
+	struct _task_struct;
+
+	/** Wait entry flag: exclusive waiter (they are woken one at a time) */
+	#define WQ_FLAG_EXCLUSIVE 0x01
+
+	/**
+	 * Wait queue entry. It lives on the stack of the sleeping process,
+	 * so sleeping does not allocate memory.
+	 */
+	struct _wait_queue_t {
+		/** Sleeping process (NULL once it was woken up) */
+		struct _task_struct *task;
+		/** WQ_FLAG_* */
+		int flags;
+		/** Links into wait queue */
+		struct _wait_queue_t *prev;
+		struct _wait_queue_t *next;
+	};
+
+	typedef struct _wait_queue_t wait_queue_t;
+
+	/**
+	 * Wait queue head, embedded in the object waited for (buffer,
+	 * i-node, etc). Non exclusive waiters are kept in front of
+	 * exclusive ones.
+	 */
+	struct _wait_queue_head_t {
+		/** First waiter */
+		wait_queue_t *first;
+		/** Last waiter */
+		wait_queue_t *last;
+	};
+
+	typedef struct _wait_queue_head_t wait_queue_head_t;
+
+	/** Static initializer of a wait queue head */
+	#define WAIT_QUEUE_HEAD_INIT { NULL, NULL }
+
+	/**
+	 * Sleep until cond becomes true. Condition is checked with
+	 * interrupts disabled, so a wakeup can't be lost between the check
+	 * and going to sleep.
+	 */
+	#define wait_event(q, cond) do {		\
+		cli();								\
+		while ( !(cond) ) {					\
+			sleep_on(q);					\
+			cli();							\
+		}									\
+		sti();								\
+	} while(0)
+
+	/**
+	 * Like wait_event(), but as an exclusive waiter: wakeup() wakes only
+	 * one of them (use it when only one process can get the object).
+	 */
+	#define wait_event_exclusive(q, cond) do {	\
+		cli();								\
+		while ( !(cond) ) {					\
+			sleep_on_exclusive(q);			\
+			cli();							\
+		}									\
+		sti();								\
+	} while(0)
 
-	/** Number of wait addresses */
-	#define WAIT_ADDRESS_SIZE 256
-
-	/* Sleep addresses */
-
-	/** Some block buffer becomes free */
-	#define WAIT_THIS_BLOCK_BUFFER_GET_FREE 1
-
-	/** Any free block buffer becomes free */
-	#define WAIT_BLOCK_BUFFER_GET_FREE 2
-
-	/** Wait for disk operation at primary IDE */
-	#define WAIT_INT_IDE_PRI  14
-	/** Wait for disk operation at secondary IDE */
-	#define WAIT_INT_IDE_SEC  15
-
-	/** Wait for proccess */
-	#define WAIT_KERNEL_THREAD 50
+	/* Prototypes */
 
-	/** Wait for i-node becomes unlocked */
-	#define WAIT_INODE_BECOMES_UNLOCKED 3
+	void init_waitqueue_head(wait_queue_head_t *queue);
 
-	/* Prototypes */
+	void sleep_on(wait_queue_head_t *queue);
 
-	void init_wait_queues(void);
+	void sleep_on_exclusive(wait_queue_head_t *queue);
 
-	void sleep_on(int sleep_addr);
+	void wakeup(wait_queue_head_t *queue);
 
-	void wakeup(int sleep_addr);
+	void wakeup_all(wait_queue_head_t *queue);
 
 #endif /* WAIT_H */
 
@@ -41,5 +41,14 @@
 	typedef long ssize_t;
 	#endif
 
+	/* lseek whence */
+
+	/** Offset is set to offset bytes */
+	#define SEEK_SET 0
+	/** Offset is set to current position plus offset bytes */
+	#define SEEK_CUR 1
+	/** Offset is set to file size plus offset bytes */
+	#define SEEK_END 2
+
 #endif /* UNISTD_H */
 
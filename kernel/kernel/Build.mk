@@ -7,5 +7,5 @@
 
 obj-y += sched.o execve.o exit.o fork.o kernel.o read.o \
 		 syscall.o write.o timer.o delay.o thread.o wait.o \
-		 cmdline.o
+		 cmdline.o iostat.o open.o mman.o sendfile.o ioring.o sync.o
 
@@ -26,11 +26,18 @@
 #include <tempos/kernel.h>
 #include <tempos/timer.h>
 #include <tempos/jiffies.h>
+#include <arch/io.h>
 #include <unistd.h>
 
 /** BogoMIPS calculated at system startup */
 uint32_t bogomips;
 
+/** Time stamp counter cycles per jiffy, calculated at system startup */
+uint32_t tsc_per_jiffy;
+
+/** Time stamp counter cycles per microsecond */
+uint32_t tsc_per_usec;
+
 
 /**
  * Calibrate delay (calculate BogoMIPS)
@@ -38,14 +45,20 @@ uint32_t bogomips;
 void calibrate_delay(void)
 {
 	uint32_t timeout;
+	uint64_t tsc_start;
 	bogomips = 0;
 
 	kprintf(KERN_INFO "Calibrating loop delay...");
 	timeout = jiffies + ((HZ / 10)); /* Calibration takes 100ms */
+	tsc_start = read_tsc();
 	
 	while( !time_after_eq(jiffies, timeout) )
 			bogomips++;
 	
+	/* Same interval measured by the time stamp counter */
+	tsc_per_jiffy = (uint32_t)(read_tsc() - tsc_start) / (HZ / 10);
+	tsc_per_usec  = tsc_per_jiffy / (1000000 / HZ);
+
 	/* FIXME: 3 it's a factor correction */
 	bogomips = bogomips / 300000; /* microsecond precision (us) */
 
@@ -53,6 +66,21 @@ void calibrate_delay(void)
 }
 
 
+/**
+ * Convert time stamp counter cycles to microseconds.
+ *
+ * \param cycles Number of TSC cycles.
+ * \return uint32_t Microseconds (0 if TSC was not calibrated).
+ */
+uint32_t tsc_to_usecs(uint32_t cycles)
+{
+	if (tsc_per_usec == 0) {
+		return 0;
+	}
+	return (cycles / tsc_per_usec);
+}
+
+
 /**
  * Delay in microseconds
  *
@@ -24,13 +24,355 @@
 
 #include <tempos/syscall.h>
 #include <tempos/kernel.h>
+#include <tempos/sched.h>
+#include <tempos/mmap.h>
+#include <tempos/ioring.h>
+#include <tempos/timer.h>
+#include <fs/vfs.h>
+#include <fs/pagecache.h>
+#include <fs/elf32.h>
+#include <arch/uaccess.h>
+#include <x86/x86.h>
+#include <string.h>
 
+/** Maximum number of arguments plus environment strings */
+#define EXEC_MAX_STRINGS 128
+
+/** Words of auxiliary vector (AT_* pairs, see do_execve) */
+#define EXEC_AUX_WORDS   14
+
+/** Maximum number of instances of exec benchmark */
+#define EXEC_BENCH_MAX     32
+
+/** Time instances of exec benchmark run before they are measured (ms) */
+#define EXEC_BENCH_WAIT_MS 500
+
+
+static int copy_strings(char *buf, uint32_t *len, uint32_t *off, int n,
+						char *const vec[], int user);
+
+static uint32_t build_stack(char *page, char *buf, uint32_t len,
+							uint32_t *off, int argc, int envc,
+							uint32_t *aux, int naux);
+
+
+/**
+ * Copy a vector of strings (argv or envp) to a buffer.
+ *
+ * \param buf Destination buffer (PAGE_SIZE bytes).
+ * \param len Used bytes of buffer (updated).
+ * \param off Offsets of strings into buffer (filled from position n).
+ * \param n Number of strings already into buffer.
+ * \param vec NULL terminated vector (NULL means empty).
+ * \param user Vector and strings are in user space.
+ * \return Number of strings copied, or -1 on error (bad vector, or
+ *         strings don't fit).
+ */
+static int copy_strings(char *buf, uint32_t *len, uint32_t *off, int n,
+						char *const vec[], int user)
+{
+	char *str;
+	int i, slen;
+
+	if (vec == NULL) {
+		return 0;
+	}
+
+	for (i = 0; ; i++) {
+		if (user) {
+			if (copy_from_user(&str, &vec[i], sizeof(char*)) != 0) {
+				return -1;
+			}
+		} else {
+			str = vec[i];
+		}
+		if (str == NULL) {
+			break;
+		}
+		if (n + i == EXEC_MAX_STRINGS) {
+			return -1;
+		}
+
+		if (user) {
+			slen = strncpy_from_user(&buf[*len], str, PAGE_SIZE - *len);
+		} else {
+			slen = strlen(str);
+			if ((uint32_t)slen >= PAGE_SIZE - *len) {
+				slen = -1;
+			} else {
+				strcpy(&buf[*len], str);
+			}
+		}
+		if (slen < 0) {
+			return -1;
+		}
+		off[n + i] = *len;
+		*len += slen + 1;
+	}
+
+	return i;
+}
+
+/**
+ * Build the top page of user stack of a new program. From the stack
+ * pointer up: argc, argv pointers, NULL, envp pointers, NULL, the
+ * auxiliary vector (pairs ending with AT_NULL) and the strings.
+ *
+ * \param page Stack page (kernel address).
+ * \param buf Strings (see copy_strings).
+ * \param len Length of strings.
+ * \param off Offsets of strings into buf (argv, then envp).
+ * \param argc Number of arguments.
+ * \param envc Number of environment strings.
+ * \param aux Auxiliary vector (including AT_NULL pair).
+ * \param naux Number of words of auxiliary vector.
+ * \return User stack pointer, or 0 if page is too small.
+ */
+static uint32_t build_stack(char *page, char *buf, uint32_t len,
+							uint32_t *off, int argc, int envc,
+							uint32_t *aux, int naux)
+{
+	uint32_t *vec, base, top, words;
+	int i;
+
+	words = argc + envc + 3 + naux;
+	top   = (PAGE_SIZE - len) & ~0x0F;
+	if (top < words * sizeof(uint32_t)) {
+		return 0;
+	}
+	memcpy(&page[PAGE_SIZE - len], buf, len);
+
+	top  = (top - words * sizeof(uint32_t)) & ~0x0F;
+	base = USER_STACK_TOP - len;
+	vec  = (uint32_t*)&page[top];
+
+	*vec++ = argc;
+	for (i = 0; i < argc; i++) {
+		*vec++ = base + off[i];
+	}
+	*vec++ = 0;
+	for (i = 0; i < envc; i++) {
+		*vec++ = base + off[argc + i];
+	}
+	*vec++ = 0;
+	memcpy(vec, aux, naux * sizeof(uint32_t));
+
+	return (USER_STACK_TOP - PAGE_SIZE + top);
+}
+
+/**
+ * Load a program into a process. The process is the current one, or
+ * a new process with no memory areas yet. Once the executable and the
+ * arguments are checked, old memory areas are released and program
+ * segments and stack are mapped (pages are loaded on demand).
+ * Dynamically linked programs are started by their interpreter, which
+ * is mapped too and finds the program through the auxiliary vector.
+ *
+ * \param task Process.
+ * \param path Program path name.
+ * \param argv Arguments (NULL terminated).
+ * \param envp Environment (NULL terminated).
+ * \param user argv and envp are in user space.
+ * \param entry Entry point (returned).
+ * \param sp User stack pointer (returned).
+ * \return 0 on success, -1 on error (process has no memory areas left
+ *         if the error happened after they were released).
+ */
+int do_execve(task_t *task, const char *path, char *const argv[],
+			  char *const envp[], int user, uint32_t *entry, uint32_t *sp)
+{
+	uint32_t off[EXEC_MAX_STRINGS];
+	uint32_t aux[EXEC_AUX_WORDS];
+	uint32_t len = 0;
+	vfs_inode *inode, *iinode = NULL;
+	elf32_image img, interp;
+	vm_area *stack;
+	char *buf, *page;
+	int argc, envc = 0, has_interp, ret = -1;
+
+	if ((inode = vfs_namei(path)) == NULL) {
+		return -1;
+	}
+	if (elf32_open(&img, inode, ELF32_DYN_BASE) < 0) {
+		vfs_iput(inode);
+		return -1;
+	}
+	interp.phdr = NULL;
+
+	buf  = (char*)kmalloc_page(GFP_NORMAL_Z);
+	page = (char*)kmalloc_page(GFP_NORMAL_Z | GFP_ZEROP);
+	if (buf == NULL || page == NULL) {
+		goto out;
+	}
+
+	/* Program interpreter (buf is used for its name first) */
+	if ((has_interp = elf32_interp(&img, buf, VFS_NAME_LEN)) < 0) {
+		goto out;
+	}
+	if (has_interp) {
+		if ((iinode = vfs_namei(buf)) == NULL ||
+			elf32_open(&interp, iinode, ELF32_INTERP_BASE) < 0 ||
+			elf32_interp(&interp, buf, VFS_NAME_LEN) != 0) {
+			goto out;
+		}
+	}
+
+	aux[0]  = AT_PHDR;
+	aux[1]  = elf32_phdr_addr(&img);
+	aux[2]  = AT_PHENT;
+	aux[3]  = sizeof(Elf32_Phdr);
+	aux[4]  = AT_PHNUM;
+	aux[5]  = img.ehdr.e_phnum;
+	aux[6]  = AT_PAGESZ;
+	aux[7]  = PAGE_SIZE;
+	aux[8]  = AT_BASE;
+	aux[9]  = (has_interp ? interp.bias : 0);
+	aux[10] = AT_ENTRY;
+	aux[11] = img.ehdr.e_entry + img.bias;
+	aux[12] = AT_NULL;
+	aux[13] = 0;
+
+	/* Arguments are copied before old areas go away */
+	if ((argc = copy_strings(buf, &len, off, 0, argv, user)) < 0 ||
+		(envc = copy_strings(buf, &len, off, argc, envp, user)) < 0 ||
+		(*sp = build_stack(page, buf, len, off, argc, envc, aux, EXEC_AUX_WORDS)) == 0) {
+		goto out;
+	}
+
+	/* Point of no return */
+	if (task == GET_TASK(cur_task)) {
+		mmap_exit();
+		ioring_exit();
+	}
+
+	if (elf32_map(&img, task, entry) < 0 ||
+		(has_interp && elf32_map(&interp, task, entry) < 0) ||
+		(stack = mmap_segment(task, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_SIZE,
+							  (PROT_READ | PROT_WRITE), NULL, 0, 0)) == NULL) {
+		mmap_release(task);
+		goto out;
+	}
+
+	/* Top page of stack is ready */
+	stack->pages[(USER_STACK_SIZE >> PAGE_SHIFT) - 1].copy = page;
+	page = NULL;
+	ret  = 0;
+
+out:
+	if (page != NULL) {
+		kfree_page(page);
+	}
+	if (buf != NULL) {
+		kfree_page(buf);
+	}
+	elf32_close(&interp);
+	if (iinode != NULL) {
+		vfs_iput(iinode);
+	}
+	elf32_close(&img);
+	vfs_iput(inode);
+	return ret;
+}
+
+/**
+ * Execute a program: current process image is replaced by the new
+ * program, which starts when system call returns.
+ *
+ * \param filename Program path name (user space).
+ * \param argv Arguments (user space, NULL terminated).
+ * \param envp Environment (user space, NULL terminated).
+ * \return Does not return on success, -1 on error.
+ */
 _pushargs int sys_execve(const char *filename, char *const argv[], char *const envp[])
 {
+	sys_frame *frame = (sys_frame*)&filename;
+	uint32_t entry, sp;
+	char *path;
+	int ret;
+
+	if ((path = (char*)kmalloc(VFS_NAME_LEN, GFP_NORMAL_Z)) == NULL) {
+		return(-1);
+	}
+	if (strncpy_from_user(path, filename, VFS_NAME_LEN) < 0) {
+		kfree(path);
+		return(-1);
+	}
 
-	kprintf(KERN_DEBUG "%s -- %s -- %s\n", filename, argv[0], envp[0]);
+	ret = do_execve(GET_TASK(cur_task), path, argv, envp, 1, &entry, &sp);
+	kfree(path);
+	if (ret < 0) {
+		return(-1);
+	}
 
-	return(-1);
+	/* Return to the new program */
+	frame->eip = entry;
+	frame->esp = sp;
+
+	return(0);
 }
 
+/**
+ * Resident memory benchmark: start N instances of a program and count
+ * their resident pages. Private pages (written data, bss, stack) belong
+ * to each instance, while text pages are page cache pages shared by all
+ * of them, so they are counted once. Instances keep running.
+ *
+ * \param path Program path name.
+ * \param n Number of instances.
+ */
+void exec_bench(const char *path, uint32_t n)
+{
+	task_t *tasks[EXEC_BENCH_MAX];
+	vfs_page **shared;
+	vm_area *area;
+	uint32_t i, j, k, npages, nshared, priv, mapped;
+	pid_t pid;
+
+	if (n > EXEC_BENCH_MAX) {
+		n = EXEC_BENCH_MAX;
+	}
+	shared = (vfs_page**)kmalloc(PAGECACHE_PAGES * sizeof(vfs_page*), GFP_NORMAL_Z);
+	if (shared == NULL) {
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		pid = get_new_pid();
+		if ((tasks[i] = exec_process(path, pid)) == NULL) {
+			release_pid(pid);
+			kprintf(KERN_ERROR "exec bench: could not run %s.\n", path);
+			n = i;
+			break;
+		}
+	}
 
+	/* Let them run (and fault their pages in) */
+	msleep(EXEC_BENCH_WAIT_MS);
+
+	nshared = priv = mapped = 0;
+	for (i = 0; i < n; i++) {
+		for (area = tasks[i]->mmap; area != NULL; area = area->next) {
+			npages = (area->end - area->start) >> PAGE_SHIFT;
+			for (j = 0; j < npages; j++) {
+				if (area->pages[j].copy != NULL) {
+					priv++;
+				}
+				if (area->pages[j].page == NULL) {
+					continue;
+				}
+				mapped++;
+				for (k = 0; k < nshared && shared[k] != area->pages[j].page; k++);
+				if (k == nshared && nshared < PAGECACHE_PAGES) {
+					shared[nshared++] = area->pages[j].page;
+				}
+			}
+		}
+	}
+	kfree(shared);
+
+	kprintf(KERN_INFO "exec bench: %d x %s, resident %d KB (%d KB private, %d KB shared)\n",
+			n, path, (priv + nshared) * (PAGE_SIZE >> 10),
+			priv * (PAGE_SIZE >> 10), nshared * (PAGE_SIZE >> 10));
+	kprintf(KERN_INFO "exec bench: %d KB if each instance had its own text\n",
+			(priv + mapped) * (PAGE_SIZE >> 10));
+}
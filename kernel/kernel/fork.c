@@ -46,67 +46,102 @@ _pushargs void sys_fork(void)
 }
 
 /**
- * This is just for test
+ * Create the first user process (init), running a program.
+ *
+ * \param path Program path name.
+ * \return 0 on success, -1 on error.
  */
-static uint32_t get_phy_addr(void *ptr)
+int _exec_init(const char *path)
 {
-	extern pagedir_t *kerneldir;
-	mregion *mem_area = (mregion *)((void*)ptr - sizeof(mregion));
-	uint32_t index    = mem_area->initial_addr >> TABLE_SHIFT;
-	uint32_t ffpage   = mem_area->initial_addr - (TABLE_SIZE * index);
-	uint32_t *table;
-
-	table = kerneldir->tables[index];
-	return (table[ffpage] & 0xFFFFF000);
+	return (exec_process(path, INIT_PID) != NULL ? 0 : -1);
 }
-void _exec_init(char *init_data)
+
+/**
+ * Create a new user process running a program.
+ *
+ * \param path Program path name.
+ * \param pid Process ID.
+ * \return task_t* New process, or NULL on error.
+ */
+task_t *exec_process(const char *path, pid_t pid)
 {
 	task_t *newth = NULL;
 	char *new_stack = NULL;
 	extern pagedir_t *kerneldir;
 	pagedir_t *pg_pdir;
-	uint32_t *ptable, *dtable, ptable_addr, dtable_addr;
+	uint32_t *dtable, dtable_addr;
 	uint32_t i;
-	uint32_t cs, ss;
+	uint32_t cs, ss, entry, ustack;
+	char *argv[2];
 
 	/* Alloc memory for task structure */
-	newth = (task_t*)kmalloc(sizeof(task_t), GFP_NORMAL_Z | GFP_USER);
+	newth = (task_t*)kmalloc(sizeof(task_t), GFP_NORMAL_Z);
 	if (newth == NULL) {
-		return;
+		return NULL;
 	}
 
 	/* Alloc memory for process's stack */
-	new_stack = (char*)kmalloc(PROCESS_STACK_SIZE, GFP_NORMAL_Z | GFP_USER);
+	new_stack = (char*)kmalloc(PROCESS_STACK_SIZE, GFP_NORMAL_Z);
 	if (new_stack == NULL) {
 		kfree(newth);
-		return;
+		return NULL;
 	}
 
 	/* Alloc memory for page table directory */
-	pg_pdir = (pagedir_t*)kmalloc(sizeof(pagedir_t), GFP_NORMAL_Z | GFP_USER);
-	if (pg_pdir == NULL) {
+	pg_pdir = (pagedir_t*)kmalloc(sizeof(pagedir_t), GFP_NORMAL_Z);
+	dtable  = (uint32_t*)kmalloc_page(GFP_NORMAL_Z);
+	if (pg_pdir == NULL || dtable == NULL) {
+		if (pg_pdir != NULL) {
+			kfree(pg_pdir);
+		}
 		kfree(newth);
 		kfree(new_stack);
-		return;
+		return NULL;
 	}
 	
 	/* Set process structure */
 	newth->state       = TASK_READY_TO_RUN;
 	newth->priority    = DEFAULT_PRIORITY;
-	newth->pid         = get_new_pid();
+	newth->pid         = pid;
 	newth->stack_base  = new_stack;
 	newth->return_code = 0;
-	newth->wait_queue  = 0;
+	init_waitqueue_head(&newth->exit_wait);
+	memset(newth->files, 0, sizeof(newth->files));
+	newth->mmap = NULL;
+	newth->ioring = NULL;
 	newth->kstack = (char*)((void*)new_stack + PROCESS_STACK_SIZE);
 
-	newth->arch_tss.regs.eip = (uint32_t)0xC0000C; /* Start point */
-/*	newth->arch_tss.regs.ds  = KERNEL_DS;
-	newth->arch_tss.regs.fs  = KERNEL_DS;
-	newth->arch_tss.regs.gs  = KERNEL_DS;
-	newth->arch_tss.regs.ss  = KERNEL_DS;
-	newth->arch_tss.regs.es  = KERNEL_DS;
-	newth->arch_tss.regs.cs  = KERNEL_CS;
-*/
+	/* Kernel is shared, process space (mmap area) is private */
+	dtable_addr = virt_to_phys(dtable);
+	for (i = 0; i < 1024; i++) {
+		if (i >= (MMAP_AREA_START >> (PAGE_SHIFT + TABLE_SHIFT)) &&
+			i < (MMAP_AREA_END >> (PAGE_SHIFT + TABLE_SHIFT))) {
+			/* mmap area: page tables are allocated on demand */
+			pg_pdir->tables[i] = NULL;
+			dtable[i] = 0;
+			continue;
+		}
+		pg_pdir->tables[i] = kerneldir->tables[i];
+		dtable[i] = kerneldir->tables_phy_addr[i] | PAGE_USER;
+	}
+	pg_pdir->tables_phy_addr = dtable;
+	pg_pdir->dir_phy_addr    = dtable_addr;
+
+	newth->arch_tss.cr3   = pg_pdir->dir_phy_addr;
+	newth->arch_tss.pgdir = pg_pdir;
+
+	/* Load program (pages are read on demand, once process runs) */
+	argv[0] = (char*)path;
+	argv[1] = NULL;
+	if (do_execve(newth, path, argv, NULL, 0, &entry, &ustack) < 0) {
+		kfree_page(dtable);
+		kfree(pg_pdir);
+		kfree(new_stack);
+		kfree(newth);
+		return NULL;
+	}
+
+	newth->arch_tss.regs.eip = entry;
 	newth->arch_tss.regs.ds  = USER_DS_RPL;
 	newth->arch_tss.regs.fs  = USER_DS_RPL;
 	newth->arch_tss.regs.gs  = USER_DS_RPL;
@@ -119,37 +154,11 @@ void _exec_init(char *init_data)
 	/* Setup thread context into stack */
 	newth->arch_tss.regs.esp = (uint32_t)newth->kstack - (14 * sizeof(newth->arch_tss.regs.eax)) - sizeof(newth->arch_tss.regs.ds);
 
-	ptable_addr = alloc_page(GFP_NORMAL_Z);
-	dtable_addr = alloc_page(GFP_NORMAL_Z);
-
-	/* Map dtable at 0x1000000 */
-	kerneldir->tables[4][0] = MAKE_ENTRY(dtable_addr, (PAGE_WRITABLE | PAGE_PRESENT | PAGE_USER));
-	dtable = (uint32_t*)0x1000000;
-	for (i = 0; i < 1024; i++) {
-		pg_pdir->tables[i] = kerneldir->tables[i];
-		dtable[i] = kerneldir->tables_phy_addr[i] | PAGE_USER;
-	}
-	dtable[3] = MAKE_ENTRY(ptable_addr, (PAGE_WRITABLE | PAGE_PRESENT | PAGE_USER));
-
-	/* Now, map ptable at 0xC00000 just for fill data */
-	kerneldir->tables[3][0] = MAKE_ENTRY(ptable_addr, (PAGE_WRITABLE | PAGE_PRESENT | PAGE_USER));
-	ptable = (uint32_t*)0xC00000;
-	ptable[0] = MAKE_ENTRY(get_phy_addr(init_data), (PAGE_WRITABLE | PAGE_PRESENT | PAGE_USER));
-
-	pg_pdir->tables_phy_addr = dtable; //(uint32_t*)dtable_addr;
-	pg_pdir->dir_phy_addr = dtable_addr;
-
-	/* 12MB : start point */
-	//kerneldir->tables[3][0] = MAKE_ENTRY(get_phy_addr(init_data), (PAGE_PRESENT));
-	//pg_pdir->dir_phy_addr = kerneldir->dir_phy_addr;
-	
-	newth->arch_tss.cr3 = pg_pdir->dir_phy_addr;
-
-	/* Configure thread's stack */
+	/* Configure thread's stack (iret goes to user stack) */
 	cs = newth->arch_tss.regs.cs;
 	ss = newth->arch_tss.regs.ss;
 	push_into_stack(newth->kstack, ss);
-	push_into_stack(newth->kstack, newth->arch_tss.regs.esp);
+	push_into_stack(newth->kstack, ustack);
 	push_into_stack(newth->kstack, newth->arch_tss.regs.eflags);
 	push_into_stack(newth->kstack, cs);
 	push_into_stack(newth->kstack, newth->arch_tss.regs.eip);
@@ -166,10 +175,18 @@ void _exec_init(char *init_data)
 
 	/* Add to task queue */
 	cli();
-	c_llist_add(&tasks, newth);
+	if (!sched_add_task(newth)) {
+		sti();
+		mmap_release(newth);
+		kfree_page(dtable);
+		kfree(pg_pdir);
+		kfree(new_stack);
+		kfree(newth);
+		return NULL;
+	}
 	sti();
 
-	return;
+	return newth;
 }
 
 /**
@@ -196,8 +213,21 @@ pid_t _fork(task_t *thread)
 		return -1;
 	}
 
-	/* Copy process structure */
+	/* Copy process structure (open files are shared) */
 	memcpy(newth, thread, sizeof(task_t));
+	init_waitqueue_head(&newth->exit_wait);
+	fd_dup_all(newth);
+
+	/* Memory mappings (and rings) belong to the parent */
+	newth->mmap   = NULL;
+	newth->ioring = NULL;
+
+	/* Child is not on any queue yet, sched_add_task() puts it there */
+	newth->state   = TASK_READY_TO_RUN;
+	newth->rq_next = NULL;
+	newth->rq_prev = NULL;
+	newth->on_rq   = 0;
+	newth->tnode   = NULL;
 
 	/* Alloc a PID */
 	child = get_new_pid();
@@ -214,7 +244,14 @@ pid_t _fork(task_t *thread)
 
 	/* Add to task queue */
 	cli();
-	c_llist_add(&tasks, newth);
+	if (!sched_add_task(newth)) {
+		sti();
+		fd_close_all(newth);
+		release_pid(child);
+		kfree(new_stack);
+		kfree(newth);
+		return -1;
+	}
 	sti();
 
 	/* This is the father, so return child's PID */
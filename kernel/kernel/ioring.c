@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: ioring.c
+ * Desc: Submission/completion rings for batched I/O
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/ioring.h>
+#include <tempos/syscall.h>
+#include <tempos/kernel.h>
+#include <tempos/sched.h>
+#include <tempos/mmap.h>
+#include <tempos/mm.h>
+#include <fs/vfs.h>
+#include <fs/bhash.h>
+#include <fs/device.h>
+#include <arch/uaccess.h>
+
+
+static dev_blk_driver_t *blk_driver(int dev);
+
+static void ioring_prefetch(ioring_sqe *sqe);
+
+static int ioring_blkio(ioring_sqe *sqe, int write);
+
+static int ioring_do(ioring_sqe *sqe);
+
+
+/**
+ * Return driver of block device number of a submission entry.
+ *
+ * \param dev Device number (IORING_BLKDEV).
+ * \return dev_blk_driver_t* Driver, or NULL if there is no such device.
+ */
+static dev_blk_driver_t *blk_driver(int dev)
+{
+	uint32_t major = (uint32_t)dev >> 16;
+
+	if (major >= MAX_DEVBLOCK_DRIVERS) {
+		return NULL;
+	}
+	return block_dev_drivers[major];
+}
+
+/**
+ * Start asynchronous reads of data needed by an entry, so all reads
+ * of a batch are queued at disk before waiting for the first one.
+ *
+ * \param sqe Submission entry.
+ */
+static void ioring_prefetch(ioring_sqe *sqe)
+{
+	vfs_file *file;
+	uint32_t off, i;
+
+	if (sqe->len == 0) {
+		return;
+	}
+
+	switch (sqe->opcode) {
+		case IORING_OP_READ:
+			if ((file = fd_get(sqe->fd)) == NULL) {
+				return;
+			}
+			off = (sqe->off == IORING_OFF_CUR ? file->f_pos : sqe->off);
+			vfs_readahead(file->inode, off >> PAGE_SHIFT,
+						  ((off + sqe->len - 1) >> PAGE_SHIFT) - (off >> PAGE_SHIFT) + 1);
+			return;
+
+		case IORING_OP_READ_BLOCK:
+			if (blk_driver(sqe->fd) == NULL) {
+				return;
+			}
+			for (i = 0; i < sqe->len / BUFF_SIZE; i++) {
+				if (bprefetch((uint32_t)sqe->fd >> 16, sqe->fd & 0xFFFF,
+							  sqe->off + i) < 0) {
+					return;
+				}
+			}
+			return;
+
+		default:
+			return;
+	}
+}
+
+/**
+ * Read or write sectors of a block device through buffer cache.
+ *
+ * \param sqe Submission entry.
+ * \param write 1 to write, 0 to read.
+ * \return Number of bytes transferred, or -1 on error.
+ */
+static int ioring_blkio(ioring_sqe *sqe, int write)
+{
+	int major = (uint32_t)sqe->fd >> 16;
+	int minor = sqe->fd & 0xFFFF;
+	char *buf = (char*)sqe->addr;
+	buff_header_t *blk;
+	uint32_t i, left;
+	int ret;
+
+	if (blk_driver(sqe->fd) == NULL || sqe->len == 0 || (sqe->len % BUFF_SIZE)) {
+		return -1;
+	}
+
+	for (i = 0; i < sqe->len / BUFF_SIZE; i++, buf += BUFF_SIZE) {
+		if (write) {
+			if ((blk = getblk(major, minor, sqe->off + i)) == NULL) {
+				break;
+			}
+			left = copy_from_user(blk->data, buf, BUFF_SIZE);
+			ret  = 0;
+			if (left == 0) {
+				ret = bwrite(major, minor, blk, BWRITE_SYNC);
+			}
+		} else {
+			if ((blk = bread(major, minor, sqe->off + i)) == NULL) {
+				break;
+			}
+			left = copy_to_user(buf, blk->data, BUFF_SIZE);
+			ret  = 0;
+		}
+		brelse(major, minor, blk);
+		if (left > 0 || ret < 0) {
+			break;
+		}
+	}
+
+	return (i > 0 ? (int)(i * BUFF_SIZE) : -1);
+}
+
+/**
+ * Execute a submission entry.
+ *
+ * \param sqe Submission entry.
+ * \return Result of operation (to completion entry).
+ */
+static int ioring_do(ioring_sqe *sqe)
+{
+	vfs_file *file = NULL;
+
+	if (sqe->opcode == IORING_OP_READ || sqe->opcode == IORING_OP_WRITE ||
+		sqe->opcode == IORING_OP_FSYNC) {
+		if ((file = fd_get(sqe->fd)) == NULL) {
+			return -1;
+		}
+	}
+
+	switch (sqe->opcode) {
+		case IORING_OP_NOP:
+			return 0;
+
+		case IORING_OP_READ:
+			if (sqe->off == IORING_OFF_CUR) {
+				return vfs_read(file, (char*)sqe->addr, sqe->len);
+			}
+			return vfs_pread(file, (char*)sqe->addr, sqe->len, sqe->off);
+
+		case IORING_OP_WRITE:
+			if (sqe->off == IORING_OFF_CUR) {
+				return vfs_write(file, (char*)sqe->addr, sqe->len);
+			}
+			return vfs_pwrite(file, (char*)sqe->addr, sqe->len, sqe->off);
+
+		case IORING_OP_FSYNC:
+			return vfs_fsync(file->inode);
+
+		case IORING_OP_READ_BLOCK:
+			return ioring_blkio(sqe, 0);
+
+		case IORING_OP_WRITE_BLOCK:
+			return ioring_blkio(sqe, 1);
+
+		default:
+			return -1;
+	}
+}
+
+/**
+ * Create the rings of current process and map them into its address
+ * space.
+ *
+ * \param entries Number of submission entries (power of 2, up to
+ *                IORING_MAX_ENTRIES). Completion ring has twice entries.
+ * \return Address of rings (ioring_t), or -1 on error.
+ */
+_pushargs int sys_ioring_setup(uint32_t entries)
+{
+	task_t *task = GET_TASK(cur_task);
+	ioring_ctx_t *ctx;
+	ioring_t *ring;
+	uint32_t addr;
+
+	if (task->ioring != NULL || entries == 0 ||
+		entries > IORING_MAX_ENTRIES || (entries & (entries - 1))) {
+		return(-1);
+	}
+
+	if ((ctx = (ioring_ctx_t*)kmalloc(sizeof(ioring_ctx_t), GFP_NORMAL_Z)) == NULL) {
+		return(-1);
+	}
+	if ((ring = (ioring_t*)kmalloc_page(GFP_NORMAL_Z | GFP_ZEROP)) == NULL) {
+		kfree(ctx);
+		return(-1);
+	}
+	ctx->ring       = ring;
+	ctx->sq_entries = entries;
+	ctx->sq_mask    = entries - 1;
+	ctx->cq_entries = entries * 2;
+	ctx->cq_mask    = (entries * 2) - 1;
+
+	/* Copy for the process only, kernel never reads them back */
+	ring->sq_entries = ctx->sq_entries;
+	ring->sq_mask    = ctx->sq_mask;
+	ring->cq_entries = ctx->cq_entries;
+	ring->cq_mask    = ctx->cq_mask;
+
+	addr = mmap_kernel_page(ring, (PROT_READ | PROT_WRITE));
+	if (addr == (uint32_t)MAP_FAILED) {
+		kfree_page(ring);
+		kfree(ctx);
+		return(-1);
+	}
+
+	task->ioring = ctx;
+	return((int)addr);
+}
+
+/**
+ * Submit entries of submission ring. Reads of all submitted entries
+ * are started first, then entries are executed in order and their
+ * completions are posted. Operations complete before this call
+ * returns, so waiting for min_complete completions never blocks: the
+ * call fails (submitting nothing) if they could not be available.
+ * Indexes read from the shared page are checked against ring sizes
+ * kept by kernel, entries are always accessed through kernel's masks.
+ *
+ * \param to_submit Number of entries to submit.
+ * \param min_complete Minimum number of pending completions.
+ * \return Number of entries submitted, or -1 on error.
+ */
+_pushargs int sys_ioring_enter(uint32_t to_submit, uint32_t min_complete)
+{
+	task_t *task = GET_TASK(cur_task);
+	ioring_ctx_t *ctx = task->ioring;
+	ioring_t *ring;
+	ioring_sqe sqe;
+	ioring_cqe *cqe;
+	uint32_t head, tail, pending, avail, room, i;
+
+	if (ctx == NULL) {
+		return(-1);
+	}
+	ring = ctx->ring;
+
+	/* Each index is read once, process may change them meanwhile */
+	head    = ring->sq_head;
+	avail   = ring->sq_tail - head;
+	tail    = ring->cq_tail;
+	pending = tail - ring->cq_head;
+	if (avail > ctx->sq_entries || pending > ctx->cq_entries) {
+		/* Corrupted indexes */
+		return(-1);
+	}
+	room = ctx->cq_entries - pending;
+
+	/* Never overflow completion ring */
+	if (to_submit > avail) {
+		to_submit = avail;
+	}
+	if (to_submit > room) {
+		to_submit = room;
+	}
+
+	/* No completions could come later: it would wait forever */
+	if (pending + to_submit < min_complete) {
+		return(-1);
+	}
+
+	for (i = 0; i < to_submit; i++) {
+		sqe = ring->sqes[(head + i) & ctx->sq_mask];
+		ioring_prefetch(&sqe);
+	}
+
+	for (i = 0; i < to_submit; i++) {
+		/* Entry could be changed by process meanwhile */
+		sqe = ring->sqes[(head + i) & ctx->sq_mask];
+		ring->sq_head = head + i + 1;
+
+		cqe = &ring->cqes[tail & ctx->cq_mask];
+		cqe->user_data = sqe.user_data;
+		cqe->res       = ioring_do(&sqe);
+		ring->cq_tail  = ++tail;
+	}
+
+	return((int)to_submit);
+}
+
+/**
+ * Release rings of current process (on exit, after its mappings).
+ */
+void ioring_exit(void)
+{
+	task_t *task = GET_TASK(cur_task);
+
+	if (task->ioring != NULL) {
+		kfree_page(task->ioring->ring);
+		kfree(task->ioring);
+		task->ioring = NULL;
+	}
+}
+
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: iostat.c
+ * Desc: Syscall iostat
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/syscall.h>
+#include <tempos/kernel.h>
+#include <fs/blkstat.h>
+#include <arch/uaccess.h>
+
+/**
+ * Retrieve I/O statistics of a block device.
+ *
+ * \param major Major number of the device (-1 for all devices when dumping).
+ * \param buf Where statistics (blk_iostat_t) will be copied to. If NULL,
+ *            statistics are shown on the console.
+ * \return 0 on success, -1 otherwise.
+ */
+_pushargs int sys_iostat(int major, void *buf)
+{
+	blk_iostat_t st;
+
+	if (buf == NULL) {
+		blkstat_dump(major);
+		return(0);
+	}
+
+	if (blkstat_get(major, &st) < 0 ||
+		copy_to_user(buf, &st, sizeof(st)) != 0) {
+		return(-1);
+	}
+	return(0);
+}
+
@@ -33,6 +33,12 @@
 #include <drv/ata_generic.h>
 #include <fs/vfs.h>
 #include <fs/device.h>
+#ifdef CONFIG_FS_EXT2
+	#include <fs/ext2/ext2.h>
+#endif
+#ifdef CONFIG_FS_TMPFS
+	#include <fs/tmpfs/tmpfs.h>
+#endif
 #include <string.h>
 #include <stdlib.h>
 #include <linkedl.h>
@@ -68,9 +74,6 @@ void tempos_main(karch_t kinf)
 	/* Keyboard */
 	init_8042();
 
-	/* Initialize wait queues */
-	init_wait_queues();
-
 	/* Initialize the scheduler */
 	init_scheduler(kernel_main_thread);
 
@@ -95,14 +98,14 @@ void thread1(void *arg)
  */
 void kernel_main_thread(void *arg)
 {
-	char rdev_str[10], *rstr, *init;
+	char rdev_str[10], *rstr, *init, *dir;
 	dev_t rootdev;
 	size_t i, rdev_len;
 	
 	/* NOTE: keep calling order for the functions below */
 
 	/* Create idle thread */
-	kernel_thread_create(DEFAULT_PRIORITY, idle_thread, NULL);
+	kernel_thread_create(IDLE_PRIORITY, idle_thread, NULL);
 
 	/* Initialize Virtual File System layer */
 	register_all_fs_types();
@@ -117,6 +120,28 @@ void kernel_main_thread(void *arg)
 	kprintf(KERN_INFO "Kernel command line: %s\n", kinfo.cmdline);
 	parse_cmdline((char*)kinfo.cmdline);
 
+	/* Polled completion of synchronous disk reads */
+	if ((rstr = cmdline_get_value("ata_poll")) != NULL) {
+		ata_set_poll_mode(atoi(rstr));
+	}
+
+#ifdef CONFIG_FS_EXT2
+	/* Directory index lookups */
+	if ((rstr = cmdline_get_value("ext2_htree")) != NULL) {
+		ext2_set_htree(atoi(rstr));
+	}
+
+	/* i-node table read ahead on directory scans */
+	if ((rstr = cmdline_get_value("ext2_inode_ra")) != NULL) {
+		ext2_set_inode_ra(atoi(rstr));
+	}
+
+	/* Blocks preallocated for regular files */
+	if ((rstr = cmdline_get_value("ext2_prealloc")) != NULL) {
+		ext2_set_prealloc(atoi(rstr));
+	}
+#endif
+
 	/* Mount root file system */
 	rstr = cmdline_get_value("root");
 	strcpy(rdev_str, rstr);
@@ -134,17 +159,68 @@ void kernel_main_thread(void *arg)
 		panic("Kernel command line root argument bad formated.");
 	}
 
-	for(;;);
 	if ( !vfs_mount_root(rootdev) ) {
 		panic("VFS ERROR: Could not mount root file system.");
 	}
 
+	/* Synchronous read latency, polling off and on (root device) */
+	if ((rstr = cmdline_get_value("ata_sync_bench")) != NULL) {
+		ata_sync_bench(rootdev.major, rootdev.minor, atoi(rstr));
+	}
+
+	/* Access time updates: 0 never, 1 on every read, 2 relative */
+	if ((rstr = cmdline_get_value("atime")) != NULL) {
+		vfs_set_atime(atoi(rstr));
+	}
+
+	/* Periodic writeback of dirty i-nodes and delayed blocks */
+	rstr = cmdline_get_value("writeback_secs");
+	vfs_start_writeback(rstr != NULL ? atoi(rstr) : VFS_WRITEBACK_SECS);
+
+	/* Directory lookup benchmark (see rootfs/gen_bigdir_img.sh) */
+	if ((rstr = cmdline_get_value("namei_bench")) != NULL) {
+		init = cmdline_get_value("namei_bench_n");
+		dir  = cmdline_get_value("namei_bench_all");
+		vfs_namei_bench(rstr, (init != NULL ? atoi(init) : 50000),
+						(dir != NULL ? atoi(dir) : 0));
+	}
+
+	/* Maximum read ahead window (KB) */
+	if ((rstr = cmdline_get_value("readahead_kb")) != NULL) {
+		vfs_set_readahead(atoi(rstr));
+	}
+
+#ifdef CONFIG_FS_TMPFS
+	/* In-memory file system (mount point must exist) */
+	if ((rstr = cmdline_get_value("tmpfs")) != NULL) {
+		init = cmdline_get_value("tmpfs_size_kb");
+		tmpfs_mount(rstr, (init != NULL ? atoi(init) : TMPFS_DEF_SIZE_KB));
+	}
+#endif
+
+	/* File write/read benchmark (needs a writable directory) */
+	if ((rstr = cmdline_get_value("rw_bench")) != NULL) {
+		init = cmdline_get_value("rw_bench_kb");
+		dir  = cmdline_get_value("rw_bench_dir");
+		vfs_rw_bench((dir != NULL ? dir : "/"), atoi(rstr),
+					 (init != NULL ? atoi(init) : 1024));
+	}
+
+	/* Resident memory of N instances of a program (shared text) */
+	if ((rstr = cmdline_get_value("exec_bench")) != NULL) {
+		init = cmdline_get_value("exec_bench_n");
+		exec_bench(rstr, (init != NULL ? atoi(init) : 10));
+	}
+
 	/* Load init */
 	init = cmdline_get_value("init");
 	if (init == NULL) {
 		init = DEFAULT_INIT_PROCCESS;
 	}
-	kprintf("Loading %s...\n", init); for(;;);
+	kprintf("Loading %s...\n", init);
+	if (_exec_init(init) < 0) {
+		kprintf(KERN_ERROR "Could not run %s.\n", init);
+	}
 
 
 	/* TEST: Read root directory */
@@ -5,5 +5,5 @@
 # TBS - Build configuration file
 #
 
-obj-y += init_mm.o kmalloc.o
+obj-y += init_mm.o kmalloc.o mmap.o
 
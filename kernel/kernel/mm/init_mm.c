@@ -89,6 +89,6 @@ void bmap_off(volatile mem_map *map, uint32_t block)
 	uint32_t byte = block >> BITMAP_SHIFT;
 	uint32_t bit  = block - (byte * (sizeof(uchar8_t) * 8));
 
-	map->bitmap[byte] |= (uchar8_t)~(BITMAP_FBIT >> bit);
+	map->bitmap[byte] &= (uchar8_t)~(BITMAP_FBIT >> bit);
 }
 
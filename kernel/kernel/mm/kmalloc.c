@@ -23,6 +23,8 @@
  */
 
 #include <tempos/mm.h>
+#include <x86/io.h>
+#include <string.h>
 
 
 /** Kernel Map memory */
@@ -220,3 +222,127 @@ void kfree(void *ptr)
 }
 
 
+
+/**
+ * Alloc one page aligned page of memory. Unlike kmalloc, there is no
+ * region information before the block, so the whole page can be used
+ * (page tables, page cache pages mapped into user space, etc.). Memory
+ * must be released with kfree_page.
+ *
+ * \param flags Flags
+ * \return Page virtual address, NULL if there is no memory.
+ */
+void *kmalloc_page(uint16_t flags)
+{
+	uint32_t page, newpage;
+	uint32_t *table;
+	uint32_t i, j;
+	zone_t mzone;
+
+	if( (flags & GFP_DMA_Z) ) {
+		mzone = DMA_ZONE;
+	} else {
+		mzone = NORMAL_ZONE;
+	}
+
+	/* Search a free page in bitmap */
+	for(i=0; i<BITMAP_SIZE; i++) {
+		if (kmem.bitmap[i] != 0xFF) {
+			break;
+		}
+	}
+	if (i == BITMAP_SIZE) {
+		return(NULL);
+	}
+	for(j=0; j<(sizeof(uchar8_t) * 8); j++) {
+		if ( !(kmem.bitmap[i] & (BITMAP_FBIT >> j)) ) {
+			break;
+		}
+	}
+	page = (i * sizeof(uchar8_t) * 8) + j;
+
+	if( !(newpage = alloc_page(mzone)) ) {
+		return(NULL);
+	}
+	bmap_on(&kmem, page);
+
+	table = kmem.pagedir->tables[GET_DINDEX(page)];
+	table[page & (TABLE_SIZE - 1)] = MAKE_ENTRY(newpage, (PAGE_WRITABLE | PAGE_PRESENT));
+	flush_tlb_page(page << PAGE_SHIFT);
+
+	if( (flags & GFP_ZEROP) ) {
+		memset((void*)(page << PAGE_SHIFT), 0, PAGE_SIZE);
+	}
+
+	return((void*)(page << PAGE_SHIFT));
+}
+
+
+/**
+ * Free a page allocated with kmalloc_page
+ */
+void kfree_page(void *ptr)
+{
+	uint32_t page = (uint32_t)ptr >> PAGE_SHIFT;
+	uint32_t *table;
+
+	table = kmem.pagedir->tables[GET_DINDEX(page)];
+	free_page(PAGE_PADDR(table[page & (TABLE_SIZE - 1)]));
+	table[page & (TABLE_SIZE - 1)] = 0;
+	flush_tlb_page((uint32_t)ptr);
+	bmap_off(&kmem, page);
+}
+
+
+/**
+ * Map a physical page (e.g. a user page) into kernel address space,
+ * so it can be accessed from any task (or interrupt handler).
+ * Release it with kunmap_page.
+ *
+ * \param paddr Physical address of the page.
+ * \return Page virtual address, NULL if there is no address space left.
+ */
+void *kmap_page(uint32_t paddr)
+{
+	uint32_t page;
+	uint32_t *table;
+	uint32_t i, j;
+
+	/* Search a free page in bitmap */
+	for(i=0; i<BITMAP_SIZE; i++) {
+		if (kmem.bitmap[i] != 0xFF) {
+			break;
+		}
+	}
+	if (i == BITMAP_SIZE) {
+		return(NULL);
+	}
+	for(j=0; j<(sizeof(uchar8_t) * 8); j++) {
+		if ( !(kmem.bitmap[i] & (BITMAP_FBIT >> j)) ) {
+			break;
+		}
+	}
+	page = (i * sizeof(uchar8_t) * 8) + j;
+	bmap_on(&kmem, page);
+
+	table = kmem.pagedir->tables[GET_DINDEX(page)];
+	table[page & (TABLE_SIZE - 1)] = MAKE_ENTRY(PAGE_PADDR(paddr), (PAGE_WRITABLE | PAGE_PRESENT));
+	flush_tlb_page(page << PAGE_SHIFT);
+
+	return((void*)(page << PAGE_SHIFT));
+}
+
+
+/**
+ * Unmap a page mapped with kmap_page (page itself is not released)
+ */
+void kunmap_page(void *ptr)
+{
+	uint32_t page = (uint32_t)ptr >> PAGE_SHIFT;
+	uint32_t *table;
+
+	table = kmem.pagedir->tables[GET_DINDEX(page)];
+	table[page & (TABLE_SIZE - 1)] = 0;
+	flush_tlb_page((uint32_t)ptr);
+	bmap_off(&kmem, page);
+}
@@ -0,0 +1,575 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: mmap.c
+ * Desc: Memory mapped files and anonymous memory
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/mmap.h>
+#include <tempos/sched.h>
+#include <tempos/kernel.h>
+#include <tempos/mm.h>
+#include <fcntl.h>
+#include <string.h>
+#include <arch/io.h>
+
+
+static vm_area *find_area(task_t *task, uint32_t addr);
+
+static uint32_t get_unmapped_area(task_t *task, uint32_t addr, uint32_t len);
+
+static vm_area *insert_area(task_t *task, uint32_t start, uint32_t len, int prot,
+							int flags, vfs_inode *inode, uint32_t pgoff);
+
+static void sync_page(vm_area *area, pagedir_t *dir, uint32_t i);
+
+static void release_area(task_t *task, vm_area *area);
+
+
+/**
+ * Find the memory area that contains an address.
+ *
+ * \param task Process.
+ * \param addr Address.
+ * \return vm_area* Memory area, or NULL if address is not mapped.
+ */
+static vm_area *find_area(task_t *task, uint32_t addr)
+{
+	vm_area *area;
+
+	for (area = task->mmap; area != NULL; area = area->next) {
+		if (addr < area->start) {
+			break;
+		}
+		if (addr < area->end) {
+			return area;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Find a free region of process's mmap area (first fit). If address
+ * hint is free, it's used.
+ *
+ * \param task Process.
+ * \param addr Address hint (page aligned, or 0).
+ * \param len Length (page aligned).
+ * \return Start address, or 0 if there is no space.
+ */
+static uint32_t get_unmapped_area(task_t *task, uint32_t addr, uint32_t len)
+{
+	vm_area *area;
+	uint32_t start;
+
+	if (addr >= MMAP_AREA_START && addr < MMAP_AREA_END &&
+		len <= MMAP_AREA_END - addr) {
+		for (area = task->mmap; area != NULL; area = area->next) {
+			if (addr < area->end && area->start < addr + len) {
+				break;
+			}
+		}
+		if (area == NULL) {
+			return addr;
+		}
+	}
+
+	start = MMAP_AREA_START;
+	for (area = task->mmap; area != NULL; area = area->next) {
+		if (area->start - start >= len) {
+			return start;
+		}
+		start = area->end;
+	}
+	if (MMAP_AREA_END - start >= len) {
+		return start;
+	}
+	return 0;
+}
+
+/**
+ * Create a memory area and insert it into process's list.
+ *
+ * \param task Process.
+ * \param start Start address (page aligned).
+ * \param len Length (page aligned).
+ * \param prot Protection (PROT_*).
+ * \param flags Flags (MAP_*).
+ * \param inode Mapped file (NULL for anonymous mappings).
+ * \param pgoff File page number mapped at start.
+ * \return vm_area* New area, or NULL if there is no memory.
+ */
+static vm_area *insert_area(task_t *task, uint32_t start, uint32_t len, int prot,
+							int flags, vfs_inode *inode, uint32_t pgoff)
+{
+	vm_area *area, **prev;
+	uint32_t npages = len >> PAGE_SHIFT;
+
+	if ((area = (vm_area*)kmalloc(sizeof(vm_area), GFP_NORMAL_Z)) == NULL) {
+		return NULL;
+	}
+	area->pages = (vm_page_t*)kmalloc(npages * sizeof(vm_page_t), GFP_NORMAL_Z);
+	if (area->pages == NULL) {
+		kfree(area);
+		return NULL;
+	}
+	memset(area->pages, 0, npages * sizeof(vm_page_t));
+
+	area->start    = start;
+	area->end      = start + len;
+	area->file_end = area->end;
+	area->prot     = prot;
+	area->flags    = flags;
+	area->pgoff    = pgoff;
+	area->inode    = (inode != NULL ? vfs_idup(inode) : NULL);
+
+	/* Keep list sorted by address */
+	for (prev = &task->mmap; *prev != NULL; prev = &(*prev)->next) {
+		if ((*prev)->start > start) {
+			break;
+		}
+	}
+	area->next = *prev;
+	*prev      = area;
+
+	return area;
+}
+
+/**
+ * Map a file (or anonymous memory) into current process's address space.
+ * Pages are not mapped here, but on the first access (see mmap_fault).
+ *
+ * \param addr Address hint (exact address with MAP_FIXED).
+ * \param len Length in bytes.
+ * \param prot Protection (PROT_*).
+ * \param flags Flags (MAP_*).
+ * \param file File to map (ignored with MAP_ANONYMOUS).
+ * \param offset File offset (page aligned).
+ * \return Start address of mapping, or MAP_FAILED on error.
+ */
+uint32_t do_mmap(uint32_t addr, uint32_t len, int prot, int flags,
+				 vfs_file *file, uint32_t offset)
+{
+	extern pagedir_t *kerneldir;
+	task_t *task = GET_TASK(cur_task);
+	uint32_t start;
+	int acc;
+
+	/* Kernel threads share kernel's directory */
+	if (task == NULL || task->arch_tss.pgdir == kerneldir) {
+		return (uint32_t)MAP_FAILED;
+	}
+
+	if (len == 0 || len > MMAP_AREA_END - MMAP_AREA_START ||
+		(offset & ~PAGE_MASK) || (addr & ~PAGE_MASK)) {
+		return (uint32_t)MAP_FAILED;
+	}
+	if (((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0)) {
+		return (uint32_t)MAP_FAILED;
+	}
+
+	if ( !(flags & MAP_ANONYMOUS) ) {
+		if (file == NULL) {
+			return (uint32_t)MAP_FAILED;
+		}
+		acc = (file->f_flags & O_ACCMODE);
+		if (acc == O_WRONLY ||
+			((flags & MAP_SHARED) && (prot & PROT_WRITE) && acc != O_RDWR)) {
+			return (uint32_t)MAP_FAILED;
+		}
+	}
+
+	len = PAGE_ALIGN(len);
+
+	if ( (flags & MAP_FIXED) ) {
+		/* Replacing existing mappings is not supported */
+		if (get_unmapped_area(task, addr, len) != addr) {
+			return (uint32_t)MAP_FAILED;
+		}
+		start = addr;
+	} else if ((start = get_unmapped_area(task, addr, len)) == 0) {
+		return (uint32_t)MAP_FAILED;
+	}
+
+	if (insert_area(task, start, len, prot, flags,
+					((flags & MAP_ANONYMOUS) ? NULL : file->inode),
+					offset >> PAGE_SHIFT) == NULL) {
+		return (uint32_t)MAP_FAILED;
+	}
+
+	return start;
+}
+
+/**
+ * Map a segment of an executable (or zero filled memory, like the
+ * stack) into a process at a fixed address. Mapping is private: file
+ * pages are read on demand through page cache and shared until
+ * written, bytes after the file part of segment read as zeros.
+ *
+ * \param task Process.
+ * \param addr Start address (page aligned).
+ * \param len Length (page aligned).
+ * \param prot Protection (PROT_*).
+ * \param inode File (NULL for zero filled memory).
+ * \param offset File offset mapped at start (page aligned).
+ * \param filesz Number of bytes (from start) backed by file.
+ * \return vm_area* New area, or NULL on error (bad or used address
+ *         range, no memory).
+ */
+vm_area *mmap_segment(task_t *task, uint32_t addr, uint32_t len,
+					  int prot, vfs_inode *inode, uint32_t offset, uint32_t filesz)
+{
+	vm_area *area;
+	int flags = (MAP_PRIVATE | MAP_FIXED);
+
+	if (len == 0 || ((addr | len | offset) & ~PAGE_MASK) ||
+		addr < MMAP_AREA_START || addr >= MMAP_AREA_END ||
+		len > MMAP_AREA_END - addr || filesz > len) {
+		return NULL;
+	}
+	if (get_unmapped_area(task, addr, len) != addr) {
+		return NULL;
+	}
+
+	if (inode == NULL) {
+		flags |= MAP_ANONYMOUS;
+	}
+	if ((area = insert_area(task, addr, len, prot, flags, inode,
+							offset >> PAGE_SHIFT)) == NULL) {
+		return NULL;
+	}
+	if (inode != NULL) {
+		area->file_end = addr + filesz;
+	}
+
+	return area;
+}
+
+/**
+ * Write a page of a shared file mapping to file when it was
+ * modified through the mapping (dirty bit of page table entry).
+ *
+ * \param area Memory area.
+ * \param dir Process's pages directory.
+ * \param i Page number into area.
+ */
+static void sync_page(vm_area *area, pagedir_t *dir, uint32_t i)
+{
+	vfs_page *page = area->pages[i].page;
+	uint32_t vaddr, entry, offset, len;
+
+	if (page == NULL || area->inode == NULL || !(area->flags & MAP_SHARED)) {
+		return;
+	}
+
+	vaddr = area->start + (i << PAGE_SHIFT);
+	entry = get_page_entry(dir, vaddr);
+	if ( !(entry & PAGE_DIRTY) ) {
+		return;
+	}
+	/* Clear dirty bit before writing: new writes dirty the page again */
+	set_page_entry(dir, vaddr, (entry & ~PAGE_DIRTY));
+
+	/* Mappings do not change file size */
+	offset = (area->pgoff + i) << PAGE_SHIFT;
+	if (offset >= area->inode->i_size) {
+		return;
+	}
+	len = area->inode->i_size - offset;
+	if (len > PAGE_SIZE) {
+		len = PAGE_SIZE;
+	}
+	vfs_writei(area->inode, page->data, offset, len);
+}
+
+/**
+ * Remove a memory area from process, releasing its pages.
+ *
+ * \param task Process.
+ * \param area Memory area.
+ */
+static void release_area(task_t *task, vm_area *area)
+{
+	pagedir_t *dir = task->arch_tss.pgdir;
+	vm_area **prev;
+	uint32_t npages, i;
+
+	for (prev = &task->mmap; *prev != NULL; prev = &(*prev)->next) {
+		if (*prev == area) {
+			*prev = area->next;
+			break;
+		}
+	}
+
+	npages = (area->end - area->start) >> PAGE_SHIFT;
+	for (i = 0; i < npages; i++) {
+		if (area->pages[i].page != NULL) {
+			sync_page(area, dir, i);
+			unmap_page(dir, area->start + (i << PAGE_SHIFT));
+			pagecache_put(area->pages[i].page);
+		}
+		if (area->pages[i].copy != NULL) {
+			unmap_page(dir, area->start + (i << PAGE_SHIFT));
+			if ( !(area->flags & VM_PINNED) ) {
+				kfree_page(area->pages[i].copy);
+			}
+		}
+	}
+
+	if (area->inode != NULL) {
+		vfs_iput(area->inode);
+	}
+	kfree(area->pages);
+	kfree(area);
+}
+
+/**
+ * Unmap a memory area of current process.
+ *
+ * \param addr Start address of area.
+ * \param len Length of area.
+ * \return 0 on success, -1 on error.
+ * \note Only whole areas can be unmapped.
+ */
+int do_munmap(uint32_t addr, uint32_t len)
+{
+	task_t *task = GET_TASK(cur_task);
+	vm_area *area;
+
+	if (task == NULL || (addr & ~PAGE_MASK) || len == 0) {
+		return -1;
+	}
+	if ((area = find_area(task, addr)) == NULL || (area->flags & VM_PINNED) ||
+		area->start != addr || area->end - addr != PAGE_ALIGN(len)) {
+		return -1;
+	}
+
+	release_area(task, area);
+	return 0;
+}
+
+/**
+ * Write modified pages of shared file mappings back to file.
+ *
+ * \param addr Start address (page aligned).
+ * \param len Length in bytes.
+ * \param flags MS_ASYNC or MS_SYNC (MS_INVALIDATE has no effect: mappings
+ *              share page cache pages, so they are always coherent).
+ * \return 0 on success, -1 on error.
+ */
+int do_msync(uint32_t addr, uint32_t len, int flags)
+{
+	task_t *task = GET_TASK(cur_task);
+	vm_area *area;
+	uint32_t end, first, last, i;
+
+	if (task == NULL || (addr & ~PAGE_MASK) ||
+		((flags & MS_ASYNC) && (flags & MS_SYNC))) {
+		return -1;
+	}
+	end = addr + PAGE_ALIGN(len);
+
+	for (area = task->mmap; area != NULL && area->start < end; area = area->next) {
+		if (area->end <= addr || area->inode == NULL ||
+			!(area->flags & MAP_SHARED)) {
+			continue;
+		}
+		first = (addr > area->start ? addr : area->start);
+		last  = (end < area->end ? end : area->end);
+		for (i = (first - area->start) >> PAGE_SHIFT;
+			 i < ((last - area->start) >> PAGE_SHIFT); i++) {
+			sync_page(area, task->arch_tss.pgdir, i);
+		}
+		if ( (flags & MS_SYNC) ) {
+			if (vfs_writeback(area->inode) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Handle a page fault into a memory mapped area: the page is read
+ * from page cache (with read around of nearby pages) and mapped, or
+ * a private copy is made on the first write of a private mapping.
+ *
+ * \param addr Fault address.
+ * \param write 1 if fault was caused by a write, 0 otherwise.
+ * \return 1 if fault was handled, 0 if address is not mapped (or
+ *         access is not allowed).
+ */
+int mmap_fault(uint32_t addr, int write)
+{
+	task_t *task = GET_TASK(cur_task);
+	pagedir_t *dir;
+	vm_area *area;
+	vm_page_t *vpage;
+	vfs_page *page;
+	uint32_t vaddr, index, ra, ra_start, flags, i;
+
+	if (task == NULL || (area = find_area(task, addr)) == NULL) {
+		return 0;
+	}
+	if ((write && !(area->prot & PROT_WRITE)) || area->prot == PROT_NONE) {
+		return 0;
+	}
+
+	/* Exceptions run with interrupts disabled, but we may wait for disk */
+	sti();
+
+	dir   = task->arch_tss.pgdir;
+	i     = (addr - area->start) >> PAGE_SHIFT;
+	vaddr = area->start + (i << PAGE_SHIFT);
+	vpage = &area->pages[i];
+	flags = PAGE_USER;
+	if ( (area->prot & PROT_WRITE) ) {
+		flags |= PAGE_WRITABLE;
+	}
+
+	/* Anonymous memory, private copies and zero filled part of segments */
+	if (area->inode == NULL || vpage->copy != NULL || vaddr >= area->file_end) {
+		if (vpage->copy == NULL) {
+			if ((vpage->copy = (char*)kmalloc_page(GFP_NORMAL_Z | GFP_ZEROP)) == NULL) {
+				return 0;
+			}
+		}
+		return (map_page(dir, vaddr, virt_to_phys(vpage->copy), flags) == 0);
+	}
+
+	/* File page */
+	if ((page = vpage->page) == NULL) {
+		index = area->pgoff + i;
+		ra    = vfs_readahead_pages();
+		if (ra > 0 && !pagecache_cached(area->inode, index)) {
+			/* Read around fault address, inside area */
+			ra_start = (i > ra / 2 ? index - ra / 2 : area->pgoff);
+			if (ra_start + ra > area->pgoff + ((area->end - area->start) >> PAGE_SHIFT)) {
+				ra = area->pgoff + ((area->end - area->start) >> PAGE_SHIFT) - ra_start;
+			}
+			vfs_readahead(area->inode, ra_start, ra);
+		}
+		if ((page = pagecache_get(area->inode, index)) == NULL) {
+			return 0;
+		}
+		vpage->page = page;
+	}
+
+	if ( (area->flags & MAP_PRIVATE) ) {
+		if (write || area->file_end - vaddr < PAGE_SIZE) {
+			/* Copy on write (or page only partially backed by file) */
+			if ((vpage->copy = (char*)kmalloc_page(GFP_NORMAL_Z)) == NULL) {
+				return 0;
+			}
+			memcpy(vpage->copy, page->data, PAGE_SIZE);
+			if (area->file_end - vaddr < PAGE_SIZE) {
+				memset(&vpage->copy[area->file_end - vaddr], 0,
+					   PAGE_SIZE - (area->file_end - vaddr));
+			}
+			vpage->page = NULL;
+			pagecache_put(page);
+			return (map_page(dir, vaddr, virt_to_phys(vpage->copy), flags) == 0);
+		}
+		/* Page cache page is shared until first write */
+		flags &= ~PAGE_WRITABLE;
+	}
+
+	return (map_page(dir, vaddr, virt_to_phys(page->data), flags) == 0);
+}
+
+/**
+ * Map a kernel page into current process's address space (memory
+ * shared between kernel and process). Page is not released with the
+ * mapping: owner must release it after process exits (mmap_exit).
+ *
+ * \param page Kernel page (allocated with kmalloc_page).
+ * \param prot Protection (PROT_*).
+ * \return Address of page into process space, or MAP_FAILED on error.
+ */
+uint32_t mmap_kernel_page(void *page, int prot)
+{
+	task_t *task = GET_TASK(cur_task);
+	vm_area *area;
+	uint32_t addr, flags;
+
+	addr = do_mmap(0, PAGE_SIZE, prot, (MAP_SHARED | MAP_ANONYMOUS), NULL, 0);
+	if (addr == (uint32_t)MAP_FAILED) {
+		return addr;
+	}
+
+	area = find_area(task, addr);
+	area->flags |= VM_PINNED;
+	area->pages[0].copy = (char*)page;
+
+	flags = PAGE_USER;
+	if ( (prot & PROT_WRITE) ) {
+		flags |= PAGE_WRITABLE;
+	}
+	if (map_page(task->arch_tss.pgdir, addr, virt_to_phys(page), flags) < 0) {
+		area->flags &= ~VM_PINNED;
+		area->pages[0].copy = NULL;
+		release_area(task, area);
+		return (uint32_t)MAP_FAILED;
+	}
+
+	return addr;
+}
+
+/**
+ * Release all memory areas of a process (page tables are kept).
+ *
+ * \param task Process.
+ */
+void mmap_release(task_t *task)
+{
+	while (task->mmap != NULL) {
+		release_area(task, task->mmap);
+	}
+}
+
+/**
+ * Release all memory mappings of current process (on exit).
+ */
+void mmap_exit(void)
+{
+	task_t *task = GET_TASK(cur_task);
+	pagedir_t *dir;
+	uint32_t i;
+
+	if (task == NULL || task->mmap == NULL) {
+		return;
+	}
+
+	mmap_release(task);
+
+	/* Page tables of mmap area */
+	dir = task->arch_tss.pgdir;
+	for (i = (MMAP_AREA_START >> (PAGE_SHIFT + TABLE_SHIFT));
+		 i < (MMAP_AREA_END >> (PAGE_SHIFT + TABLE_SHIFT)); i++) {
+		if (dir->tables[i] != NULL) {
+			dir->tables_phy_addr[i] = 0;
+			kfree_page(dir->tables[i]);
+			dir->tables[i] = NULL;
+		}
+	}
+	write_cr3(task->arch_tss.cr3);
+}
+
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: mman.c
+ * Desc: mmap, munmap and msync system calls
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/syscall.h>
+#include <tempos/kernel.h>
+#include <tempos/sched.h>
+#include <tempos/mmap.h>
+#include <arch/uaccess.h>
+
+/**
+ * Map a file (or anonymous memory) into process's address space.
+ *
+ * \param uargs mmap arguments (user space, see sys/mman.h).
+ * \return Start address of mapping, or MAP_FAILED (-1) on error.
+ */
+_pushargs int sys_mmap(struct mmap_args *uargs)
+{
+	struct mmap_args args;
+	vfs_file *file = NULL;
+
+	if (copy_from_user(&args, uargs, sizeof(args)) != 0) {
+		return(-1);
+	}
+
+	if ( !(args.flags & MAP_ANONYMOUS) ) {
+		if ((file = fd_get(args.fd)) == NULL) {
+			return(-1);
+		}
+	}
+
+	return((int)do_mmap((uint32_t)args.addr, args.len, args.prot,
+						args.flags, file, args.offset));
+}
+
+/**
+ * Unmap a memory area.
+ *
+ * \param addr Start address.
+ * \param len Length.
+ * \return 0 on success, -1 on error.
+ */
+_pushargs int sys_munmap(void *addr, size_t len)
+{
+	return(do_munmap((uint32_t)addr, len));
+}
+
+/**
+ * Write modified pages of a shared file mapping to file.
+ *
+ * \param addr Start address.
+ * \param len Length.
+ * \param flags MS_ASYNC, MS_SYNC, MS_INVALIDATE.
+ * \return 0 on success, -1 on error.
+ */
+_pushargs int sys_msync(void *addr, size_t len, int flags)
+{
+	return(do_msync((uint32_t)addr, len, flags));
+}
+
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: open.c
+ * Desc: Syscalls open and close
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/syscall.h>
+#include <tempos/kernel.h>
+#include <tempos/sched.h>
+#include <arch/uaccess.h>
+
+/**
+ * Open a file.
+ *
+ * \param pathname File path name (user space).
+ * \param flags Open flags (see fcntl.h).
+ * \param mode Permissions of a new file (O_CREAT).
+ * \return New file descriptor, or -1 on error.
+ */
+_pushargs int sys_open(const char *pathname, int flags, int mode)
+{
+	vfs_file *file;
+	char *path;
+	int fd;
+
+	if ((path = (char*)kmalloc(VFS_NAME_LEN, GFP_NORMAL_Z)) == NULL) {
+		return(-1);
+	}
+	if (strncpy_from_user(path, pathname, VFS_NAME_LEN) < 0) {
+		kfree(path);
+		return(-1);
+	}
+
+	file = vfs_open(path, flags, (uint16_t)mode);
+	kfree(path);
+	if (file == NULL) {
+		return(-1);
+	}
+
+	if ((fd = fd_install(file)) < 0) {
+		vfs_close(file);
+	}
+
+	return(fd);
+}
+
+/**
+ * Close a file descriptor.
+ *
+ * \param fd File descriptor.
+ * \return 0 on success, -1 on error.
+ */
+_pushargs int sys_close(int fd)
+{
+	return(fd_close(fd));
+}
+
+/**
+ * Change file offset of a file descriptor.
+ *
+ * \param fd File descriptor.
+ * \param offset Offset (bytes).
+ * \param whence SEEK_SET, SEEK_CUR or SEEK_END.
+ * \return New file offset, or -1 on error.
+ */
+_pushargs int sys_lseek(int fd, int offset, int whence)
+{
+	vfs_file *file;
+
+	if ((file = fd_get(fd)) == NULL) {
+		return(-1);
+	}
+
+	return(vfs_lseek(file, offset, whence));
+}
+
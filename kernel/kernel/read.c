@@ -24,12 +24,24 @@
 
 #include <tempos/syscall.h>
 #include <tempos/kernel.h>
+#include <tempos/sched.h>
 
+/**
+ * Read from a file descriptor.
+ *
+ * \param fd File descriptor.
+ * \param buf User buffer.
+ * \param count Number of bytes to read.
+ * \return Number of bytes read (0 at end of file), or -1 on error.
+ */
 _pushargs ssize_t sys_read(int fd, void *buf, size_t count)
 {
-	kprintf(KERN_DEBUG "read: %d -- %s -- %d", fd, buf, count);
+	vfs_file *file;
 
-	return(-1);
-}
+	if ((file = fd_get(fd)) == NULL) {
+		return(-1);
+	}
 
+	return(vfs_read(file, (char*)buf, count));
+}
 
@@ -26,8 +26,10 @@
 #include <tempos/kernel.h>
 #include <tempos/timer.h>
 #include <tempos/jiffies.h>
+#include <arch/bitops.h>
+#include <arch/io.h>
 
-/** Scheduler Quantum */
+/** Scheduler Quantum (of DEFAULT_PRIORITY tasks) */
 static uint32_t scheduler_quantum = (HZ / 100); /* 10 ms */
 
 /** Scheduler time counter */
@@ -39,6 +41,23 @@ c_llist *tasks = NULL;
 /** Element of list that points to current task */
 c_llist *cur_task = NULL;
 
+/**
+ * Run queues: tasks ready to run (current task is not queued), one
+ * queue per priority level. Bit n of rq_bitmap is set when queue of
+ * priority n is not empty, so the next task is found without looking
+ * at sleeping tasks at all.
+ */
+static task_t *rq_head[SCHED_PRIO_LEVELS];
+static uint32_t rq_bitmap;
+
+
+static void rq_enqueue(task_t *task);
+
+static void rq_dequeue(task_t *task);
+
+static uint32_t sched_timeslice(task_t *task);
+
+
 /**
  * Initialize the scheduler. This function creates the circular
  * linked list and call architecture specific code to initialize
@@ -56,6 +75,139 @@ void init_scheduler(void (*start_routine)(void*))
 	arch_init_scheduler(start_routine);
 }
 
+/**
+ * Add a task to the tail of the run queue of its priority.
+ */
+static void rq_enqueue(task_t *task)
+{
+	task_t *head = rq_head[task->priority];
+
+	if (head == NULL) {
+		task->rq_next = NULL;
+		task->rq_prev = task;
+		rq_head[task->priority] = task;
+		rq_bitmap |= (1 << task->priority);
+	} else {
+		task->rq_next = NULL;
+		task->rq_prev = head->rq_prev;
+		head->rq_prev->rq_next = task;
+		head->rq_prev = task;
+	}
+	task->on_rq = 1;
+}
+
+/**
+ * Remove a task from its run queue.
+ */
+static void rq_dequeue(task_t *task)
+{
+	task_t **head = &rq_head[task->priority];
+
+	if (*head == task) {
+		*head = task->rq_next;
+		if (*head == NULL) {
+			rq_bitmap &= ~(1 << task->priority);
+		} else {
+			(*head)->rq_prev = task->rq_prev;
+		}
+	} else {
+		task->rq_prev->rq_next = task->rq_next;
+		if (task->rq_next != NULL) {
+			task->rq_next->rq_prev = task->rq_prev;
+		} else {
+			(*head)->rq_prev = task->rq_prev;
+		}
+	}
+	task->rq_next = NULL;
+	task->rq_prev = NULL;
+	task->on_rq   = 0;
+}
+
+/**
+ * Time slice of a task: the quantum scaled by priority, from twice
+ * the quantum (MAX_PRIORITY) down to one tick.
+ *
+ * \param task Task.
+ * \return Time slice (in jiffies).
+ */
+static uint32_t sched_timeslice(task_t *task)
+{
+	uint32_t slice;
+
+	slice = (scheduler_quantum * (SCHED_PRIO_LEVELS - task->priority)) /
+			(SCHED_PRIO_LEVELS - DEFAULT_PRIORITY);
+	return (slice > 0 ? slice : 1);
+}
+
+/**
+ * Add a new task to the list of tasks and, if it is ready to run,
+ * to its run queue. Priority is clamped to valid levels.
+ *
+ * \param task Task.
+ * \return 1 on success, 0 on error (no memory).
+ * \note Interrupts must be disabled.
+ */
+int sched_add_task(task_t *task)
+{
+	if (task->priority < MAX_PRIORITY) {
+		task->priority = MAX_PRIORITY;
+	} else if (task->priority > MIN_PRIORITY) {
+		task->priority = MIN_PRIORITY;
+	}
+
+	if (!c_llist_add(&tasks, task)) {
+		return 0;
+	}
+	task->tnode = tasks->prev;
+
+	task->on_rq = 0;
+	if (task->state == TASK_READY_TO_RUN) {
+		rq_enqueue(task);
+	}
+	return 1;
+}
+
+/**
+ * Remove a task from the list of tasks (and from its run queue).
+ *
+ * \param task Task (not the current one).
+ * \note Interrupts must be disabled.
+ */
+void sched_remove_task(task_t *task)
+{
+	if (task->on_rq) {
+		rq_dequeue(task);
+	}
+	c_llist_remove(&tasks, task);
+	task->tnode = NULL;
+}
+
+/**
+ * Make a sleeping task ready to run. A task with higher priority than
+ * the current one preempts it on the next tick.
+ *
+ * \param task Task.
+ * \note Interrupts must be disabled.
+ */
+void sched_wakeup(task_t *task)
+{
+	task_t *current_task = GET_TASK(cur_task);
+
+	if (task == current_task) {
+		/* Woken up before it could sleep */
+		task->state = TASK_RUNNING;
+		return;
+	}
+
+	task->state = TASK_READY_TO_RUN;
+	if (!task->on_rq) {
+		rq_enqueue(task);
+		if (current_task != NULL && task->priority < current_task->priority) {
+			sched_cnt = jiffies;
+		}
+	}
+}
+
 
 /**
  * Check if scheduler quantum is expired and
@@ -68,7 +220,6 @@ void do_schedule(pt_regs *regs)
 	if( !time_after(jiffies, sched_cnt) ) {
 		return;
 	} else {
-		sched_cnt = jiffies + scheduler_quantum;
 		schedule();
 	}
 }
@@ -77,29 +228,40 @@ void do_schedule(pt_regs *regs)
 /**
  * Decides what task to run and make the task switch.
  *
- * TempOS scheduler uses a round robin policy.
+ * TempOS scheduler runs the first task of the highest priority non
+ * empty run queue (round robin inside each priority). A running task
+ * keeps the processor while only lower priority tasks are ready.
+ *
+ * \note Interrupts are disabled here and remain disabled when the
+ *       task resumes.
  */
 void schedule(void)
 {
-	task_t *c_task;
-	c_llist *tmp, *head;
+	task_t *c_task, *next;
 
 	if (cur_task == NULL) {
 		return;
 	}
 
-	/* do schedule */
-	tmp = head = cur_task;
-	do {
-		tmp = tmp->next;
-		c_task = GET_TASK(tmp);
-		if (c_task->state == TASK_RUNNING || 
-				c_task->state == TASK_READY_TO_RUN) {
-			switch_to(tmp);
-			break;
-		} else {
-			continue;
+	cli();
+	c_task = GET_TASK(cur_task);
+
+	if (rq_bitmap == 0) {
+		sched_cnt = jiffies + sched_timeslice(c_task);
+		return;
+	}
+	next = rq_head[find_first_bit(rq_bitmap)];
+
+	if (c_task->state == TASK_RUNNING) {
+		if (next->priority > c_task->priority) {
+			sched_cnt = jiffies + sched_timeslice(c_task);
+			return;
 		}
-	} while(tmp == head);
+		rq_enqueue(c_task);
+	}
+
+	rq_dequeue(next);
+	sched_cnt = jiffies + sched_timeslice(next);
+	switch_to(next->tnode);
 }
 
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: sendfile.c
+ * Desc: sendfile system call
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/syscall.h>
+#include <tempos/kernel.h>
+#include <tempos/sched.h>
+
+/**
+ * Copy data between two file descriptors inside kernel, from
+ * input file's offset to output file's offset (no user buffer).
+ *
+ * \param out_fd Output file descriptor.
+ * \param in_fd Input file descriptor.
+ * \param count Number of bytes to copy.
+ * \return Number of bytes copied (0 at end of input file), or -1 on error.
+ */
+_pushargs ssize_t sys_sendfile(int out_fd, int in_fd, size_t count)
+{
+	vfs_file *out, *in;
+
+	if ((out = fd_get(out_fd)) == NULL || (in = fd_get(in_fd)) == NULL) {
+		return(-1);
+	}
+
+	return(vfs_sendfile(out, in, count));
+}
+
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2012 Renê de Souza Pinto
+ * Tempos - Tempos is an Educational and multi purpose Operating System
+ *
+ * File: sync.c
+ * Desc: sync and fsync system calls
+ *
+ * This file is part of TempOS.
+ *
+ * TempOS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * TempOS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <tempos/syscall.h>
+#include <tempos/kernel.h>
+#include <tempos/sched.h>
+
+/**
+ * Write all delayed blocks and dirty i-nodes to disk.
+ *
+ * \return Always 0.
+ */
+_pushargs int sys_sync(void)
+{
+	vfs_sync();
+	return(0);
+}
+
+/**
+ * Write delayed blocks and i-node of an open file to disk.
+ *
+ * \param fd File descriptor.
+ * \return 0 on success, -1 on error.
+ */
+_pushargs int sys_fsync(int fd)
+{
+	vfs_file *file;
+
+	if ((file = fd_get(fd)) == NULL) {
+		return(-1);
+	}
+
+	return(vfs_fsync(file->inode));
+}
+
@@ -33,7 +33,19 @@ void *syscall_table[] = {
 	&sys_fork,			/* 1 */
 	&sys_execve,		/* 2 */
 	&sys_read,			/* 3 */
-	&sys_write			/* 4 */
+	&sys_write,			/* 4 */
+	&sys_iostat,		/* 5 */
+	&sys_open,			/* 6 */
+	&sys_close,			/* 7 */
+	&sys_lseek,			/* 8 */
+	&sys_mmap,			/* 9 */
+	&sys_munmap,		/* 10 */
+	&sys_msync,			/* 11 */
+	&sys_sendfile,		/* 12 */
+	&sys_ioring_setup,	/* 13 */
+	&sys_ioring_enter,	/* 14 */
+	&sys_sync,			/* 15 */
+	&sys_fsync			/* 16 */
 	//&sys_wait
 
 };
@@ -58,7 +58,10 @@ task_t *kernel_thread_create(int priority, void (*start_routine)(void *), void *
 	newth->priority = priority;
 	newth->pid = KERNEL_PID;
 	newth->return_code = 0;
-	newth->wait_queue = 0;
+	init_waitqueue_head(&newth->exit_wait);
+	memset(newth->files, 0, sizeof(newth->files));
+	newth->mmap = NULL;
+	newth->ioring = NULL;
 	newth->stack_base = new_kstack;
 	newth->kstack = (char*)((void*)new_kstack + PROCESS_STACK_SIZE);
 
@@ -75,7 +78,12 @@ task_t *kernel_thread_create(int priority, void (*start_routine)(void *), void *
 
 	/* Add to task queue */
 	cli();
-	c_llist_add(&tasks, newth);
+	if (!sched_add_task(newth)) {
+		sti();
+		kfree(new_kstack);
+		kfree(newth);
+		return NULL;
+	}
 	sti();
 
 	/* Return */
@@ -86,11 +94,15 @@ void kernel_thread_exit(int return_code)
 {
 	task_t *current_task;
 
+	fd_close_all(GET_TASK(cur_task));
+	mmap_exit();
+	ioring_exit();
+
 	cli();
 	current_task = GET_TASK(cur_task);
 	current_task->state = TASK_ZOMBIE;
 	current_task->return_code = return_code;
-	wakeup(WAIT_KERNEL_THREAD);
+	wakeup_all(&current_task->exit_wait);
 	sti();
 	schedule();
 }
@@ -103,12 +115,11 @@ int kernel_thread_wait(task_t *th)
 		return -1;
 	}
 
-	while(th->state != TASK_ZOMBIE)
-		sleep_on(WAIT_KERNEL_THREAD);
+	wait_event(&th->exit_wait, th->state == TASK_ZOMBIE);
 
 	cli();
 	ret = th->return_code;
-	c_llist_remove(&tasks, th);
+	sched_remove_task(th);
 	kfree(th->stack_base);
 	kfree(th);
 	sti();
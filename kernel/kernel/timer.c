@@ -25,6 +25,7 @@
 #include <tempos/timer.h>
 #include <tempos/jiffies.h>
 #include <tempos/sched.h>
+#include <tempos/wait.h>
 #include <linkedl.h>
 #include <semaphore.h>
 #include <unistd.h>
@@ -34,9 +35,14 @@
 /** Queue of alarms */
 llist *alarm_queue;
 
+/** Wall clock time at system startup (seconds since epoch) */
+static uint32_t boot_time;
+
 
 void timer_handler(int i, pt_regs *regs);
 
+static void msleep_alarm(pt_regs *regs, void *arg);
+
 
 /**
  * Contains the number of system clock ticks
@@ -55,6 +61,8 @@ void init_timer(void)
 
 	kprintf(KERN_INFO "Initializing timer...\n");
 
+	boot_time = rtc_get_time();
+
 	llist_create(&alarm_queue);
 
 	if( request_irq(TIMER_IRQ, timer_handler, 0, "PIT") < 0 ) {
@@ -86,6 +94,7 @@ void timer_handler(int i, pt_regs *regs)
 			/* Execute handler and remove from list */
 			llist_remove_nth(&alarm_queue, pos);
 			alarm->handler(regs, alarm->arg);
+			kfree(alarm);
 		}
 
 		pos++;
@@ -130,4 +139,40 @@ int new_alarm(uint32_t expires, void (*handler)(pt_regs *, void *), void *arg)
 	return(1);
 }
 
+/**
+ * Current wall clock time.
+ *
+ * \return Seconds since epoch.
+ */
+uint32_t get_seconds(void)
+{
+	return boot_time + (jiffies / HZ);
+}
 
+/**
+ * Alarm handler of msleep(): wake up the sleeping task.
+ */
+static void msleep_alarm(pt_regs *regs, void *arg)
+{
+	wakeup_all((wait_queue_head_t *)arg);
+}
+
+/**
+ * Put the current task to sleep for (at least) some milliseconds.
+ *
+ * \param msecs Milliseconds to sleep.
+ * \note Unlike mdelay(), the processor is given to other tasks.
+ */
+void msleep(uint32_t msecs)
+{
+	wait_queue_head_t queue = WAIT_QUEUE_HEAD_INIT;
+	uint32_t expires;
+
+	expires = jiffies + ((msecs * HZ) / 1000) + 1;
+	if (!new_alarm(expires, msleep_alarm, &queue)) {
+		return;
+	}
+
+	/* Alarm can't fire between the check and going to sleep */
+	wait_event(&queue, time_after(jiffies, expires));
+}
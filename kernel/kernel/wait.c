@@ -23,81 +23,179 @@
  */
 
 #include <tempos/wait.h>
+#include <tempos/sched.h>
 #include <arch/io.h>
 
-/** List of wait addresses. Each position represents a wait address */
-llist *wait_queues[WAIT_ADDRESS_SIZE];
 
+static void wq_add(wait_queue_head_t *queue, wait_queue_t *wait);
+
+static void wq_remove(wait_queue_head_t *queue, wait_queue_t *wait);
+
+static void do_sleep(wait_queue_head_t *queue, int flags);
+
+static void do_wakeup(wait_queue_head_t *queue, int nr_exclusive);
+
+
+/**
+ * Initialize a wait queue head.
+ *
+ * \param queue The wait queue.
+ */
+void init_waitqueue_head(wait_queue_head_t *queue)
+{
+	queue->first = NULL;
+	queue->last  = NULL;
+}
 
 /**
- * This functions initializes the wait queues.
+ * Add an entry to a wait queue: non exclusive waiters go to the front,
+ * exclusive ones to the back.
  */
-void init_wait_queues(void)
+static void wq_add(wait_queue_head_t *queue, wait_queue_t *wait)
 {
-	int i;
-	for (i = 0; i < WAIT_ADDRESS_SIZE; i++) {
-		llist_create(&wait_queues[i]);
+	if ( (wait->flags & WQ_FLAG_EXCLUSIVE) ) {
+		wait->prev = queue->last;
+		wait->next = NULL;
+		if (queue->last != NULL) {
+			queue->last->next = wait;
+		} else {
+			queue->first = wait;
+		}
+		queue->last = wait;
+	} else {
+		wait->prev = NULL;
+		wait->next = queue->first;
+		if (queue->first != NULL) {
+			queue->first->prev = wait;
+		} else {
+			queue->last = wait;
+		}
+		queue->first = wait;
 	}
 }
 
+/**
+ * Remove an entry from a wait queue.
+ */
+static void wq_remove(wait_queue_head_t *queue, wait_queue_t *wait)
+{
+	if (wait->prev != NULL) {
+		wait->prev->next = wait->next;
+	} else {
+		queue->first = wait->next;
+	}
+	if (wait->next != NULL) {
+		wait->next->prev = wait->prev;
+	} else {
+		queue->last = wait->prev;
+	}
+	wait->prev = NULL;
+	wait->next = NULL;
+}
 
 /**
- * This function puts the process that called it to sleep
- * until the event represented by sleep_addr become available.
+ * Put the current process to sleep on a wait queue.
  *
- * \param sleep_addr The event that process should wait for.
+ * \param queue The wait queue.
+ * \param flags WQ_FLAG_*.
  */
-void sleep_on(int sleep_addr)
+static void do_sleep(wait_queue_head_t *queue, int flags)
 {
 	task_t *current_task = GET_TASK(cur_task);
-
-	/* sanity check */
-	if (sleep_addr < 0 || sleep_addr >= WAIT_ADDRESS_SIZE) {
-		return;
-	}
+	wait_queue_t wait;
 
 	cli();
-	
-	current_task->state = TASK_STOPPED;
 
-	llist_add(&wait_queues[sleep_addr], current_task);
+	wait.task  = current_task;
+	wait.flags = flags;
+	wq_add(queue, &wait);
+	current_task->state = TASK_STOPPED;
 
 	schedule();
 
 	/* Process resumes execution from here when it wakes up */
-	/*llist_remove(&wait_queues[sleep_addr], current_task);*/
-	
+
+	/* Nothing else could run: process didn't sleep at all */
+	if (wait.task != NULL) {
+		wq_remove(queue, &wait);
+		current_task->state = TASK_RUNNING;
+	}
+
 	sti();
+}
 
-	return;
+/**
+ * This function puts the process that called it to sleep on
+ * a wait queue that belongs to some object (i-node, etc).
+ *
+ * \param queue The wait queue.
+ * \note Call it with interrupts disabled after checking the condition
+ *       to wait for (see wait_event()); they are enabled on return.
+ */
+void sleep_on(wait_queue_head_t *queue)
+{
+	do_sleep(queue, 0);
 }
 
+/**
+ * Like sleep_on(), but process sleeps as an exclusive waiter.
+ *
+ * \param queue The wait queue.
+ */
+void sleep_on_exclusive(wait_queue_head_t *queue)
+{
+	do_sleep(queue, WQ_FLAG_EXCLUSIVE);
+}
 
 /**
- * Wake up all process sleeping waiting for sleep_addr resource(s).
- * \param sleep_addr Slepe address.
- * \note All process waiting for sleep_addr will be put in TASK_READY_TO_RUN state.
+ * Wake up processes sleeping on a wait queue: all non exclusive waiters
+ * and at most nr_exclusive exclusive ones (all of them if it's zero).
+ * Woken up processes leave the queue.
  */
-void wakeup(int sleep_addr)
+static void do_wakeup(wait_queue_head_t *queue, int nr_exclusive)
 {
+	wait_queue_t *wait, *next;
 	task_t *task;
-	llist *queue, *tmp;
-
-	/* sanity check */
-	if (sleep_addr < 0 || sleep_addr >= WAIT_ADDRESS_SIZE) {
-		return;
-	}
+	int excl;
 
 	cli();
 
-	queue = wait_queues[sleep_addr];
-	foreach(queue, tmp) {
-		task = GET_TASK(tmp);
+	for (wait = queue->first; wait != NULL; wait = next) {
+		next = wait->next;
+		task = wait->task;
+		excl = (wait->flags & WQ_FLAG_EXCLUSIVE);
+
+		wq_remove(queue, wait);
+		wait->task = NULL;
+		sched_wakeup(task);
 
-		task->state = TASK_READY_TO_RUN;
-		llist_remove(&queue, tmp);
+		if (excl && --nr_exclusive == 0) {
+			break;
+		}
 	}
 
 	sti();
 }
 
+/**
+ * Wake up all non exclusive waiters of a wait queue and one exclusive
+ * waiter.
+ *
+ * \param queue The wait queue.
+ */
+void wakeup(wait_queue_head_t *queue)
+{
+	do_wakeup(queue, 1);
+}
+
+/**
+ * Wake up all processes sleeping on a wait queue.
+ *
+ * \param queue The wait queue.
+ * \note The queue becomes empty.
+ */
+void wakeup_all(wait_queue_head_t *queue)
+{
+	do_wakeup(queue, 0);
+}
+
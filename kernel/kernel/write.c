@@ -24,26 +24,41 @@
 
 #include <tempos/syscall.h>
 #include <tempos/kernel.h>
+#include <tempos/sched.h>
+#include <arch/uaccess.h>
 
+/**
+ * Write to a file descriptor. Standard output and error descriptors
+ * not associated with a file are written to the console.
+ *
+ * \param fd File descriptor.
+ * \param buf User buffer.
+ * \param count Number of bytes to write.
+ * \return Number of bytes written, or -1 on error.
+ */
 _pushargs ssize_t sys_write(int fd, const void *buf, size_t count)
 {
 	char buffer[256];
-	char *tmp = (char*)buf;
-	size_t i;
+	vfs_file *file;
+	size_t done, len;
 
-	//kprintf(KERN_DEBUG "SYSWRITE_IN: %d %ld %ld\n", fd, buf, count);
+	if ((file = fd_get(fd)) != NULL) {
+		return(vfs_write(file, (char*)buf, count));
+	}
 
-	if(count < 256) {
-		for(i=0;i<=count;i++) {
-			buffer[i] = tmp[i];
-		}
+	if (fd != 1 && fd != 2) {
+		return(-1);
 	}
 
-	if(fd == 1) {
-		kprintf(KERN_DEBUG "%s\n", buffer);
+	for (done = 0; done < count; done += len) {
+		len = (count - done < sizeof(buffer) ? count - done : sizeof(buffer) - 1);
+		if (copy_from_user(buffer, (char*)buf + done, len) != 0) {
+			return(done > 0 ? (ssize_t)done : -1);
+		}
+		buffer[len] = '\0';
+		kprintf("%s", buffer);
 	}
 
 	return(count);
 }
 
-
@@ -0,0 +1,146 @@
+#!/bin/sh
+#
+# Generate a hard disk image with a large indexed directory (htree),
+# used by the kernel directory lookup benchmark:
+#
+#   kernel /boot/tempos.elf root=3:1 namei_bench=/bigdir namei_bench_n=50000
+#
+# Boot also with ext2_htree=0 to compare against linear search.
+#
+# Directory scan (stat of every entry, like "ls -l"), for instance with
+# NFILES=10000; boot also with ext2_inode_ra=0 to compare against
+# reading i-nodes on demand:
+#
+#   kernel /boot/tempos.elf root=3:1 namei_bench=/bigdir namei_bench_n=10000 namei_bench_all=1
+#
+
+RTREE=rtree
+NFILES=${NFILES:-50000}
+BIGDIR=bigdir
+MINSIZE=67108864 #64MB
+IMGNAME=hdisk_bigdir.img
+FFILE=part1.fdisk
+PARTNUM=1
+
+LOGFILE=$(mktemp)
+MNTDIR=$(mktemp -d)
+
+exec_c()
+{
+	$* > $LOGFILE 2>&1
+	if [ $? -eq 0 ]; then
+		echo -e "[ \033[0;32mOK\033[0m ]"
+	else
+		echo -e "[ \033[0;31mFailed\033[0m ]"
+		echo "Log information:"
+		cat $LOGFILE
+		clean
+		exit 1
+	fi
+}
+
+clean()
+{
+	rm $LOGFILE
+	if [ -n "$(mount | grep $MNTDIR)" ]; then
+		umount $MNTDIR > /dev/null 2>&1
+	fi
+	if [ -n "$LOOPDEV" ]; then
+		kpartx -d $LOOPDEV > /dev/null 2>&1
+		losetup -d $LOOPDEV > /dev/null 2>&1
+	fi
+	rmdir $MNTDIR
+}
+
+# Create NFILES empty files: f00000, f00001, ...
+mkbigdir()
+{
+	mkdir -p $1 || return 1
+	i=0
+	while [ $i -lt $NFILES ]; do
+		: > $1/$(printf "f%05d" $i) || return 1
+		i=$(($i+1))
+	done
+}
+
+
+##
+# Main
+#
+if [ $UID != 0 ]; then
+	echo "Please, run this script as root."
+	echo
+	exit 1
+fi
+
+DSIZE=$(du -s $RTREE | cut -f1)
+if [ $DSIZE -lt $MINSIZE ]; then
+	DSIZE=$MINSIZE
+fi
+
+# Initializing
+echo "*** TempOS big directory image generator ***"
+echo "Disk output image name: $IMGNAME"
+echo "Disk size (in bytes):   $DSIZE"
+echo "Root tree source:       $RTREE"
+echo "Directory entries:      /$BIGDIR ($NFILES)"
+echo "fdisk commands source:  $FFILE"
+echo "Root partition number:  $PARTNUM"
+echo "---------------------------------"
+
+# Create image
+echo -n "Creating disk image...             "
+exec_c dd if=/dev/zero of=$IMGNAME bs=512 count=$(($DSIZE/512))
+
+LOOPDEV=$(losetup -f)
+res=$?
+echo -n "Partitioning image...              "
+if [ $res != 0 ]; then
+	echo "Error: could not find loop device file."
+	echo
+	exit 1
+else
+	exec_c fdisk $IMGNAME < $FFILE
+fi
+
+echo -n "Checking partition(s)...           "
+losetup $LOOPDEV $IMGNAME
+exec_c kpartx -a $LOOPDEV
+
+DEVPART=/dev/mapper/$(basename ${LOOPDEV})p${PARTNUM}
+
+echo -n "Formating EXT2 file system...      "
+exec_c mkfs.ext2 -O dir_index -N $(($NFILES+1024)) $DEVPART
+
+echo -n "Mounting partition...              "
+exec_c mount $DEVPART $MNTDIR
+
+echo -n "Copying files...                   "
+exec_c cp -r $RTREE/. $MNTDIR
+
+echo -n "Creating big directory...          "
+exec_c mkbigdir $MNTDIR/$BIGDIR
+
+echo -n "Umounting partition...             "
+exec_c umount $MNTDIR
+
+# ext2 driver does not build directory indexes, e2fsck does
+echo -n "Indexing directories...            "
+e2fsck -fyD $DEVPART > $LOGFILE 2>&1
+if [ $? -le 1 ]; then
+	echo -e "[ \033[0;32mOK\033[0m ]"
+else
+	echo -e "[ \033[0;31mFailed\033[0m ]"
+	cat $LOGFILE
+	clean
+	exit 1
+fi
+
+kpartx -d $LOOPDEV ; losetup -d $LOOPDEV
+
+echo -n "Compressing...                     "
+exec_c gzip $IMGNAME
+
+clean
+echo "Done."
+exit 0